@@ -0,0 +1,191 @@
+/**
+ * Arena allocator for simulation state
+ *
+ * Every allocation is 64 byte aligned (one cache line, enough for any SIMD
+ * load). Memory is only returned to the heap by arena_free(), arena_reset()
+ * and arena_rewind() keep the blocks around so a warmed up arena never
+ * touches the heap again.
+ *
+ * Define ARENA_IMPLEMENTATION in exactly one translation unit. Hosts with
+ * their own memory system can redefine ARENA_REALLOC(ptr, size) and
+ * ARENA_FREE(ptr) before including the implementation.
+ */
+
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifndef ARENA_REALLOC
+#include <stdlib.h>
+#define ARENA_REALLOC realloc
+#endif
+
+#ifndef ARENA_FREE
+#include <stdlib.h>
+#define ARENA_FREE free
+#endif
+
+#define ARENA_ALIGNMENT 64
+#define ARENA_DEFAULT_BLOCK_SIZE (256 * 1024)
+
+typedef struct ArenaBlock {
+  struct ArenaBlock *next;
+  char *data; // ARENA_ALIGNMENT aligned start inside the block
+  size_t capacity;
+  size_t used;
+} ArenaBlock;
+
+typedef struct {
+  ArenaBlock *first;
+  ArenaBlock *current;
+  // minimum size of new blocks, ARENA_DEFAULT_BLOCK_SIZE when zero
+  size_t block_size;
+  // number of times the arena went to the heap, to check steady state
+  size_t heap_allocations;
+} Arena;
+
+typedef struct {
+  ArenaBlock *block;
+  size_t used;
+} ArenaMark;
+
+// Returns NULL when the heap is exhausted, memory is not cleared
+void *arena_alloc(Arena *arena, size_t size);
+void *arena_alloc_zero(Arena *arena, size_t size);
+// Grows the most recent allocation in place when possible, copies otherwise
+void *arena_realloc(Arena *arena, void *ptr, size_t old_size, size_t new_size);
+
+// Releases everything allocated since the mark
+ArenaMark arena_mark(Arena *arena);
+void arena_rewind(Arena *arena, ArenaMark mark);
+// Releases every allocation but keeps the blocks for reuse
+void arena_reset(Arena *arena);
+// Gives all blocks back through ARENA_FREE
+void arena_free(Arena *arena);
+
+#endif // ARENA_H_
+
+#ifdef ARENA_IMPLEMENTATION
+
+#include <stdint.h>
+#include <string.h>
+
+static size_t arena_align_up(size_t value) {
+  return (value + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+static ArenaBlock *arena_new_block(Arena *arena, size_t size) {
+  size_t capacity = arena->block_size ? arena->block_size
+                                      : ARENA_DEFAULT_BLOCK_SIZE;
+  if (capacity < size)
+    capacity = size;
+  capacity = arena_align_up(capacity);
+
+  ArenaBlock *block =
+      ARENA_REALLOC(NULL, sizeof(ArenaBlock) + ARENA_ALIGNMENT + capacity);
+  if (!block)
+    return NULL;
+  arena->heap_allocations++;
+
+  uintptr_t start = (uintptr_t)(block + 1);
+  block->data = (char *)arena_align_up((size_t)start);
+  block->next = NULL;
+  block->capacity = capacity;
+  block->used = 0;
+  return block;
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+  size = arena_align_up(size ? size : 1);
+
+  // walk the kept blocks after a reset or rewind before going to the heap
+  while (arena->current &&
+         arena->current->used + size > arena->current->capacity) {
+    if (!arena->current->next)
+      break;
+    arena->current = arena->current->next;
+    arena->current->used = 0;
+  }
+
+  if (!arena->current ||
+      arena->current->used + size > arena->current->capacity) {
+    ArenaBlock *block = arena_new_block(arena, size);
+    if (!block)
+      return NULL;
+    if (arena->current) {
+      // keep any kept blocks after the new one reachable
+      block->next = arena->current->next;
+      arena->current->next = block;
+    } else {
+      arena->first = block;
+    }
+    arena->current = block;
+  }
+
+  void *ptr = arena->current->data + arena->current->used;
+  arena->current->used += size;
+  return ptr;
+}
+
+void *arena_alloc_zero(Arena *arena, size_t size) {
+  void *ptr = arena_alloc(arena, size);
+  if (ptr)
+    memset(ptr, 0, size);
+  return ptr;
+}
+
+void *arena_realloc(Arena *arena, void *ptr, size_t old_size, size_t new_size) {
+  if (!ptr)
+    return arena_alloc(arena, new_size);
+  if (new_size <= old_size)
+    return ptr;
+
+  ArenaBlock *block = arena->current;
+  size_t old_aligned = arena_align_up(old_size ? old_size : 1);
+  size_t new_aligned = arena_align_up(new_size);
+  if (block && (char *)ptr + old_aligned == block->data + block->used &&
+      block->used - old_aligned + new_aligned <= block->capacity) {
+    block->used += new_aligned - old_aligned;
+    return ptr;
+  }
+
+  void *grown = arena_alloc(arena, new_size);
+  if (grown)
+    memcpy(grown, ptr, old_size);
+  return grown;
+}
+
+ArenaMark arena_mark(Arena *arena) {
+  ArenaMark mark = {arena->current, arena->current ? arena->current->used : 0};
+  return mark;
+}
+
+void arena_rewind(Arena *arena, ArenaMark mark) {
+  if (!mark.block) {
+    arena_reset(arena);
+    return;
+  }
+  arena->current = mark.block;
+  arena->current->used = mark.used;
+}
+
+void arena_reset(Arena *arena) {
+  arena->current = arena->first;
+  if (arena->current)
+    arena->current->used = 0;
+}
+
+void arena_free(Arena *arena) {
+  ArenaBlock *block = arena->first;
+  while (block) {
+    ArenaBlock *next = block->next;
+    ARENA_FREE(block);
+    block = next;
+  }
+  arena->first = NULL;
+  arena->current = NULL;
+}
+
+#endif // ARENA_IMPLEMENTATION
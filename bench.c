@@ -0,0 +1,1829 @@
+/**
+ * Headless libcloth benchmark
+ *
+ * Steps large cloths without a window and prints timings for the grid and
+ * explicit topologies, the Morton reordering pass, strain limiting, shear and
+ * bending materials, multi-cloth worlds, shared-topology instancing, turbulent
+ * wind, aerodynamics, continuous collision against a fast sphere, fixed
+ * against adaptive substeps, triangle mesh colliders of growing size, a
+ * distance field baked from one of them, tearing, cutting, directly solved
+ * strands, the sparse global solve against relaxation, shape matched boxes
+ * against boxes of sticks, crowds of ragdolls and a tetrahedral soft body.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cloth.h"
+
+#define BENCH_COLS 512
+#define BENCH_ROWS 512
+#define BENCH_SPACING 10.0f
+#define BENCH_STEPS 20
+
+static double bench_now(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static ClothDesc bench_desc(ClothTopology topology, bool *pinned) {
+  ClothDesc desc = cloth_default_desc();
+  desc.topology = topology;
+  desc.cols = BENCH_COLS;
+  desc.rows = BENCH_ROWS;
+  desc.spacing = BENCH_SPACING;
+  desc.origin = (Vector3){200, -500, 0};
+  desc.pinned = pinned;
+  return desc;
+}
+
+static Cloth *bench_create(ClothTopology topology, bool *pinned) {
+  ClothDesc desc = bench_desc(topology, pinned);
+  Cloth *cloth = cloth_create(&desc);
+  if (!cloth)
+    return NULL;
+
+  Vector3 center = {desc.origin.x + BENCH_COLS * BENCH_SPACING / 2.0f,
+                    desc.origin.y + BENCH_ROWS * BENCH_SPACING / 2.0f, 100.0f};
+  cloth_add_sphere_collider(cloth, center, 60.0f);
+  return cloth;
+}
+
+// The same grid as an explicit mesh with deterministically scattered particle
+// indices, like a mesh from an exporter that knows nothing about locality.
+static Cloth *bench_create_scattered(const bool *pinned) {
+  int count = BENCH_COLS * BENCH_ROWS;
+  int edge_count = (BENCH_COLS - 1) * BENCH_ROWS + (BENCH_ROWS - 1) * BENCH_COLS;
+  int *new_index = malloc(sizeof(int) * count);
+  Vector3 *positions = malloc(sizeof(Vector3) * count);
+  bool *scattered_pins = malloc(sizeof(bool) * count);
+  int *edges = malloc(sizeof(int) * 2 * edge_count);
+  Cloth *cloth = NULL;
+  if (!new_index || !positions || !scattered_pins || !edges)
+    goto done;
+
+  for (int i = 0; i < count; i++) {
+    new_index[i] = i;
+  }
+  uint32_t state = 0x9e3779b9;
+  for (int i = count - 1; i > 0; i--) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    int j = state % (uint32_t)(i + 1);
+    int tmp = new_index[i];
+    new_index[i] = new_index[j];
+    new_index[j] = tmp;
+  }
+
+  ClothDesc desc = bench_desc(CLOTH_TOPOLOGY_EXPLICIT, scattered_pins);
+  int edge = 0;
+  for (int y = 0; y < BENCH_ROWS; y++) {
+    for (int x = 0; x < BENCH_COLS; x++) {
+      int index = y * BENCH_COLS + x;
+      Vector3 offset = {x * BENCH_SPACING, y * BENCH_SPACING, 0};
+      positions[new_index[index]] = Vector3Add(desc.origin, offset);
+      scattered_pins[new_index[index]] = pinned[index];
+      if (x < BENCH_COLS - 1) {
+        edges[edge++] = new_index[index];
+        edges[edge++] = new_index[index + 1];
+      }
+      if (y < BENCH_ROWS - 1) {
+        edges[edge++] = new_index[index];
+        edges[edge++] = new_index[index + BENCH_COLS];
+      }
+    }
+  }
+
+  desc.positions = positions;
+  desc.particle_count = count;
+  desc.edges = edges;
+  desc.edge_count = edge_count;
+  cloth = cloth_create(&desc);
+  if (cloth) {
+    Vector3 center = {desc.origin.x + BENCH_COLS * BENCH_SPACING / 2.0f,
+                      desc.origin.y + BENCH_ROWS * BENCH_SPACING / 2.0f,
+                      100.0f};
+    cloth_add_sphere_collider(cloth, center, 60.0f);
+  }
+
+done:
+  free(new_index);
+  free(positions);
+  free(scattered_pins);
+  free(edges);
+  return cloth;
+}
+
+// Replays the position loads of one constraint sweep through a 32 KiB,
+// 8-way LRU cache model with 64 byte lines. Hardware counters aren't portable,
+// this gives a stable number to compare layouts with.
+#define BENCH_CACHE_LINE 64
+#define BENCH_CACHE_WAYS 8
+#define BENCH_CACHE_SETS 64
+
+typedef struct {
+  uint64_t tags[BENCH_CACHE_SETS][BENCH_CACHE_WAYS];
+  long misses;
+} BenchCache;
+
+static void bench_cache_touch(BenchCache *cache, uint64_t line) {
+  uint64_t *set = cache->tags[line % BENCH_CACHE_SETS];
+  int way = 0;
+  while (way < BENCH_CACHE_WAYS - 1 && set[way] != line)
+    way++;
+  if (set[way] != line)
+    cache->misses++;
+  // move to front, the last way is the least recently used
+  memmove(&set[1], &set[0], sizeof(uint64_t) * way);
+  set[0] = line;
+}
+
+static long bench_cache_misses(const Cloth *cloth) {
+  BenchCache cache;
+  memset(cache.tags, 0xff, sizeof(cache.tags));
+  cache.misses = 0;
+
+  int edge_count = cloth_edge_count(cloth);
+  for (int i = 0; i < edge_count; i++) {
+    int indices[2];
+    cloth_get_edge(cloth, i, &indices[0], &indices[1]);
+    for (int k = 0; k < 2; k++) {
+      uint64_t first = (uint64_t)indices[k] * sizeof(Vector3);
+      uint64_t last = first + sizeof(Vector3) - 1;
+      for (uint64_t line = first / BENCH_CACHE_LINE;
+           line <= last / BENCH_CACHE_LINE; line++) {
+        bench_cache_touch(&cache, line);
+      }
+    }
+  }
+  return cache.misses;
+}
+
+static double bench_steps(Cloth *cloth) {
+  double start = bench_now();
+  for (int i = 0; i < BENCH_STEPS; i++) {
+    cloth_step(cloth);
+  }
+  return (bench_now() - start) * 1000.0 / BENCH_STEPS;
+}
+
+typedef struct {
+  float mean;
+  float max;
+} BenchError;
+
+// relative stretch |d - rest| / rest over all grid links
+static BenchError bench_grid_stretch(const Cloth *cloth) {
+  BenchError error = {0};
+  const Vector3 *positions = cloth_positions(cloth);
+  int edge_count = cloth_edge_count(cloth);
+  for (int i = 0; i < edge_count; i++) {
+    int p1, p2;
+    cloth_get_edge(cloth, i, &p1, &p2);
+    float d = Vector3Distance(positions[p1], positions[p2]);
+    float e = fabsf(d - BENCH_SPACING) / BENCH_SPACING;
+    error.mean += e;
+    error.max = fmaxf(error.max, e);
+  }
+  error.mean /= edge_count > 0 ? edge_count : 1;
+  return error;
+}
+
+// A crowd of small flags plus a few big banners, stepped through a world
+// with one thread and then with every core
+#define BENCH_WORLD_SMALL 400
+#define BENCH_WORLD_SMALL_SIZE 24
+#define BENCH_WORLD_LARGE 8
+#define BENCH_WORLD_LARGE_SIZE 128
+
+static Cloth *bench_create_flag(int size, int index) {
+  ClothDesc desc = cloth_default_desc();
+  desc.topology = CLOTH_TOPOLOGY_GRID;
+  desc.cols = size;
+  desc.rows = size;
+  desc.spacing = BENCH_SPACING;
+  desc.origin = (Vector3){index * 50.0f, 0, 0};
+  Cloth *cloth = cloth_create(&desc);
+  if (!cloth)
+    return NULL;
+  for (int x = 0; x < size; x += 4) {
+    cloth_set_pinned(cloth, x, true);
+  }
+  return cloth;
+}
+
+static ClothWorld *bench_create_world(Cloth **cloths, int count,
+                                      int thread_count) {
+  ClothWorld *world = cloth_world_create(thread_count);
+  for (int i = 0; world && i < count; i++) {
+    if (!cloth_world_add(world, cloths[i])) {
+      cloth_world_destroy(world);
+      return NULL;
+    }
+  }
+  return world;
+}
+
+// one more step to look at in chrome://tracing or Perfetto
+static void bench_trace_world(ClothWorld *world, const char *path) {
+  cloth_world_set_tracing(world, true);
+  cloth_world_step_all(world);
+  if (cloth_world_write_trace(world, path))
+    printf("wrote job graph trace of one step to %s\n", path);
+}
+
+// A plain cloth_step() loop, a world on one thread and a world on every core
+// take turns a step at a time so they see the same machine, and each keeps
+// its fastest step. The single thread world against the plain loop is the
+// cost of binning and building the graph every step.
+static int bench_world_scaling(void) {
+  int count = BENCH_WORLD_SMALL + BENCH_WORLD_LARGE;
+  Cloth **cloths = calloc(count, sizeof(Cloth *));
+  if (!cloths)
+    return 1;
+  ClothWorld *serial = NULL;
+  ClothWorld *parallel = NULL;
+  int result = 1;
+  for (int i = 0; i < count; i++) {
+    int size = i < BENCH_WORLD_LARGE ? BENCH_WORLD_LARGE_SIZE
+                                     : BENCH_WORLD_SMALL_SIZE;
+    cloths[i] = bench_create_flag(size, i);
+    if (!cloths[i])
+      goto done;
+  }
+  serial = bench_create_world(cloths, count, 1);
+  parallel = bench_create_world(cloths, count, 0);
+  if (!serial || !parallel)
+    goto done;
+
+  double plain_ms = INFINITY, serial_ms = INFINITY, parallel_ms = INFINITY;
+  for (int step = 0; step < BENCH_STEPS; step++) {
+    double start = bench_now();
+    for (int i = 0; i < count; i++) {
+      cloth_step(cloths[i]);
+    }
+    double serial_start = bench_now();
+    cloth_world_step_all(serial);
+    double parallel_start = bench_now();
+    cloth_world_step_all(parallel);
+    double end = bench_now();
+    plain_ms = fmin(plain_ms, (serial_start - start) * 1000.0);
+    serial_ms = fmin(serial_ms, (parallel_start - serial_start) * 1000.0);
+    parallel_ms = fmin(parallel_ms, (end - parallel_start) * 1000.0);
+  }
+  bench_trace_world(serial, "world_trace_serial.json");
+  bench_trace_world(parallel, "world_trace.json");
+
+  int threads = cloth_world_thread_count(parallel);
+  printf("world, %d cloths:     %8.3f ms/step plain loop, %8.3f ms/step on 1 "
+         "thread (%+.1f%% graph and binning)\n",
+         count, plain_ms, serial_ms, 100.0 * (serial_ms - plain_ms) / plain_ms);
+  if (threads > 1)
+    printf("world on %2d threads:  %8.3f ms/step (%.2fx the plain loop)\n",
+           threads, parallel_ms, plain_ms / parallel_ms);
+  else
+    printf("world on every core:  only one hardware thread, no speedup to "
+           "measure\n");
+  result = 0;
+
+done:
+  cloth_world_destroy(serial);
+  cloth_world_destroy(parallel);
+  for (int i = 0; i < count; i++) {
+    cloth_destroy(cloths[i]);
+  }
+  free(cloths);
+  return result;
+}
+
+// The same crowd of explicit flags built once per cloth and once as
+// instances of a shared template
+#define BENCH_CROWD 500
+#define BENCH_CROWD_SIZE 32
+
+typedef struct {
+  double setup_ms;
+  double step_ms;
+  size_t memory_bytes;
+} BenchCrowd;
+
+static bool bench_crowd(bool shared, BenchCrowd *result) {
+  Cloth **cloths = calloc(BENCH_CROWD, sizeof(Cloth *));
+  if (!cloths)
+    return false;
+
+  ClothDesc desc = cloth_default_desc();
+  desc.topology = CLOTH_TOPOLOGY_EXPLICIT;
+  desc.cols = BENCH_CROWD_SIZE;
+  desc.rows = BENCH_CROWD_SIZE;
+  desc.spacing = BENCH_SPACING;
+  bool pinned[BENCH_CROWD_SIZE * BENCH_CROWD_SIZE] = {0};
+  for (int x = 0; x < BENCH_CROWD_SIZE; x += 4) {
+    pinned[x] = true;
+  }
+  desc.pinned = pinned;
+
+  bool ok = true;
+  double start = bench_now();
+  ClothTemplate *tmpl = shared ? cloth_template_create(&desc) : NULL;
+  for (int i = 0; ok && i < BENCH_CROWD; i++) {
+    if (shared) {
+      cloths[i] =
+          tmpl ? cloth_create_instance(tmpl, MatrixTranslate(i * 50.0f, 0, 0))
+               : NULL;
+    } else {
+      desc.origin = (Vector3){i * 50.0f, 0, 0};
+      cloths[i] = cloth_create(&desc);
+    }
+    ok = cloths[i] != NULL;
+  }
+  result->setup_ms = (bench_now() - start) * 1000.0;
+
+  if (ok) {
+    ClothStats stats = cloth_get_stats(cloths[0]);
+    result->memory_bytes = stats.shared_memory_bytes;
+    for (int i = 0; i < BENCH_CROWD; i++) {
+      result->memory_bytes += cloth_get_stats(cloths[i]).memory_bytes;
+    }
+
+    start = bench_now();
+    for (int s = 0; s < BENCH_STEPS; s++) {
+      for (int i = 0; i < BENCH_CROWD; i++) {
+        cloth_step(cloths[i]);
+      }
+    }
+    result->step_ms = (bench_now() - start) * 1000.0 / BENCH_STEPS;
+  }
+
+  for (int i = 0; i < BENCH_CROWD; i++) {
+    cloth_destroy(cloths[i]);
+  }
+  cloth_template_destroy(tmpl);
+  free(cloths);
+  return ok;
+}
+
+static int bench_instancing(void) {
+  BenchCrowd separate, shared;
+  if (!bench_crowd(false, &separate) || !bench_crowd(true, &shared))
+    return 1;
+  printf("crowd of %d, separate: %8.3f ms setup, %8.3f ms/step, %zu KiB\n",
+         BENCH_CROWD, separate.setup_ms, separate.step_ms,
+         separate.memory_bytes / 1024);
+  printf("crowd of %d, shared:   %8.3f ms setup, %8.3f ms/step, %zu KiB\n",
+         BENCH_CROWD, shared.setup_ms, shared.step_ms,
+         shared.memory_bytes / 1024);
+  return 0;
+}
+
+// Turbulent wind on a cloth of about a million particles: the cost of the
+// lookups alone and the share of a full step
+#define BENCH_WIND_SIZE 1024
+#define BENCH_WIND_STEPS 4
+
+static int bench_wind(void) {
+  ClothWindField *field = cloth_wind_field_create(32, 1);
+  ClothDesc desc = cloth_default_desc();
+  desc.cols = BENCH_WIND_SIZE;
+  desc.rows = BENCH_WIND_SIZE;
+  desc.spacing = BENCH_SPACING;
+  Cloth *cloth = field ? cloth_create(&desc) : NULL;
+  int count = BENCH_WIND_SIZE * BENCH_WIND_SIZE;
+  Vector3 *gusts = malloc(sizeof(Vector3) * count);
+  if (!cloth || !gusts) {
+    cloth_wind_field_destroy(field);
+    cloth_destroy(cloth);
+    free(gusts);
+    return 1;
+  }
+
+  // the first pass faults the output pages in, time the second
+  double sample_ms = 0.0;
+  for (int pass = 0; pass < 2; pass++) {
+    double start = bench_now();
+    cloth_wind_field_sample(field, cloth_positions(cloth), count,
+                            (Vector3){0.5f, 0.25f, 0.75f}, 1.0f / 40.0f,
+                            gusts);
+    sample_ms = (bench_now() - start) * 1000.0;
+  }
+
+  double start = bench_now();
+
+  for (int i = 0; i < BENCH_WIND_STEPS; i++) {
+    cloth_step(cloth);
+  }
+  double calm_ms = (bench_now() - start) * 1000.0 / BENCH_WIND_STEPS;
+
+  int turbulence =
+      cloth_add_force(cloth, (ClothForce){.type = CLOTH_FORCE_TURBULENCE,
+                                          .enabled = true,
+                                          .acceleration = {0.5f, 0, 0.8f},
+                                          .field = field,
+                                          .turbulence = 0.6f,
+                                          .scale = 40.0f,
+                                          .scroll = {50, 0, 80}});
+  start = bench_now();
+  for (int i = 0; i < BENCH_WIND_STEPS; i++) {
+    cloth_step(cloth);
+  }
+  double windy_ms = (bench_now() - start) * 1000.0 / BENCH_WIND_STEPS;
+
+  printf("wind field, %d particles: %8.3f ms per sampling pass, step "
+         "%8.3f ms calm, %8.3f ms with turbulence (%.1f%%)\n",
+         count, sample_ms, calm_ms, windy_ms,
+         100.0 * sample_ms / (windy_ms > 0.0 ? windy_ms : 1.0));
+
+  // the same wind as drag and lift per triangle, in steady air and with
+  // gusts sampled once per quad. Calm, steady and gusty steps take turns so
+  // they see the same machine, each keeps its fastest step.
+  cloth_enable_force(cloth, turbulence, false);
+  ClothForce steady = {.type = CLOTH_FORCE_AERODYNAMIC,
+                       .enabled = true,
+                       .velocity = {50, 0, 80},
+                       .drag = 1.2e-4f,
+                       .lift = 0.6e-4f};
+  ClothForce gusty = steady;
+  gusty.field = field;
+  gusty.turbulence = 50.0f;
+  gusty.scale = 40.0f;
+  gusty.scroll = (Vector3){50, 0, 80};
+  int aero = cloth_add_force(cloth, steady);
+  double aero_ms[3] = {INFINITY, INFINITY, INFINITY};
+  for (int i = 0; i < BENCH_WIND_STEPS; i++) {
+    for (int mode = 0; mode < 3; mode++) {
+      cloth_set_force(cloth, aero, mode == 2 ? gusty : steady);
+      cloth_enable_force(cloth, aero, mode > 0);
+      start = bench_now();
+      cloth_step(cloth);
+      aero_ms[mode] = fmin(aero_ms[mode], (bench_now() - start) * 1000.0);
+    }
+  }
+  int triangles = 2 * (BENCH_WIND_SIZE - 1) * (BENCH_WIND_SIZE - 1);
+  printf("aerodynamics, %d triangles: %.1f ns per triangle, %.1f with "
+         "gusts (step %8.3f ms calm, %8.3f ms, %8.3f ms)\n",
+         triangles, (aero_ms[1] - aero_ms[0]) * 1e6 / triangles,
+         (aero_ms[2] - aero_ms[0]) * 1e6 / triangles, aero_ms[0], aero_ms[1],
+         aero_ms[2]);
+
+  free(gusts);
+  cloth_destroy(cloth);
+  cloth_wind_field_destroy(field);
+  return 0;
+}
+
+#define BENCH_CCD_SIZE 48
+#define BENCH_CCD_SPACING 5.0f
+#define BENCH_CCD_RADIUS 40.0f
+#define BENCH_CCD_TRAVEL 120.0f
+#define BENCH_CCD_SUBSTEPS 4
+
+// Fires a sphere through a hanging cloth at speed units per frame, split
+// into substeps, and counts the particles it left behind: the ones it
+// tunneled through instead of pushing
+static int bench_ccd_run(float speed, bool continuous, int substeps,
+                         double *frame_ms) {
+  ClothDesc desc = cloth_default_desc();
+  desc.cols = BENCH_CCD_SIZE;
+  desc.rows = BENCH_CCD_SIZE;
+  desc.spacing = BENCH_CCD_SPACING;
+  desc.time_step /= substeps;
+  bool pinned[BENCH_CCD_SIZE * BENCH_CCD_SIZE] = {0};
+  for (int x = 0; x < BENCH_CCD_SIZE; x++) {
+    pinned[x] = true;
+  }
+  desc.pinned = pinned;
+  Cloth *cloth = cloth_create(&desc);
+  if (!cloth)
+    return -1;
+  cloth_set_continuous_collision(cloth, continuous);
+
+  float middle = (BENCH_CCD_SIZE - 1) * BENCH_CCD_SPACING / 2.0f;
+  Vector3 center = {middle, middle, -BENCH_CCD_RADIUS - 10.0f};
+  int sphere = cloth_add_sphere_collider(cloth, center, BENCH_CCD_RADIUS);
+  int frames = (int)(BENCH_CCD_TRAVEL / speed);
+
+  double start = bench_now();
+  for (int f = 0; f < frames; f++) {
+    for (int s = 0; s < substeps; s++) {
+      center.z += speed / substeps;
+      cloth_set_sphere_collider(cloth, sphere, center, BENCH_CCD_RADIUS);
+      cloth_step(cloth);
+    }
+  }
+  *frame_ms = (bench_now() - start) * 1000.0 / frames;
+
+  int behind = 0;
+  const Vector3 *positions = cloth_positions(cloth);
+  for (int i = 0; i < cloth_particle_count(cloth); i++) {
+    float dx = positions[i].x - center.x;
+    float dy = positions[i].y - center.y;
+    float core = BENCH_CCD_RADIUS / 2.0f;
+    behind += dx * dx + dy * dy < core * core && positions[i].z < center.z;
+  }
+  cloth_destroy(cloth);
+  return behind;
+}
+
+static int bench_ccd(void) {
+  const float speeds[] = {15.0f, 40.0f, 120.0f};
+  for (size_t i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++) {
+    double discrete_ms, substep_ms, continuous_ms;
+    int discrete = bench_ccd_run(speeds[i], false, 1, &discrete_ms);
+    int substepped = bench_ccd_run(speeds[i], false, BENCH_CCD_SUBSTEPS,
+                                   &substep_ms);
+    int continuous = bench_ccd_run(speeds[i], true, 1, &continuous_ms);
+    if (discrete < 0 || substepped < 0 || continuous < 0)
+      return 1;
+    printf("sphere at %3.0f/frame: tunneled %3d discrete (%6.3f ms), %3d "
+           "with %d substeps (%6.3f ms), %3d continuous (%6.3f ms)\n",
+           speeds[i], discrete, discrete_ms, substepped, BENCH_CCD_SUBSTEPS,
+           substep_ms, continuous, continuous_ms);
+  }
+  return 0;
+}
+
+#define BENCH_ADAPTIVE_CYCLES 3
+#define BENCH_ADAPTIVE_CYCLE 200
+#define BENCH_ADAPTIVE_PUNCH 5
+#define BENCH_ADAPTIVE_SPEED 30.0f
+
+typedef struct {
+  double frame_ms;
+  double worst_ms;
+  double substeps;
+  float stretch;
+} BenchAdaptive;
+
+// The hanging cloth of bench_ccd_run() mostly at rest, punched through by
+// the sphere and let go again once a cycle. Fixed runs split every frame
+// into substeps by hand, adaptive ones leave it to the cloth. Reports the
+// worst link stretch over the run.
+static int bench_adaptive_run(int substeps, bool adaptive,
+                              BenchAdaptive *result) {
+  ClothDesc desc = cloth_default_desc();
+  desc.cols = BENCH_CCD_SIZE;
+  desc.rows = BENCH_CCD_SIZE;
+  desc.spacing = BENCH_CCD_SPACING;
+  if (!adaptive)
+    desc.time_step /= substeps;
+  bool pinned[BENCH_CCD_SIZE * BENCH_CCD_SIZE] = {0};
+  for (int x = 0; x < BENCH_CCD_SIZE; x++) {
+    pinned[x] = true;
+  }
+  desc.pinned = pinned;
+  Cloth *cloth = cloth_create(&desc);
+  if (!cloth)
+    return 1;
+  if (adaptive)
+    cloth_set_adaptive_step(cloth, 0.5f, substeps);
+
+  float middle = (BENCH_CCD_SIZE - 1) * BENCH_CCD_SPACING / 2.0f;
+  float back = -BENCH_CCD_RADIUS - 20.0f;
+  Vector3 center = {middle, middle, back};
+  int sphere = cloth_add_sphere_collider(cloth, center, BENCH_CCD_RADIUS);
+  *result = (BenchAdaptive){0};
+  int frames = BENCH_ADAPTIVE_CYCLES * BENCH_ADAPTIVE_CYCLE;
+  long substep_sum = 0;
+
+  double start = bench_now();
+  for (int f = 0; f < frames; f++) {
+    // forward through the cloth, hold, back out, hold
+    int phase = f % BENCH_ADAPTIVE_CYCLE;
+    float velocity = 0.0f;
+    if (phase < BENCH_ADAPTIVE_PUNCH)
+      velocity = BENCH_ADAPTIVE_SPEED;
+    else if (phase >= BENCH_ADAPTIVE_CYCLE / 2 &&
+             phase < BENCH_ADAPTIVE_CYCLE / 2 + BENCH_ADAPTIVE_PUNCH)
+      velocity = -BENCH_ADAPTIVE_SPEED;
+
+    double frame_start = bench_now();
+    for (int s = 0; s < (adaptive ? 1 : substeps); s++) {
+      center.z += velocity / (adaptive ? 1 : substeps);
+      cloth_set_sphere_collider(cloth, sphere, center, BENCH_CCD_RADIUS);
+      cloth_step(cloth);
+    }
+    result->worst_ms =
+        fmax(result->worst_ms, (bench_now() - frame_start) * 1000.0);
+    substep_sum += adaptive ? cloth_get_substep_count(cloth) : substeps;
+
+    const Vector3 *positions = cloth_positions(cloth);
+    int edge_count = cloth_edge_count(cloth);
+    for (int i = 0; i < edge_count; i++) {
+      int p1, p2;
+      cloth_get_edge(cloth, i, &p1, &p2);
+      float d = Vector3Distance(positions[p1], positions[p2]);
+      result->stretch = fmaxf(result->stretch,
+                              (d - BENCH_CCD_SPACING) / BENCH_CCD_SPACING);
+    }
+  }
+  result->frame_ms = (bench_now() - start) * 1000.0 / frames;
+  result->substeps = (double)substep_sum / frames;
+  cloth_destroy(cloth);
+  return 0;
+}
+
+// Fixed substep counts against adaptive substeps up to the largest of them
+static int bench_adaptive(void) {
+  const struct {
+    int substeps;
+    bool adaptive;
+  } runs[] = {{1, false}, {2, false}, {4, false}, {8, false}, {8, true}};
+  for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+    BenchAdaptive result;
+    if (bench_adaptive_run(runs[i].substeps, runs[i].adaptive, &result))
+      return 1;
+    printf("%-8s %d substeps: %6.3f ms/frame (worst %6.3f), %4.2f substeps "
+           "on average, stretch max %6.3f\n",
+           runs[i].adaptive ? "adaptive" : "fixed", runs[i].substeps,
+           result.frame_ms, result.worst_ms, result.substeps, result.stretch);
+  }
+  return 0;
+}
+
+#define BENCH_MESH_RADIUS 100.0f
+#define BENCH_MESH_QUERY_ROWS 256
+#define BENCH_MESH_CLOTH 64
+
+// Sphere of stacks rings and 2 * stacks segments facing outwards, skipping
+// the empty triangles at the poles
+static ClothMeshCollider *bench_mesh_sphere(int stacks, Vector3 center,
+                                            Vector3 *vertices, int *indices) {
+  int slices = 2 * stacks;
+  for (int i = 0; i <= stacks; i++) {
+    float theta = PI * i / stacks;
+    for (int j = 0; j <= slices; j++) {
+      float phi = 2.0f * PI * j / slices;
+      Vector3 dir = {sinf(theta) * cosf(phi), cosf(theta),
+                     sinf(theta) * sinf(phi)};
+      vertices[i * (slices + 1) + j] =
+          Vector3Add(center, Vector3Scale(dir, BENCH_MESH_RADIUS));
+    }
+  }
+  int count = 0;
+  for (int i = 0; i < stacks; i++) {
+    for (int j = 0; j < slices; j++) {
+      int v00 = i * (slices + 1) + j;
+      int v10 = v00 + slices + 1;
+      if (i > 0) {
+        int *t = &indices[3 * count++];
+        t[0] = v00;
+        t[1] = v00 + 1;
+        t[2] = v10;
+      }
+      if (i < stacks - 1) {
+        int *t = &indices[3 * count++];
+        t[0] = v00 + 1;
+        t[1] = v10 + 1;
+        t[2] = v10;
+      }
+    }
+  }
+  return cloth_mesh_collider_create(vertices, (stacks + 1) * (slices + 1),
+                                    indices, count);
+}
+
+// One cloth step against the mesh or the field, or the equivalent analytic
+// sphere when both are NULL, with the cloth hanging into the sphere
+static double bench_mesh_step(const ClothMeshCollider *mesh,
+                              const ClothSdfCollider *sdf, Vector3 center) {
+  ClothDesc desc = cloth_default_desc();
+  desc.cols = BENCH_MESH_CLOTH;
+  desc.rows = BENCH_MESH_CLOTH;
+  desc.spacing = 4.0f * BENCH_MESH_RADIUS / BENCH_MESH_CLOTH;
+  Cloth *cloth = cloth_create(&desc);
+  if (!cloth)
+    return -1.0;
+  if (mesh)
+    cloth_add_mesh_collider(cloth, mesh, 0.0f);
+  else if (sdf)
+    cloth_add_sdf_collider(cloth, sdf, 0.0f);
+  else
+    cloth_add_sphere_collider(cloth, center, BENCH_MESH_RADIUS);
+  double ms = bench_steps(cloth);
+  cloth_destroy(cloth);
+  return ms;
+}
+
+#define BENCH_SDF_STACKS 64
+#define BENCH_SDF_VOXELS 48
+#define BENCH_SDF_CACHE "bench_sdf.bin"
+
+// Bakes the mesh into a distance field: the cost of baking against loading
+// it back from disk, of a lookup against a mesh query and how far the
+// sampled distances stray from the mesh
+static int bench_sdf_collider(const ClothMeshCollider *mesh, Vector3 center,
+                              const Vector3 *points, int count) {
+  Vector3 half = Vector3Scale((Vector3){1, 1, 1}, 1.2f * BENCH_MESH_RADIUS);
+  float voxel_size = 2.4f * BENCH_MESH_RADIUS / BENCH_SDF_VOXELS;
+  double start = bench_now();
+  ClothSdfCollider *sdf = cloth_sdf_collider_create_from_mesh(
+      mesh, Vector3Subtract(center, half), Vector3Add(center, half),
+      voxel_size);
+  double bake_ms = (bench_now() - start) * 1000.0;
+  if (!sdf)
+    return 1;
+
+  start = bench_now();
+  bool cached = cloth_sdf_collider_save(sdf, BENCH_SDF_CACHE);
+  ClothSdfCollider *loaded = cached ? cloth_sdf_collider_load(BENCH_SDF_CACHE)
+                                    : NULL;
+  double cache_ms = (bench_now() - start) * 1000.0;
+  remove(BENCH_SDF_CACHE);
+  float *distances = malloc(sizeof(float) * count);
+  Vector3 *gradients = malloc(sizeof(Vector3) * count);
+  if (!loaded || !distances || !gradients) {
+    cloth_sdf_collider_destroy(sdf);
+    cloth_sdf_collider_destroy(loaded);
+    free(distances);
+    free(gradients);
+    return 1;
+  }
+
+  start = bench_now();
+  cloth_sdf_collider_sample(loaded, points, count, distances, gradients);
+  double sample_ns = (bench_now() - start) * 1e9 / count;
+
+  float max_error = 0.0f;
+  for (int i = 0; i < count; i++) {
+    Vector3 closest, normal;
+    if (!cloth_mesh_collider_closest(mesh, points[i], BENCH_MESH_RADIUS,
+                                     &closest, &normal))
+      continue;
+    Vector3 diff = Vector3Subtract(points[i], closest);
+    float exact = Vector3Length(diff);
+    if (Vector3DotProduct(diff, normal) < 0.0f)
+      exact = -exact;
+    max_error = fmaxf(max_error, fabsf(distances[i] - exact));
+  }
+
+  printf("distance field, %d^3 voxels: bake %8.3f ms, save and load "
+         "%7.3f ms, %5.1f ns per lookup, max error %.3f, cloth step "
+         "%7.3f ms\n",
+         BENCH_SDF_VOXELS + 1, bake_ms, cache_ms, sample_ns, max_error,
+         bench_mesh_step(NULL, loaded, center));
+  cloth_sdf_collider_destroy(sdf);
+  cloth_sdf_collider_destroy(loaded);
+  free(distances);
+  free(gradients);
+  return 0;
+}
+
+// Building once against refitting every frame, and the query cost as the
+// triangle count grows 16 times per row
+static int bench_mesh_colliders(void) {
+  const int stacks[] = {16, 64, 256};
+  int max_stacks = stacks[sizeof(stacks) / sizeof(stacks[0]) - 1];
+  int max_vertices = (max_stacks + 1) * (2 * max_stacks + 1);
+  Vector3 *vertices = malloc(sizeof(Vector3) * max_vertices);
+  Vector3 *moved = malloc(sizeof(Vector3) * max_vertices);
+  int *indices = malloc(sizeof(int) * 3 * 4 * max_stacks * max_stacks);
+  int query_count = BENCH_MESH_QUERY_ROWS * BENCH_MESH_QUERY_ROWS;
+  Vector3 *points = malloc(sizeof(Vector3) * query_count);
+  if (!vertices || !moved || !indices || !points) {
+    free(vertices);
+    free(moved);
+    free(indices);
+    free(points);
+    return 1;
+  }
+
+  float middle = (BENCH_MESH_CLOTH - 1) * 2.0f * BENCH_MESH_RADIUS /
+                 BENCH_MESH_CLOTH;
+  Vector3 center = {middle, middle, 0.9f * BENCH_MESH_RADIUS};
+  // points scattered in a shell around the surface but visited in rows, as
+  // neighboring cloth particles would query it
+  uint32_t state = 12345;
+  for (int i = 0; i < query_count; i++) {
+    float theta = PI * (i / BENCH_MESH_QUERY_ROWS + 0.5f) /
+                  BENCH_MESH_QUERY_ROWS;
+    float phi = 2.0f * PI * (i % BENCH_MESH_QUERY_ROWS) /
+                BENCH_MESH_QUERY_ROWS;
+    state = state * 1664525u + 1013904223u;
+    float shell = 0.95f + (state >> 8) * (0.1f / 16777216.0f);
+    Vector3 dir = {sinf(theta) * cosf(phi), cosf(theta),
+                   sinf(theta) * sinf(phi)};
+    points[i] = Vector3Add(center,
+                           Vector3Scale(dir, BENCH_MESH_RADIUS * shell));
+  }
+
+  int result = 0;
+  for (size_t s = 0; s < sizeof(stacks) / sizeof(stacks[0]); s++) {
+    double start = bench_now();
+    ClothMeshCollider *mesh =
+        bench_mesh_sphere(stacks[s], center, vertices, indices);
+    double build_ms = (bench_now() - start) * 1000.0;
+    if (!mesh) {
+      result = 1;
+      break;
+    }
+
+    // a breathing sphere, every vertex moves
+    int vertex_count = (stacks[s] + 1) * (2 * stacks[s] + 1);
+    for (int i = 0; i < vertex_count; i++) {
+      Vector3 offset = Vector3Subtract(vertices[i], center);
+      moved[i] = Vector3Add(center, Vector3Scale(offset, 1.01f));
+    }
+    start = bench_now();
+    cloth_mesh_collider_update(mesh, moved);
+    double refit_ms = (bench_now() - start) * 1000.0;
+    cloth_mesh_collider_update(mesh, vertices);
+
+    int hits = 0;
+    start = bench_now();
+    for (int i = 0; i < query_count; i++) {
+      Vector3 closest, normal;
+      hits += cloth_mesh_collider_closest(mesh, points[i],
+                                          0.1f * BENCH_MESH_RADIUS, &closest,
+                                          &normal);
+    }
+    double query_ns = (bench_now() - start) * 1e9 / query_count;
+
+    double step_ms = bench_mesh_step(mesh, NULL, center);
+    printf("mesh collider, %6d triangles: build %8.3f ms, refit %7.3f ms, "
+           "%5.0f ns per query (%d hits), cloth step %7.3f ms\n",
+           cloth_mesh_collider_triangle_count(mesh), build_ms, refit_ms,
+           query_ns, hits, step_ms);
+    if (stacks[s] == BENCH_SDF_STACKS)
+      result = bench_sdf_collider(mesh, center, points, query_count);
+    cloth_mesh_collider_destroy(mesh);
+    if (result != 0)
+      break;
+  }
+  if (result == 0)
+    printf("analytic sphere collider:  cloth step %7.3f ms\n",
+           bench_mesh_step(NULL, NULL, center));
+
+  free(vertices);
+  free(moved);
+  free(indices);
+  free(points);
+  return result;
+}
+
+#define BENCH_TEAR_SIZE 256
+#define BENCH_TEAR_STEPS 60
+#define BENCH_TEAR_STRETCH 1.5f
+
+// Hangs an explicit cloth and yanks its lower half down until it rips,
+// timing every step. With tear set the worst step shows what removing
+// sticks and splitting particles costs next to the average one, which is
+// what rebuilding the cloth after each tear would cost every time instead.
+static int bench_tearing_run(bool tear, double *mean_ms, double *worst_ms,
+                             int *torn, double *create_ms) {
+  ClothDesc desc = cloth_default_desc();
+  desc.topology = CLOTH_TOPOLOGY_EXPLICIT;
+  desc.cols = BENCH_TEAR_SIZE;
+  desc.rows = BENCH_TEAR_SIZE;
+  desc.spacing = BENCH_SPACING;
+  bool *pinned = calloc(BENCH_TEAR_SIZE * BENCH_TEAR_SIZE, sizeof(bool));
+  if (!pinned)
+    return 1;
+  for (int x = 0; x < BENCH_TEAR_SIZE; x++) {
+    pinned[x] = x % 4 == 0;
+  }
+  desc.pinned = pinned;
+
+  double start = bench_now();
+  Cloth *cloth = cloth_create(&desc);
+  *create_ms = (bench_now() - start) * 1000.0;
+  free(pinned);
+  if (!cloth)
+    return 1;
+  if (tear && !cloth_set_tearing(cloth, BENCH_TEAR_STRETCH)) {
+    cloth_destroy(cloth);
+    return 1;
+  }
+
+  float size = BENCH_TEAR_SIZE * BENCH_SPACING;
+  cloth_add_force(cloth, (ClothForce){.type = CLOTH_FORCE_REGION,
+                                      .enabled = true,
+                                      .acceleration = {0, 40, 0},
+                                      .min = {-size, size / 2, -size},
+                                      .max = {2 * size, 2 * size, size}});
+
+  int edges = cloth_edge_count(cloth);
+  double total = 0.0;
+  *worst_ms = 0.0;
+  for (int s = 0; s < BENCH_TEAR_STEPS; s++) {
+    start = bench_now();
+    cloth_step(cloth);
+    double ms = (bench_now() - start) * 1000.0;
+    total += ms;
+    *worst_ms = fmax(*worst_ms, ms);
+  }
+  *mean_ms = total / BENCH_TEAR_STEPS;
+  *torn = edges - cloth_edge_count(cloth);
+  cloth_destroy(cloth);
+  return 0;
+}
+
+static int bench_tearing(void) {
+  double intact_mean, intact_worst, tear_mean, tear_worst, create_ms;
+  int torn;
+  if (bench_tearing_run(false, &intact_mean, &intact_worst, &torn,
+                        &create_ms) ||
+      bench_tearing_run(true, &tear_mean, &tear_worst, &torn, &create_ms))
+    return 1;
+  printf("tearing %dx%d: %d sticks torn, %6.3f ms/step (worst %6.3f) vs "
+         "%6.3f ms/step (worst %6.3f) intact, rebuild %6.3f ms\n",
+         BENCH_TEAR_SIZE, BENCH_TEAR_SIZE, torn, tear_mean, tear_worst,
+         intact_mean, intact_worst, create_ms);
+  return 0;
+}
+
+#define BENCH_CUT_SIZE 1024
+#define BENCH_CUT_COUNT 16
+
+// Sweeps a blade from a fixed eye across a million particle cloth, one
+// short stroke per cut like a mouse drag between frames. A step runs between
+// strokes, so cuts work from the block bounds the step left.
+static int bench_cutting(void) {
+  ClothDesc desc = cloth_default_desc();
+  desc.topology = CLOTH_TOPOLOGY_EXPLICIT;
+  desc.cols = BENCH_CUT_SIZE;
+  desc.rows = BENCH_CUT_SIZE;
+  desc.spacing = BENCH_SPACING;
+  Cloth *cloth = cloth_create(&desc);
+  if (!cloth || !cloth_reorder(cloth))
+    return 1;
+
+  float size = BENCH_CUT_SIZE * BENCH_SPACING;
+  ClothRay last = {{size / 2, size / 2, -size}, {0, -0.4f, 1}};
+  double total = 0.0;
+  double worst = 0.0;
+  int cut = 0;
+  for (int i = 0; i < BENCH_CUT_COUNT; i++) {
+    ClothRay ray = last;
+    ray.direction.y += 0.8f / BENCH_CUT_COUNT;
+    ray.direction.x += 0.05f;
+    double start = bench_now();
+    int count = cloth_cut(cloth, last, ray);
+    double ms = (bench_now() - start) * 1000.0;
+    if (count < 0) {
+      cloth_destroy(cloth);
+      return 1;
+    }
+    // the first cut also builds the per particle lists
+    if (i > 0) {
+      total += ms;
+      worst = fmax(worst, ms);
+    }
+    cut += count;
+    last = ray;
+    if (!cloth_step(cloth)) {
+      cloth_destroy(cloth);
+      return 1;
+    }
+  }
+  printf("cutting %dx%d: %d sticks in %d strokes, %6.3f ms/stroke (worst "
+         "%6.3f)\n",
+         BENCH_CUT_SIZE, BENCH_CUT_SIZE, cut, BENCH_CUT_COUNT,
+         total / (BENCH_CUT_COUNT - 1), worst);
+  cloth_destroy(cloth);
+  return 0;
+}
+
+#define BENCH_STRANDS 4096
+#define BENCH_STRAND_LENGTH 64
+#define BENCH_STRAND_STEPS 50
+#define BENCH_GALE_STEPS 400
+
+// The same hanging hair as directly solved strands or as explicit chains
+// relaxed like any mesh, both swung sideways by a steady breeze
+static Cloth *bench_create_strands(bool direct, int iterations) {
+  int count = BENCH_STRANDS * BENCH_STRAND_LENGTH;
+  bool *pinned = calloc(count, sizeof(bool));
+  Vector3 *positions = malloc(sizeof(Vector3) * count);
+  int *edges = malloc(sizeof(int) * 2 * count);
+  if (!pinned || !positions || !edges) {
+    free(pinned);
+    free(positions);
+    free(edges);
+    return NULL;
+  }
+  for (int x = 0; x < BENCH_STRANDS; x++) {
+    pinned[x] = true;
+  }
+
+  ClothDesc desc = cloth_default_desc();
+  desc.cols = BENCH_STRANDS;
+  desc.rows = BENCH_STRAND_LENGTH;
+  desc.spacing = BENCH_SPACING;
+  desc.pinned = pinned;
+  desc.iterations = iterations;
+  if (direct) {
+    desc.topology = CLOTH_TOPOLOGY_STRANDS;
+  } else {
+    int edge_count = 0;
+    for (int y = 0; y < BENCH_STRAND_LENGTH; y++) {
+      for (int x = 0; x < BENCH_STRANDS; x++) {
+        int index = y * BENCH_STRANDS + x;
+        positions[index] =
+            (Vector3){x * BENCH_SPACING, y * BENCH_SPACING, 0.0f};
+        if (y > 0) {
+          edges[2 * edge_count] = index - BENCH_STRANDS;
+          edges[2 * edge_count + 1] = index;
+          edge_count++;
+        }
+      }
+    }
+    desc.topology = CLOTH_TOPOLOGY_EXPLICIT;
+    desc.positions = positions;
+    desc.particle_count = count;
+    desc.edges = edges;
+    desc.edge_count = edge_count;
+  }
+  Cloth *cloth = cloth_create(&desc);
+  free(pinned);
+  free(positions);
+  free(edges);
+  if (cloth)
+    cloth_set_wind(cloth, (Vector3){0.3f, 0.0f, 0.2f});
+  return cloth;
+}
+
+// The breeze, then a gale ten times as strong for BENCH_GALE_STEPS
+// steps. Under load the linearized step has to hold the weight of the whole
+// strand, the gale runs report the worst stretch of any step.
+static int bench_strands(void) {
+  const struct {
+    bool direct;
+    int iterations;
+    bool gale;
+  } runs[] = {{true, 1, false},  {true, 2, false},  {false, 5, false},
+              {false, 20, false}, {false, 50, false}, {true, 1, true},
+              {true, 2, true}};
+  for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+    Cloth *cloth = bench_create_strands(runs[i].direct, runs[i].iterations);
+    if (!cloth)
+      return 1;
+    int steps = BENCH_STRAND_STEPS;
+    if (runs[i].gale) {
+      cloth_set_wind(cloth, (Vector3){3.0f, 0.0f, 2.0f});
+      steps = BENCH_GALE_STEPS;
+    }
+    double total = 0.0;
+    float worst = 0.0f;
+    for (int s = 0; s < steps; s++) {
+      double start = bench_now();
+      cloth_step(cloth);
+      total += bench_now() - start;
+      if (runs[i].gale)
+        worst = fmaxf(worst, bench_grid_stretch(cloth).max);
+    }
+    BenchError stretch = bench_grid_stretch(cloth);
+    printf("%d strands of %d, %-8s %2d iterations%s: %7.3f ms/step, stretch "
+           "mean %.5f max %.5f",
+           BENCH_STRANDS, BENCH_STRAND_LENGTH,
+           runs[i].direct ? "direct" : "relaxed", runs[i].iterations,
+           runs[i].gale ? " in a gale" : "", total * 1000.0 / steps,
+           stretch.mean, stretch.max);
+    if (runs[i].gale)
+      printf(" worst %.5f", worst);
+    printf("\n");
+    cloth_destroy(cloth);
+  }
+  return 0;
+}
+
+#define BENCH_GLOBAL_STEPS 50
+#define BENCH_GLOBAL_NEWTON 2
+#define BENCH_GLOBAL_MAX_ITERATIONS 1280
+
+// Explicit sheet of size x size hanging from its top row in a breeze. The
+// weight of a column pulls on every link above it, relaxation has to carry
+// corrections across the whole sheet to hold it.
+static Cloth *bench_create_sheet(int size, int iterations) {
+  ClothDesc desc = cloth_default_desc();
+  desc.topology = CLOTH_TOPOLOGY_EXPLICIT;
+  desc.cols = size;
+  desc.rows = size;
+  desc.spacing = BENCH_SPACING;
+  desc.iterations = iterations;
+  Cloth *cloth = cloth_create(&desc);
+  if (!cloth)
+    return NULL;
+  for (int x = 0; x < size; x++) {
+    cloth_set_pinned(cloth, x, true);
+  }
+  cloth_set_wind(cloth, (Vector3){0.3f, 0.0f, 0.2f});
+  return cloth;
+}
+
+// ms per step and the stretch the sheet settles at
+static double bench_sheet(Cloth *cloth, BenchError *stretch) {
+  double start = bench_now();
+  for (int s = 0; s < BENCH_GLOBAL_STEPS; s++) {
+    cloth_step(cloth);
+  }
+  double ms = (bench_now() - start) * 1000.0 / BENCH_GLOBAL_STEPS;
+  *stretch = bench_grid_stretch(cloth);
+  return ms;
+}
+
+// The global solve against relaxation on sheets of growing size. Relaxation
+// is cheap per iteration but needs more of them the bigger and stiffer the
+// sheet, the factorization grows faster than the sheet but two Newton steps
+// hold it at rest length. Relaxation iterations double until the worst link
+// is within 1% and then 0.1% of its rest length, where that costs more than
+// the global solve is past the crossover.
+static int bench_global_solve(void) {
+  const int sizes[] = {16, 32, 48, 64, 96};
+  const float tolerances[] = {0.01f, 0.001f};
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    int size = sizes[i];
+    Cloth *cloth = bench_create_sheet(size, 1);
+    if (!cloth || !cloth_set_global_solve(cloth, BENCH_GLOBAL_NEWTON))
+      return 1;
+    // the first step orders and lays out the factor
+    double start = bench_now();
+    cloth_step(cloth);
+    double setup_ms = (bench_now() - start) * 1000.0;
+    BenchError stretch;
+    double ms = bench_sheet(cloth, &stretch);
+    cloth_destroy(cloth);
+    printf("sheet %2dx%-2d global, %d Newton steps: %8.3f ms/step, first "
+           "%7.3f ms, stretch max %.5f\n",
+           size, size, BENCH_GLOBAL_NEWTON, ms, setup_ms, stretch.max);
+
+    int iterations = 5;
+    for (size_t t = 0; t < sizeof(tolerances) / sizeof(tolerances[0]); t++) {
+      for (;;) {
+        cloth = bench_create_sheet(size, iterations);
+        if (!cloth)
+          return 1;
+        ms = bench_sheet(cloth, &stretch);
+        cloth_destroy(cloth);
+        if (stretch.max <= tolerances[t] ||
+            iterations >= BENCH_GLOBAL_MAX_ITERATIONS)
+          break;
+        iterations *= 2;
+      }
+      printf("            relaxed within %4.1f%%: %4d iterations, %8.3f "
+             "ms/step, stretch max %.5f\n",
+             tolerances[t] * 100.0f, iterations, ms, stretch.max);
+    }
+  }
+  return 0;
+}
+
+#define BENCH_BOXES 4096
+#define BENCH_BOX_SIZE 10.0f
+#define BENCH_BOX_STEPS 100
+
+// Boxes of eight particles hanging from a corner, rigid either through one
+// shape matching cluster each or through sticks between all 28 pairs of
+// corners
+static Cloth *bench_create_boxes(bool clusters, int iterations) {
+  int count = BENCH_BOXES * 8;
+  Vector3 *positions = malloc(sizeof(Vector3) * count);
+  int *edges = malloc(sizeof(int) * 2 * 28 * BENCH_BOXES);
+  if (!positions || !edges) {
+    free(positions);
+    free(edges);
+    return NULL;
+  }
+  int edge_count = 0;
+  for (int b = 0; b < BENCH_BOXES; b++) {
+    Vector3 origin = {(b % 64) * 4 * BENCH_BOX_SIZE,
+                      (b / 64) * 4 * BENCH_BOX_SIZE, 0.0f};
+    for (int k = 0; k < 8; k++) {
+      positions[8 * b + k] =
+          Vector3Add(origin, (Vector3){(k & 1) * BENCH_BOX_SIZE,
+                                       (k >> 1 & 1) * BENCH_BOX_SIZE,
+                                       (k >> 2 & 1) * BENCH_BOX_SIZE});
+      for (int j = 0; !clusters && j < k; j++) {
+        edges[2 * edge_count] = 8 * b + j;
+        edges[2 * edge_count + 1] = 8 * b + k;
+        edge_count++;
+      }
+    }
+  }
+
+  ClothDesc desc = cloth_default_desc();
+  desc.topology = CLOTH_TOPOLOGY_EXPLICIT;
+  desc.positions = positions;
+  desc.particle_count = count;
+  desc.edges = edges;
+  desc.edge_count = edge_count;
+  desc.iterations = iterations;
+  Cloth *cloth = cloth_create(&desc);
+  free(edges);
+  if (!cloth) {
+    free(positions);
+    return NULL;
+  }
+  for (int b = 0; clusters && b < BENCH_BOXES; b++) {
+    int members[8];
+    for (int k = 0; k < 8; k++) {
+      members[k] = 8 * b + k;
+    }
+    if (cloth_add_shape_cluster(cloth, members, 8, 1.0f) < 0) {
+      cloth_destroy(cloth);
+      free(positions);
+      return NULL;
+    }
+  }
+  // hang every box from one corner so it swings down around it
+  for (int b = 0; b < BENCH_BOXES; b++) {
+    cloth_set_pinned(cloth, 8 * b, true);
+  }
+  free(positions);
+  return cloth;
+}
+
+// Worst relative change of a corner to corner distance
+static float bench_box_distortion(const Cloth *cloth) {
+  const Vector3 *positions = cloth_positions(cloth);
+  float rest[8][8];
+  float worst = 0.0f;
+  for (int i = 0; i < 8; i++) {
+    for (int j = 0; j < 8; j++) {
+      int d = (i ^ j);
+      rest[i][j] = BENCH_BOX_SIZE * sqrtf((float)((d & 1) + (d >> 1 & 1) +
+                                                  (d >> 2 & 1)));
+    }
+  }
+  for (int b = 0; b < BENCH_BOXES; b++) {
+    for (int i = 0; i < 8; i++) {
+      for (int j = i + 1; j < 8; j++) {
+        float d = Vector3Distance(positions[8 * b + i], positions[8 * b + j]);
+        worst = fmaxf(worst, fabsf(d - rest[i][j]) / rest[i][j]);
+      }
+    }
+  }
+  return worst;
+}
+
+// Shape matching holds a box rigid in one pass, sticks need iterations to
+// get close
+static int bench_shape_matching(void) {
+  const struct {
+    bool clusters;
+    int iterations;
+  } runs[] = {{true, 1}, {false, 1}, {false, 5}, {false, 20}};
+  for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+    Cloth *cloth = bench_create_boxes(runs[i].clusters, runs[i].iterations);
+    if (!cloth)
+      return 1;
+    double start = bench_now();
+    for (int s = 0; s < BENCH_BOX_STEPS; s++) {
+      cloth_step(cloth);
+    }
+    double ms = (bench_now() - start) * 1000.0 / BENCH_BOX_STEPS;
+    float worst = bench_box_distortion(cloth);
+    printf("%d swinging boxes, %-8s %2d iterations: %7.3f ms/step, "
+           "distortion max %.5f\n",
+           BENCH_BOXES, runs[i].clusters ? "clusters" : "sticks",
+           runs[i].iterations, ms, worst);
+    cloth_destroy(cloth);
+  }
+  return 0;
+}
+
+#define BENCH_RAGDOLLS 8192
+#define BENCH_RAGDOLL_STEPS 50
+#define BENCH_RAGDOLL_JOINTS 15
+
+// The paper's stick figure: head, neck, pelvis, then shoulder, elbow, hand,
+// hip, knee and foot on the left and on the right
+static const Vector3 bench_skeleton[BENCH_RAGDOLL_JOINTS] = {
+    {0, -34, 0},  {0, -28, 0},  {0, -6, 0},  {-8, -27, 0}, {-8, -16, 4},
+    {-8, -7, 8},  {-4, -4, 0},  {-4, 8, 3},  {-4, 20, 0},  {8, -27, 0},
+    {8, -16, 4},  {8, -7, 8},   {4, -4, 0},  {4, 8, 3},    {4, 20, 0}};
+static const int bench_bones[] = {
+    0, 1, 1, 3, 1, 9,  3, 4,   4, 5, 9, 10, 10, 11, 1, 2, 2, 6, 2, 12,
+    6, 7, 7, 8, 12, 13, 13, 14, 3, 6, 9, 12, 3, 12, 9, 6, 6, 12};
+static const ClothAngleLimit bench_limits[] = {
+    {3, 4, 5, 0.3f, PI},   {9, 10, 11, 0.3f, PI}, {6, 7, 8, 0.3f, PI},
+    {12, 13, 14, 0.3f, PI}, {0, 1, 2, 2.2f, PI}};
+
+// Crowd of ragdolls, batched with angle limits or as one explicit mesh of
+// their bones relaxed in color batches
+static Cloth *bench_create_ragdolls(bool batched) {
+  int bone_count = (int)(sizeof(bench_bones) / sizeof(bench_bones[0]) / 2);
+  ClothDesc desc = cloth_default_desc();
+  desc.spacing = 30.0f;
+  if (batched) {
+    desc.topology = CLOTH_TOPOLOGY_RAGDOLLS;
+    desc.cols = BENCH_RAGDOLLS;
+    desc.positions = bench_skeleton;
+    desc.particle_count = BENCH_RAGDOLL_JOINTS;
+    desc.edges = bench_bones;
+    desc.edge_count = bone_count;
+    desc.angle_limits = bench_limits;
+    desc.angle_limit_count =
+        (int)(sizeof(bench_limits) / sizeof(bench_limits[0]));
+    return cloth_create(&desc);
+  }
+
+  int count = BENCH_RAGDOLLS * BENCH_RAGDOLL_JOINTS;
+  Vector3 *positions = malloc(sizeof(Vector3) * count);
+  int *edges = malloc(sizeof(int) * 2 * bone_count * BENCH_RAGDOLLS);
+  if (!positions || !edges) {
+    free(positions);
+    free(edges);
+    return NULL;
+  }
+  for (int r = 0; r < BENCH_RAGDOLLS; r++) {
+    int first = r * BENCH_RAGDOLL_JOINTS;
+    for (int j = 0; j < BENCH_RAGDOLL_JOINTS; j++) {
+      positions[first + j] = Vector3Add(
+          bench_skeleton[j], (Vector3){r * desc.spacing, 0.0f, 0.0f});
+    }
+    for (int e = 0; e < 2 * bone_count; e++) {
+      edges[2 * bone_count * r + e] = first + bench_bones[e];
+    }
+  }
+  desc.topology = CLOTH_TOPOLOGY_EXPLICIT;
+  desc.positions = positions;
+  desc.particle_count = count;
+  desc.edges = edges;
+  desc.edge_count = bone_count * BENCH_RAGDOLLS;
+  Cloth *cloth = cloth_create(&desc);
+  free(positions);
+  free(edges);
+  return cloth;
+}
+
+static int bench_joint(bool batched, int ragdoll, int joint) {
+  return batched ? joint * BENCH_RAGDOLLS + ragdoll
+                 : ragdoll * BENCH_RAGDOLL_JOINTS + joint;
+}
+
+// Yanks every ragdoll's head sideways, harder the further along the crowd,
+// the rest of the body follows through the constraints and keeps moving
+static void bench_knock_ragdolls(Cloth *cloth, bool batched) {
+  const Vector3 *positions = cloth_positions(cloth);
+  for (int r = 0; r < BENCH_RAGDOLLS; r++) {
+    Vector3 push = {2.0f + (r % 7), 0.0f, 4.0f - (r % 5) * 2.0f};
+    int head = bench_joint(batched, r, 0);
+    cloth_set_position(cloth, head, Vector3Add(positions[head], push));
+  }
+}
+
+// Worst relative stretch of a bone
+static float bench_bone_stretch(const Cloth *cloth, bool batched) {
+  const Vector3 *positions = cloth_positions(cloth);
+  int bone_count = (int)(sizeof(bench_bones) / sizeof(bench_bones[0]) / 2);
+  float worst = 0.0f;
+  for (int r = 0; r < BENCH_RAGDOLLS; r++) {
+    for (int b = 0; b < bone_count; b++) {
+      int a = bench_bones[2 * b], c = bench_bones[2 * b + 1];
+      float rest = Vector3Distance(bench_skeleton[a], bench_skeleton[c]);
+      float d = Vector3Distance(positions[bench_joint(batched, r, a)],
+                                positions[bench_joint(batched, r, c)]);
+      worst = fmaxf(worst, fabsf(d - rest) / rest);
+    }
+  }
+  return worst;
+}
+
+// Ragdolls step independently in lanes, the same skeletons as a mesh share
+// color batches with no room for limits. The two crowds take turns a step at
+// a time and each keeps its fastest step.
+static int bench_ragdolls(void) {
+  Cloth *crowds[2] = {bench_create_ragdolls(true),
+                      bench_create_ragdolls(false)};
+  if (!crowds[0] || !crowds[1]) {
+    cloth_destroy(crowds[0]);
+    cloth_destroy(crowds[1]);
+    return 1;
+  }
+  double ms[2] = {INFINITY, INFINITY};
+  for (int i = 0; i < 2; i++) {
+    bench_knock_ragdolls(crowds[i], i == 0);
+  }
+  for (int s = 0; s < BENCH_RAGDOLL_STEPS; s++) {
+    for (int i = 0; i < 2; i++) {
+      double start = bench_now();
+      cloth_step(crowds[i]);
+      ms[i] = fmin(ms[i], (bench_now() - start) * 1000.0);
+    }
+  }
+  for (int i = 0; i < 2; i++) {
+    printf("%d ragdolls, %-7s: %7.3f ms/step, %5.1f ns per joint, bone "
+           "stretch max %.5f\n",
+           BENCH_RAGDOLLS, i == 0 ? "batched" : "mesh", ms[i],
+           ms[i] * 1e6 / (BENCH_RAGDOLLS * BENCH_RAGDOLL_JOINTS),
+           bench_bone_stretch(crowds[i], i == 0));
+    cloth_destroy(crowds[i]);
+  }
+
+  int threads[] = {1, 0};
+  for (int i = 0; i < 2; i++) {
+    ClothWorld *world = cloth_world_create(threads[i]);
+    Cloth *cloth = bench_create_ragdolls(true);
+    if (cloth)
+      bench_knock_ragdolls(cloth, true);
+    if (!world || !cloth || !cloth_world_add(world, cloth)) {
+      cloth_world_destroy(world);
+      cloth_destroy(cloth);
+      return 1;
+    }
+    double start = bench_now();
+    for (int s = 0; s < BENCH_RAGDOLL_STEPS; s++) {
+      cloth_world_step_all(world);
+    }
+    double ms = (bench_now() - start) * 1000.0 / BENCH_RAGDOLL_STEPS;
+    printf("%d ragdolls in a world on %2d threads: %7.3f ms/step\n",
+           BENCH_RAGDOLLS, cloth_world_thread_count(world), ms);
+    cloth_world_destroy(world);
+    cloth_destroy(cloth);
+  }
+  return 0;
+}
+
+#define BENCH_BLOCK_CELLS 26
+#define BENCH_BLOCK_STEPS 60
+
+typedef struct {
+  Vector3 *positions;
+  int particle_count;
+  int *edges;
+  int edge_count;
+  int *tetrahedra;
+  int tetrahedron_count;
+} BenchBlock;
+
+static int bench_compare_edges(const void *a, const void *b) {
+  const int *ea = a;
+  const int *eb = b;
+  if (ea[0] != eb[0])
+    return ea[0] < eb[0] ? -1 : 1;
+  return (ea[1] > eb[1]) - (ea[1] < eb[1]);
+}
+
+// A cube of cells split into six tetrahedra each around the cell's main
+// diagonal, which matches up across neighboring cells. Edges are those of
+// the tetrahedra.
+static bool bench_build_block(BenchBlock *block) {
+  // corners of the six tetrahedra, bit 0 is x, bit 1 y and bit 2 z
+  static const int kuhn[6][4] = {{0, 1, 3, 7}, {0, 1, 5, 7}, {0, 2, 3, 7},
+                                 {0, 2, 6, 7}, {0, 4, 5, 7}, {0, 4, 6, 7}};
+  int n = BENCH_BLOCK_CELLS;
+  int side = n + 1;
+  block->particle_count = side * side * side;
+  block->tetrahedron_count = 6 * n * n * n;
+  block->positions = malloc(sizeof(Vector3) * block->particle_count);
+  block->tetrahedra = malloc(sizeof(int) * 4 * block->tetrahedron_count);
+  block->edges = malloc(sizeof(int) * 12 * block->tetrahedron_count);
+  if (!block->positions || !block->tetrahedra || !block->edges)
+    return false;
+
+  for (int z = 0; z < side; z++) {
+    for (int y = 0; y < side; y++) {
+      for (int x = 0; x < side; x++) {
+        block->positions[(z * side + y) * side + x] =
+            (Vector3){x * BENCH_SPACING, y * BENCH_SPACING, z * BENCH_SPACING};
+      }
+    }
+  }
+
+  int *tet = block->tetrahedra;
+  int *edge = block->edges;
+  for (int z = 0; z < n; z++) {
+    for (int y = 0; y < n; y++) {
+      for (int x = 0; x < n; x++) {
+        int corner[8];
+        for (int k = 0; k < 8; k++) {
+          corner[k] = ((z + (k >> 2 & 1)) * side + y + (k >> 1 & 1)) * side +
+                      x + (k & 1);
+        }
+        for (int t = 0; t < 6; t++) {
+          for (int k = 0; k < 4; k++) {
+            tet[k] = corner[kuhn[t][k]];
+          }
+          for (int i = 0; i < 4; i++) {
+            for (int j = i + 1; j < 4; j++) {
+              *edge++ = tet[i] < tet[j] ? tet[i] : tet[j];
+              *edge++ = tet[i] < tet[j] ? tet[j] : tet[i];
+            }
+          }
+          tet += 4;
+        }
+      }
+    }
+  }
+
+  int pairs = 6 * block->tetrahedron_count;
+  qsort(block->edges, pairs, 2 * sizeof(int), bench_compare_edges);
+  block->edge_count = 0;
+  for (int i = 0; i < pairs; i++) {
+    int *e = &block->edges[2 * i];
+    int *last = &block->edges[2 * (block->edge_count - 1)];
+    if (block->edge_count > 0 && e[0] == last[0] && e[1] == last[1])
+      continue;
+    block->edges[2 * block->edge_count] = e[0];
+    block->edges[2 * block->edge_count + 1] = e[1];
+    block->edge_count++;
+  }
+  return true;
+}
+
+static void bench_free_block(BenchBlock *block) {
+  free(block->positions);
+  free(block->edges);
+  free(block->tetrahedra);
+}
+
+// Volume of the block relative to its rest volume
+static double bench_block_volume(const Cloth *cloth, const BenchBlock *block) {
+  const Vector3 *positions = cloth_positions(cloth);
+  double volume = 0.0;
+  double rest = 0.0;
+  for (int i = 0; i < block->tetrahedron_count; i++) {
+    const int *t = &block->tetrahedra[4 * i];
+    Vector3 e[3], r[3];
+    for (int k = 0; k < 3; k++) {
+      e[k] = Vector3Subtract(positions[t[k + 1]], positions[t[0]]);
+      r[k] = Vector3Subtract(block->positions[t[k + 1]],
+                             block->positions[t[0]]);
+    }
+    double v = Vector3DotProduct(e[0], Vector3CrossProduct(e[1], e[2]));
+    double v0 = Vector3DotProduct(r[0], Vector3CrossProduct(r[1], r[2]));
+    volume += v0 < 0.0 ? -v : v;
+    rest += fabs(v0);
+  }
+  return volume / rest;
+}
+
+// A sphere pressed into a soft block standing on its bottom face, held
+// together by the edges of its tetrahedra with and without their volumes
+static int bench_soft_body(void) {
+  BenchBlock block = {0};
+  if (!bench_build_block(&block)) {
+    bench_free_block(&block);
+    return 1;
+  }
+  int side = BENCH_BLOCK_CELLS + 1;
+  float size = BENCH_BLOCK_CELLS * BENCH_SPACING;
+  bool *pinned = calloc(block.particle_count, sizeof(bool));
+  if (!pinned) {
+    bench_free_block(&block);
+    return 1;
+  }
+  // gravity points down +y, the block stands on its last layer of y
+  for (int z = 0; z < side; z++) {
+    for (int x = 0; x < side; x++) {
+      pinned[(z * side + side - 1) * side + x] = true;
+    }
+  }
+
+  for (int volumes = 0; volumes < 2; volumes++) {
+    ClothDesc desc = cloth_default_desc();
+    desc.topology = CLOTH_TOPOLOGY_EXPLICIT;
+    desc.positions = block.positions;
+    desc.particle_count = block.particle_count;
+    desc.edges = block.edges;
+    desc.edge_count = block.edge_count;
+    desc.tetrahedra = volumes ? block.tetrahedra : NULL;
+    desc.tetrahedron_count = volumes ? block.tetrahedron_count : 0;
+    desc.pinned = pinned;
+    Cloth *cloth = cloth_create(&desc);
+    if (!cloth) {
+      free(pinned);
+      bench_free_block(&block);
+      return 1;
+    }
+    float radius = 0.4f * size;
+    Vector3 center = {0.5f * size, -radius, 0.5f * size};
+    int sphere = cloth_add_sphere_collider(cloth, center, radius);
+
+    double start = bench_now();
+    for (int s = 0; s < BENCH_BLOCK_STEPS; s++) {
+      // down to a third of the block's height
+      center.y = -radius + size / 3.0f * (s + 1) / BENCH_BLOCK_STEPS;
+      cloth_set_sphere_collider(cloth, sphere, center, radius);
+      cloth_step(cloth);
+    }
+    double ms = (bench_now() - start) * 1000.0 / BENCH_BLOCK_STEPS;
+    printf("soft block of %d tetrahedra, %-14s: %7.3f ms/step, volume "
+           "%.3f of rest\n",
+           block.tetrahedron_count, volumes ? "edges, volumes" : "edges", ms,
+           bench_block_volume(cloth, &block));
+    cloth_destroy(cloth);
+  }
+  free(pinned);
+  bench_free_block(&block);
+  return 0;
+}
+
+#define BENCH_SETTLE_SIZE 64
+#define BENCH_SETTLE_STEPS 1000
+
+// Few iterations with strain limiting against more iterations without, on a
+// sheet pinned like the big one and left to settle. Stretch builds up over
+// hundreds of steps, a sheet just let go is still near rest.
+static int bench_strain_limit(void) {
+  const struct {
+    int iterations;
+    float limit;
+  } runs[] = {{2, 0.1f}, {2, 0.0f}, {5, 0.0f}, {10, 0.0f}, {20, 0.0f}};
+  bool pinned[BENCH_SETTLE_SIZE * BENCH_SETTLE_SIZE] = {0};
+  for (int x = 0; x < BENCH_SETTLE_SIZE; x++) {
+    pinned[x] = x % 5 == 0 || x == BENCH_SETTLE_SIZE - 1;
+  }
+  for (int topology = 0; topology < 2; topology++) {
+    for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+      ClothDesc desc = bench_desc(topology ? CLOTH_TOPOLOGY_EXPLICIT
+                                           : CLOTH_TOPOLOGY_GRID,
+                                  pinned);
+      desc.cols = BENCH_SETTLE_SIZE;
+      desc.rows = BENCH_SETTLE_SIZE;
+      desc.iterations = runs[i].iterations;
+      Cloth *cloth = cloth_create(&desc);
+      if (!cloth || !cloth_set_strain_limit(cloth, runs[i].limit)) {
+        cloth_destroy(cloth);
+        return 1;
+      }
+      double start = bench_now();
+      for (int s = 0; s < BENCH_SETTLE_STEPS; s++) {
+        cloth_step(cloth);
+      }
+      double ms = (bench_now() - start) * 1000.0 / BENCH_SETTLE_STEPS;
+      BenchError stretch = bench_grid_stretch(cloth);
+      printf("%-8s %dx%d settled, %2d iterations, strain limit %3.0f%%: "
+             "%6.3f ms/step, stretch mean %.5f max %.5f\n",
+             topology ? "explicit" : "grid", BENCH_SETTLE_SIZE,
+             BENCH_SETTLE_SIZE, runs[i].iterations, runs[i].limit * 100.0f,
+             ms, stretch.mean, stretch.max);
+      cloth_destroy(cloth);
+    }
+  }
+  return 0;
+}
+
+#define BENCH_SWATCH_COLS 32
+#define BENCH_SWATCH_ROWS 16
+#define BENCH_SWATCH_STEPS 2000
+
+// Settles a small swatch of desc's material and returns where its free edge
+// ended up against its length. Held along its first row and blown sideways it
+// sways in the plane, which only shear resists. Held flat along its first two
+// rows with gravity out of the plane it folds down at the held edge unless
+// something resists bending, then it reaches out further.
+static float bench_swatch(ClothDesc desc, bool cantilever) {
+  bool pinned[BENCH_SWATCH_COLS * BENCH_SWATCH_ROWS] = {0};
+  int held = cantilever ? 2 : 1;
+  for (int i = 0; i < held * BENCH_SWATCH_COLS; i++) {
+    pinned[i] = true;
+  }
+  desc.cols = BENCH_SWATCH_COLS;
+  desc.rows = BENCH_SWATCH_ROWS;
+  desc.spacing = BENCH_SPACING;
+  desc.origin = (Vector3){0};
+  desc.pinned = pinned;
+  if (cantilever)
+    desc.gravity = (Vector3){0, 0, CLOTH_DEFAULT_GRAVITY};
+  Cloth *cloth = cloth_create(&desc);
+  if (!cloth)
+    return NAN;
+  if (!cantilever)
+    cloth_set_wind(cloth, (Vector3){0.5f * CLOTH_DEFAULT_GRAVITY, 0, 0});
+  for (int s = 0; s < BENCH_SWATCH_STEPS; s++) {
+    cloth_step(cloth);
+  }
+
+  const Vector3 *edge =
+      &cloth_positions(cloth)[(BENCH_SWATCH_ROWS - 1) * BENCH_SWATCH_COLS];
+  double sum = 0.0;
+  for (int x = 0; x < BENCH_SWATCH_COLS; x++) {
+    sum += cantilever ? edge[x].y : edge[x].x - x * BENCH_SPACING;
+  }
+  cloth_destroy(cloth);
+  return (float)(sum / BENCH_SWATCH_COLS /
+                 ((BENCH_SWATCH_ROWS - 1) * BENCH_SPACING));
+}
+
+// Shear and bending materials: step time and memory on the large sheet, and
+// how a swatch of each holds its shape
+static int bench_materials(bool *pinned) {
+  const struct {
+    ClothTopology topology;
+    float shear;
+    float bending;
+  } runs[] = {{CLOTH_TOPOLOGY_GRID, 0.0f, 0.0f},
+              {CLOTH_TOPOLOGY_GRID, 1.0f, 0.0f},
+              {CLOTH_TOPOLOGY_GRID, 0.0f, 1.0f},
+              {CLOTH_TOPOLOGY_GRID, 1.0f, 1.0f},
+              {CLOTH_TOPOLOGY_EXPLICIT, 0.0f, 0.0f},
+              {CLOTH_TOPOLOGY_EXPLICIT, 0.0f, 0.05f},
+              {CLOTH_TOPOLOGY_EXPLICIT, 0.0f, 0.2f}};
+  size_t plain_bytes = 0;
+  for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+    ClothDesc desc = bench_desc(runs[i].topology, pinned);
+    desc.shear_stiffness = runs[i].shear;
+    desc.bending_stiffness = runs[i].bending;
+    Cloth *cloth = cloth_create(&desc);
+    if (!cloth)
+      return 1;
+    double ms = bench_steps(cloth);
+    size_t bytes = cloth_get_stats(cloth).memory_bytes;
+    cloth_destroy(cloth);
+    if (runs[i].shear == 0.0f && runs[i].bending == 0.0f)
+      plain_bytes = bytes;
+
+    printf("%-8s shear %.2f bending %.2f: %8.3f ms/step, %+8.1f KiB, swatch "
+           "sways %.3f, reaches %.3f\n",
+           runs[i].topology == CLOTH_TOPOLOGY_GRID ? "grid" : "explicit",
+           runs[i].shear, runs[i].bending, ms,
+           ((double)bytes - (double)plain_bytes) / 1024.0,
+           bench_swatch(desc, false), bench_swatch(desc, true));
+  }
+  return 0;
+}
+
+int main(void) {
+  bool *pinned = calloc(BENCH_COLS * BENCH_ROWS, sizeof(bool));
+  if (!pinned)
+    return 1;
+  for (int x = 0; x < BENCH_COLS; x++) {
+    pinned[x] = x % 5 == 0 || x == BENCH_COLS - 1;
+  }
+
+  printf("cloth %dx%d, %d steps of %d iterations\n", BENCH_COLS, BENCH_ROWS,
+         BENCH_STEPS, CLOTH_DEFAULT_ITERATIONS);
+
+  Cloth *cloth = bench_create(CLOTH_TOPOLOGY_GRID, pinned);
+  if (!cloth)
+    return 1;
+  printf("grid topology:        %8.3f ms/step\n", bench_steps(cloth));
+  cloth_destroy(cloth);
+
+  cloth = bench_create(CLOTH_TOPOLOGY_EXPLICIT, pinned);
+  if (!cloth)
+    return 1;
+  ClothStats stats = cloth_get_stats(cloth);
+  printf("explicit, row order:  %8.3f ms/step, %ld simulated misses/sweep, "
+         "%d color batches\n",
+         bench_steps(cloth), bench_cache_misses(cloth), stats.batch_count);
+  printf("constraint records:   %d bytes packed (%d per cache line)\n",
+         stats.constraint_record_bytes, 64 / stats.constraint_record_bytes);
+
+  // the arenas are warm now, stepping must not go back to the heap
+  size_t heap_before = cloth_get_stats(cloth).heap_allocations;
+  bench_steps(cloth);
+  size_t heap_after = cloth_get_stats(cloth).heap_allocations;
+  printf("steady-state heap allocations: %zu over %d steps\n",
+         heap_after - heap_before, BENCH_STEPS);
+  cloth_destroy(cloth);
+
+  cloth = bench_create_scattered(pinned);
+  if (!cloth)
+    return 1;
+  long scattered_misses = bench_cache_misses(cloth);
+  printf("explicit, scattered:  %8.3f ms/step, %ld simulated misses/sweep\n",
+         bench_steps(cloth), scattered_misses);
+
+  double start = bench_now();
+  if (!cloth_reorder(cloth))
+    return 1;
+  double reorder_ms = (bench_now() - start) * 1000.0;
+  long reordered_misses = bench_cache_misses(cloth);
+  printf("explicit, reordered:  %8.3f ms/step, %ld simulated misses/sweep\n",
+         bench_steps(cloth), reordered_misses);
+  printf("reorder cost:         %8.3f ms, misses reduced by %.1f%%\n",
+         reorder_ms,
+         100.0 * (scattered_misses - reordered_misses) /
+             (scattered_misses > 0 ? scattered_misses : 1));
+  cloth_destroy(cloth);
+
+  int result = bench_strain_limit();
+  if (result == 0)
+    result = bench_materials(pinned);
+  free(pinned);
+  if (result == 0)
+    result = bench_world_scaling();
+  if (result == 0)
+    result = bench_instancing();
+  if (result == 0)
+    result = bench_wind();
+  if (result == 0)
+    result = bench_ccd();
+  if (result == 0)
+    result = bench_adaptive();
+  if (result == 0)
+    result = bench_mesh_colliders();
+  if (result == 0)
+    result = bench_tearing();
+  if (result == 0)
+    result = bench_cutting();
+  if (result == 0)
+    result = bench_strands();
+  if (result == 0)
+    result = bench_global_solve();
+  if (result == 0)
+    result = bench_shape_matching();
+  if (result == 0)
+    result = bench_ragdolls();
+  if (result == 0)
+    result = bench_soft_body();
+  return result;
+}
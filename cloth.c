@@ -0,0 +1,5618 @@
+/**
+ * libcloth - Verlet cloth simulation core
+ *
+ * Implementation based on Thomas Jakobsen's 2001 paper
+ * "Advanced Character Physics"
+ *
+ * Features: Verlet integration, force generators, per-triangle
+ * aerodynamics, distance constraints on implicit grids with shear and
+ * bending stencils, explicit colored meshes with dihedral bending, directly
+ * solved strands or ragdolls with angle limits, volume preserving
+ * tetrahedra, an optional sparse direct solve of stiff meshes, sphere
+ * collision, instances sharing one topology.
+ */
+
+#include "cloth.h"
+#include "jobs.h"
+#include "sparse.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_IMPLEMENTATION
+#include "arena.h"
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define CLOTH_SSE 1
+#endif
+
+// Explicit constraints are split into color batches whose constraints never
+// share a particle, the last batch takes whatever doesn't fit
+#define MAX_CONSTRAINT_COLORS 64
+
+typedef struct Constraint {
+  int p1;
+  int p2;
+  float rest_length;
+} Constraint;
+
+typedef struct {
+  int p[3];
+} Triangle;
+
+// Keeps the signed volume of its corners at rest_volume
+typedef struct {
+  int p[4];
+  float rest_volume;
+} Tetrahedron;
+
+// Bending across the edge p[2] p[3] shared by the triangles p[0] p[2] p[3]
+// and p[1] p[3] p[2], keeps the signed angle between their normals at
+// rest_angle
+typedef struct {
+  int p[4];
+  float rest_angle;
+} Dihedral;
+
+// Bone or angle limit of a ragdoll skeleton, between joints a and b
+typedef struct {
+  int a;
+  int b;
+} RagdollLink;
+
+// Solver-side record for an explicit constraint, 8 per cache line. Pin state
+// is folded into the top bits of p2 and selects the correction weights, rest
+// lengths live in parallel streams.
+typedef struct {
+  uint32_t p1;
+  uint32_t p2; // PACKED_INDEX_MASK: particle index, above: pin code
+} PackedConstraint;
+
+#define PACKED_PIN_SHIFT 30
+#define PACKED_INDEX_MASK ((1u << PACKED_PIN_SHIFT) - 1)
+
+// Share of the correction applied to {p1, p2} per pin code, where bit 0 means
+// p1 is pinned and bit 1 means p2 is pinned
+static const float pin_weights[4][2] = {{0.5f, 0.5f}, {0.0f, 1.0f},
+                                        {1.0f, 0.0f}, {0.0f, 0.0f}};
+
+// Precomputed invariants of the explicit constraints in the same order as
+// ClothTemplate.constraints, regenerated only when topology or pinning
+// changes. All streams are 64 byte aligned arena allocations.
+typedef struct {
+  PackedConstraint *packed;
+  float *rest_length;
+  float *rest_length_sq;
+  int capacity;
+} SolverConstraints;
+
+typedef struct {
+  Vector3 center;
+  float radius;
+  // the step sweeps the sphere from start to center, previous is where it
+  // was when the last step ran. A substep covers its share of the sweep,
+  // from to to.
+  Vector3 start;
+  Vector3 previous;
+  Vector3 from;
+  Vector3 to;
+} SphereCollider;
+
+// A shared mesh (collider.c) and how far from its surface particles stay
+typedef struct {
+  const ClothMeshCollider *mesh;
+  float thickness;
+} MeshCollider;
+
+// A shared signed distance field (collider.c) and the distance particles
+// keep from its zero level
+typedef struct {
+  const ClothSdfCollider *sdf;
+  float thickness;
+} SdfCollider;
+
+// Shape matching cluster, members [first, first + count) of
+// Cloth.cluster_particles and Cloth.cluster_rest
+typedef struct {
+  Quaternion rotation; // of the last fit, where the next one starts
+  int first;
+  int count;
+  float stiffness;
+  float yield;
+  float creep;
+} ShapeCluster;
+
+// Ids of the constraints or triangles of one particle, a range of
+// TearState.pool
+typedef struct {
+  int first;
+  int count;
+} IdList;
+
+// Incremental topology for tearing. Records move between slots as batches
+// are compacted, ids stay put so particles can keep lists of them.
+typedef struct {
+  int *constraint_slot; // by id, -1 once torn
+  int *slot_constraint; // by slot
+  int *triangle_slot;
+  int *slot_triangle;
+  int *dihedral_slot;
+  int *slot_dihedral;
+  // dihedrals by triangle id, 3 per triangle, -1 where there are fewer
+  int *triangle_dihedrals;
+  // per particle, up to Cloth.particle_capacity
+  IdList *constraint_list;
+  IdList *triangle_list;
+  // list storage, lists of split particles are appended at the end
+  int *pool;
+  int pool_count;
+  int pool_capacity;
+  // longest rest length, removing and splitting never makes one longer
+  float max_rest_length;
+  // bounds of the CUT_BLOCK particle blocks for cutting, left by the end of
+  // the last step and grown by split particles, up to Cloth.particle_capacity
+  Vector3 *block_min;
+  Vector3 *block_max;
+  // false once particles moved since, the next cut bounds them again
+  bool bounds_valid;
+} TearState;
+
+// Off-diagonal term of the global system: constraints a and b share particle
+// k, sign is the product of their gradient signs there
+typedef struct {
+  int slot;
+  int a;
+  int b;
+  int k;
+  float sign;
+} GlobalCoupling;
+
+// Explicit constraints solved as one system (sparse.c). A Newton step
+// linearizes every constraint at the current positions and solves
+//   J W J^T lambda = rest_length - length
+// for the multipliers, J holding the constraint directions and W the inverse
+// masses. Constraints are coupled where they share a particle, so the
+// ordering and layout of the factor only change with the topology.
+typedef struct {
+  int newton_steps; // 0 when relaxing
+  SparseCholesky *chol; // NULL until built and after the topology changed
+  // streams for chol, reset whenever it is rebuilt
+  Arena arena;
+  GlobalCoupling *couplings;
+  int coupling_count;
+  int *diagonal; // slot of each constraint's diagonal entry
+  double *values;
+  double *rhs; // rest_length - length per constraint
+  double *lambda;
+  Vector3 *direction; // unit p1 to p2 per constraint
+  double *move; // x, y, z per particle
+} GlobalSolve;
+
+// Everything the instances of one cloth have in common. Nothing in here
+// changes once instances exist, so they can all read it from any thread.
+struct ClothTemplate {
+  Arena arena;
+
+  ClothTopology topology;
+  // only used by CLOTH_TOPOLOGY_GRID and CLOTH_TOPOLOGY_STRANDS, particles
+  // are stored row-major
+  int grid_cols;
+  int grid_rows;
+  float grid_spacing;
+
+  // only used by CLOTH_TOPOLOGY_RAGDOLLS, where grid_cols counts ragdolls and
+  // grid_rows joints. Links are the bones then the angle limits, each keeps
+  // the distance between its joints of ragdoll r within
+  // [link_range[2 * l * cols + r], link_range[(2 * l + 1) * cols + r]].
+  RagdollLink *links;
+  int link_count;
+  int bone_count;
+  float *link_range;
+
+  // particles at rest in template space and their initial pinning
+  Vector3 *rest_position;
+  bool *pinned;
+  int particle_count;
+
+  Constraint *constraints;
+  int constraint_count;
+
+  // only used by CLOTH_TOPOLOGY_EXPLICIT, constraints are sorted by color and
+  // batch b spans [batch_offsets[b], batch_offsets[b + 1])
+  int batch_offsets[MAX_CONSTRAINT_COLORS + 1];
+  int batch_count;
+  // packed records for the initial pinning
+  SolverConstraints solver;
+
+  // Triangles for aerodynamics, implied by the quads of a grid. Explicit ones
+  // are colored like the constraints, batch b spans
+  // [triangle_offsets[b], triangle_offsets[b + 1]).
+  Triangle *triangles;
+  int triangle_count;
+  int triangle_offsets[MAX_CONSTRAINT_COLORS + 1];
+  int triangle_batch_count;
+  // particles per unit of rest area, turns triangle forces into accelerations
+  float area_density;
+  // shortest constraint at rest, 0 for none
+  float min_rest_length;
+
+  // Tetrahedra of a soft body, only for meshes. Colored like the triangles,
+  // batch b spans [tetrahedron_offsets[b], tetrahedron_offsets[b + 1]).
+  Tetrahedron *tetrahedra;
+  int tetrahedron_count;
+  int tetrahedron_offsets[MAX_CONSTRAINT_COLORS + 1];
+  int tetrahedron_batch_count;
+
+  // Bending of meshes, built when the desc asks for bending stiffness. Colored
+  // the same way, batch b spans [dihedral_offsets[b], dihedral_offsets[b + 1]).
+  Dihedral *dihedrals;
+  int dihedral_count;
+  int dihedral_offsets[MAX_CONSTRAINT_COLORS + 1];
+  int dihedral_batch_count;
+
+  // instance settings from the desc
+  int iterations;
+  float time_step;
+  float damping;
+  float particle_radius;
+  Vector3 gravity;
+  float shear_stiffness;
+  float bending_stiffness;
+};
+
+struct Cloth {
+  // every allocation of the cloth lives in arena, scratch holds temporaries
+  // and is reset at the start of each step
+  Arena arena;
+  Arena scratch;
+
+  const ClothTemplate *tmpl;
+  // set when the cloth was created on its own, only then may it change the
+  // topology (see cloth_reorder)
+  ClothTemplate *owned_tmpl;
+
+  // particles as structure of arrays
+  Vector3 *position;
+  Vector3 *prev_position;
+  bool *pinned;
+  int particle_count;
+  // room in the particle streams, tearing adds particles
+  int particle_capacity;
+
+  // CLOTH_TOPOLOGY_STRANDS solver state, five streams of one float per link
+  // indexed by its upper particle: direction x, y, z and the forward sweep's
+  // modified upper diagonal and right hand side
+  float *strand_work;
+
+  // the template's records until pinning of this instance diverges, then
+  // own_solver, which is rebuilt whenever solver_dirty is set
+  const SolverConstraints *solver;
+  SolverConstraints own_solver;
+  bool solver_dirty;
+
+  int iterations;
+  float time_step;
+  float damping;
+  float particle_radius;
+  Vector3 gravity;
+  Vector3 wind;
+  float volume_stiffness;
+  // share of the error corrected per iteration by the grid's diagonal links,
+  // and by its skip-one links or a mesh's dihedrals, 0 skips them
+  float shear_stiffness;
+  float bending_stiffness;
+  // simulated time, scrolls turbulence
+  double time;
+
+  // Adaptive substeps, off while max_substeps is 0. step_dt is the length of
+  // the running substep and last_dt of the one before, velocity_scale is
+  // the damping per substep times their ratio.
+  float courant;
+  int max_substeps;
+  int substep_count;
+  float step_dt;
+  float last_dt;
+  float velocity_scale;
+  // Largest squared distance a particle moved in the last integration, per
+  // job tile when the last step ran as jobs
+  float motion_sq;
+  float *tile_motion_sq;
+  int tile_motion_capacity;
+  int motion_tiles;
+
+  ClothForce *forces;
+  int force_count;
+  int force_capacity;
+
+  ShapeCluster *clusters;
+  int cluster_count;
+  int cluster_capacity;
+  // members of every cluster, their particles and offsets from the center
+  // of the cluster's rest shape
+  int *cluster_particles;
+  Vector3 *cluster_rest;
+  int member_count;
+  int member_capacity;
+
+  SphereCollider *spheres;
+  int sphere_count;
+  int sphere_capacity;
+  MeshCollider *meshes;
+  int mesh_count;
+  int mesh_capacity;
+  SdfCollider *sdfs;
+  int sdf_count;
+  int sdf_capacity;
+  // test particle paths against swept spheres instead of end positions only
+  bool continuous_collision;
+
+  // longest a stick may stretch as a multiple of its rest length after the
+  // iterations, 0 when not limiting
+  float strain_limit;
+  // nearest pin of each particle along the cloth, -1 for pins and particles
+  // cut off from every pin, and its distance at rest. Rebuilt while limiting
+  // strain whenever anchors_valid is cleared.
+  int *anchor;
+  float *anchor_reach;
+  int anchor_capacity;
+  bool anchors_valid;
+  // squared stretch ratio at which constraints break, 0 when not tearing
+  float tear_ratio_sq;
+  TearState *tear;
+  // explicit constraints solved together instead of relaxed
+  GlobalSolve global;
+};
+
+ClothDesc cloth_default_desc(void) {
+  ClothDesc desc = {0};
+  desc.topology = CLOTH_TOPOLOGY_GRID;
+  desc.iterations = CLOTH_DEFAULT_ITERATIONS;
+  desc.time_step = CLOTH_DEFAULT_TIME_STEP;
+  desc.damping = CLOTH_DEFAULT_DAMPING;
+  desc.particle_radius = CLOTH_DEFAULT_PARTICLE_RADIUS;
+  desc.gravity = (Vector3){0, CLOTH_DEFAULT_GRAVITY, 0};
+  return desc;
+}
+
+static PackedConstraint pack_constraint(const Constraint *c,
+                                        const bool *pinned) {
+  uint32_t pin_code = (pinned[c->p1] ? 1u : 0u) | (pinned[c->p2] ? 2u : 0u);
+  return (PackedConstraint){(uint32_t)c->p1,
+                            (uint32_t)c->p2 | (pin_code << PACKED_PIN_SHIFT)};
+}
+
+// Packs the explicit constraints of tmpl with the pin codes of pinned
+static bool build_solver(Arena *arena, SolverConstraints *solver,
+                         const ClothTemplate *tmpl, const bool *pinned) {
+  int count = tmpl->constraint_count;
+  if (count > solver->capacity) {
+    // the old streams stay in the arena until it is freed
+    solver->packed = arena_alloc(arena, sizeof(PackedConstraint) * count);
+    solver->rest_length = arena_alloc(arena, sizeof(float) * count);
+    solver->rest_length_sq = arena_alloc(arena, sizeof(float) * count);
+    if (!solver->packed || !solver->rest_length || !solver->rest_length_sq) {
+      solver->capacity = 0;
+      return false;
+    }
+    solver->capacity = count;
+  }
+
+  for (int i = 0; i < count; i++) {
+    const Constraint *c = &tmpl->constraints[i];
+    solver->packed[i] = pack_constraint(c, pinned);
+    solver->rest_length[i] = c->rest_length;
+    solver->rest_length_sq[i] = c->rest_length * c->rest_length;
+  }
+  return true;
+}
+
+// Gives the cloth its own packed records once its pinning left the template's
+static bool update_solver_constraints(Cloth *cloth) {
+  if (!cloth->solver_dirty)
+    return true;
+  if (!build_solver(&cloth->arena, &cloth->own_solver, cloth->tmpl,
+                    cloth->pinned))
+    return false;
+  cloth->solver = &cloth->own_solver;
+  cloth->solver_dirty = false;
+  return true;
+}
+
+// Drops the global system after the topology changed, the next step orders
+// and lays it out again
+static void release_global_solve(Cloth *cloth) {
+  sparse_cholesky_destroy(cloth->global.chol);
+  cloth->global.chol = NULL;
+  arena_reset(&cloth->global.arena);
+}
+
+// Greedy edge coloring of the explicit constraints, then a counting sort so
+// every color batch is contiguous in tmpl->constraints.
+static bool color_constraints(ClothTemplate *tmpl, Arena *scratch) {
+  int count = tmpl->constraint_count;
+  ArenaMark mark = arena_mark(scratch);
+  uint64_t *used =
+      arena_alloc_zero(scratch, sizeof(uint64_t) * tmpl->particle_count);
+  unsigned char *colors = arena_alloc(scratch, count);
+  Constraint *sorted = arena_alloc(scratch, sizeof(Constraint) * count);
+  if (!used || !colors || !sorted) {
+    arena_rewind(scratch, mark);
+    return false;
+  }
+
+  int color_counts[MAX_CONSTRAINT_COLORS] = {0};
+  tmpl->batch_count = 0;
+
+  for (int i = 0; i < count; i++) {
+    Constraint *c = &tmpl->constraints[i];
+    uint64_t taken = used[c->p1] | used[c->p2];
+
+    int color = 0;
+    while (color < MAX_CONSTRAINT_COLORS - 1 && (taken >> color) & 1)
+      color++;
+
+    used[c->p1] |= (uint64_t)1 << color;
+    used[c->p2] |= (uint64_t)1 << color;
+    colors[i] = (unsigned char)color;
+    color_counts[color]++;
+    if (color + 1 > tmpl->batch_count)
+      tmpl->batch_count = color + 1;
+  }
+
+  tmpl->batch_offsets[0] = 0;
+  for (int b = 0; b < tmpl->batch_count; b++) {
+    tmpl->batch_offsets[b + 1] = tmpl->batch_offsets[b] + color_counts[b];
+  }
+
+  int cursor[MAX_CONSTRAINT_COLORS];
+  memcpy(cursor, tmpl->batch_offsets, sizeof(cursor));
+  for (int i = 0; i < count; i++) {
+    sorted[cursor[colors[i]]++] = tmpl->constraints[i];
+  }
+
+  memcpy(tmpl->constraints, sorted, sizeof(Constraint) * count);
+  arena_rewind(scratch, mark);
+  return true;
+}
+
+// Same for triangles, tetrahedra and dihedrals, records of size bytes that
+// start with their corners. A particle may only appear once per batch.
+static bool color_records(void *records, size_t size, int corners, int count,
+                          int particle_count, int *offsets, int *batch_count,
+                          Arena *scratch) {
+  ArenaMark mark = arena_mark(scratch);
+  uint64_t *used = arena_alloc_zero(scratch, sizeof(uint64_t) * particle_count);
+  unsigned char *colors = arena_alloc(scratch, count);
+  char *sorted = arena_alloc(scratch, size * count);
+  if (!used || !colors || !sorted) {
+    arena_rewind(scratch, mark);
+    return false;
+  }
+
+  int color_counts[MAX_CONSTRAINT_COLORS] = {0};
+  *batch_count = 0;
+
+  for (int i = 0; i < count; i++) {
+    const int *p = (const int *)((char *)records + size * i);
+    uint64_t taken = 0;
+    for (int k = 0; k < corners; k++) {
+      taken |= used[p[k]];
+    }
+
+    int color = 0;
+    while (color < MAX_CONSTRAINT_COLORS - 1 && (taken >> color) & 1)
+      color++;
+
+    for (int k = 0; k < corners; k++) {
+      used[p[k]] |= (uint64_t)1 << color;
+    }
+    colors[i] = (unsigned char)color;
+    color_counts[color]++;
+    if (color + 1 > *batch_count)
+      *batch_count = color + 1;
+  }
+
+  offsets[0] = 0;
+  for (int b = 0; b < *batch_count; b++) {
+    offsets[b + 1] = offsets[b] + color_counts[b];
+  }
+
+  int cursor[MAX_CONSTRAINT_COLORS];
+  memcpy(cursor, offsets, sizeof(cursor));
+  for (int i = 0; i < count; i++) {
+    memcpy(sorted + size * cursor[colors[i]]++, (char *)records + size * i,
+           size);
+  }
+
+  if (count > 0)
+    memcpy(records, sorted, size * count);
+  arena_rewind(scratch, mark);
+  return true;
+}
+
+static bool color_triangles(ClothTemplate *tmpl, Arena *scratch) {
+  return color_records(tmpl->triangles, sizeof(Triangle), 3,
+                       tmpl->triangle_count, tmpl->particle_count,
+                       tmpl->triangle_offsets, &tmpl->triangle_batch_count,
+                       scratch);
+}
+
+static bool color_tetrahedra(ClothTemplate *tmpl, Arena *scratch) {
+  return color_records(tmpl->tetrahedra, sizeof(Tetrahedron), 4,
+                       tmpl->tetrahedron_count, tmpl->particle_count,
+                       tmpl->tetrahedron_offsets,
+                       &tmpl->tetrahedron_batch_count, scratch);
+}
+
+static bool color_dihedrals(ClothTemplate *tmpl, Arena *scratch) {
+  return color_records(tmpl->dihedrals, sizeof(Dihedral), 4,
+                       tmpl->dihedral_count, tmpl->particle_count,
+                       tmpl->dihedral_offsets, &tmpl->dihedral_batch_count,
+                       scratch);
+}
+
+static int compare_constraints(const void *a, const void *b) {
+  const Constraint *ca = a;
+  const Constraint *cb = b;
+  if (ca->p1 != cb->p1)
+    return ca->p1 < cb->p1 ? -1 : 1;
+  return (ca->p2 > cb->p2) - (ca->p2 < cb->p2);
+}
+
+// Sorting inside a batch is free since its constraints are independent
+static void sort_constraint_batches(ClothTemplate *tmpl) {
+  for (int b = 0; b < tmpl->batch_count; b++) {
+    int first = tmpl->batch_offsets[b];
+    int count = tmpl->batch_offsets[b + 1] - first;
+    qsort(&tmpl->constraints[first], count, sizeof(Constraint),
+          compare_constraints);
+  }
+}
+
+// permute one particle stream in place through scratch memory
+static bool permute_stream(Cloth *cloth, void *stream, size_t element_size,
+                           const int *new_index) {
+  ArenaMark mark = arena_mark(&cloth->scratch);
+  char *reordered =
+      arena_alloc(&cloth->scratch, element_size * cloth->particle_count);
+  if (!reordered)
+    return false;
+
+  for (int i = 0; i < cloth->particle_count; i++) {
+    memcpy(reordered + new_index[i] * element_size,
+           (char *)stream + i * element_size, element_size);
+  }
+  memcpy(stream, reordered, element_size * cloth->particle_count);
+  arena_rewind(&cloth->scratch, mark);
+  return true;
+}
+
+// Moves particle i to slot new_index[i] in the cloth and its template and
+// remaps every index reference, keeping p1 < p2 so constraints sort by their
+// lowest particle.
+static bool permute_particles(Cloth *cloth, ClothTemplate *tmpl,
+                              const int *new_index) {
+  if (!permute_stream(cloth, cloth->position, sizeof(Vector3), new_index) ||
+      !permute_stream(cloth, cloth->prev_position, sizeof(Vector3),
+                      new_index) ||
+      !permute_stream(cloth, cloth->pinned, sizeof(bool), new_index) ||
+      !permute_stream(cloth, tmpl->rest_position, sizeof(Vector3),
+                      new_index) ||
+      !permute_stream(cloth, tmpl->pinned, sizeof(bool), new_index))
+    return false;
+
+  for (int i = 0; i < tmpl->constraint_count; i++) {
+    Constraint *c = &tmpl->constraints[i];
+    int p1 = new_index[c->p1];
+    int p2 = new_index[c->p2];
+    c->p1 = p1 < p2 ? p1 : p2;
+    c->p2 = p1 < p2 ? p2 : p1;
+  }
+  for (int i = 0; i < tmpl->triangle_count; i++) {
+    for (int k = 0; k < 3; k++) {
+      tmpl->triangles[i].p[k] = new_index[tmpl->triangles[i].p[k]];
+    }
+  }
+  for (int i = 0; i < tmpl->tetrahedron_count; i++) {
+    for (int k = 0; k < 4; k++) {
+      tmpl->tetrahedra[i].p[k] = new_index[tmpl->tetrahedra[i].p[k]];
+    }
+  }
+  for (int i = 0; i < tmpl->dihedral_count; i++) {
+    for (int k = 0; k < 4; k++) {
+      tmpl->dihedrals[i].p[k] = new_index[tmpl->dihedrals[i].p[k]];
+    }
+  }
+  return true;
+}
+
+// Tearing. Removing a constraint, triangle or dihedral moves the last record
+// of its color batch into the hole, then the last record of every later batch
+// into the hole that leaves, so batches stay contiguous for at most one move
+// per color. Neither removing records nor handing some of a particle's records
+// to a copy of it can put two records of one batch on the same particle, so
+// the coloring stays valid and nothing is ever recolored.
+
+#define TEAR_MAX_FAN 64
+// particles per block of the cut bounds, see cut_constraints()
+#define CUT_BLOCK 256
+
+// the bounds pass visits every particle, keep libm's NaN handling out of it
+static inline Vector3 min3(Vector3 a, Vector3 b) {
+  return (Vector3){a.x < b.x ? a.x : b.x, a.y < b.y ? a.y : b.y,
+                   a.z < b.z ? a.z : b.z};
+}
+
+static inline Vector3 max3(Vector3 a, Vector3 b) {
+  return (Vector3){a.x > b.x ? a.x : b.x, a.y > b.y ? a.y : b.y,
+                   a.z > b.z ? a.z : b.z};
+}
+
+// Grows the particle streams of the cloth, its template and the tear lists
+static bool reserve_particles(Cloth *cloth, int capacity) {
+  int old = cloth->particle_capacity;
+  if (capacity <= old)
+    return true;
+  ClothTemplate *tmpl = cloth->owned_tmpl;
+  TearState *tear = cloth->tear;
+
+  // streams that grew keep their new home even if a later one fails
+  Vector3 *position =
+      arena_realloc(&cloth->arena, cloth->position, sizeof(Vector3) * old,
+                    sizeof(Vector3) * capacity);
+  if (!position)
+    return false;
+  cloth->position = position;
+  Vector3 *prev_position =
+      arena_realloc(&cloth->arena, cloth->prev_position,
+                    sizeof(Vector3) * old, sizeof(Vector3) * capacity);
+  if (!prev_position)
+    return false;
+  cloth->prev_position = prev_position;
+  bool *pinned = arena_realloc(&cloth->arena, cloth->pinned,
+                               sizeof(bool) * old, sizeof(bool) * capacity);
+  if (!pinned)
+    return false;
+  cloth->pinned = pinned;
+  Vector3 *rest_position =
+      arena_realloc(&tmpl->arena, tmpl->rest_position, sizeof(Vector3) * old,
+                    sizeof(Vector3) * capacity);
+  if (!rest_position)
+    return false;
+  tmpl->rest_position = rest_position;
+  bool *tmpl_pinned = arena_realloc(&tmpl->arena, tmpl->pinned,
+                                    sizeof(bool) * old,
+                                    sizeof(bool) * capacity);
+  if (!tmpl_pinned)
+    return false;
+  tmpl->pinned = tmpl_pinned;
+  if (tear) {
+    IdList *constraint_list =
+        arena_realloc(&cloth->arena, tear->constraint_list,
+                      sizeof(IdList) * old, sizeof(IdList) * capacity);
+    if (!constraint_list)
+      return false;
+    tear->constraint_list = constraint_list;
+    IdList *triangle_list =
+        arena_realloc(&cloth->arena, tear->triangle_list,
+                      sizeof(IdList) * old, sizeof(IdList) * capacity);
+    if (!triangle_list)
+      return false;
+    tear->triangle_list = triangle_list;
+    int old_blocks = (old + CUT_BLOCK - 1) / CUT_BLOCK;
+    int blocks = (capacity + CUT_BLOCK - 1) / CUT_BLOCK;
+    Vector3 *block_min =
+        arena_realloc(&cloth->arena, tear->block_min,
+                      sizeof(Vector3) * old_blocks, sizeof(Vector3) * blocks);
+    if (!block_min)
+      return false;
+    tear->block_min = block_min;
+    Vector3 *block_max =
+        arena_realloc(&cloth->arena, tear->block_max,
+                      sizeof(Vector3) * old_blocks, sizeof(Vector3) * blocks);
+    if (!block_max)
+      return false;
+    tear->block_max = block_max;
+  }
+  cloth->particle_capacity = capacity;
+  return true;
+}
+
+static bool reserve_pool(Cloth *cloth, int count) {
+  TearState *tear = cloth->tear;
+  if (tear->pool_count + count <= tear->pool_capacity)
+    return true;
+  int capacity = 2 * tear->pool_capacity + count;
+  int *pool = arena_realloc(&cloth->arena, tear->pool,
+                            sizeof(int) * tear->pool_capacity,
+                            sizeof(int) * capacity);
+  if (!pool)
+    return false;
+  tear->pool = pool;
+  tear->pool_capacity = capacity;
+  return true;
+}
+
+// Slots and per particle lists of the current topology
+static bool init_tearing(Cloth *cloth) {
+  ClothTemplate *tmpl = cloth->owned_tmpl;
+  int count = cloth->particle_count;
+  // headroom for split particles, beyond it the streams double
+  if (!reserve_particles(cloth, count + count / 8 + 16))
+    return false;
+  int constraints = tmpl->constraint_count;
+  int triangles = tmpl->triangle_count;
+  int dihedrals = tmpl->dihedral_count;
+  int pool_capacity = 2 * constraints + 3 * triangles;
+  pool_capacity += pool_capacity / 8 + 16;
+
+  Arena *arena = &cloth->arena;
+  TearState *tear = arena_alloc_zero(arena, sizeof(TearState));
+  if (!tear)
+    return false;
+  tear->constraint_slot = arena_alloc(arena, sizeof(int) * constraints);
+  tear->slot_constraint = arena_alloc(arena, sizeof(int) * constraints);
+  tear->triangle_slot = arena_alloc(arena, sizeof(int) * triangles);
+  tear->slot_triangle = arena_alloc(arena, sizeof(int) * triangles);
+  tear->dihedral_slot = arena_alloc(arena, sizeof(int) * dihedrals);
+  tear->slot_dihedral = arena_alloc(arena, sizeof(int) * dihedrals);
+  tear->triangle_dihedrals = arena_alloc(arena, sizeof(int) * 3 * triangles);
+  tear->constraint_list =
+      arena_alloc_zero(arena, sizeof(IdList) * cloth->particle_capacity);
+  tear->triangle_list =
+      arena_alloc_zero(arena, sizeof(IdList) * cloth->particle_capacity);
+  tear->pool = arena_alloc(arena, sizeof(int) * pool_capacity);
+  int blocks = (cloth->particle_capacity + CUT_BLOCK - 1) / CUT_BLOCK;
+  tear->block_min = arena_alloc(arena, sizeof(Vector3) * blocks);
+  tear->block_max = arena_alloc(arena, sizeof(Vector3) * blocks);
+  if (!tear->constraint_slot || !tear->slot_constraint ||
+      !tear->triangle_slot || !tear->slot_triangle || !tear->dihedral_slot ||
+      !tear->slot_dihedral || !tear->triangle_dihedrals ||
+      !tear->constraint_list || !tear->triangle_list || !tear->pool ||
+      !tear->block_min || !tear->block_max)
+    return false;
+  tear->pool_capacity = pool_capacity;
+
+  // size the lists, lay them out back to back, then fill them
+  for (int i = 0; i < constraints; i++) {
+    tear->constraint_list[tmpl->constraints[i].p1].count++;
+    tear->constraint_list[tmpl->constraints[i].p2].count++;
+  }
+  for (int i = 0; i < triangles; i++) {
+    for (int k = 0; k < 3; k++) {
+      tear->triangle_list[tmpl->triangles[i].p[k]].count++;
+    }
+  }
+  for (int i = 0; i < count; i++) {
+    tear->constraint_list[i].first = tear->pool_count;
+    tear->pool_count += tear->constraint_list[i].count;
+    tear->constraint_list[i].count = 0;
+    tear->triangle_list[i].first = tear->pool_count;
+    tear->pool_count += tear->triangle_list[i].count;
+    tear->triangle_list[i].count = 0;
+  }
+  for (int i = 0; i < constraints; i++) {
+    const Constraint *c = &tmpl->constraints[i];
+    tear->max_rest_length = fmaxf(tear->max_rest_length, c->rest_length);
+    IdList *l1 = &tear->constraint_list[c->p1];
+    IdList *l2 = &tear->constraint_list[c->p2];
+    tear->pool[l1->first + l1->count++] = i;
+    tear->pool[l2->first + l2->count++] = i;
+    tear->constraint_slot[i] = i;
+    tear->slot_constraint[i] = i;
+  }
+  for (int i = 0; i < triangles; i++) {
+    for (int k = 0; k < 3; k++) {
+      IdList *l = &tear->triangle_list[tmpl->triangles[i].p[k]];
+      tear->pool[l->first + l->count++] = i;
+    }
+    tear->triangle_slot[i] = i;
+    tear->slot_triangle[i] = i;
+    for (int k = 0; k < 3; k++) {
+      tear->triangle_dihedrals[3 * i + k] = -1;
+    }
+  }
+  // a dihedral lives as long as both triangles on its edge, which are the
+  // ones around its first edge corner holding the second and a wing
+  for (int i = 0; i < dihedrals; i++) {
+    const int *d = tmpl->dihedrals[i].p;
+    const IdList *l = &tear->triangle_list[d[2]];
+    for (int j = 0; j < l->count; j++) {
+      int t = tear->pool[l->first + j];
+      const int *p = tmpl->triangles[t].p;
+      bool edge = p[0] == d[3] || p[1] == d[3] || p[2] == d[3];
+      for (int w = 0; w < 2 && edge; w++) {
+        if (p[0] != d[w] && p[1] != d[w] && p[2] != d[w])
+          continue;
+        int *slots = &tear->triangle_dihedrals[3 * t];
+        for (int k = 0; k < 3; k++) {
+          if (slots[k] < 0) {
+            slots[k] = i;
+            break;
+          }
+        }
+      }
+    }
+    tear->dihedral_slot[i] = i;
+    tear->slot_dihedral[i] = i;
+  }
+  cloth->tear = tear;
+  return true;
+}
+
+static void list_remove(TearState *tear, IdList *list, int id) {
+  int *ids = &tear->pool[list->first];
+  for (int i = 0; i < list->count; i++) {
+    if (ids[i] == id) {
+      ids[i] = ids[--list->count];
+      return;
+    }
+  }
+}
+
+static void copy_solver_record(SolverConstraints *solver, int from, int to) {
+  solver->packed[to] = solver->packed[from];
+  solver->rest_length[to] = solver->rest_length[from];
+  solver->rest_length_sq[to] = solver->rest_length_sq[from];
+}
+
+static void move_constraint(Cloth *cloth, int from, int to) {
+  ClothTemplate *tmpl = cloth->owned_tmpl;
+  TearState *tear = cloth->tear;
+  tmpl->constraints[to] = tmpl->constraints[from];
+  copy_solver_record(&tmpl->solver, from, to);
+  if (cloth->solver == &cloth->own_solver)
+    copy_solver_record(&cloth->own_solver, from, to);
+  int id = tear->slot_constraint[from];
+  tear->slot_constraint[to] = id;
+  tear->constraint_slot[id] = to;
+}
+
+static void move_triangle(Cloth *cloth, int from, int to) {
+  ClothTemplate *tmpl = cloth->owned_tmpl;
+  TearState *tear = cloth->tear;
+  tmpl->triangles[to] = tmpl->triangles[from];
+  int id = tear->slot_triangle[from];
+  tear->slot_triangle[to] = id;
+  tear->triangle_slot[id] = to;
+}
+
+static void move_dihedral(Cloth *cloth, int from, int to) {
+  ClothTemplate *tmpl = cloth->owned_tmpl;
+  TearState *tear = cloth->tear;
+  tmpl->dihedrals[to] = tmpl->dihedrals[from];
+  int id = tear->slot_dihedral[from];
+  tear->slot_dihedral[to] = id;
+  tear->dihedral_slot[id] = to;
+}
+
+// Takes the record at slot out of the batches in offsets as described above,
+// move relocates one record. Returns the new record count.
+static int remove_batched(Cloth *cloth, int *offsets, int batch_count,
+                          int slot, void (*move)(Cloth *, int, int)) {
+  int b = 0;
+  while (offsets[b + 1] <= slot)
+    b++;
+  int hole = slot;
+  for (; b < batch_count; b++) {
+    int last = offsets[b + 1] - 1;
+    if (last != hole)
+      move(cloth, last, hole);
+    hole = last;
+    offsets[b + 1]--;
+  }
+  return offsets[batch_count];
+}
+
+static void remove_triangle(Cloth *cloth, int id) {
+  ClothTemplate *tmpl = cloth->owned_tmpl;
+  TearState *tear = cloth->tear;
+  int slot = tear->triangle_slot[id];
+  for (int k = 0; k < 3; k++) {
+    list_remove(tear, &tear->triangle_list[tmpl->triangles[slot].p[k]], id);
+  }
+  tear->triangle_slot[id] = -1;
+  tmpl->triangle_count =
+      remove_batched(cloth, tmpl->triangle_offsets,
+                     tmpl->triangle_batch_count, slot, move_triangle);
+
+  // nothing bends across an open edge
+  for (int k = 0; k < 3; k++) {
+    int d = tear->triangle_dihedrals[3 * id + k];
+    if (d < 0 || tear->dihedral_slot[d] < 0)
+      continue;
+    int d_slot = tear->dihedral_slot[d];
+    tear->dihedral_slot[d] = -1;
+    tmpl->dihedral_count =
+        remove_batched(cloth, tmpl->dihedral_offsets,
+                       tmpl->dihedral_batch_count, d_slot, move_dihedral);
+  }
+}
+
+// whether triangles a and b (ids) share an edge at v
+static bool share_edge(const Cloth *cloth, int a, int b, int v) {
+  const int *pa = cloth->tmpl->triangles[cloth->tear->triangle_slot[a]].p;
+  const int *pb = cloth->tmpl->triangles[cloth->tear->triangle_slot[b]].p;
+  for (int k = 0; k < 3; k++) {
+    if (pa[k] != v && (pa[k] == pb[0] || pa[k] == pb[1] || pa[k] == pb[2]))
+      return true;
+  }
+  return false;
+}
+
+// Appends a particle where v is, or returns -1 when out of memory
+static int add_particle(Cloth *cloth, int v) {
+  if (cloth->particle_count == cloth->particle_capacity &&
+      !reserve_particles(cloth, 2 * cloth->particle_capacity))
+    return -1;
+  ClothTemplate *tmpl = cloth->owned_tmpl;
+  int copy = cloth->particle_count++;
+  tmpl->particle_count++;
+  cloth->position[copy] = cloth->position[v];
+  cloth->prev_position[copy] = cloth->prev_position[v];
+  cloth->pinned[copy] = cloth->pinned[v];
+  tmpl->rest_position[copy] = tmpl->rest_position[v];
+  tmpl->pinned[copy] = tmpl->pinned[v];
+  // the copy sits on v, which its block's bounds already held
+  TearState *tear = cloth->tear;
+  int b = copy / CUT_BLOCK;
+  if (copy % CUT_BLOCK == 0) {
+    tear->block_min[b] = cloth->position[copy];
+    tear->block_max[b] = cloth->position[copy];
+  } else {
+    tear->block_min[b] = min3(tear->block_min[b], cloth->position[copy]);
+    tear->block_max[b] = max3(tear->block_max[b], cloth->position[copy]);
+  }
+  return copy;
+}
+
+// Splits v once the triangles around it fell apart into fans that only meet
+// at v, a tear front running through the particle. Every fan after the first
+// gets its own copy of v along with the constraints on its edges,
+// constraints on no triangle stay with v. Out of memory leaves v whole.
+static void split_particle(Cloth *cloth, int v) {
+  TearState *tear = cloth->tear;
+  int n = tear->triangle_list[v].count;
+  int degree = tear->constraint_list[v].count;
+  if (n < 2 || n > TEAR_MAX_FAN || degree > TEAR_MAX_FAN)
+    return;
+
+  int tris[TEAR_MAX_FAN];
+  int fan[TEAR_MAX_FAN];
+  int links[TEAR_MAX_FAN];
+  memcpy(tris, &tear->pool[tear->triangle_list[v].first], sizeof(int) * n);
+  memcpy(links, &tear->pool[tear->constraint_list[v].first],
+         sizeof(int) * degree);
+  // label every triangle with the first triangle of its fan
+  for (int i = 0; i < n; i++) {
+    fan[i] = i;
+  }
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (int i = 0; i < n; i++) {
+      for (int j = i + 1; j < n; j++) {
+        if (fan[i] != fan[j] && share_edge(cloth, tris[i], tris[j], v)) {
+          int lowest = fan[i] < fan[j] ? fan[i] : fan[j];
+          fan[i] = fan[j] = lowest;
+          changed = true;
+        }
+      }
+    }
+  }
+
+  ClothTemplate *tmpl = cloth->owned_tmpl;
+  for (int f = 1; f < n; f++) {
+    if (fan[f] != f)
+      continue;
+    // what moves: the fan's triangles, and links to a corner of one
+    bool moves[TEAR_MAX_FAN];
+    int moving = 0;
+    int moving_tris = 0;
+    for (int c = 0; c < degree; c++) {
+      const Constraint *link =
+          &tmpl->constraints[tear->constraint_slot[links[c]]];
+      int other = link->p1 == v ? link->p2 : link->p1;
+      moves[c] = false;
+      for (int i = 0; i < n && !moves[c]; i++) {
+        const int *p = tmpl->triangles[tear->triangle_slot[tris[i]]].p;
+        moves[c] = fan[i] == f &&
+                   (p[0] == other || p[1] == other || p[2] == other);
+      }
+      moving += moves[c];
+    }
+    for (int i = 0; i < n; i++) {
+      moving_tris += fan[i] == f;
+    }
+    if (!reserve_pool(cloth, moving + moving_tris))
+      return;
+    int copy = add_particle(cloth, v);
+    if (copy < 0)
+      return;
+
+    IdList *copy_links = &tear->constraint_list[copy];
+    IdList *copy_tris = &tear->triangle_list[copy];
+    *copy_links = (IdList){tear->pool_count, 0};
+    *copy_tris = (IdList){tear->pool_count + moving, 0};
+    tear->pool_count += moving + moving_tris;
+
+    for (int i = 0; i < n; i++) {
+      if (fan[i] != f)
+        continue;
+      int *p = tmpl->triangles[tear->triangle_slot[tris[i]]].p;
+      for (int k = 0; k < 3; k++) {
+        if (p[k] == v)
+          p[k] = copy;
+      }
+      // both triangles of a dihedral through v are in the same fan
+      for (int k = 0; k < 3; k++) {
+        int d = tear->triangle_dihedrals[3 * tris[i] + k];
+        if (d < 0 || tear->dihedral_slot[d] < 0)
+          continue;
+        int *q = tmpl->dihedrals[tear->dihedral_slot[d]].p;
+        for (int j = 0; j < 4; j++) {
+          if (q[j] == v)
+            q[j] = copy;
+        }
+      }
+      list_remove(tear, &tear->triangle_list[v], tris[i]);
+      tear->pool[copy_tris->first + copy_tris->count++] = tris[i];
+    }
+    for (int c = 0; c < degree; c++) {
+      if (!moves[c])
+        continue;
+      int slot = tear->constraint_slot[links[c]];
+      Constraint *link = &tmpl->constraints[slot];
+      // the copy has the highest index, so it stays second
+      link->p1 = link->p1 == v ? link->p2 : link->p1;
+      link->p2 = copy;
+      tmpl->solver.packed[slot] = pack_constraint(link, tmpl->pinned);
+      if (cloth->solver == &cloth->own_solver)
+        cloth->own_solver.packed[slot] = pack_constraint(link, cloth->pinned);
+      list_remove(tear, &tear->constraint_list[v], links[c]);
+      tear->pool[copy_links->first + copy_links->count++] = links[c];
+    }
+  }
+}
+
+static void tear_constraint(Cloth *cloth, int slot) {
+  ClothTemplate *tmpl = cloth->owned_tmpl;
+  TearState *tear = cloth->tear;
+  int id = tear->slot_constraint[slot];
+  int p1 = tmpl->constraints[slot].p1;
+  int p2 = tmpl->constraints[slot].p2;
+  list_remove(tear, &tear->constraint_list[p1], id);
+  list_remove(tear, &tear->constraint_list[p2], id);
+  tear->constraint_slot[id] = -1;
+  release_global_solve(cloth);
+  cloth->anchors_valid = false;
+  tmpl->constraint_count = remove_batched(
+      cloth, tmpl->batch_offsets, tmpl->batch_count, slot, move_constraint);
+
+  // the cloth is open between p1 and p2 now, so are the triangles across it
+  const IdList *list = &tear->triangle_list[p1];
+  for (int i = list->count - 1; i >= 0; i--) {
+    int t = tear->pool[list->first + i];
+    const int *p = tmpl->triangles[tear->triangle_slot[t]].p;
+    if (p[0] == p2 || p[1] == p2 || p[2] == p2)
+      remove_triangle(cloth, t);
+  }
+  split_particle(cloth, p1);
+  split_particle(cloth, p2);
+}
+
+// Breaks every constraint stretched past the tear ratio. The scan runs from
+// the back, records a removal moves come from slots already checked.
+static void tear_constraints(Cloth *cloth) {
+  const SolverConstraints *solver = cloth->solver;
+  for (int i = cloth->tmpl->constraint_count - 1; i >= 0; i--) {
+    int p1 = (int)solver->packed[i].p1;
+    int p2 = (int)(solver->packed[i].p2 & PACKED_INDEX_MASK);
+    // splits may move the particle streams
+    const Vector3 *position = cloth->position;
+    float dist_sq = Vector3LengthSqr(Vector3Subtract(position[p2],
+                                                     position[p1]));
+    if (dist_sq > cloth->tear_ratio_sq * solver->rest_length_sq[i])
+      tear_constraint(cloth, i);
+  }
+}
+
+// Cutting. The blade sweeps a quad between two rays, split into two
+// triangles. Particles are bounded in blocks of consecutive indices, which
+// Morton reordering keeps compact, and only constraints at particles of
+// blocks the blade comes near are tested against it. Whatever it crosses is
+// torn like a stretched constraint, so only that region of the topology
+// changes. The block bounds are kept in the tear state: the end of every
+// step refreshes them alongside the other per particle passes, so a cut
+// between steps only walks the blocks.
+
+// constraints stretched further than this, or the tear ratio, past their rest
+// length can reach out of their blocks' boxes unnoticed
+#define CUT_STRETCH 2.0f
+
+typedef struct {
+  Vector3 a, b, c;
+  Vector3 normal; // unnormalized, for rejecting by side
+} CutTriangle;
+
+static CutTriangle cut_triangle(Vector3 a, Vector3 b, Vector3 c) {
+  Vector3 normal =
+      Vector3CrossProduct(Vector3Subtract(b, a), Vector3Subtract(c, a));
+  return (CutTriangle){a, b, c, normal};
+}
+
+// Segment p to q against a triangle, Moller-Trumbore with t in [0, 1] for
+// the few segments that have ends on both sides of its plane
+static bool segment_crosses(Vector3 p, Vector3 q, const CutTriangle *tri) {
+  float side_p = Vector3DotProduct(tri->normal, Vector3Subtract(p, tri->a));
+  float side_q = Vector3DotProduct(tri->normal, Vector3Subtract(q, tri->a));
+  if ((side_p > 0.0f && side_q > 0.0f) || (side_p < 0.0f && side_q < 0.0f))
+    return false;
+  Vector3 dir = Vector3Subtract(q, p);
+  Vector3 e1 = Vector3Subtract(tri->b, tri->a);
+  Vector3 e2 = Vector3Subtract(tri->c, tri->a);
+  Vector3 h = Vector3CrossProduct(dir, e2);
+  float det = Vector3DotProduct(e1, h);
+  if (fabsf(det) < 1e-12f)
+    return false;
+  float inv = 1.0f / det;
+  Vector3 s = Vector3Subtract(p, tri->a);
+  float u = Vector3DotProduct(s, h) * inv;
+  if (u < 0.0f || u > 1.0f)
+    return false;
+  Vector3 r = Vector3CrossProduct(s, e1);
+  float v = Vector3DotProduct(dir, r) * inv;
+  if (v < 0.0f || u + v > 1.0f)
+    return false;
+  float t = Vector3DotProduct(e2, r) * inv;
+  return t >= 0.0f && t <= 1.0f;
+}
+
+// Conservative box against triangle: their boxes overlap and the triangle's
+// plane passes through the box
+static bool box_touches_triangle(Vector3 min, Vector3 max,
+                                 const CutTriangle *tri) {
+  // rays from one eye leave the second triangle of the quad without area
+  if (Vector3LengthSqr(tri->normal) == 0.0f)
+    return false;
+  Vector3 tri_min = min3(min3(tri->a, tri->b), tri->c);
+  Vector3 tri_max = max3(max3(tri->a, tri->b), tri->c);
+  if (tri_min.x > max.x || tri_max.x < min.x || tri_min.y > max.y ||
+      tri_max.y < min.y || tri_min.z > max.z || tri_max.z < min.z)
+    return false;
+  Vector3 n = tri->normal;
+  Vector3 center = Vector3Scale(Vector3Add(min, max), 0.5f);
+  Vector3 half = Vector3Scale(Vector3Subtract(max, min), 0.5f);
+  float radius =
+      half.x * fabsf(n.x) + half.y * fabsf(n.y) + half.z * fabsf(n.z);
+  float distance = Vector3DotProduct(n, Vector3Subtract(center, tri->a));
+  return fabsf(distance) <= radius;
+}
+
+static bool crosses_blade(Vector3 p, Vector3 q, const CutTriangle *blade) {
+  return segment_crosses(p, q, &blade[0]) || segment_crosses(p, q, &blade[1]);
+}
+
+// Bounds of the blocks of particles [first, end), first on a block boundary
+static void bound_blocks(Cloth *cloth, int first, int end) {
+  TearState *tear = cloth->tear;
+  const Vector3 *position = cloth->position;
+  for (int i = first; i < end; i += CUT_BLOCK) {
+    int block_end = i + CUT_BLOCK < end ? i + CUT_BLOCK : end;
+    Vector3 lo = position[i];
+    Vector3 hi = lo;
+    for (int k = i + 1; k < block_end; k++) {
+      lo = min3(lo, position[k]);
+      hi = max3(hi, position[k]);
+    }
+    tear->block_min[i / CUT_BLOCK] = lo;
+    tear->block_max[i / CUT_BLOCK] = hi;
+  }
+}
+
+static int cut_constraints(Cloth *cloth, ClothRay from, ClothRay to) {
+  ClothTemplate *tmpl = cloth->owned_tmpl;
+  TearState *tear = cloth->tear;
+  int count = cloth->particle_count;
+  int block_count = (count + CUT_BLOCK - 1) / CUT_BLOCK;
+
+  ArenaMark mark = arena_mark(&cloth->scratch);
+  bool *touched = arena_alloc(&cloth->scratch, sizeof(bool) * block_count);
+  if (!touched)
+    return -1;
+
+  // only particles moved outside of a step, by hand, need bounding here
+  if (!tear->bounds_valid) {
+    bound_blocks(cloth, 0, count);
+    tear->bounds_valid = true;
+  }
+  const Vector3 *position = cloth->position;
+  const Vector3 *block_min = tear->block_min;
+  const Vector3 *block_max = tear->block_max;
+  Vector3 min = block_min[0];
+  Vector3 max = block_max[0];
+  for (int b = 1; b < block_count; b++) {
+    min = min3(min, block_min[b]);
+    max = max3(max, block_max[b]);
+  }
+
+  // long enough rays to cross the whole cloth from either origin
+  Vector3 center = Vector3Scale(Vector3Add(min, max), 0.5f);
+  float extent = Vector3Length(Vector3Subtract(max, min)) * 0.5f;
+  float from_length = Vector3Distance(from.position, center) + extent;
+  float to_length = Vector3Distance(to.position, center) + extent;
+  Vector3 from_end = Vector3Add(
+      from.position,
+      Vector3Scale(Vector3Normalize(from.direction), from_length));
+  Vector3 to_end = Vector3Add(
+      to.position, Vector3Scale(Vector3Normalize(to.direction), to_length));
+  CutTriangle blade[2] = {cut_triangle(from.position, from_end, to_end),
+                          cut_triangle(from.position, to_end, to.position)};
+
+  float stretch = fmaxf(CUT_STRETCH, sqrtf(cloth->tear_ratio_sq));
+  float r = tear->max_rest_length * stretch;
+  Vector3 reach = {r, r, r};
+  for (int b = 0; b < block_count; b++) {
+    Vector3 lo = Vector3Subtract(block_min[b], reach);
+    Vector3 hi = Vector3Add(block_max[b], reach);
+    touched[b] = box_touches_triangle(lo, hi, &blade[0]) ||
+              box_touches_triangle(lo, hi, &blade[1]);
+  }
+
+  // collect ids first, tearing rewrites the lists being walked. A constraint
+  // between two near blocks is tested from its lower particle only.
+  int *cut = NULL;
+  int cut_count = 0;
+  int cut_capacity = 0;
+  bool ok = true;
+  for (int b = 0; b < block_count && ok; b++) {
+    if (!touched[b])
+      continue;
+    int end = (b + 1) * CUT_BLOCK < count ? (b + 1) * CUT_BLOCK : count;
+    for (int v = b * CUT_BLOCK; v < end && ok; v++) {
+      const IdList *list = &tear->constraint_list[v];
+      for (int i = 0; i < list->count; i++) {
+        int id = tear->pool[list->first + i];
+        const Constraint *c = &tmpl->constraints[tear->constraint_slot[id]];
+        int other = c->p1 == v ? c->p2 : c->p1;
+        if (other < v && touched[other / CUT_BLOCK])
+          continue;
+        if (!crosses_blade(position[v], position[other], blade))
+          continue;
+        if (cut_count == cut_capacity) {
+          int capacity = cut_capacity ? cut_capacity * 2 : 64;
+          int *grown = arena_realloc(&cloth->scratch, cut,
+                                     sizeof(int) * cut_capacity,
+                                     sizeof(int) * capacity);
+          if (!grown) {
+            ok = false;
+            break;
+          }
+          cut = grown;
+          cut_capacity = capacity;
+        }
+        cut[cut_count++] = id;
+      }
+    }
+  }
+
+  // out of memory cuts nothing rather than part of the stroke
+  if (ok) {
+    for (int i = 0; i < cut_count; i++) {
+      tear_constraint(cloth, tear->constraint_slot[cut[i]]);
+    }
+  }
+  arena_rewind(&cloth->scratch, mark);
+  return ok ? cut_count : -1;
+}
+
+// spread the low 10 bits of v so there are two zero bits between each
+static uint32_t morton_spread(uint32_t v) {
+  v &= 0x3ff;
+  v = (v | (v << 16)) & 0x030000ff;
+  v = (v | (v << 8)) & 0x0300f00f;
+  v = (v | (v << 4)) & 0x030c30c3;
+  v = (v | (v << 2)) & 0x09249249;
+  return v;
+}
+
+typedef struct {
+  uint32_t code;
+  int index;
+} MortonKey;
+
+static int compare_morton_keys(const void *a, const void *b) {
+  const MortonKey *ka = a;
+  const MortonKey *kb = b;
+  if (ka->code != kb->code)
+    return ka->code < kb->code ? -1 : 1;
+  return (ka->index > kb->index) - (ka->index < kb->index);
+}
+
+// Renumber particles along a Morton (Z-order) curve over their positions so
+// that constraints touch nearby memory, then re-sort every color batch by
+// first particle. Meshes from arbitrary sources come with scattered indices,
+// the grid topology is already in row order and is left alone.
+bool cloth_reorder(Cloth *cloth) {
+  if (cloth->tmpl->topology != CLOTH_TOPOLOGY_EXPLICIT ||
+      cloth->particle_count == 0)
+    return true;
+  // a shared template would renumber the particles of every instance
+  ClothTemplate *tmpl = cloth->owned_tmpl;
+  if (!tmpl)
+    return false;
+
+  Vector3 min = cloth->position[0];
+  Vector3 max = min;
+  for (int i = 1; i < cloth->particle_count; i++) {
+    min = Vector3Min(min, cloth->position[i]);
+    max = Vector3Max(max, cloth->position[i]);
+  }
+  Vector3 extent = Vector3Subtract(max, min);
+  float largest = fmaxf(extent.x, fmaxf(extent.y, extent.z));
+  float scale = largest > 0.0f ? 1023.0f / largest : 0.0f;
+
+  ArenaMark mark = arena_mark(&cloth->scratch);
+  MortonKey *keys =
+      arena_alloc(&cloth->scratch, sizeof(MortonKey) * cloth->particle_count);
+  int *new_index =
+      arena_alloc(&cloth->scratch, sizeof(int) * cloth->particle_count);
+  if (!keys || !new_index) {
+    arena_rewind(&cloth->scratch, mark);
+    return false;
+  }
+
+  for (int i = 0; i < cloth->particle_count; i++) {
+    Vector3 q = Vector3Scale(Vector3Subtract(cloth->position[i], min), scale);
+    keys[i].code = morton_spread((uint32_t)q.x) |
+                   (morton_spread((uint32_t)q.y) << 1) |
+                   (morton_spread((uint32_t)q.z) << 2);
+    keys[i].index = i;
+  }
+  qsort(keys, cloth->particle_count, sizeof(MortonKey), compare_morton_keys);
+
+  for (int i = 0; i < cloth->particle_count; i++) {
+    new_index[keys[i].index] = i;
+  }
+
+  bool ok = permute_particles(cloth, tmpl, new_index);
+  if (ok) {
+    for (int m = 0; m < cloth->member_count; m++) {
+      cloth->cluster_particles[m] = new_index[cloth->cluster_particles[m]];
+    }
+    sort_constraint_batches(tmpl);
+    ok = build_solver(&tmpl->arena, &tmpl->solver, tmpl, tmpl->pinned);
+    if (cloth->solver == &cloth->own_solver)
+      cloth->solver_dirty = true;
+    cloth->anchors_valid = false;
+    release_global_solve(cloth);
+  }
+  arena_rewind(&cloth->scratch, mark);
+
+  // every slot and particle index moved, list them again
+  if (ok && cloth->tear) {
+    cloth->tear = NULL;
+    ok = init_tearing(cloth);
+  }
+  return ok;
+}
+
+// Particles [first, end) against one sphere that moved from start to center
+// during the step. A particle outside the sphere when the step began whose
+// path relative to the sphere enters it hit the surface somewhere in
+// between, it is pushed back out to the tangent plane at that contact so
+// neither a fast particle nor a fast sphere can tunnel, while sliding along
+// the surface is kept. Particles that were already inside, or all of them
+// without continuous collision, are pushed out the nearest way.
+static void resolve_sphere_collision(Cloth *cloth,
+                                     const SphereCollider *sphere, int first,
+                                     int end) {
+  float min_dist = sphere->radius + cloth->particle_radius;
+  float min_dist_sq = min_dist * min_dist;
+  Vector3 start = cloth->continuous_collision ? sphere->from : sphere->to;
+
+  for (int i = first; i < end; i++) {
+    Vector3 diff = Vector3Subtract(cloth->position[i], sphere->to);
+    Vector3 normal = {0};
+    float depth = 0.0f;
+    bool hit = false;
+
+    // relative to the sphere the particle moves from from to diff, solve
+    // |from + t path| = min_dist for its first contact
+    Vector3 from = Vector3Subtract(cloth->prev_position[i], start);
+    Vector3 path = Vector3Subtract(diff, from);
+    float from_sq = Vector3LengthSqr(from);
+    float approach = Vector3DotProduct(from, path);
+    if (cloth->continuous_collision && from_sq >= min_dist_sq &&
+        approach < 0.0f) {
+      float path_sq = Vector3LengthSqr(path);
+      float discriminant =
+          approach * approach - path_sq * (from_sq - min_dist_sq);
+      float t = discriminant >= 0.0f
+                    ? (-approach - sqrtf(discriminant)) / path_sq
+                    : 2.0f;
+      if (t <= 1.0f) {
+        normal = Vector3Scale(Vector3Add(from, Vector3Scale(path, t)),
+                              1.0f / min_dist);
+        depth = min_dist - Vector3DotProduct(diff, normal);
+        hit = true;
+      }
+    }
+    if (!hit) {
+      float dist = Vector3Length(diff);
+      // If inside sphere
+      if (dist < min_dist) {
+        normal = Vector3Normalize(diff);
+        depth = min_dist - dist;
+      }
+    }
+    if (depth <= 0.0f)
+      continue;
+
+    // Push out to surface
+    cloth->position[i] =
+        Vector3Add(cloth->position[i], Vector3Scale(normal, depth));
+
+    // friction
+    cloth->prev_position[i] =
+        Vector3Lerp(cloth->prev_position[i], cloth->position[i], 0.1f);
+  }
+}
+
+// Particles [first, end) against one triangle mesh. Faces are one sided: a
+// particle closer than thickness to the nearest face is pushed away from it
+// when in front, and back out to the front when it slipped behind.
+static void resolve_mesh_collision(Cloth *cloth, const MeshCollider *collider,
+                                   int first, int end) {
+  float min_dist = collider->thickness + cloth->particle_radius;
+
+  for (int i = first; i < end; i++) {
+    Vector3 closest, normal;
+    if (!cloth_mesh_collider_closest(collider->mesh, cloth->position[i],
+                                     min_dist, &closest, &normal))
+      continue;
+    Vector3 diff = Vector3Subtract(cloth->position[i], closest);
+    float dist = Vector3Length(diff);
+    if (Vector3DotProduct(diff, normal) > 0.0f && dist > 0.0f)
+      normal = Vector3Scale(diff, 1.0f / dist);
+
+    // Push out to surface
+    cloth->position[i] = Vector3Add(closest, Vector3Scale(normal, min_dist));
+
+    // friction
+    cloth->prev_position[i] =
+        Vector3Lerp(cloth->prev_position[i], cloth->position[i], 0.1f);
+  }
+}
+
+#define SDF_SAMPLE_CHUNK 256
+
+// Particles [first, end) against a distance field, in chunks sampled at once.
+// Particles closer than thickness are moved up the gradient until they
+// aren't.
+static void resolve_sdf_collision(Cloth *cloth, const SdfCollider *collider,
+                                  int first, int end) {
+  float min_dist = collider->thickness + cloth->particle_radius;
+  float distance[SDF_SAMPLE_CHUNK];
+  Vector3 gradient[SDF_SAMPLE_CHUNK];
+
+  for (int i = first; i < end; i += SDF_SAMPLE_CHUNK) {
+    int count = end - i < SDF_SAMPLE_CHUNK ? end - i : SDF_SAMPLE_CHUNK;
+    cloth_sdf_collider_sample(collider->sdf, &cloth->position[i], count,
+                              distance, gradient);
+    for (int k = 0; k < count; k++) {
+      float depth = min_dist - distance[k];
+      float length = Vector3Length(gradient[k]);
+      if (depth <= 0.0f || length == 0.0f)
+        continue;
+
+      // Push out to surface
+      Vector3 *position = &cloth->position[i + k];
+      *position = Vector3Add(*position,
+                             Vector3Scale(gradient[k], depth / length));
+
+      // friction
+      cloth->prev_position[i + k] =
+          Vector3Lerp(cloth->prev_position[i + k], *position, 0.1f);
+    }
+  }
+}
+
+// particles [first, end) against every collider
+static void resolve_collisions(Cloth *cloth, int first, int end) {
+  for (int s = 0; s < cloth->sphere_count; s++) {
+    resolve_sphere_collision(cloth, &cloth->spheres[s], first, end);
+  }
+  for (int m = 0; m < cloth->mesh_count; m++) {
+    resolve_mesh_collision(cloth, &cloth->meshes[m], first, end);
+  }
+  for (int d = 0; d < cloth->sdf_count; d++) {
+    resolve_sdf_collision(cloth, &cloth->sdfs[d], first, end);
+  }
+}
+
+// Colliders sweep from where the last step left them to where they are now,
+// and the cut bounds go stale until the step is done
+static void begin_step(Cloth *cloth) {
+  for (int s = 0; s < cloth->sphere_count; s++) {
+    cloth->spheres[s].start = cloth->spheres[s].previous;
+    cloth->spheres[s].previous = cloth->spheres[s].center;
+  }
+  if (cloth->tear)
+    cloth->tear->bounds_valid = false;
+}
+
+// After the cut bounds of every block were taken: they hold again, then
+// stretched constraints tear, which only adds particles where others are
+static void finish_step(Cloth *cloth) {
+  if (cloth->tear)
+    cloth->tear->bounds_valid = true;
+  if (cloth->tear_ratio_sq > 0.0f)
+    tear_constraints(cloth);
+}
+
+// Substeps for the coming step, enough that neither the fastest particle nor
+// a sphere moves more than courant times the smaller of the particle radius
+// and the shortest constraint per substep. Particles are expected to keep the
+// speed they had in the last substep. Runs before begin_step().
+static int plan_substeps(const Cloth *cloth) {
+  if (cloth->max_substeps == 0)
+    return 1;
+  float scale = cloth->tmpl->min_rest_length;
+  if (cloth->particle_radius > 0.0f &&
+      (scale <= 0.0f || cloth->particle_radius < scale))
+    scale = cloth->particle_radius;
+  float limit = cloth->courant * scale;
+  if (limit <= 0.0f)
+    return 1;
+
+  float motion_sq = cloth->motion_sq;
+  for (int t = 0; t < cloth->motion_tiles; t++) {
+    motion_sq = fmaxf(motion_sq, cloth->tile_motion_sq[t]);
+  }
+  float travel = sqrtf(motion_sq) * (float)cloth->substep_count;
+  for (int s = 0; s < cloth->sphere_count; s++) {
+    const SphereCollider *sphere = &cloth->spheres[s];
+    travel = fmaxf(travel, Vector3Distance(sphere->previous, sphere->center));
+  }
+  float substeps = ceilf(travel / limit);
+  if (!(substeps > 1.0f))
+    return 1;
+  return substeps < (float)cloth->max_substeps ? (int)substeps
+                                               : cloth->max_substeps;
+}
+
+// Sets up substep k of count equal ones: their length, the damping that
+// compounds to the step's over all of them and the velocity carried over
+// from a substep of another length, and the spheres' share of their sweeps
+static void begin_substep(Cloth *cloth, int k, int count) {
+  cloth->last_dt = cloth->step_dt;
+  cloth->step_dt = cloth->time_step / count;
+  float damping =
+      count > 1 ? powf(cloth->damping, 1.0f / count) : cloth->damping;
+  cloth->velocity_scale =
+      cloth->last_dt > 0.0f ? damping * (cloth->step_dt / cloth->last_dt)
+                            : damping;
+  cloth->time += cloth->step_dt;
+  for (int s = 0; s < cloth->sphere_count; s++) {
+    SphereCollider *sphere = &cloth->spheres[s];
+    sphere->from = k == 0 ? sphere->start : sphere->to;
+    sphere->to = k == count - 1 ? sphere->center
+                                : Vector3Lerp(sphere->start, sphere->center,
+                                              (float)(k + 1) / count);
+  }
+}
+
+// Gravity, wind and every uniform force summed into one constant for the
+// integrator, no per-particle acceleration is stored
+static Vector3 uniform_acceleration(const Cloth *cloth) {
+  Vector3 acceleration = Vector3Add(cloth->gravity, cloth->wind);
+  for (int f = 0; f < cloth->force_count; f++) {
+    const ClothForce *force = &cloth->forces[f];
+    if (force->enabled && force->type == CLOTH_FORCE_UNIFORM)
+      acceleration = Vector3Add(acceleration, force->acceleration);
+  }
+  return acceleration;
+}
+
+// verlet integration step for particles [first, end), returns the largest
+// squared distance one of them moved
+static float verlet(Cloth *cloth, int first, int end) {
+  float dt_sq = cloth->step_dt * cloth->step_dt;
+  // Calculate Acceleration term (a * dt * dt)
+  Vector3 accelerationStep = Vector3Scale(uniform_acceleration(cloth), dt_sq);
+  float motion_sq = 0.0f;
+
+  for (int i = first; i < end; i++) {
+    if (cloth->pinned[i])
+      continue;
+
+    Vector3 temp = cloth->position[i];
+
+    // Calculate Velocity, rescaled when the last substep had another length
+    Vector3 velocity = Vector3Subtract(cloth->position[i], cloth->prev_position[i]);
+    velocity = Vector3Scale(velocity, cloth->velocity_scale);
+
+    // Verlet Integration: next = curr + vel + acc
+    Vector3 nextPos =
+        Vector3Add(Vector3Add(cloth->position[i], velocity), accelerationStep);
+
+    cloth->position[i] = nextPos;
+    cloth->prev_position[i] = temp;
+    motion_sq = fmaxf(motion_sq,
+                      Vector3LengthSqr(Vector3Add(velocity, accelerationStep)));
+  }
+  return motion_sq;
+}
+
+// gusts are sampled in chunks on the stack, tiles run on several threads
+#define WIND_SAMPLE_CHUNK 256
+
+// Where the wind field of a force has drifted to by now, in texels. Kept
+// small since the volume repeats anyway.
+static Vector3 gust_offset(const Cloth *cloth, const ClothForce *force) {
+  double resolution = cloth_wind_field_resolution(force->field);
+  double drift = -cloth->time / force->scale;
+  return (Vector3){(float)fmod(force->scroll.x * drift, resolution),
+                   (float)fmod(force->scroll.y * drift, resolution),
+                   (float)fmod(force->scroll.z * drift, resolution)};
+}
+
+// Position dependent forces on top of verlet(), one pass per generator.
+// prev_position holds the position the step started from, which is where
+// the force is evaluated.
+static void apply_local_forces(Cloth *cloth, int first, int end) {
+  float dt_sq = cloth->step_dt * cloth->step_dt;
+  const Vector3 *origin = cloth->prev_position;
+  Vector3 *position = cloth->position;
+  const bool *pinned = cloth->pinned;
+
+  for (int f = 0; f < cloth->force_count; f++) {
+    const ClothForce *force = &cloth->forces[f];
+    if (!force->enabled)
+      continue;
+
+    switch (force->type) {
+    case CLOTH_FORCE_ATTRACTOR: {
+      float radius_sq = force->radius * force->radius;
+      for (int i = first; i < end; i++) {
+        Vector3 diff = Vector3Subtract(force->center, origin[i]);
+        float dist_sq = Vector3LengthSqr(diff);
+        if (pinned[i] || dist_sq >= radius_sq || dist_sq == 0.0f)
+          continue;
+        // linear falloff to zero at the radius
+        float dist = sqrtf(dist_sq);
+        float scale =
+            force->strength * (1.0f - dist / force->radius) / dist * dt_sq;
+        position[i] = Vector3Add(position[i], Vector3Scale(diff, scale));
+      }
+      break;
+    }
+    case CLOTH_FORCE_REGION: {
+      Vector3 step = Vector3Scale(force->acceleration, dt_sq);
+      for (int i = first; i < end; i++) {
+        Vector3 p = origin[i];
+        if (pinned[i] || p.x < force->min.x || p.y < force->min.y ||
+            p.z < force->min.z || p.x > force->max.x || p.y > force->max.y ||
+            p.z > force->max.z)
+          continue;
+        position[i] = Vector3Add(position[i], step);
+      }
+      break;
+    }
+    case CLOTH_FORCE_TURBULENCE: {
+      if (!force->field || force->scale <= 0.0f)
+        break;
+      Vector3 offset = gust_offset(cloth, force);
+      Vector3 step = Vector3Scale(force->acceleration, dt_sq);
+      float gust = force->turbulence * dt_sq;
+
+      Vector3 gusts[WIND_SAMPLE_CHUNK];
+      for (int i = first; i < end; i += WIND_SAMPLE_CHUNK) {
+        int count = end - i < WIND_SAMPLE_CHUNK ? end - i : WIND_SAMPLE_CHUNK;
+        cloth_wind_field_sample(force->field, &origin[i], count, offset,
+                                1.0f / force->scale, gusts);
+        for (int k = 0; k < count; k++) {
+          if (pinned[i + k])
+            continue;
+          position[i + k] = Vector3Add(
+              position[i + k], Vector3Add(step, Vector3Scale(gusts[k], gust)));
+        }
+      }
+      break;
+    }
+    default:
+      // uniform forces are part of verlet(), aerodynamic ones run over
+      // triangles in apply_aerodynamics()
+      break;
+    }
+  }
+}
+
+// Fraction of delta that closes the gap to rest_length: (d - rest) / d. The
+// strain limiting pass sets limit and only shortens sticks longer than rest.
+static inline float distance_ratio(float dist_sq, float rest_length,
+                                   bool limit) {
+  // Avoid division by zero
+  if (dist_sq == 0.0f)
+    return 0.0f;
+
+  float ratio = 1.0f - rest_length / sqrtf(dist_sq);
+  return limit ? fmaxf(ratio, 0.0f) : ratio;
+}
+
+// move both particles towards rest, weights come from pin_weights so pinned
+// particles don't move
+static inline void apply_correction(Vector3 *position, int p1, int p2,
+                                    Vector3 delta, float ratio,
+                                    const float weights[2]) {
+  Vector3 correction = Vector3Scale(delta, ratio);
+  position[p1] = Vector3Add(position[p1], Vector3Scale(correction, weights[0]));
+  position[p2] =
+      Vector3Subtract(position[p2], Vector3Scale(correction, weights[1]));
+}
+
+static inline const float *link_weights(const bool *pinned, int p1, int p2) {
+  return pin_weights[(pinned[p1] ? 1 : 0) | (pinned[p2] ? 2 : 0)];
+}
+
+static inline void solve_distance(Vector3 *position, int p1, int p2,
+                                  float rest_length, const float weights[2],
+                                  bool limit) {
+  Vector3 delta = Vector3Subtract(position[p2], position[p1]);
+  float ratio = distance_ratio(Vector3LengthSqr(delta), rest_length, limit);
+  apply_correction(position, p1, p2, delta, ratio, weights);
+}
+
+#ifdef CLOTH_SSE
+static inline __m128 distance_ratio4(__m128 dist_sq, __m128 rest_length,
+                                     bool limit) {
+  __m128 nonzero = _mm_cmpgt_ps(dist_sq, _mm_setzero_ps());
+  __m128 ratio = _mm_sub_ps(_mm_set1_ps(1.0f),
+                            _mm_div_ps(rest_length, _mm_sqrt_ps(dist_sq)));
+  if (limit)
+    ratio = _mm_max_ps(ratio, _mm_setzero_ps());
+  return _mm_and_ps(ratio, nonzero);
+}
+
+// Four independent constraints (same color or same red-black pass) at once,
+// the ratio math runs in SSE lanes, positions are gathered and scattered per
+// lane since constraints index arbitrary particles.
+static inline void solve_distance4(Vector3 *position, const int p1[4],
+                                   const int p2[4], __m128 rest_length,
+                                   const float *const weights[4], bool limit) {
+  Vector3 delta[4];
+  for (int k = 0; k < 4; k++) {
+    delta[k] = Vector3Subtract(position[p2[k]], position[p1[k]]);
+  }
+  __m128 dx = _mm_setr_ps(delta[0].x, delta[1].x, delta[2].x, delta[3].x);
+  __m128 dy = _mm_setr_ps(delta[0].y, delta[1].y, delta[2].y, delta[3].y);
+  __m128 dz = _mm_setr_ps(delta[0].z, delta[1].z, delta[2].z, delta[3].z);
+  __m128 dist_sq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+                              _mm_mul_ps(dz, dz));
+
+  float ratio[4];
+  _mm_storeu_ps(ratio, distance_ratio4(dist_sq, rest_length, limit));
+  for (int k = 0; k < 4; k++) {
+    apply_correction(position, p1[k], p2[k], delta[k], ratio[k], weights[k]);
+  }
+}
+
+// Four links with the x, y and z of their ends in the low lanes of a[k] and
+// b[k], the top lane is don't-care. Only the squared deltas are transposed,
+// so callers load each particle as one register instead of gathering floats.
+// NULL weights means no end is pinned.
+static inline void solve_distance_ends4(__m128 a[4], __m128 b[4],
+                                        __m128 rest_length,
+                                        const float *const weights[4],
+                                        bool limit) {
+  __m128 d[4];
+  __m128 sq[4];
+  for (int k = 0; k < 4; k++) {
+    d[k] = _mm_sub_ps(b[k], a[k]);
+    sq[k] = _mm_mul_ps(d[k], d[k]);
+  }
+  __m128 xy01 = _mm_unpacklo_ps(sq[0], sq[1]); // x0 x1 y0 y1
+  __m128 xy23 = _mm_unpacklo_ps(sq[2], sq[3]); // x2 x3 y2 y3
+  __m128 z01 = _mm_unpackhi_ps(sq[0], sq[1]);  // z0 z1 - -
+  __m128 z23 = _mm_unpackhi_ps(sq[2], sq[3]);  // z2 z3 - -
+  __m128 dist_sq = _mm_add_ps(
+      _mm_add_ps(_mm_movelh_ps(xy01, xy23), _mm_movehl_ps(xy23, xy01)),
+      _mm_movelh_ps(z01, z23));
+  __m128 ratio = distance_ratio4(dist_sq, rest_length, limit);
+
+  __m128 r[4] = {_mm_shuffle_ps(ratio, ratio, _MM_SHUFFLE(0, 0, 0, 0)),
+                 _mm_shuffle_ps(ratio, ratio, _MM_SHUFFLE(1, 1, 1, 1)),
+                 _mm_shuffle_ps(ratio, ratio, _MM_SHUFFLE(2, 2, 2, 2)),
+                 _mm_shuffle_ps(ratio, ratio, _MM_SHUFFLE(3, 3, 3, 3))};
+  __m128 half = _mm_set1_ps(0.5f);
+  for (int k = 0; k < 4; k++) {
+    __m128 correction = _mm_mul_ps(d[k], r[k]);
+    __m128 w1 = weights ? _mm_set1_ps(weights[k][0]) : half;
+    __m128 w2 = weights ? _mm_set1_ps(weights[k][1]) : half;
+    a[k] = _mm_add_ps(a[k], _mm_mul_ps(correction, w1));
+    b[k] = _mm_sub_ps(b[k], _mm_mul_ps(correction, w2));
+  }
+}
+
+// x, y and z of v into one particle without touching the next
+static inline void store_vector3(Vector3 *position, int p, __m128 v) {
+  _mm_storel_pi((__m64 *)&position[p].x, v);
+  _mm_store_ss(&position[p].z, _mm_movehl_ps(v, v));
+}
+#endif
+
+// constraints [first, end) of color batch b, limit runs the strain limiting
+// pass instead
+static void solve_batch(Cloth *cloth, int b, int first, int end, bool limit) {
+  Vector3 *position = cloth->position;
+  const PackedConstraint *packed = cloth->solver->packed;
+  const float *rest_length = cloth->solver->rest_length;
+  float stretch = cloth->strain_limit;
+
+  int i = first;
+#ifdef CLOTH_SSE
+  // the overflow color may share particles, keep it scalar
+  if (b < MAX_CONSTRAINT_COLORS - 1) {
+    for (; i + 4 <= end; i += 4) {
+      int p1[4];
+      int p2[4];
+      const float *weights[4];
+      for (int k = 0; k < 4; k++) {
+        uint32_t second = packed[i + k].p2;
+        p1[k] = (int)packed[i + k].p1;
+        p2[k] = (int)(second & PACKED_INDEX_MASK);
+        weights[k] = pin_weights[second >> PACKED_PIN_SHIFT];
+      }
+      __m128 rest4 = _mm_loadu_ps(&rest_length[i]);
+      if (limit)
+        rest4 = _mm_mul_ps(rest4, _mm_set1_ps(stretch));
+      solve_distance4(position, p1, p2, rest4, weights, limit);
+    }
+  }
+#else
+  (void)b;
+#endif
+  for (; i < end; i++) {
+    uint32_t second = packed[i].p2;
+    float rest = limit ? rest_length[i] * stretch : rest_length[i];
+    solve_distance(position, (int)packed[i].p1,
+                   (int)(second & PACKED_INDEX_MASK), rest,
+                   pin_weights[second >> PACKED_PIN_SHIFT], limit);
+  }
+}
+
+static void satisfy_explicit_constraints(Cloth *cloth, bool limit) {
+  const int *batch_offsets = cloth->tmpl->batch_offsets;
+  for (int b = 0; b < cloth->tmpl->batch_count; b++) {
+    solve_batch(cloth, b, batch_offsets[b], batch_offsets[b + 1], limit);
+  }
+}
+
+#ifdef CLOTH_SSE
+static inline __m128 dot4(const __m128 a[3], const __m128 b[3]) {
+  return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], b[0]), _mm_mul_ps(a[1], b[1])),
+                    _mm_mul_ps(a[2], b[2]));
+}
+
+static inline void cross4(const __m128 a[3], const __m128 b[3],
+                          __m128 out[3]) {
+  out[0] = _mm_sub_ps(_mm_mul_ps(a[1], b[2]), _mm_mul_ps(a[2], b[1]));
+  out[1] = _mm_sub_ps(_mm_mul_ps(a[2], b[0]), _mm_mul_ps(a[0], b[2]));
+  out[2] = _mm_sub_ps(_mm_mul_ps(a[0], b[1]), _mm_mul_ps(a[1], b[0]));
+}
+
+// 1 / x where x > 0, else 0
+static inline __m128 safe_rcp4(__m128 x) {
+  __m128 positive = _mm_cmpgt_ps(x, _mm_setzero_ps());
+  return _mm_and_ps(_mm_div_ps(_mm_set1_ps(1.0f), x), positive);
+}
+#endif
+
+// Volume constraints. A tetrahedron with edges e1, e2, e3 from its first
+// corner has volume V = e1 . (e2 x e3) / 6, whose gradients are
+//   g1 = (e2 x e3) / 6, g2 = (e3 x e1) / 6, g3 = (e1 x e2) / 6
+// for the other corners and -(g1 + g2 + g3) for the first. Corner i moves
+// by w_i s g_i with s = (V0 - V) / sum w_j |g_j|^2, scaled by the cloth's
+// volume stiffness, as in position based dynamics. Batches are colored like
+// the sticks, so four tetrahedra of a batch are projected at once.
+
+#define SIXTH (1.0f / 6.0f)
+
+static void solve_volume(Vector3 *position, const bool *pinned,
+                         const Tetrahedron *t, float stiffness) {
+  Vector3 x0 = position[t->p[0]];
+  Vector3 e[3];
+  float w[4];
+  for (int k = 0; k < 3; k++) {
+    e[k] = Vector3Subtract(position[t->p[k + 1]], x0);
+  }
+  for (int k = 0; k < 4; k++) {
+    w[k] = pinned[t->p[k]] ? 0.0f : 1.0f;
+  }
+  Vector3 g[4];
+  for (int k = 0; k < 3; k++) {
+    Vector3 a = e[(k + 1) % 3];
+    Vector3 b = e[(k + 2) % 3];
+    g[k + 1] = (Vector3){(a.y * b.z - a.z * b.y) * SIXTH,
+                         (a.z * b.x - a.x * b.z) * SIXTH,
+                         (a.x * b.y - a.y * b.x) * SIXTH};
+  }
+  g[0] = (Vector3){-(g[1].x + g[2].x + g[3].x), -(g[1].y + g[2].y + g[3].y),
+                   -(g[1].z + g[2].z + g[3].z)};
+  float volume = e[0].x * g[1].x + e[0].y * g[1].y + e[0].z * g[1].z;
+  float den = 0.0f;
+  for (int k = 0; k < 4; k++) {
+    den += w[k] * (g[k].x * g[k].x + g[k].y * g[k].y + g[k].z * g[k].z);
+  }
+  float s = (t->rest_volume - volume) * stiffness *
+            (den > 0.0f ? 1.0f / den : 0.0f);
+  for (int k = 0; k < 4; k++) {
+    int p = t->p[k];
+    position[p] = Vector3Add(position[p], Vector3Scale(g[k], w[k] * s));
+  }
+}
+
+#ifdef CLOTH_SSE
+// solve_volume for four tetrahedra without shared corners, lane for lane
+// the same arithmetic
+static void solve_volume4(Vector3 *position, const bool *pinned,
+                          const Tetrahedron *t, float stiffness) {
+  Vector3 e[3][4];
+  float w[4][4];
+  for (int k = 0; k < 4; k++) {
+    Vector3 x0 = position[t[k].p[0]];
+    for (int j = 0; j < 3; j++) {
+      e[j][k] = Vector3Subtract(position[t[k].p[j + 1]], x0);
+    }
+    for (int j = 0; j < 4; j++) {
+      w[j][k] = pinned[t[k].p[j]] ? 0.0f : 1.0f;
+    }
+  }
+  __m128 ev[3][3];
+  for (int j = 0; j < 3; j++) {
+    ev[j][0] = _mm_setr_ps(e[j][0].x, e[j][1].x, e[j][2].x, e[j][3].x);
+    ev[j][1] = _mm_setr_ps(e[j][0].y, e[j][1].y, e[j][2].y, e[j][3].y);
+    ev[j][2] = _mm_setr_ps(e[j][0].z, e[j][1].z, e[j][2].z, e[j][3].z);
+  }
+  __m128 sixth = _mm_set1_ps(SIXTH);
+  __m128 g[4][3];
+  for (int j = 0; j < 3; j++) {
+    cross4(ev[(j + 1) % 3], ev[(j + 2) % 3], g[j + 1]);
+    for (int c = 0; c < 3; c++) {
+      g[j + 1][c] = _mm_mul_ps(g[j + 1][c], sixth);
+    }
+  }
+  for (int c = 0; c < 3; c++) {
+    g[0][c] = _mm_xor_ps(
+        _mm_add_ps(_mm_add_ps(g[1][c], g[2][c]), g[3][c]),
+        _mm_set1_ps(-0.0f));
+  }
+  __m128 volume = dot4(ev[0], g[1]);
+  __m128 den = _mm_setzero_ps();
+  __m128 wv[4];
+  for (int j = 0; j < 4; j++) {
+    wv[j] = _mm_loadu_ps(w[j]);
+    den = _mm_add_ps(den, _mm_mul_ps(wv[j], dot4(g[j], g[j])));
+  }
+  __m128 rest = _mm_setr_ps(t[0].rest_volume, t[1].rest_volume,
+                            t[2].rest_volume, t[3].rest_volume);
+  __m128 s = _mm_mul_ps(
+      _mm_mul_ps(_mm_sub_ps(rest, volume), _mm_set1_ps(stiffness)),
+      safe_rcp4(den));
+  for (int j = 0; j < 4; j++) {
+    __m128 scale = _mm_mul_ps(wv[j], s);
+    float move[3][4];
+    for (int c = 0; c < 3; c++) {
+      _mm_storeu_ps(move[c], _mm_mul_ps(g[j][c], scale));
+    }
+    for (int k = 0; k < 4; k++) {
+      int p = t[k].p[j];
+      position[p] = Vector3Add(position[p],
+                               (Vector3){move[0][k], move[1][k], move[2][k]});
+    }
+  }
+}
+#endif
+
+// tetrahedra [first, end) of color batch b
+static void solve_volume_batch(Cloth *cloth, int b, int first, int end) {
+  const Tetrahedron *tetrahedra = cloth->tmpl->tetrahedra;
+  int i = first;
+#ifdef CLOTH_SSE
+  // the overflow color may share particles, keep it scalar
+  if (b < MAX_CONSTRAINT_COLORS - 1) {
+    for (; i + 4 <= end; i += 4) {
+      solve_volume4(cloth->position, cloth->pinned, &tetrahedra[i],
+                    cloth->volume_stiffness);
+    }
+  }
+#else
+  (void)b;
+#endif
+  for (; i < end; i++) {
+    solve_volume(cloth->position, cloth->pinned, &tetrahedra[i],
+                 cloth->volume_stiffness);
+  }
+}
+
+static void satisfy_volume_constraints(Cloth *cloth) {
+  const int *offsets = cloth->tmpl->tetrahedron_offsets;
+  for (int b = 0; b < cloth->tmpl->tetrahedron_batch_count; b++) {
+    solve_volume_batch(cloth, b, offsets[b], offsets[b + 1]);
+  }
+}
+
+// Bending of meshes. For a dihedral with wings x0, x1 and shared edge
+// e = x3 - x2 the triangle normals n1 = (x2 - x0) x (x3 - x0) and
+// n2 = (x3 - x1) x (x2 - x1) are apart by the signed angle
+//   atan2(-(n1 x n2) . e, |e| n1 . n2)
+// which is 0 while the triangles are flat. With m_i = n_i / |n_i|^2 its
+// gradients (Bridson et al. 2003, "Simulation of clothing with folds and
+// wrinkles") are
+//   g0 = |e| m1, g1 = |e| m2
+//   g2 = ((x0 - x3) . e m1 + (x1 - x3) . e m2) / |e|
+//   g3 = ((x2 - x0) . e m1 + (x2 - x1) . e m2) / |e|
+// and the corners move like those of a tetrahedron, by w_i s g_i with
+// s = (rest - angle) / sum w_j |g_j|^2 times the bending stiffness. SSE has
+// no atan2, so both paths use the same polynomial, good to about 1e-5.
+
+#define ATAN_C0 0.99997726f
+#define ATAN_C1 -0.33262347f
+#define ATAN_C2 0.19354346f
+#define ATAN_C3 -0.11643287f
+#define ATAN_C4 0.05265332f
+#define ATAN_C5 -0.01172120f
+
+static inline float approx_atan2(float y, float x) {
+  float ax = fabsf(x);
+  float ay = fabsf(y);
+  float hi = fmaxf(ax, ay);
+  float a = fminf(ax, ay) * (hi > 0.0f ? 1.0f / hi : 0.0f);
+  float a2 = a * a;
+  float r = a * (ATAN_C0 +
+                 a2 * (ATAN_C1 +
+                       a2 * (ATAN_C2 +
+                             a2 * (ATAN_C3 + a2 * (ATAN_C4 + a2 * ATAN_C5)))));
+  if (ay > ax)
+    r = 0.5f * PI - r;
+  if (x < 0.0f)
+    r = PI - r;
+  return copysignf(r, y);
+}
+
+// rest - angle, the short way around
+static inline float wrap_angle(float d) {
+  if (d > PI)
+    d -= 2.0f * PI;
+  if (d < -PI)
+    d += 2.0f * PI;
+  return d;
+}
+
+// angle between the normals n1 and n2 of two triangles sharing the edge e
+static inline float normal_angle(Vector3 n1, Vector3 n2, Vector3 e,
+                                 float e_len) {
+  return approx_atan2(-Vector3DotProduct(Vector3CrossProduct(n1, n2), e),
+                      e_len * Vector3DotProduct(n1, n2));
+}
+
+static void solve_dihedral(Vector3 *position, const bool *pinned,
+                           const Dihedral *d, float stiffness) {
+  Vector3 x[4];
+  float w[4];
+  for (int k = 0; k < 4; k++) {
+    x[k] = position[d->p[k]];
+    w[k] = pinned[d->p[k]] ? 0.0f : 1.0f;
+  }
+  Vector3 e = Vector3Subtract(x[3], x[2]);
+  Vector3 n1 = Vector3CrossProduct(Vector3Subtract(x[2], x[0]),
+                                   Vector3Subtract(x[3], x[0]));
+  Vector3 n2 = Vector3CrossProduct(Vector3Subtract(x[3], x[1]),
+                                   Vector3Subtract(x[2], x[1]));
+  float e_len = sqrtf(Vector3DotProduct(e, e));
+  float inv_e = e_len > 0.0f ? 1.0f / e_len : 0.0f;
+  float n1_sq = Vector3DotProduct(n1, n1);
+  float n2_sq = Vector3DotProduct(n2, n2);
+  Vector3 m1 = Vector3Scale(n1, n1_sq > 0.0f ? 1.0f / n1_sq : 0.0f);
+  Vector3 m2 = Vector3Scale(n2, n2_sq > 0.0f ? 1.0f / n2_sq : 0.0f);
+
+  Vector3 g[4];
+  g[0] = Vector3Scale(m1, e_len);
+  g[1] = Vector3Scale(m2, e_len);
+  g[2] = Vector3Add(
+      Vector3Scale(m1, Vector3DotProduct(Vector3Subtract(x[0], x[3]), e) *
+                           inv_e),
+      Vector3Scale(m2, Vector3DotProduct(Vector3Subtract(x[1], x[3]), e) *
+                           inv_e));
+  g[3] = Vector3Add(
+      Vector3Scale(m1, Vector3DotProduct(Vector3Subtract(x[2], x[0]), e) *
+                           inv_e),
+      Vector3Scale(m2, Vector3DotProduct(Vector3Subtract(x[2], x[1]), e) *
+                           inv_e));
+
+  float angle = normal_angle(n1, n2, e, e_len);
+  float den = 0.0f;
+  for (int k = 0; k < 4; k++) {
+    den += w[k] * Vector3DotProduct(g[k], g[k]);
+  }
+  float s = wrap_angle(d->rest_angle - angle) * stiffness *
+            (den > 0.0f ? 1.0f / den : 0.0f);
+  for (int k = 0; k < 4; k++) {
+    int p = d->p[k];
+    position[p] = Vector3Add(position[p], Vector3Scale(g[k], w[k] * s));
+  }
+}
+
+#ifdef CLOTH_SSE
+static inline __m128 approx_atan2_4(__m128 y, __m128 x) {
+  __m128 sign = _mm_set1_ps(-0.0f);
+  __m128 ax = _mm_andnot_ps(sign, x);
+  __m128 ay = _mm_andnot_ps(sign, y);
+  __m128 a = _mm_mul_ps(_mm_min_ps(ax, ay), safe_rcp4(_mm_max_ps(ax, ay)));
+  __m128 a2 = _mm_mul_ps(a, a);
+  __m128 r = _mm_add_ps(_mm_set1_ps(ATAN_C4),
+                        _mm_mul_ps(a2, _mm_set1_ps(ATAN_C5)));
+  r = _mm_add_ps(_mm_set1_ps(ATAN_C3), _mm_mul_ps(a2, r));
+  r = _mm_add_ps(_mm_set1_ps(ATAN_C2), _mm_mul_ps(a2, r));
+  r = _mm_add_ps(_mm_set1_ps(ATAN_C1), _mm_mul_ps(a2, r));
+  r = _mm_mul_ps(a, _mm_add_ps(_mm_set1_ps(ATAN_C0), _mm_mul_ps(a2, r)));
+  __m128 swap = _mm_cmpgt_ps(ay, ax);
+  r = _mm_or_ps(_mm_and_ps(swap, _mm_sub_ps(_mm_set1_ps(0.5f * PI), r)),
+                _mm_andnot_ps(swap, r));
+  __m128 back = _mm_cmplt_ps(x, _mm_setzero_ps());
+  r = _mm_or_ps(_mm_and_ps(back, _mm_sub_ps(_mm_set1_ps(PI), r)),
+                _mm_andnot_ps(back, r));
+  return _mm_or_ps(r, _mm_and_ps(y, sign));
+}
+
+static inline void sub4(const __m128 a[3], const __m128 b[3], __m128 out[3]) {
+  for (int c = 0; c < 3; c++) {
+    out[c] = _mm_sub_ps(a[c], b[c]);
+  }
+}
+
+// solve_dihedral for four dihedrals without shared corners, lane for lane
+// the same arithmetic
+static void solve_dihedral4(Vector3 *position, const bool *pinned,
+                            const Dihedral *d, float stiffness) {
+  __m128 x[4][3];
+  __m128 wv[4];
+  for (int j = 0; j < 4; j++) {
+    Vector3 v[4];
+    float w[4];
+    for (int k = 0; k < 4; k++) {
+      v[k] = position[d[k].p[j]];
+      w[k] = pinned[d[k].p[j]] ? 0.0f : 1.0f;
+    }
+    x[j][0] = _mm_setr_ps(v[0].x, v[1].x, v[2].x, v[3].x);
+    x[j][1] = _mm_setr_ps(v[0].y, v[1].y, v[2].y, v[3].y);
+    x[j][2] = _mm_setr_ps(v[0].z, v[1].z, v[2].z, v[3].z);
+    wv[j] = _mm_loadu_ps(w);
+  }
+  __m128 e[3], a[3], b[3], n1[3], n2[3];
+  sub4(x[3], x[2], e);
+  sub4(x[2], x[0], a);
+  sub4(x[3], x[0], b);
+  cross4(a, b, n1);
+  sub4(x[3], x[1], a);
+  sub4(x[2], x[1], b);
+  cross4(a, b, n2);
+  __m128 e_len = _mm_sqrt_ps(dot4(e, e));
+  __m128 inv_e = safe_rcp4(e_len);
+  __m128 r1 = safe_rcp4(dot4(n1, n1));
+  __m128 r2 = safe_rcp4(dot4(n2, n2));
+  __m128 m1[3], m2[3];
+  for (int c = 0; c < 3; c++) {
+    m1[c] = _mm_mul_ps(n1[c], r1);
+    m2[c] = _mm_mul_ps(n2[c], r2);
+  }
+
+  // weights of m1 and m2 in every gradient
+  __m128 c1[4], c2[4];
+  c1[0] = e_len;
+  c2[0] = _mm_setzero_ps();
+  c1[1] = _mm_setzero_ps();
+  c2[1] = e_len;
+  sub4(x[0], x[3], a);
+  c1[2] = _mm_mul_ps(dot4(a, e), inv_e);
+  sub4(x[1], x[3], a);
+  c2[2] = _mm_mul_ps(dot4(a, e), inv_e);
+  sub4(x[2], x[0], a);
+  c1[3] = _mm_mul_ps(dot4(a, e), inv_e);
+  sub4(x[2], x[1], a);
+  c2[3] = _mm_mul_ps(dot4(a, e), inv_e);
+  __m128 g[4][3];
+  for (int c = 0; c < 3; c++) {
+    g[0][c] = _mm_mul_ps(m1[c], e_len);
+    g[1][c] = _mm_mul_ps(m2[c], e_len);
+    for (int j = 2; j < 4; j++) {
+      g[j][c] = _mm_add_ps(_mm_mul_ps(m1[c], c1[j]), _mm_mul_ps(m2[c], c2[j]));
+    }
+  }
+
+  __m128 n12[3];
+  cross4(n1, n2, n12);
+  __m128 angle = approx_atan2_4(_mm_xor_ps(dot4(n12, e), _mm_set1_ps(-0.0f)),
+                                _mm_mul_ps(e_len, dot4(n1, n2)));
+  __m128 den = _mm_setzero_ps();
+  for (int j = 0; j < 4; j++) {
+    den = _mm_add_ps(den, _mm_mul_ps(wv[j], dot4(g[j], g[j])));
+  }
+  __m128 rest = _mm_setr_ps(d[0].rest_angle, d[1].rest_angle,
+                            d[2].rest_angle, d[3].rest_angle);
+  __m128 diff = _mm_sub_ps(rest, angle);
+  __m128 two_pi = _mm_set1_ps(2.0f * PI);
+  diff = _mm_sub_ps(diff, _mm_and_ps(_mm_cmpgt_ps(diff, _mm_set1_ps(PI)),
+                                     two_pi));
+  diff = _mm_add_ps(diff, _mm_and_ps(_mm_cmplt_ps(diff, _mm_set1_ps(-PI)),
+                                     two_pi));
+  __m128 s = _mm_mul_ps(_mm_mul_ps(diff, _mm_set1_ps(stiffness)),
+                        safe_rcp4(den));
+  for (int j = 0; j < 4; j++) {
+    __m128 scale = _mm_mul_ps(wv[j], s);
+    float move[3][4];
+    for (int c = 0; c < 3; c++) {
+      _mm_storeu_ps(move[c], _mm_mul_ps(g[j][c], scale));
+    }
+    for (int k = 0; k < 4; k++) {
+      int p = d[k].p[j];
+      position[p] = Vector3Add(position[p],
+                               (Vector3){move[0][k], move[1][k], move[2][k]});
+    }
+  }
+}
+#endif
+
+// dihedrals [first, end) of color batch b
+static void solve_dihedral_batch(Cloth *cloth, int b, int first, int end) {
+  const Dihedral *dihedrals = cloth->tmpl->dihedrals;
+  int i = first;
+#ifdef CLOTH_SSE
+  // the overflow color may share particles, keep it scalar
+  if (b < MAX_CONSTRAINT_COLORS - 1) {
+    for (; i + 4 <= end; i += 4) {
+      solve_dihedral4(cloth->position, cloth->pinned, &dihedrals[i],
+                      cloth->bending_stiffness);
+    }
+  }
+#else
+  (void)b;
+#endif
+  for (; i < end; i++) {
+    solve_dihedral(cloth->position, cloth->pinned, &dihedrals[i],
+                   cloth->bending_stiffness);
+  }
+}
+
+static void satisfy_dihedral_constraints(Cloth *cloth) {
+  if (cloth->bending_stiffness <= 0.0f)
+    return;
+  const int *offsets = cloth->tmpl->dihedral_offsets;
+  for (int b = 0; b < cloth->tmpl->dihedral_batch_count; b++) {
+    solve_dihedral_batch(cloth, b, offsets[b], offsets[b + 1]);
+  }
+}
+
+// Red-black ordering over the implicit grid links: horizontal links starting
+// at even columns, then odd columns, then the same for vertical links by row.
+// Links inside one pass never share a particle, so the order within a pass
+// doesn't matter and no constraint memory or index loads are needed.
+
+// horizontal links of one parity in rows [first_row, end_row)
+static void solve_grid_horizontal(Cloth *cloth, int parity, int first_row,
+                                  int end_row, bool limit) {
+  Vector3 *position = cloth->position;
+  const bool *pinned = cloth->pinned;
+  int cols = cloth->tmpl->grid_cols;
+  float rest_length = cloth->tmpl->grid_spacing;
+  if (limit)
+    rest_length *= cloth->strain_limit;
+#ifdef CLOTH_SSE
+  __m128 rest4 = _mm_set1_ps(rest_length);
+#endif
+
+  for (int y = first_row; y < end_row; y++) {
+    int row = y * cols;
+    int x = parity;
+#ifdef CLOTH_SSE
+    // eight particles per step, the load of the last one also reads x of
+    // the next, so one must follow in the row
+    for (; x + 8 < cols; x += 8) {
+      int p = row + x;
+      uint64_t pins;
+      memcpy(&pins, &pinned[p], sizeof(pins));
+      const float *weights[4];
+      for (int k = 0; k < 4 && pins; k++) {
+        weights[k] = link_weights(pinned, p + 2 * k, p + 2 * k + 1);
+      }
+      float *f = &position[p].x;
+      __m128 a[4];
+      __m128 b[4];
+      for (int k = 0; k < 4; k++) {
+        a[k] = _mm_loadu_ps(f + 6 * k);
+        b[k] = _mm_loadu_ps(f + 6 * k + 3);
+      }
+      solve_distance_ends4(a, b, rest4, pins ? weights : NULL, limit);
+      // ascending, each store's top lane is overwritten by the next
+      for (int k = 0; k < 3; k++) {
+        _mm_storeu_ps(f + 6 * k, a[k]);
+        _mm_storeu_ps(f + 6 * k + 3, b[k]);
+      }
+      _mm_storeu_ps(f + 18, a[3]);
+      store_vector3(position, p + 7, b[3]);
+    }
+#endif
+    for (; x < cols - 1; x += 2) {
+      int p1 = row + x;
+      solve_distance(position, p1, p1 + 1, rest_length,
+                     link_weights(pinned, p1, p1 + 1), limit);
+    }
+  }
+}
+
+// vertical links leaving the rows of one parity in [first_row, end_row)
+static void solve_grid_vertical(Cloth *cloth, int parity, int first_row,
+                                int end_row, bool limit) {
+  Vector3 *position = cloth->position;
+  const bool *pinned = cloth->pinned;
+  int cols = cloth->tmpl->grid_cols;
+  int rows = cloth->tmpl->grid_rows;
+  float rest_length = cloth->tmpl->grid_spacing;
+  if (limit)
+    rest_length *= cloth->strain_limit;
+#ifdef CLOTH_SSE
+  __m128 rest4 = _mm_set1_ps(rest_length);
+#endif
+
+  if (end_row > rows - 1)
+    end_row = rows - 1;
+  for (int y = first_row + ((first_row - parity) & 1); y < end_row; y += 2) {
+    int row = y * cols;
+    int x = 0;
+#ifdef CLOTH_SSE
+    // as for rows, a particle must follow the four in each row
+    for (; x + 4 < cols; x += 4) {
+      int p1 = row + x;
+      int p2 = p1 + cols;
+      uint32_t pins1;
+      uint32_t pins2;
+      memcpy(&pins1, &pinned[p1], sizeof(pins1));
+      memcpy(&pins2, &pinned[p2], sizeof(pins2));
+      const float *weights[4];
+      for (int k = 0; k < 4 && (pins1 | pins2); k++) {
+        weights[k] = link_weights(pinned, p1 + k, p2 + k);
+      }
+      __m128 a[4];
+      __m128 b[4];
+      for (int k = 0; k < 4; k++) {
+        a[k] = _mm_loadu_ps(&position[p1 + k].x);
+        b[k] = _mm_loadu_ps(&position[p2 + k].x);
+      }
+      solve_distance_ends4(a, b, rest4, pins1 | pins2 ? weights : NULL,
+                           limit);
+      for (int k = 0; k < 3; k++) {
+        _mm_storeu_ps(&position[p1 + k].x, a[k]);
+        _mm_storeu_ps(&position[p2 + k].x, b[k]);
+      }
+      store_vector3(position, p1 + 3, a[3]);
+      store_vector3(position, p2 + 3, b[3]);
+    }
+#endif
+    for (; x < cols; x++) {
+      int p1 = row + x;
+      solve_distance(position, p1, p1 + cols, rest_length,
+                     link_weights(pinned, p1, p1 + cols), limit);
+    }
+  }
+}
+
+static void satisfy_grid_constraints(Cloth *cloth, bool limit) {
+  int rows = cloth->tmpl->grid_rows;
+  for (int parity = 0; parity < 2; parity++) {
+    solve_grid_horizontal(cloth, parity, 0, rows, limit);
+  }
+  for (int parity = 0; parity < 2; parity++) {
+    solve_grid_vertical(cloth, parity, 0, rows, limit);
+  }
+}
+
+// Shear and bending stencils over the grid: diagonal links across every quad
+// and links skipping one particle along rows and columns, at rest lengths
+// spacing * sqrt(2) and 2 * spacing. Like the structural links they are
+// implied by (row, col) and cost no memory. Diagonals leaving rows of one
+// parity are independent like vertical links, skip-one links are split by
+// whether they start in the first or second pair of every four columns, or
+// rows. Their stiffness scales the correction weights.
+
+// pin_weights times stiffness
+static void scale_pin_weights(float stiffness, float weights[4][2]) {
+  for (int i = 0; i < 4; i++) {
+    weights[i][0] = pin_weights[i][0] * stiffness;
+    weights[i][1] = pin_weights[i][1] * stiffness;
+  }
+}
+
+static inline const float *stencil_weights(const float weights[4][2],
+                                           const bool *pinned, int p1,
+                                           int p2) {
+  return weights[(pinned[p1] ? 1 : 0) | (pinned[p2] ? 2 : 0)];
+}
+
+// count links p -> p + offset from consecutive particles p starting at first
+static void solve_grid_run(Cloth *cloth, int first, int count, int offset,
+                           float rest_length, const float weights[4][2]) {
+  Vector3 *position = cloth->position;
+  const bool *pinned = cloth->pinned;
+  int i = 0;
+#ifdef CLOTH_SSE
+  __m128 rest4 = _mm_set1_ps(rest_length);
+  for (; i + 4 <= count; i += 4) {
+    int p1[4] = {first + i, first + i + 1, first + i + 2, first + i + 3};
+    int p2[4] = {p1[0] + offset, p1[1] + offset, p1[2] + offset,
+                 p1[3] + offset};
+    const float *link[4] = {stencil_weights(weights, pinned, p1[0], p2[0]),
+                            stencil_weights(weights, pinned, p1[1], p2[1]),
+                            stencil_weights(weights, pinned, p1[2], p2[2]),
+                            stencil_weights(weights, pinned, p1[3], p2[3])};
+    solve_distance4(position, p1, p2, rest4, link, false);
+  }
+#endif
+  for (; i < count; i++) {
+    int p1 = first + i;
+    solve_distance(position, p1, p1 + offset, rest_length,
+                   stencil_weights(weights, pinned, p1, p1 + offset), false);
+  }
+}
+
+// diagonals leaving the rows of one parity in [first_row, end_row), pass 0
+// and 1 go down and right, 2 and 3 down and left
+static void solve_grid_shear(Cloth *cloth, int pass, int first_row,
+                             int end_row) {
+  int cols = cloth->tmpl->grid_cols;
+  int rows = cloth->tmpl->grid_rows;
+  int parity = pass & 1;
+  float rest_length = cloth->tmpl->grid_spacing * sqrtf(2.0f);
+  float weights[4][2];
+  scale_pin_weights(cloth->shear_stiffness, weights);
+
+  if (end_row > rows - 1)
+    end_row = rows - 1;
+  for (int y = first_row + ((first_row - parity) & 1); y < end_row; y += 2) {
+    if (pass < 2)
+      solve_grid_run(cloth, y * cols, cols - 1, cols + 1, rest_length,
+                     weights);
+    else
+      solve_grid_run(cloth, y * cols + 1, cols - 1, cols - 1, rest_length,
+                     weights);
+  }
+}
+
+// skip-one links starting in rows [first_row, end_row). Pass 0 and 1 are
+// horizontal links from columns x with (x >> 1 & 1) == pass, 2 and 3
+// vertical links from rows y with (y >> 1 & 1) == pass - 2.
+static void solve_grid_bending(Cloth *cloth, int pass, int first_row,
+                               int end_row) {
+  Vector3 *position = cloth->position;
+  const bool *pinned = cloth->pinned;
+  int cols = cloth->tmpl->grid_cols;
+  int rows = cloth->tmpl->grid_rows;
+  float rest_length = 2.0f * cloth->tmpl->grid_spacing;
+  float weights[4][2];
+  scale_pin_weights(cloth->bending_stiffness, weights);
+
+  if (pass >= 2) {
+    if (end_row > rows - 2)
+      end_row = rows - 2;
+    for (int y = first_row; y < end_row; y++) {
+      if ((y >> 1 & 1) == pass - 2)
+        solve_grid_run(cloth, y * cols, cols, 2 * cols, rest_length,
+                       weights);
+    }
+    return;
+  }
+
+#ifdef CLOTH_SSE
+  __m128 rest4 = _mm_set1_ps(rest_length);
+#endif
+  for (int y = first_row; y < end_row; y++) {
+    int row = y * cols;
+    int x = 2 * pass;
+#ifdef CLOTH_SSE
+    // two pairs of links, {x, x + 1} and {x + 4, x + 5}
+    for (; x + 7 < cols; x += 8) {
+      int p1[4] = {row + x, row + x + 1, row + x + 4, row + x + 5};
+      int p2[4] = {p1[0] + 2, p1[1] + 2, p1[2] + 2, p1[3] + 2};
+      const float *link[4] = {stencil_weights(weights, pinned, p1[0], p2[0]),
+                              stencil_weights(weights, pinned, p1[1], p2[1]),
+                              stencil_weights(weights, pinned, p1[2], p2[2]),
+                              stencil_weights(weights, pinned, p1[3], p2[3])};
+      solve_distance4(position, p1, p2, rest4, link, false);
+    }
+#endif
+    for (; x < cols - 2; x += 4) {
+      for (int p1 = row + x; p1 < row + x + 2 && p1 < row + cols - 2; p1++) {
+        solve_distance(position, p1, p1 + 2, rest_length,
+                       stencil_weights(weights, pinned, p1, p1 + 2), false);
+      }
+    }
+  }
+}
+
+static void satisfy_grid_stencils(Cloth *cloth) {
+  int rows = cloth->tmpl->grid_rows;
+  for (int pass = 0; cloth->shear_stiffness > 0.0f && pass < 4; pass++) {
+    solve_grid_shear(cloth, pass, 0, rows);
+  }
+  for (int pass = 0; cloth->bending_stiffness > 0.0f && pass < 4; pass++) {
+    solve_grid_bending(cloth, pass, 0, rows);
+  }
+}
+
+// Strands. Gauss-Seidel relaxation only straightens a chain by about a link
+// per iteration from wherever it is held. A strand's links are instead
+// linearized and solved together: with unit link directions u_i and inverse
+// masses w_i the system J W J^T lambda = -C is tridiagonal, w_i + w_(i+1) on
+// the diagonal and -w_(i+1) u_i.u_(i+1) next to it, so the Thomas algorithm
+// solves it in one sweep down the strand and one back up. Particle i then
+// moves by w_i (u_(i-1) lambda_(i-1) - u_i lambda_i). A solve is one Newton
+// step on every link at once. Neighboring strands are neighboring columns,
+// so the sweeps go row by row across all strands of a tile, four at a time
+// with SSE, and stream through memory instead of striding down a column.
+//
+// Written with the mean tension t = (lambda_(i-1) + lambda_i) / 2 that move
+// is (lambda_(i-1) - lambda_i) (u_(i-1) + u_i) / 2 + t (u_(i-1) - u_i). The
+// second part straightens a bend of angle theta by about |t| theta sideways,
+// which overshoots the straight line once a loaded strand's tension nears
+// its link length, and the bend then flips and grows every step. Like the
+// global solve's step limit t is clamped there. That part hardly changes
+// the links' lengths, so loaded strands still hold, and one relaxation
+// sweep down the strands takes up what the clamp and the linearization
+// leave. A strand under more load than its iterations can carry stretches
+// instead of blowing up.
+
+// largest mean tension used to straighten bends, as a share of a link
+#define STRAND_MAX_TENSION 0.3f
+
+typedef struct {
+  float *ux;
+  float *uy;
+  float *uz;
+  // the forward sweep's modified upper diagonal. Until the next row needs
+  // it, a row keeps the reciprocal of its pivot here.
+  float *upper;
+  // the forward sweep's modified right hand side, then lambda
+  float *rhs;
+} StrandWork;
+
+static StrandWork strand_work(const Cloth *cloth) {
+  int count = cloth->particle_count;
+  float *work = cloth->strand_work;
+  return (StrandWork){work, work + count, work + 2 * count, work + 3 * count,
+                      work + 4 * count};
+}
+
+// forward sweep over the link below particle p = (row, x)
+static void strand_forward(Cloth *cloth, const StrandWork *work, int row,
+                           int p) {
+  int cols = cloth->tmpl->grid_cols;
+  const Vector3 *position = cloth->position;
+  const bool *pinned = cloth->pinned;
+  Vector3 prev_u = {0};
+  float prev_inv_den = 0.0f;
+  float prev_rhs = 0.0f;
+  if (row > 0) {
+    int q = p - cols;
+    prev_u = (Vector3){work->ux[q], work->uy[q], work->uz[q]};
+    prev_inv_den = work->upper[q];
+    prev_rhs = work->rhs[q];
+  }
+
+  Vector3 d = Vector3Subtract(position[p + cols], position[p]);
+  float length = sqrtf(Vector3DotProduct(d, d));
+  Vector3 u = Vector3Scale(d, length > 0.0f ? 1.0f / length : 0.0f);
+  float w0 = pinned[p] ? 0.0f : 1.0f;
+  float w1 = pinned[p + cols] ? 0.0f : 1.0f;
+  // coupling with the link above through particle p
+  float e = -w0 * Vector3DotProduct(prev_u, u);
+  float c = e * prev_inv_den;
+  if (row > 0)
+    work->upper[p - cols] = c;
+  float den = w0 + w1 - e * c;
+  float inv_den = den > 0.0f ? 1.0f / den : 0.0f;
+  work->ux[p] = u.x;
+  work->uy[p] = u.y;
+  work->uz[p] = u.z;
+  work->upper[p] = inv_den;
+  work->rhs[p] =
+      (cloth->tmpl->grid_spacing - length - e * prev_rhs) * inv_den;
+}
+
+// back substitution for the link below p, lambda_below is 0 on the last one
+static void strand_back(const StrandWork *work, int p, float lambda_below) {
+  work->rhs[p] = work->rhs[p] - work->upper[p] * lambda_below;
+}
+
+// moves particle p = (row, x) by the links above and below it
+static void strand_apply(Cloth *cloth, const StrandWork *work, int row,
+                         int p) {
+  int cols = cloth->tmpl->grid_cols;
+  int rows = cloth->tmpl->grid_rows;
+  if (cloth->pinned[p])
+    return;
+  int q = p - cols;
+  Vector3 move;
+  if (row == 0) {
+    move = Vector3Scale((Vector3){work->ux[p], work->uy[p], work->uz[p]},
+                        -work->rhs[p]);
+  } else if (row == rows - 1) {
+    move = Vector3Scale((Vector3){work->ux[q], work->uy[q], work->uz[q]},
+                        work->rhs[q]);
+  } else {
+    Vector3 above = {work->ux[q], work->uy[q], work->uz[q]};
+    Vector3 below = {work->ux[p], work->uy[p], work->uz[p]};
+    float along = 0.5f * (work->rhs[q] - work->rhs[p]);
+    float limit = STRAND_MAX_TENSION * cloth->tmpl->grid_spacing;
+    float tension = Clamp(0.5f * (work->rhs[q] + work->rhs[p]), -limit, limit);
+    move = Vector3Add(Vector3Scale(Vector3Add(above, below), along),
+                      Vector3Scale(Vector3Subtract(above, below), tension));
+  }
+  cloth->position[p] = Vector3Add(cloth->position[p], move);
+}
+
+#ifdef CLOTH_SSE
+static inline void load_strand_row(const Vector3 *position, int p,
+                                   __m128 v[3]) {
+  v[0] = _mm_setr_ps(position[p].x, position[p + 1].x, position[p + 2].x,
+                     position[p + 3].x);
+  v[1] = _mm_setr_ps(position[p].y, position[p + 1].y, position[p + 2].y,
+                     position[p + 3].y);
+  v[2] = _mm_setr_ps(position[p].z, position[p + 1].z, position[p + 2].z,
+                     position[p + 3].z);
+}
+
+static inline __m128 strand_weights(const bool *pinned, int p) {
+  return _mm_setr_ps(pinned[p] ? 0.0f : 1.0f, pinned[p + 1] ? 0.0f : 1.0f,
+                     pinned[p + 2] ? 0.0f : 1.0f,
+                     pinned[p + 3] ? 0.0f : 1.0f);
+}
+
+// strand_forward for particles p to p + 3, lane for lane the same arithmetic
+static void strand_forward4(Cloth *cloth, const StrandWork *work, int row,
+                            int p) {
+  int cols = cloth->tmpl->grid_cols;
+  const bool *pinned = cloth->pinned;
+  __m128 zero = _mm_setzero_ps();
+  __m128 prev_u[3] = {zero, zero, zero};
+  __m128 prev_inv_den = zero;
+  __m128 prev_rhs = zero;
+  if (row > 0) {
+    int q = p - cols;
+    prev_u[0] = _mm_loadu_ps(&work->ux[q]);
+    prev_u[1] = _mm_loadu_ps(&work->uy[q]);
+    prev_u[2] = _mm_loadu_ps(&work->uz[q]);
+    prev_inv_den = _mm_loadu_ps(&work->upper[q]);
+    prev_rhs = _mm_loadu_ps(&work->rhs[q]);
+  }
+
+  __m128 top[3];
+  __m128 bottom[3];
+  load_strand_row(cloth->position, p, top);
+  load_strand_row(cloth->position, p + cols, bottom);
+  __m128 d[3];
+  for (int k = 0; k < 3; k++) {
+    d[k] = _mm_sub_ps(bottom[k], top[k]);
+  }
+  __m128 length = _mm_sqrt_ps(
+      _mm_add_ps(_mm_add_ps(_mm_mul_ps(d[0], d[0]), _mm_mul_ps(d[1], d[1])),
+                 _mm_mul_ps(d[2], d[2])));
+  __m128 inv_length = safe_rcp4(length);
+  __m128 u[3];
+  for (int k = 0; k < 3; k++) {
+    u[k] = _mm_mul_ps(d[k], inv_length);
+  }
+  __m128 w0 = strand_weights(pinned, p);
+  __m128 w1 = strand_weights(pinned, p + cols);
+  __m128 dot = _mm_add_ps(
+      _mm_add_ps(_mm_mul_ps(prev_u[0], u[0]), _mm_mul_ps(prev_u[1], u[1])),
+      _mm_mul_ps(prev_u[2], u[2]));
+  __m128 e = _mm_mul_ps(_mm_xor_ps(w0, _mm_set1_ps(-0.0f)), dot);
+  __m128 c = _mm_mul_ps(e, prev_inv_den);
+  if (row > 0)
+    _mm_storeu_ps(&work->upper[p - cols], c);
+  __m128 den = _mm_sub_ps(_mm_add_ps(w0, w1), _mm_mul_ps(e, c));
+  __m128 inv_den = safe_rcp4(den);
+  __m128 rest4 = _mm_set1_ps(cloth->tmpl->grid_spacing);
+  _mm_storeu_ps(&work->ux[p], u[0]);
+  _mm_storeu_ps(&work->uy[p], u[1]);
+  _mm_storeu_ps(&work->uz[p], u[2]);
+  _mm_storeu_ps(&work->upper[p], inv_den);
+  _mm_storeu_ps(&work->rhs[p],
+                _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(rest4, length),
+                                      _mm_mul_ps(e, prev_rhs)),
+                           inv_den));
+}
+
+static void strand_back4(const StrandWork *work, int p, __m128 lambda_below) {
+  _mm_storeu_ps(&work->rhs[p],
+                _mm_sub_ps(_mm_loadu_ps(&work->rhs[p]),
+                           _mm_mul_ps(_mm_loadu_ps(&work->upper[p]),
+                                      lambda_below)));
+}
+
+// strand_apply for particles p to p + 3, lane for lane the same arithmetic
+static void strand_apply4(Cloth *cloth, const StrandWork *work, int row,
+                          int p) {
+  int cols = cloth->tmpl->grid_cols;
+  int rows = cloth->tmpl->grid_rows;
+  int q = p - cols;
+  __m128 move[3];
+  if (row == 0) {
+    __m128 lambda = _mm_xor_ps(_mm_loadu_ps(&work->rhs[p]), _mm_set1_ps(-0.0f));
+    move[0] = _mm_mul_ps(_mm_loadu_ps(&work->ux[p]), lambda);
+    move[1] = _mm_mul_ps(_mm_loadu_ps(&work->uy[p]), lambda);
+    move[2] = _mm_mul_ps(_mm_loadu_ps(&work->uz[p]), lambda);
+  } else if (row == rows - 1) {
+    __m128 lambda = _mm_loadu_ps(&work->rhs[q]);
+    move[0] = _mm_mul_ps(_mm_loadu_ps(&work->ux[q]), lambda);
+    move[1] = _mm_mul_ps(_mm_loadu_ps(&work->uy[q]), lambda);
+    move[2] = _mm_mul_ps(_mm_loadu_ps(&work->uz[q]), lambda);
+  } else {
+    __m128 above[3] = {_mm_loadu_ps(&work->ux[q]), _mm_loadu_ps(&work->uy[q]),
+                       _mm_loadu_ps(&work->uz[q])};
+    __m128 below[3] = {_mm_loadu_ps(&work->ux[p]), _mm_loadu_ps(&work->uy[p]),
+                       _mm_loadu_ps(&work->uz[p])};
+    __m128 lambda_above = _mm_loadu_ps(&work->rhs[q]);
+    __m128 lambda_below = _mm_loadu_ps(&work->rhs[p]);
+    __m128 half = _mm_set1_ps(0.5f);
+    __m128 along = _mm_mul_ps(half, _mm_sub_ps(lambda_above, lambda_below));
+    __m128 limit =
+        _mm_set1_ps(STRAND_MAX_TENSION * cloth->tmpl->grid_spacing);
+    __m128 tension =
+        _mm_min_ps(_mm_max_ps(_mm_mul_ps(half, _mm_add_ps(lambda_above,
+                                                          lambda_below)),
+                              _mm_xor_ps(limit, _mm_set1_ps(-0.0f))),
+                   limit);
+    for (int k = 0; k < 3; k++) {
+      move[k] = _mm_add_ps(
+          _mm_mul_ps(_mm_add_ps(above[k], below[k]), along),
+          _mm_mul_ps(_mm_sub_ps(above[k], below[k]), tension));
+    }
+  }
+  float step[3][4];
+  for (int k = 0; k < 3; k++) {
+    _mm_storeu_ps(step[k], move[k]);
+  }
+  for (int k = 0; k < 4; k++) {
+    if (!cloth->pinned[p + k])
+      cloth->position[p + k] =
+          Vector3Add(cloth->position[p + k],
+                     (Vector3){step[0][k], step[1][k], step[2][k]});
+  }
+}
+#endif
+
+// one Gauss-Seidel sweep down strands [first, end)
+static void relax_strands(Cloth *cloth, int first, int end) {
+  Vector3 *position = cloth->position;
+  const bool *pinned = cloth->pinned;
+  int cols = cloth->tmpl->grid_cols;
+  int rows = cloth->tmpl->grid_rows;
+  float rest_length = cloth->tmpl->grid_spacing;
+#ifdef CLOTH_SSE
+  __m128 rest4 = _mm_set1_ps(rest_length);
+#endif
+
+  for (int y = 0; y < rows - 1; y++) {
+    int row = y * cols;
+    int x = first;
+#ifdef CLOTH_SSE
+    for (; x + 4 <= end; x += 4) {
+      int p1[4] = {row + x, row + x + 1, row + x + 2, row + x + 3};
+      int p2[4] = {p1[0] + cols, p1[1] + cols, p1[2] + cols, p1[3] + cols};
+      const float *weights[4] = {
+          link_weights(pinned, p1[0], p2[0]),
+          link_weights(pinned, p1[1], p2[1]),
+          link_weights(pinned, p1[2], p2[2]),
+          link_weights(pinned, p1[3], p2[3])};
+      solve_distance4(position, p1, p2, rest4, weights, false);
+    }
+#endif
+    for (; x < end; x++) {
+      int p1 = row + x;
+      solve_distance(position, p1, p1 + cols, rest_length,
+                     link_weights(pinned, p1, p1 + cols), false);
+    }
+  }
+}
+
+// strands [first, end), independent of each other
+static void solve_strands(Cloth *cloth, int first, int end) {
+  int cols = cloth->tmpl->grid_cols;
+  int rows = cloth->tmpl->grid_rows;
+  StrandWork work = strand_work(cloth);
+
+  for (int y = 0; y < rows - 1; y++) {
+    int row = y * cols;
+    int x = first;
+#ifdef CLOTH_SSE
+    for (; x + 4 <= end; x += 4) {
+      strand_forward4(cloth, &work, y, row + x);
+    }
+#endif
+    for (; x < end; x++) {
+      strand_forward(cloth, &work, y, row + x);
+    }
+  }
+
+  for (int y = rows - 2; y >= 0; y--) {
+    int row = y * cols;
+    bool last = y == rows - 2;
+    int x = first;
+#ifdef CLOTH_SSE
+    for (; x + 4 <= end; x += 4) {
+      __m128 below = last ? _mm_setzero_ps()
+                          : _mm_loadu_ps(&work.rhs[row + cols + x]);
+      // the last link has nothing below it, its slot still holds a pivot
+      if (last)
+        _mm_storeu_ps(&work.upper[row + x], below);
+      strand_back4(&work, row + x, below);
+    }
+#endif
+    for (; x < end; x++) {
+      float below = last ? 0.0f : work.rhs[row + cols + x];
+      if (last)
+        work.upper[row + x] = 0.0f;
+      strand_back(&work, row + x, below);
+    }
+  }
+
+  for (int y = 0; y < rows; y++) {
+    int row = y * cols;
+    int x = first;
+#ifdef CLOTH_SSE
+    for (; x + 4 <= end; x += 4) {
+      strand_apply4(cloth, &work, y, row + x);
+    }
+#endif
+    for (; x < end; x++) {
+      strand_apply(cloth, &work, y, row + x);
+    }
+  }
+  relax_strands(cloth, first, end);
+}
+
+// Ragdolls. Every ragdoll has the same links in the same order, relaxed
+// one after another like the paper's stick constraints, and an angle limit
+// is the paper's inequality constraint on the distance between the outer
+// joints, clamped instead of pulled to a rest length. Ragdolls never share
+// a joint, so link l is applied to four of them at once with SSE. Joint j of
+// neighboring ragdolls are neighboring particles, and ragdolls are solved in
+// chunks small enough that a chunk's joints stay in cache over all links.
+// With SSE a chunk is copied into structure of arrays first, so the packed
+// Vector3 shuffles are paid once per joint instead of twice per link.
+
+#define RAGDOLL_CHUNK 64
+
+// link l of ragdoll r
+static void solve_ragdoll_link(Cloth *cloth, int l, int r) {
+  const ClothTemplate *tmpl = cloth->tmpl;
+  int cols = tmpl->grid_cols;
+  int a = tmpl->links[l].a * cols + r;
+  int b = tmpl->links[l].b * cols + r;
+  float lo = tmpl->link_range[2 * l * cols + r];
+  float hi = tmpl->link_range[(2 * l + 1) * cols + r];
+  Vector3 *position = cloth->position;
+
+  Vector3 d = Vector3Subtract(position[b], position[a]);
+  float length = sqrtf(d.x * d.x + d.y * d.y + d.z * d.z);
+  float target = fminf(fmaxf(length, lo), hi);
+  float wa = cloth->pinned[a] ? 0.0f : 1.0f;
+  float wb = cloth->pinned[b] ? 0.0f : 1.0f;
+  float den = length * (wa + wb);
+  float s = (length - target) * (den > 0.0f ? 1.0f / den : 0.0f);
+  position[a] = Vector3Add(position[a], Vector3Scale(d, wa * s));
+  position[b] = Vector3Subtract(position[b], Vector3Scale(d, wb * s));
+}
+
+#ifdef CLOTH_SSE
+// Particles p to p + 3 into x, y and z lanes. Four packed Vector3 are three
+// whole registers, shuffled instead of gathered a float at a time.
+static inline void load_vector3x4(const Vector3 *position, int p,
+                                  __m128 v[3]) {
+  const float *f = &position[p].x;
+  __m128 m0 = _mm_loadu_ps(f);     // x0 y0 z0 x1
+  __m128 m1 = _mm_loadu_ps(f + 4); // y1 z1 x2 y2
+  __m128 m2 = _mm_loadu_ps(f + 8); // z2 x3 y3 z3
+  __m128 a = _mm_shuffle_ps(m0, m1, _MM_SHUFFLE(1, 0, 3, 0)); // x0 x1 y1 z1
+  __m128 b = _mm_shuffle_ps(m1, m2, _MM_SHUFFLE(1, 0, 3, 2)); // x2 y2 z2 x3
+  v[0] = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 0, 1, 0));
+  v[1] = _mm_shuffle_ps(_mm_shuffle_ps(m0, a, _MM_SHUFFLE(2, 2, 1, 1)),
+                        _mm_shuffle_ps(b, m2, _MM_SHUFFLE(2, 2, 1, 1)),
+                        _MM_SHUFFLE(2, 0, 2, 0));
+  v[2] = _mm_shuffle_ps(_mm_shuffle_ps(m0, m1, _MM_SHUFFLE(1, 1, 2, 2)),
+                        _mm_shuffle_ps(m2, m2, _MM_SHUFFLE(3, 3, 0, 0)),
+                        _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+static inline void store_vector3x4(Vector3 *position, int p,
+                                   const __m128 v[3]) {
+  float *f = &position[p].x;
+  __m128 xy01 = _mm_unpacklo_ps(v[0], v[1]); // x0 y0 x1 y1
+  __m128 xy23 = _mm_unpackhi_ps(v[0], v[1]); // x2 y2 x3 y3
+  __m128 zx01 = _mm_shuffle_ps(v[2], v[0], _MM_SHUFFLE(1, 1, 0, 0));
+  __m128 yz1 = _mm_shuffle_ps(v[1], v[2], _MM_SHUFFLE(1, 1, 1, 1));
+  __m128 zx23 = _mm_shuffle_ps(v[2], v[0], _MM_SHUFFLE(3, 3, 2, 2));
+  __m128 yz3 = _mm_shuffle_ps(v[1], v[2], _MM_SHUFFLE(3, 3, 3, 3));
+  _mm_storeu_ps(f, _mm_shuffle_ps(xy01, zx01, _MM_SHUFFLE(2, 0, 1, 0)));
+  _mm_storeu_ps(f + 4, _mm_shuffle_ps(yz1, xy23, _MM_SHUFFLE(1, 0, 2, 0)));
+  _mm_storeu_ps(f + 8, _mm_shuffle_ps(zx23, yz3, _MM_SHUFFLE(2, 0, 2, 0)));
+}
+
+// Link with range [lo, hi] between joints xa and xb of four ragdolls, x, y
+// and z lanes, lane for lane the arithmetic of solve_ragdoll_link
+static inline void relax_ragdoll_link4(__m128 xa[3], __m128 xb[3], __m128 lo,
+                                       __m128 hi, __m128 wa, __m128 wb) {
+  __m128 d[3];
+  for (int k = 0; k < 3; k++) {
+    d[k] = _mm_sub_ps(xb[k], xa[k]);
+  }
+  __m128 length = _mm_sqrt_ps(
+      _mm_add_ps(_mm_add_ps(_mm_mul_ps(d[0], d[0]), _mm_mul_ps(d[1], d[1])),
+                 _mm_mul_ps(d[2], d[2])));
+  __m128 target = _mm_min_ps(_mm_max_ps(length, lo), hi);
+  __m128 den = _mm_mul_ps(length, _mm_add_ps(wa, wb));
+  __m128 s = _mm_mul_ps(_mm_sub_ps(length, target), safe_rcp4(den));
+  __m128 ka = _mm_mul_ps(wa, s);
+  __m128 kb = _mm_mul_ps(wb, s);
+  for (int k = 0; k < 3; k++) {
+    xa[k] = _mm_add_ps(xa[k], _mm_mul_ps(d[k], ka));
+    xb[k] = _mm_sub_ps(xb[k], _mm_mul_ps(d[k], kb));
+  }
+}
+
+// solve_ragdoll_link for ragdolls r to r + 3
+static void solve_ragdoll_link4(Cloth *cloth, int l, int r) {
+  const ClothTemplate *tmpl = cloth->tmpl;
+  int cols = tmpl->grid_cols;
+  int a = tmpl->links[l].a * cols + r;
+  int b = tmpl->links[l].b * cols + r;
+  __m128 lo = _mm_loadu_ps(&tmpl->link_range[2 * l * cols + r]);
+  __m128 hi = _mm_loadu_ps(&tmpl->link_range[(2 * l + 1) * cols + r]);
+
+  __m128 xa[3];
+  __m128 xb[3];
+  load_vector3x4(cloth->position, a, xa);
+  load_vector3x4(cloth->position, b, xb);
+  relax_ragdoll_link4(xa, xb, lo, hi, strand_weights(cloth->pinned, a),
+                      strand_weights(cloth->pinned, b));
+  store_vector3x4(cloth->position, a, xa);
+  store_vector3x4(cloth->position, b, xb);
+}
+
+// floats per coordinate of the structure of arrays copy of a chunk
+#define RAGDOLL_SOA_FLOATS 2048
+
+// Every link of ragdolls [first, end), a multiple of four of them, on a
+// structure of arrays copy: joint j of ragdoll first + k at j * width + k,
+// with the weights of the joints alongside
+static void solve_ragdolls_soa(Cloth *cloth, int first, int end) {
+  const ClothTemplate *tmpl = cloth->tmpl;
+  int cols = tmpl->grid_cols;
+  int joints = tmpl->grid_rows;
+  int width = end - first;
+  float x[3][RAGDOLL_SOA_FLOATS];
+  float w[RAGDOLL_SOA_FLOATS];
+
+  for (int j = 0; j < joints; j++) {
+    for (int k = 0; k < width; k += 4) {
+      int p = j * cols + first + k;
+      __m128 v[3];
+      load_vector3x4(cloth->position, p, v);
+      for (int a = 0; a < 3; a++) {
+        _mm_storeu_ps(&x[a][j * width + k], v[a]);
+      }
+      _mm_storeu_ps(&w[j * width + k], strand_weights(cloth->pinned, p));
+    }
+  }
+
+  for (int l = 0; l < tmpl->link_count; l++) {
+    int a = tmpl->links[l].a * width;
+    int b = tmpl->links[l].b * width;
+    const float *lo = &tmpl->link_range[2 * l * cols + first];
+    const float *hi = &tmpl->link_range[(2 * l + 1) * cols + first];
+    for (int k = 0; k < width; k += 4) {
+      __m128 xa[3];
+      __m128 xb[3];
+      for (int c = 0; c < 3; c++) {
+        xa[c] = _mm_loadu_ps(&x[c][a + k]);
+        xb[c] = _mm_loadu_ps(&x[c][b + k]);
+      }
+      relax_ragdoll_link4(xa, xb, _mm_loadu_ps(&lo[k]), _mm_loadu_ps(&hi[k]),
+                          _mm_loadu_ps(&w[a + k]), _mm_loadu_ps(&w[b + k]));
+      for (int c = 0; c < 3; c++) {
+        _mm_storeu_ps(&x[c][a + k], xa[c]);
+        _mm_storeu_ps(&x[c][b + k], xb[c]);
+      }
+    }
+  }
+
+  for (int j = 0; j < joints; j++) {
+    for (int k = 0; k < width; k += 4) {
+      __m128 v[3];
+      for (int a = 0; a < 3; a++) {
+        v[a] = _mm_loadu_ps(&x[a][j * width + k]);
+      }
+      store_vector3x4(cloth->position, j * cols + first + k, v);
+    }
+  }
+}
+#endif
+
+// ragdolls [first, end), independent of each other
+static void solve_ragdolls(Cloth *cloth, int first, int end) {
+  int link_count = cloth->tmpl->link_count;
+  int chunk_size = RAGDOLL_CHUNK;
+#ifdef CLOTH_SSE
+  // whole fours of ragdolls, as many per chunk as the copy has room for;
+  // skeletons too big for four go link by link
+  int joints = cloth->tmpl->grid_rows;
+  int soa_width = joints > 0 ? RAGDOLL_SOA_FLOATS / joints / 4 * 4 : 0;
+  if (soa_width > RAGDOLL_CHUNK)
+    soa_width = RAGDOLL_CHUNK;
+  if (soa_width >= 4)
+    chunk_size = soa_width;
+#endif
+  for (int chunk = first; chunk < end; chunk += chunk_size) {
+    int chunk_end = chunk + chunk_size < end ? chunk + chunk_size : end;
+    int start = chunk;
+#ifdef CLOTH_SSE
+    if (soa_width >= 4) {
+      start += (chunk_end - chunk) / 4 * 4;
+      solve_ragdolls_soa(cloth, chunk, start);
+    }
+#endif
+    for (int l = 0; l < link_count; l++) {
+      int r = start;
+#ifdef CLOTH_SSE
+      for (; r + 4 <= chunk_end; r += 4) {
+        solve_ragdoll_link4(cloth, l, r);
+      }
+#endif
+      for (; r < chunk_end; r++) {
+        solve_ragdoll_link(cloth, l, r);
+      }
+    }
+  }
+}
+
+// Global solve of the explicit constraints (see GlobalSolve)
+
+// Keeps J W J^T positive definite where constraints are redundant or both
+// of their particles are pinned
+#define GLOBAL_REGULARIZATION 1e-6
+// Far from rest the linearization can't be trusted. Steps moving the
+// particles of a constraint by more than this share of its rest length are
+// damped.
+#define GLOBAL_MAX_MOVE 0.5
+#define GLOBAL_DAMPING_GROWTH 100.0
+#define GLOBAL_MAX_DAMPING 10.0
+
+// Orders and lays out the factor for the current constraints and lists which
+// of them are coupled through which particle
+static bool build_global_solve(Cloth *cloth) {
+  GlobalSolve *global = &cloth->global;
+  const Constraint *constraints = cloth->tmpl->constraints;
+  int n = cloth->tmpl->constraint_count;
+  int particles = cloth->particle_count;
+  arena_reset(&global->arena);
+  if (n == 0)
+    return true;
+
+  // constraints at every particle, then every constraint's neighbors
+  ArenaMark mark = arena_mark(&cloth->scratch);
+  int *first = arena_alloc_zero(&cloth->scratch, sizeof(int) * (particles + 1));
+  int *cursor = arena_alloc(&cloth->scratch, sizeof(int) * particles);
+  int *incident = arena_alloc(&cloth->scratch, sizeof(int) * 2 * n);
+  int *start = arena_alloc(&cloth->scratch, sizeof(int) * (n + 1));
+  if (!first || !cursor || !incident || !start) {
+    arena_rewind(&cloth->scratch, mark);
+    return false;
+  }
+  for (int i = 0; i < n; i++) {
+    first[constraints[i].p1 + 1]++;
+    first[constraints[i].p2 + 1]++;
+  }
+  int coupling_count = 0;
+  for (int k = 0; k < particles; k++) {
+    int degree = first[k + 1];
+    coupling_count += degree * (degree - 1) / 2;
+    first[k + 1] += first[k];
+    cursor[k] = first[k];
+  }
+  for (int i = 0; i < n; i++) {
+    incident[cursor[constraints[i].p1]++] = i;
+    incident[cursor[constraints[i].p2]++] = i;
+  }
+  start[0] = 0;
+  for (int i = 0; i < n; i++) {
+    const Constraint *c = &constraints[i];
+    start[i + 1] = start[i] + first[c->p1 + 1] - first[c->p1] - 1 +
+                   first[c->p2 + 1] - first[c->p2] - 1;
+  }
+  int *neighbors = arena_alloc(&cloth->scratch, sizeof(int) * start[n]);
+  if (!neighbors) {
+    arena_rewind(&cloth->scratch, mark);
+    return false;
+  }
+  for (int i = 0; i < n; i++) {
+    int count = start[i];
+    int ends[2] = {constraints[i].p1, constraints[i].p2};
+    for (int e = 0; e < 2; e++) {
+      for (int p = first[ends[e]]; p < first[ends[e] + 1]; p++) {
+        if (incident[p] != i)
+          neighbors[count++] = incident[p];
+      }
+    }
+  }
+
+  global->chol = sparse_cholesky_create(n, start, neighbors);
+  global->couplings =
+      arena_alloc(&global->arena, sizeof(GlobalCoupling) * coupling_count);
+  global->diagonal = arena_alloc(&global->arena, sizeof(int) * n);
+  global->rhs = arena_alloc(&global->arena, sizeof(double) * n);
+  global->lambda = arena_alloc(&global->arena, sizeof(double) * n);
+  global->direction = arena_alloc(&global->arena, sizeof(Vector3) * n);
+  global->move = arena_alloc(&global->arena, sizeof(double) * 3 * particles);
+  global->values =
+      global->chol ? arena_alloc(&global->arena,
+                                 sizeof(double) *
+                                     sparse_cholesky_slot_count(global->chol))
+                   : NULL;
+  bool ok = global->chol && (global->couplings || coupling_count == 0) &&
+            global->diagonal && global->rhs && global->lambda &&
+            global->direction && global->move && global->values;
+  if (ok) {
+    for (int i = 0; i < n; i++) {
+      global->diagonal[i] = sparse_cholesky_slot(global->chol, i, i);
+    }
+    global->coupling_count = 0;
+    for (int k = 0; k < particles; k++) {
+      for (int p = first[k]; p < first[k + 1]; p++) {
+        for (int q = p + 1; q < first[k + 1]; q++) {
+          int a = incident[p];
+          int b = incident[q];
+          // the gradient of a constraint is -u at p1 and u at p2
+          float sign = (constraints[a].p1 == k) == (constraints[b].p1 == k)
+                           ? 1.0f
+                           : -1.0f;
+          global->couplings[global->coupling_count++] = (GlobalCoupling){
+              sparse_cholesky_slot(global->chol, a, b), a, b, k, sign};
+        }
+      }
+    }
+  }
+  arena_rewind(&cloth->scratch, mark);
+  if (!ok)
+    release_global_solve(cloth);
+  return ok;
+}
+
+static bool update_global_solve(Cloth *cloth) {
+  if (cloth->global.chol || cloth->tmpl->constraint_count == 0)
+    return true;
+  return build_global_solve(cloth);
+}
+
+// Moves of the particles from the damped system
+// (J W J^T + damping I) lambda = rhs, false when it doesn't factor or
+// moves some particle too far
+static bool solve_global_damped(Cloth *cloth, double damping) {
+  GlobalSolve *global = &cloth->global;
+  const Constraint *constraints = cloth->tmpl->constraints;
+  const bool *pinned = cloth->pinned;
+  int n = cloth->tmpl->constraint_count;
+  for (int i = 0; i < n; i++) {
+    global->values[global->diagonal[i]] += damping;
+  }
+  bool factored = sparse_cholesky_factor(global->chol, global->values);
+  for (int i = 0; i < n; i++) {
+    global->values[global->diagonal[i]] -= damping;
+  }
+  if (!factored)
+    return false;
+
+  memcpy(global->lambda, global->rhs, sizeof(double) * n);
+  sparse_cholesky_solve(global->chol, global->lambda);
+  // along a taut row the multipliers grow huge but cancel out at every
+  // particle, so the sums are kept in double
+  double *move = global->move;
+  memset(move, 0, sizeof(double) * 3 * cloth->particle_count);
+  for (int i = 0; i < n; i++) {
+    const Constraint *c = &constraints[i];
+    Vector3 u = global->direction[i];
+    double lambda = global->lambda[i];
+    if (!pinned[c->p1]) {
+      move[3 * c->p1] -= u.x * lambda;
+      move[3 * c->p1 + 1] -= u.y * lambda;
+      move[3 * c->p1 + 2] -= u.z * lambda;
+    }
+    if (!pinned[c->p2]) {
+      move[3 * c->p2] += u.x * lambda;
+      move[3 * c->p2 + 1] += u.y * lambda;
+      move[3 * c->p2 + 2] += u.z * lambda;
+    }
+  }
+  for (int i = 0; i < n; i++) {
+    double limit = GLOBAL_MAX_MOVE * constraints[i].rest_length;
+    const double *a = &move[3 * constraints[i].p1];
+    const double *b = &move[3 * constraints[i].p2];
+    if (a[0] * a[0] + a[1] * a[1] + a[2] * a[2] > limit * limit ||
+        b[0] * b[0] + b[1] * b[1] + b[2] * b[2] > limit * limit)
+      return false;
+  }
+  return true;
+}
+
+// One Newton step over all explicit constraints. Steps that go too far are
+// damped Levenberg-Marquardt style, raising the damping until the step is
+// small enough, and the step falls back to a relaxation pass when even the
+// most damped one isn't.
+static void solve_global(Cloth *cloth) {
+  GlobalSolve *global = &cloth->global;
+  if (!global->chol)
+    return;
+  const Constraint *constraints = cloth->tmpl->constraints;
+  int n = cloth->tmpl->constraint_count;
+  Vector3 *position = cloth->position;
+  const bool *pinned = cloth->pinned;
+  double *values = global->values;
+
+  memset(values, 0,
+         sizeof(double) * sparse_cholesky_slot_count(global->chol));
+  for (int i = 0; i < n; i++) {
+    const Constraint *c = &constraints[i];
+    Vector3 delta = Vector3Subtract(position[c->p2], position[c->p1]);
+    float length = Vector3Length(delta);
+    global->direction[i] = length > 0.0f
+                               ? Vector3Scale(delta, 1.0f / length)
+                               : (Vector3){0, 0, 0};
+    global->rhs[i] = c->rest_length - length;
+    values[global->diagonal[i]] =
+        (pinned[c->p1] ? 0.0 : 1.0) + (pinned[c->p2] ? 0.0 : 1.0);
+  }
+  for (int i = 0; i < global->coupling_count; i++) {
+    const GlobalCoupling *coupling = &global->couplings[i];
+    if (!pinned[coupling->k])
+      values[coupling->slot] +=
+          coupling->sign * Vector3DotProduct(global->direction[coupling->a],
+                                             global->direction[coupling->b]);
+  }
+
+  double damping = GLOBAL_REGULARIZATION;
+  while (!solve_global_damped(cloth, damping)) {
+    damping *= GLOBAL_DAMPING_GROWTH;
+    if (damping > GLOBAL_MAX_DAMPING) {
+      satisfy_explicit_constraints(cloth, false);
+      return;
+    }
+  }
+
+  const double *move = global->move;
+  for (int i = 0; i < cloth->particle_count; i++) {
+    position[i].x += (float)move[3 * i];
+    position[i].y += (float)move[3 * i + 1];
+    position[i].z += (float)move[3 * i + 2];
+  }
+}
+
+// Shape matching (Mueller et al. 2005). A cluster's goal is its rest shape
+// rotated by the rotation R that best maps it onto where its particles are,
+// the rotational part of A = sum (x_i - c) q_i^T with c the current center
+// and q_i the rest offsets. R is found as in Mueller et al. 2016, rotating
+// towards sum R_j x A_j over the columns j until it stops turning, starting
+// from the last step's rotation so a few rounds are enough. The rotation
+// vector is turned into a quaternion without trigonometry, which shortens
+// big turns but not their direction, so clusters can be fitted four at a
+// time with SSE.
+
+#define SHAPE_ROTATION_ITERATIONS 3
+
+// row-major rotation matrix of a unit quaternion
+static void quaternion_matrix(Quaternion q, float r[9]) {
+  float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+  float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+  float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+  r[0] = 1.0f - 2.0f * (yy + zz);
+  r[1] = 2.0f * (xy - wz);
+  r[2] = 2.0f * (xz + wy);
+  r[3] = 2.0f * (xy + wz);
+  r[4] = 1.0f - 2.0f * (xx + zz);
+  r[5] = 2.0f * (yz - wx);
+  r[6] = 2.0f * (xz - wy);
+  r[7] = 2.0f * (yz + wx);
+  r[8] = 1.0f - 2.0f * (xx + yy);
+}
+
+// Center of the cluster's particles and A, row-major with element k at
+// a[k * stride]. Pinned particles don't move, so as if infinitely heavy they
+// become the center and the mean of their rest offsets the origin the rest
+// shape turns around, which is zero when nothing is pinned.
+static Vector3 shape_covariance(const Cloth *cloth,
+                                const ShapeCluster *cluster, float *a,
+                                int stride, Vector3 *origin) {
+  const int *particles = &cloth->cluster_particles[cluster->first];
+  const Vector3 *rest = &cloth->cluster_rest[cluster->first];
+  Vector3 center = {0, 0, 0};
+  Vector3 pinned_center = {0, 0, 0};
+  Vector3 pinned_origin = {0, 0, 0};
+  int pinned = 0;
+  for (int i = 0; i < cluster->count; i++) {
+    Vector3 x = cloth->position[particles[i]];
+    center = Vector3Add(center, x);
+    if (cloth->pinned[particles[i]]) {
+      pinned_center = Vector3Add(pinned_center, x);
+      pinned_origin = Vector3Add(pinned_origin, rest[i]);
+      pinned++;
+    }
+  }
+  center = Vector3Scale(center, 1.0f / cluster->count);
+  *origin = (Vector3){0, 0, 0};
+  if (pinned > 0) {
+    center = Vector3Scale(pinned_center, 1.0f / pinned);
+    *origin = Vector3Scale(pinned_origin, 1.0f / pinned);
+  }
+
+  float sum[9] = {0};
+  for (int i = 0; i < cluster->count; i++) {
+    Vector3 d = Vector3Subtract(cloth->position[particles[i]], center);
+    Vector3 q = Vector3Subtract(rest[i], *origin);
+    sum[0] += d.x * q.x;
+    sum[1] += d.x * q.y;
+    sum[2] += d.x * q.z;
+    sum[3] += d.y * q.x;
+    sum[4] += d.y * q.y;
+    sum[5] += d.y * q.z;
+    sum[6] += d.z * q.x;
+    sum[7] += d.z * q.y;
+    sum[8] += d.z * q.z;
+  }
+  for (int k = 0; k < 9; k++) {
+    a[k * stride] = sum[k];
+  }
+  return center;
+}
+
+static void fit_rotation(const float a[9], Quaternion *rotation) {
+  Quaternion q = *rotation;
+  for (int it = 0; it < SHAPE_ROTATION_ITERATIONS; it++) {
+    float r[9];
+    quaternion_matrix(q, r);
+    Vector3 omega = {0, 0, 0};
+    float dot = 0.0f;
+    for (int j = 0; j < 3; j++) {
+      Vector3 rj = {r[j], r[3 + j], r[6 + j]};
+      Vector3 aj = {a[j], a[3 + j], a[6 + j]};
+      omega = Vector3Add(omega, Vector3CrossProduct(rj, aj));
+      dot += Vector3DotProduct(rj, aj);
+    }
+    // half the rotation vector, applied as the quaternion (v, 1)
+    Vector3 v = Vector3Scale(omega, 0.5f / (fabsf(dot) + 1e-9f));
+    Quaternion t = {
+        q.x + v.x * q.w + (v.y * q.z - v.z * q.y),
+        q.y + v.y * q.w + (v.z * q.x - v.x * q.z),
+        q.z + v.z * q.w + (v.x * q.y - v.y * q.x),
+        q.w - (v.x * q.x + v.y * q.y + v.z * q.z),
+    };
+    float scale = 1.0f / sqrtf(t.x * t.x + t.y * t.y + t.z * t.z + t.w * t.w);
+    q = (Quaternion){t.x * scale, t.y * scale, t.z * scale, t.w * scale};
+  }
+  *rotation = q;
+}
+
+#ifdef CLOTH_SSE
+// fit_rotation for four clusters, lane k of a[j] is element j of cluster k's
+// matrix, q holds the quaternions' x, y, z and w
+static void fit_rotation4(const __m128 a[9], __m128 q[4]) {
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 two = _mm_set1_ps(2.0f);
+  for (int it = 0; it < SHAPE_ROTATION_ITERATIONS; it++) {
+    __m128 xx = _mm_mul_ps(q[0], q[0]), yy = _mm_mul_ps(q[1], q[1]);
+    __m128 zz = _mm_mul_ps(q[2], q[2]), xy = _mm_mul_ps(q[0], q[1]);
+    __m128 xz = _mm_mul_ps(q[0], q[2]), yz = _mm_mul_ps(q[1], q[2]);
+    __m128 wx = _mm_mul_ps(q[3], q[0]), wy = _mm_mul_ps(q[3], q[1]);
+    __m128 wz = _mm_mul_ps(q[3], q[2]);
+    __m128 r[9] = {
+        _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))),
+        _mm_mul_ps(two, _mm_sub_ps(xy, wz)),
+        _mm_mul_ps(two, _mm_add_ps(xz, wy)),
+        _mm_mul_ps(two, _mm_add_ps(xy, wz)),
+        _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))),
+        _mm_mul_ps(two, _mm_sub_ps(yz, wx)),
+        _mm_mul_ps(two, _mm_sub_ps(xz, wy)),
+        _mm_mul_ps(two, _mm_add_ps(yz, wx)),
+        _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))),
+    };
+    __m128 omega[3] = {_mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps()};
+    __m128 dot = _mm_setzero_ps();
+    for (int j = 0; j < 3; j++) {
+      __m128 rj[3] = {r[j], r[3 + j], r[6 + j]};
+      __m128 aj[3] = {a[j], a[3 + j], a[6 + j]};
+      __m128 c[3];
+      cross4(rj, aj, c);
+      for (int k = 0; k < 3; k++) {
+        omega[k] = _mm_add_ps(omega[k], c[k]);
+      }
+      dot = _mm_add_ps(dot, dot4(rj, aj));
+    }
+    __m128 abs_dot = _mm_andnot_ps(_mm_set1_ps(-0.0f), dot);
+    __m128 s = _mm_div_ps(_mm_set1_ps(0.5f),
+                          _mm_add_ps(abs_dot, _mm_set1_ps(1e-9f)));
+    __m128 v[3] = {_mm_mul_ps(omega[0], s), _mm_mul_ps(omega[1], s),
+                   _mm_mul_ps(omega[2], s)};
+    __m128 t[4] = {
+        _mm_add_ps(_mm_add_ps(q[0], _mm_mul_ps(v[0], q[3])),
+                   _mm_sub_ps(_mm_mul_ps(v[1], q[2]), _mm_mul_ps(v[2], q[1]))),
+        _mm_add_ps(_mm_add_ps(q[1], _mm_mul_ps(v[1], q[3])),
+                   _mm_sub_ps(_mm_mul_ps(v[2], q[0]), _mm_mul_ps(v[0], q[2]))),
+        _mm_add_ps(_mm_add_ps(q[2], _mm_mul_ps(v[2], q[3])),
+                   _mm_sub_ps(_mm_mul_ps(v[0], q[1]), _mm_mul_ps(v[1], q[0]))),
+        _mm_sub_ps(q[3], dot4(v, q)),
+    };
+    __m128 length_sq = _mm_add_ps(dot4(t, t), _mm_mul_ps(t[3], t[3]));
+    __m128 scale = _mm_div_ps(one, _mm_sqrt_ps(length_sq));
+    for (int k = 0; k < 4; k++) {
+      q[k] = _mm_mul_ps(t[k], scale);
+    }
+  }
+}
+#endif
+
+// Pulls the particles towards the fitted shape, after moving the rest shape
+// of a plastic cluster towards the current one
+static void apply_shape(Cloth *cloth, ShapeCluster *cluster, Vector3 center,
+                        Vector3 origin) {
+  const int *particles = &cloth->cluster_particles[cluster->first];
+  Vector3 *rest = &cloth->cluster_rest[cluster->first];
+  Vector3 *position = cloth->position;
+  float r[9];
+  quaternion_matrix(cluster->rotation, r);
+
+  if (cluster->creep > 0.0f) {
+    // deviation from the rest shape in the cluster's frame, R^T (x - c) - q
+    float deviation_sq = 0.0f;
+    float size_sq = 0.0f;
+    for (int i = 0; i < cluster->count; i++) {
+      Vector3 d = Vector3Subtract(position[particles[i]], center);
+      Vector3 local = {origin.x + r[0] * d.x + r[3] * d.y + r[6] * d.z,
+                       origin.y + r[1] * d.x + r[4] * d.y + r[7] * d.z,
+                       origin.z + r[2] * d.x + r[5] * d.y + r[8] * d.z};
+      deviation_sq += Vector3LengthSqr(Vector3Subtract(local, rest[i]));
+      size_sq += Vector3LengthSqr(rest[i]);
+    }
+    if (deviation_sq > cluster->yield * cluster->yield * size_sq) {
+      Vector3 mean = {0, 0, 0};
+      for (int i = 0; i < cluster->count; i++) {
+        Vector3 d = Vector3Subtract(position[particles[i]], center);
+        Vector3 local = {origin.x + r[0] * d.x + r[3] * d.y + r[6] * d.z,
+                         origin.y + r[1] * d.x + r[4] * d.y + r[7] * d.z,
+                         origin.z + r[2] * d.x + r[5] * d.y + r[8] * d.z};
+        rest[i] = Vector3Lerp(rest[i], local, cluster->creep);
+        mean = Vector3Add(mean, rest[i]);
+      }
+      // keep the rest offsets around their center, the frame moves instead
+      mean = Vector3Scale(mean, 1.0f / cluster->count);
+      for (int i = 0; i < cluster->count; i++) {
+        rest[i] = Vector3Subtract(rest[i], mean);
+      }
+      origin = Vector3Subtract(origin, mean);
+    }
+  }
+
+  for (int i = 0; i < cluster->count; i++) {
+    int p = particles[i];
+    if (cloth->pinned[p])
+      continue;
+    Vector3 q = Vector3Subtract(rest[i], origin);
+    Vector3 goal = {center.x + r[0] * q.x + r[1] * q.y + r[2] * q.z,
+                    center.y + r[3] * q.x + r[4] * q.y + r[5] * q.z,
+                    center.z + r[6] * q.x + r[7] * q.y + r[8] * q.z};
+    position[p] = Vector3Lerp(position[p], goal, cluster->stiffness);
+  }
+}
+
+// Clusters [first, end). Four at a time are fitted from the same positions
+// before any of them moves particles, clusters sharing particles within a
+// group see each other's previous pass.
+static void match_shapes(Cloth *cloth, int first, int end) {
+  int c = first;
+#ifdef CLOTH_SSE
+  for (; c + 4 <= end; c += 4) {
+    ShapeCluster *group = &cloth->clusters[c];
+    float a[9][4];
+    Vector3 center[4], origin[4];
+    for (int k = 0; k < 4; k++) {
+      center[k] = shape_covariance(cloth, &group[k], &a[0][k], 4, &origin[k]);
+    }
+    __m128 av[9];
+    for (int j = 0; j < 9; j++) {
+      av[j] = _mm_loadu_ps(a[j]);
+    }
+    __m128 q[4];
+    for (int k = 0; k < 4; k++) {
+      q[k] = _mm_loadu_ps(&group[k].rotation.x);
+    }
+    _MM_TRANSPOSE4_PS(q[0], q[1], q[2], q[3]);
+    fit_rotation4(av, q);
+    _MM_TRANSPOSE4_PS(q[0], q[1], q[2], q[3]);
+    for (int k = 0; k < 4; k++) {
+      _mm_storeu_ps(&group[k].rotation.x, q[k]);
+      apply_shape(cloth, &group[k], center[k], origin[k]);
+    }
+  }
+#endif
+  for (; c < end; c++) {
+    ShapeCluster *cluster = &cloth->clusters[c];
+    float a[9];
+    Vector3 origin;
+    Vector3 center = shape_covariance(cloth, cluster, a, 1, &origin);
+    fit_rotation(a, &cluster->rotation);
+    apply_shape(cloth, cluster, center, origin);
+  }
+}
+
+// a particle reached from a pin, kept in a binary min-heap by distance
+typedef struct {
+  float distance;
+  int particle;
+} AnchorVisit;
+
+static void push_visit(AnchorVisit *heap, int *count, AnchorVisit visit) {
+  int i = (*count)++;
+  while (i > 0 && heap[(i - 1) / 2].distance > visit.distance) {
+    heap[i] = heap[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  heap[i] = visit;
+}
+
+static AnchorVisit pop_visit(AnchorVisit *heap, int *count) {
+  AnchorVisit top = heap[0];
+  AnchorVisit last = heap[--*count];
+  int i = 0;
+  for (int child = 1; child < *count; child = 2 * i + 1) {
+    if (child + 1 < *count && heap[child + 1].distance < heap[child].distance)
+      child++;
+    if (heap[child].distance >= last.distance)
+      break;
+    heap[i] = heap[child];
+    i = child;
+  }
+  heap[i] = last;
+  return top;
+}
+
+// Distance to c from a point source da from a and db from b, unfolding the
+// triangle into the plane of a, b and the source. Infinite unless the
+// straight line from the source to c crosses the edge from a to b.
+static float unfold_distance(Vector3 a, Vector3 b, Vector3 c, float da,
+                             float db) {
+  Vector3 ab = Vector3Subtract(b, a);
+  Vector3 ac = Vector3Subtract(c, a);
+  float length = Vector3Length(ab);
+  if (length <= 0.0f)
+    return INFINITY;
+  float cx = Vector3DotProduct(ac, ab) / length;
+  float cy = sqrtf(fmaxf(Vector3DotProduct(ac, ac) - cx * cx, 0.0f));
+  // the source sits on the other side of the edge, rounding may put it a
+  // hair off a source in line with the edge
+  float sx = (da * da - db * db + length * length) / (2.0f * length);
+  float sy = -sqrtf(fmaxf(da * da - sx * sx, 0.0f));
+  if (cy <= 0.0f)
+    return INFINITY;
+  float x = sx - (cx - sx) * sy / (cy - sy);
+  if (x < 0.0f || x > length)
+    return INFINITY;
+  return sqrtf((cx - sx) * (cx - sx) + (cy - sy) * (cy - sy));
+}
+
+// Finds every particle's nearest pin and how far it is along the cloth at
+// rest, with Dijkstra from all pins at once. Grids step through their links
+// and diagonals and, being flat at rest, reach the straight distance to the
+// pin. Meshes step along their sticks and triangle edges, and across
+// triangles like fast marching: a triangle with two corners reached from the
+// same pin is unfolded to find its third corner's straight distance from
+// it, so flat meshes reach about as far as grids while cuts and folds are
+// still gone around.
+static bool update_strain_anchors(Cloth *cloth) {
+  if (cloth->anchors_valid)
+    return true;
+  const ClothTemplate *tmpl = cloth->tmpl;
+  int n = cloth->particle_count;
+  if (n > cloth->anchor_capacity) {
+    int *anchor = arena_realloc(&cloth->arena, cloth->anchor,
+                                sizeof(int) * cloth->anchor_capacity,
+                                sizeof(int) * n);
+    if (!anchor)
+      return false;
+    cloth->anchor = anchor;
+    float *reach = arena_realloc(&cloth->arena, cloth->anchor_reach,
+                                 sizeof(float) * cloth->anchor_capacity,
+                                 sizeof(float) * n);
+    if (!reach)
+      return false;
+    cloth->anchor_reach = reach;
+    cloth->anchor_capacity = n;
+  }
+
+  // a mesh's sticks then its triangle edges as links, the links and
+  // triangles at every particle, and a heap entry per pin and per way a
+  // particle can be reached
+  bool grid = tmpl->topology == CLOTH_TOPOLOGY_GRID;
+  int sticks = grid ? 0 : tmpl->constraint_count;
+  int triangles = grid ? 0 : tmpl->triangle_count;
+  int links = sticks + 3 * triangles;
+  size_t visits = (size_t)n + 2 * (size_t)links + 6 * (size_t)triangles;
+  if (grid)
+    visits = 9 * (size_t)n;
+  ArenaMark mark = arena_mark(&cloth->scratch);
+  float *distance = arena_alloc(&cloth->scratch, sizeof(float) * n);
+  bool *settled = arena_alloc_zero(&cloth->scratch, sizeof(bool) * n);
+  int *first = arena_alloc_zero(&cloth->scratch, sizeof(int) * (n + 1));
+  int *first_triangle =
+      arena_alloc_zero(&cloth->scratch, sizeof(int) * (n + 1));
+  int *ends = arena_alloc(&cloth->scratch, sizeof(int) * 2 * links);
+  int *incident = arena_alloc(&cloth->scratch, sizeof(int) * 2 * links);
+  int *corner_of = arena_alloc(&cloth->scratch, sizeof(int) * 3 * triangles);
+  AnchorVisit *heap =
+      arena_alloc(&cloth->scratch, sizeof(AnchorVisit) * visits);
+  if (!distance || !settled || !first || !first_triangle || !heap ||
+      (links > 0 && (!ends || !incident || (triangles > 0 && !corner_of)))) {
+    arena_rewind(&cloth->scratch, mark);
+    return false;
+  }
+  for (int i = 0; i < links; i++) {
+    if (i < sticks) {
+      ends[2 * i] = tmpl->constraints[i].p1;
+      ends[2 * i + 1] = tmpl->constraints[i].p2;
+    } else {
+      const int *p = tmpl->triangles[(i - sticks) / 3].p;
+      ends[2 * i] = p[(i - sticks) % 3];
+      ends[2 * i + 1] = p[((i - sticks) % 3 + 1) % 3];
+      first_triangle[ends[2 * i] + 1]++;
+    }
+    first[ends[2 * i] + 1]++;
+    first[ends[2 * i + 1] + 1]++;
+  }
+  for (int k = 0; k < n; k++) {
+    first[k + 1] += first[k];
+    first_triangle[k + 1] += first_triangle[k];
+  }
+  for (int i = 0; i < links; i++) {
+    incident[first[ends[2 * i]]++] = i;
+    incident[first[ends[2 * i + 1]]++] = i;
+    if (i >= sticks)
+      corner_of[first_triangle[ends[2 * i]]++] = (i - sticks) / 3;
+  }
+  // filling moved every start to the next particle's
+  for (int k = n; k > 0; k--) {
+    first[k] = first[k - 1];
+    first_triangle[k] = first_triangle[k - 1];
+  }
+  first[0] = 0;
+  first_triangle[0] = 0;
+
+  int *anchor = cloth->anchor;
+  const Vector3 *rest = tmpl->rest_position;
+  int count = 0;
+  for (int i = 0; i < n; i++) {
+    distance[i] = cloth->pinned[i] ? 0.0f : INFINITY;
+    anchor[i] = cloth->pinned[i] ? i : -1;
+    if (cloth->pinned[i])
+      push_visit(heap, &count, (AnchorVisit){0.0f, i});
+  }
+  int cols = tmpl->grid_cols;
+  int rows = tmpl->grid_rows;
+  float spacing = tmpl->grid_spacing;
+  while (count > 0) {
+    int v = pop_visit(heap, &count).particle;
+    if (settled[v])
+      continue;
+    settled[v] = true;
+    int degree = grid ? 9 : first[v + 1] - first[v];
+    for (int k = 0; k < degree; k++) {
+      int u;
+      float length;
+      if (grid) {
+        int x = v % cols + k % 3 - 1;
+        int y = v / cols + k / 3 - 1;
+        if (k == 4 || x < 0 || x >= cols || y < 0 || y >= rows)
+          continue;
+        u = y * cols + x;
+        length = k % 2 ? spacing : spacing * 1.41421356f;
+      } else {
+        int link = incident[first[v] + k];
+        u = ends[2 * link] == v ? ends[2 * link + 1] : ends[2 * link];
+        length = link < sticks ? tmpl->constraints[link].rest_length
+                               : Vector3Distance(rest[u], rest[v]);
+      }
+      if (distance[v] + length < distance[u]) {
+        distance[u] = distance[v] + length;
+        anchor[u] = anchor[v];
+        push_visit(heap, &count, (AnchorVisit){distance[u], u});
+      }
+    }
+    for (int k = first_triangle[v]; k < first_triangle[v + 1]; k++) {
+      const int *p = tmpl->triangles[corner_of[k]].p;
+      int at = p[0] == v ? 0 : p[1] == v ? 1 : 2;
+      for (int side = 1; side <= 2; side++) {
+        int w = p[(at + side) % 3];
+        int u = p[(at + 3 - side) % 3];
+        if (!settled[w] || settled[u] || anchor[w] != anchor[v])
+          continue;
+        float d = unfold_distance(rest[v], rest[w], rest[u], distance[v],
+                                  distance[w]);
+        if (d < distance[u]) {
+          distance[u] = d;
+          anchor[u] = anchor[v];
+          push_visit(heap, &count, (AnchorVisit){d, u});
+        }
+      }
+    }
+  }
+
+  for (int i = 0; i < n; i++) {
+    if (cloth->pinned[i])
+      anchor[i] = -1;
+    else if (anchor[i] >= 0)
+      cloth->anchor_reach[i] =
+          grid ? Vector3Distance(rest[i], rest[anchor[i]]) : distance[i];
+  }
+  arena_rewind(&cloth->scratch, mark);
+  cloth->anchors_valid = true;
+  return true;
+}
+
+// Holds particles [first, end) within strain_limit times their reach of
+// their anchor, only the particle moves
+static void pull_to_anchors(Cloth *cloth, int first, int end) {
+  Vector3 *position = cloth->position;
+  const int *anchor = cloth->anchor;
+  const float *reach = cloth->anchor_reach;
+  float limit = cloth->strain_limit;
+  for (int i = first; i < end; i++) {
+    if (anchor[i] < 0)
+      continue;
+    Vector3 pin = position[anchor[i]];
+    Vector3 delta = Vector3Subtract(position[i], pin);
+    float length_sq = Vector3DotProduct(delta, delta);
+    float max = reach[i] * limit;
+    if (length_sq > max * max)
+      position[i] =
+          Vector3Add(pin, Vector3Scale(delta, max / sqrtf(length_sq)));
+  }
+}
+
+// Strain limiting. Few iterations leave cloth stretchy and the stretch
+// gathers where it hangs from its pins, a clamp on the sticks alone only
+// carries a correction a stick or two per pass. So every particle is first
+// pulled to within strain_limit times its rest distance of its nearest pin,
+// which takes the weight off the sticks below the pins at once, then one
+// more pass over the sticks in their usual batches shortens those still
+// stretched past strain_limit times their rest length.
+static void limit_strain(Cloth *cloth) {
+  pull_to_anchors(cloth, 0, cloth->particle_count);
+  if (cloth->tmpl->topology == CLOTH_TOPOLOGY_GRID)
+    satisfy_grid_constraints(cloth, true);
+  else
+    satisfy_explicit_constraints(cloth, true);
+}
+
+static bool satisfy_constraints(Cloth *cloth) {
+  ClothTopology topology = cloth->tmpl->topology;
+  if (topology == CLOTH_TOPOLOGY_EXPLICIT && !update_solver_constraints(cloth))
+    return false;
+  if (cloth->strain_limit > 0.0f && !update_strain_anchors(cloth))
+    return false;
+
+  bool global = cloth->global.newton_steps > 0;
+  if (global && !update_global_solve(cloth))
+    return false;
+
+  int iterations = global ? cloth->global.newton_steps : cloth->iterations;
+  for (int j = 0; j < iterations; j++) {
+    if (topology == CLOTH_TOPOLOGY_GRID) {
+      satisfy_grid_constraints(cloth, false);
+      satisfy_grid_stencils(cloth);
+    } else if (topology == CLOTH_TOPOLOGY_STRANDS)
+      solve_strands(cloth, 0, cloth->tmpl->grid_cols);
+    else if (topology == CLOTH_TOPOLOGY_RAGDOLLS)
+      solve_ragdolls(cloth, 0, cloth->tmpl->grid_cols);
+    else if (global)
+      solve_global(cloth);
+    else
+      satisfy_explicit_constraints(cloth, false);
+    satisfy_dihedral_constraints(cloth);
+    satisfy_volume_constraints(cloth);
+    if (j == iterations - 1 && cloth->strain_limit > 0.0f)
+      limit_strain(cloth);
+
+    match_shapes(cloth, 0, cloth->cluster_count);
+    resolve_collisions(cloth, 0, cloth->particle_count);
+  }
+  return true;
+}
+
+// Aerodynamics over triangles. Air at velocity v relative to a triangle of
+// area A and unit normal n facing the air gives
+//   drag: drag * A * (n.v) * v
+//   lift: lift * A * (n.v) * (|v| n - (n.v) v / |v|)
+// so lift is perpendicular to the flow and peaks at 45 degrees. With the
+// area vector c = 2 A n of the triangle's cross product that is
+//   ((drag |c.v| - lift (c.v)^2 / (|c| |v|)) v + lift |v| (c.v) / |c| c) / 2
+// and no normal needs to be flipped or normalized. Each corner takes a third.
+typedef struct {
+  Vector3 air; // air velocity without gusts
+  // coefficients turned into a position change per corner
+  float drag;
+  float lift;
+  // from a sum of three corner displacements to velocity
+  float to_velocity;
+  // gusts, NULL field for none
+  const ClothWindField *field;
+  Vector3 offset;
+  float texels_per_unit;
+  float turbulence;
+} AeroParams;
+
+static AeroParams aero_params(const Cloth *cloth, const ClothForce *force) {
+  float dt = cloth->step_dt;
+  // force to acceleration, the halved c and the third per corner
+  float scale = cloth->tmpl->area_density * dt * dt / 6.0f;
+  AeroParams params = {.air = force->velocity,
+                       .drag = force->drag * scale,
+                       .lift = force->lift * scale,
+                       .to_velocity = dt > 0.0f ? 1.0f / (3.0f * dt) : 0.0f};
+  if (force->field && force->scale > 0.0f) {
+    params.field = force->field;
+    params.offset = gust_offset(cloth, force);
+    params.texels_per_unit = 1.0f / force->scale;
+    params.turbulence = force->turbulence;
+  }
+  return params;
+}
+
+static inline float fast_rsqrt(float x) {
+#ifdef CLOTH_SSE
+  float y = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+#else
+  union {
+    float f;
+    uint32_t i;
+  } bits = {x};
+  bits.i = 0x5f3759df - (bits.i >> 1);
+  float y = bits.f;
+#endif
+  // one Newton step, ~22 bits with the SSE estimate
+  return y * (1.5f - 0.5f * x * y * y);
+}
+
+// corner displacement from the area vector c and the relative air velocity v
+static inline Vector3 aero_force(Vector3 c, Vector3 v, float drag,
+                                 float lift) {
+  float c_sq = Vector3LengthSqr(c);
+  float v_sq = Vector3LengthSqr(v);
+  if (c_sq == 0.0f || v_sq == 0.0f)
+    return (Vector3){0};
+  float cv = Vector3DotProduct(c, v);
+  float inverse_c = fast_rsqrt(c_sq);
+  float inverse_v = fast_rsqrt(v_sq);
+  float along = drag * fabsf(cv) - lift * cv * cv * inverse_c * inverse_v;
+  float across = lift * v_sq * inverse_v * cv * inverse_c;
+  return Vector3Add(Vector3Scale(v, along), Vector3Scale(c, across));
+}
+
+#ifdef CLOTH_SSE
+// fast_rsqrt() in four lanes, same estimate and Newton step
+static inline __m128 fast_rsqrt4(__m128 x) {
+  __m128 y = _mm_rsqrt_ps(x);
+  __m128 half_x_yy =
+      _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), x), y), y);
+  return _mm_mul_ps(y, _mm_sub_ps(_mm_set1_ps(1.5f), half_x_yy));
+}
+
+// aero_force() for four triangles, c, v and out as x, y and z lanes
+static inline void aero_force4(const __m128 c[3], const __m128 v[3],
+                               __m128 drag, __m128 lift, __m128 out[3]) {
+  __m128 c_sq = dot4(c, c);
+  __m128 v_sq = dot4(v, v);
+  __m128 cv = dot4(c, v);
+  __m128 valid = _mm_and_ps(_mm_cmpgt_ps(c_sq, _mm_setzero_ps()),
+                            _mm_cmpgt_ps(v_sq, _mm_setzero_ps()));
+  __m128 inverse_c = fast_rsqrt4(c_sq);
+  __m128 inverse_v = fast_rsqrt4(v_sq);
+  __m128 abs_cv = _mm_andnot_ps(_mm_set1_ps(-0.0f), cv);
+
+  __m128 along = _mm_sub_ps(
+      _mm_mul_ps(drag, abs_cv),
+      _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(_mm_mul_ps(lift, cv), cv), inverse_c),
+                 inverse_v));
+  __m128 across = _mm_mul_ps(
+      _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(lift, v_sq), inverse_v), cv),
+      inverse_c);
+  // degenerate triangles and still air give NaN above
+  along = _mm_and_ps(along, valid);
+  across = _mm_and_ps(across, valid);
+  for (int k = 0; k < 3; k++) {
+    out[k] = _mm_add_ps(_mm_mul_ps(v[k], along), _mm_mul_ps(c[k], across));
+  }
+}
+#endif
+
+// One aerodynamic force on mesh triangles [0, count). Geometry comes from the
+// positions the step started at, velocity from what verlet() made of them.
+// Corners are gathered and scattered per triangle, the force math between
+// runs four triangles at a time.
+static void aero_triangles(Cloth *cloth, const AeroParams *params,
+                           const Triangle *triangles, int count) {
+  const Vector3 *origin = cloth->prev_position;
+  Vector3 *position = cloth->position;
+  const bool *pinned = cloth->pinned;
+
+  Vector3 area[WIND_SAMPLE_CHUNK];
+  Vector3 air[WIND_SAMPLE_CHUNK];
+  Vector3 force[WIND_SAMPLE_CHUNK];
+  Vector3 gusts[WIND_SAMPLE_CHUNK];
+  for (int first = 0; first < count; first += WIND_SAMPLE_CHUNK) {
+    const Triangle *tri = &triangles[first];
+    int n = count - first < WIND_SAMPLE_CHUNK ? count - first
+                                              : WIND_SAMPLE_CHUNK;
+
+    for (int k = 0; k < n; k++) {
+      const int *p = tri[k].p;
+      Vector3 a = origin[p[0]];
+      Vector3 b = origin[p[1]];
+      Vector3 c = origin[p[2]];
+      area[k] =
+          Vector3CrossProduct(Vector3Subtract(b, a), Vector3Subtract(c, a));
+      Vector3 start = Vector3Add(Vector3Add(a, b), c);
+      Vector3 now = Vector3Add(Vector3Add(position[p[0]], position[p[1]]),
+                               position[p[2]]);
+      Vector3 moved = Vector3Subtract(now, start);
+      air[k] = Vector3Subtract(params->air,
+                               Vector3Scale(moved, params->to_velocity));
+      // centroids, in case there are gusts
+      force[k] = Vector3Scale(start, 1.0f / 3.0f);
+    }
+    if (params->field) {
+      cloth_wind_field_sample(params->field, force, n, params->offset,
+                              params->texels_per_unit, gusts);
+      for (int k = 0; k < n; k++) {
+        air[k] = Vector3Add(air[k], Vector3Scale(gusts[k], params->turbulence));
+      }
+    }
+
+    int k = 0;
+#ifdef CLOTH_SSE
+    __m128 drag = _mm_set1_ps(params->drag);
+    __m128 lift = _mm_set1_ps(params->lift);
+    for (; k + 4 <= n; k += 4) {
+      const Vector3 *c = &area[k];
+      const Vector3 *v = &air[k];
+      __m128 c4[3] = {_mm_setr_ps(c[0].x, c[1].x, c[2].x, c[3].x),
+                      _mm_setr_ps(c[0].y, c[1].y, c[2].y, c[3].y),
+                      _mm_setr_ps(c[0].z, c[1].z, c[2].z, c[3].z)};
+      __m128 v4[3] = {_mm_setr_ps(v[0].x, v[1].x, v[2].x, v[3].x),
+                      _mm_setr_ps(v[0].y, v[1].y, v[2].y, v[3].y),
+                      _mm_setr_ps(v[0].z, v[1].z, v[2].z, v[3].z)};
+      __m128 f4[3];
+      aero_force4(c4, v4, drag, lift, f4);
+      float f[3][4];
+      for (int a = 0; a < 3; a++) {
+        _mm_storeu_ps(f[a], f4[a]);
+      }
+      for (int j = 0; j < 4; j++) {
+        force[k + j] = (Vector3){f[0][j], f[1][j], f[2][j]};
+      }
+    }
+#endif
+    for (; k < n; k++) {
+      force[k] = aero_force(area[k], air[k], params->drag, params->lift);
+    }
+
+    for (int k = 0; k < n; k++) {
+      for (int j = 0; j < 3; j++) {
+        int i = tri[k].p[j];
+        if (!pinned[i])
+          position[i] = Vector3Add(position[i], force[k]);
+      }
+    }
+  }
+}
+
+// quads per chunk of a grid row, sized to keep the row buffers on the stack
+#define AERO_GRID_CHUNK 128
+
+// Particles of one grid row as structure of arrays: start position x, y, z
+// then displacement so far x, y, z
+typedef float AeroRow[6][AERO_GRID_CHUNK + 1];
+
+static void load_aero_row(const Cloth *cloth, int first, int count,
+                          AeroRow row) {
+  const Vector3 *origin = cloth->prev_position;
+  const Vector3 *position = cloth->position;
+  int k = 0;
+#ifdef CLOTH_SSE
+  for (; k + 4 <= count; k += 4) {
+    __m128 o[3], p[3];
+    load_vector3x4(origin, first + k, o);
+    load_vector3x4(position, first + k, p);
+    for (int a = 0; a < 3; a++) {
+      _mm_storeu_ps(&row[a][k], o[a]);
+      _mm_storeu_ps(&row[3 + a][k], _mm_sub_ps(p[a], o[a]));
+    }
+  }
+#endif
+  for (; k < count; k++) {
+    Vector3 o = origin[first + k];
+    Vector3 moved = Vector3Subtract(position[first + k], o);
+    row[0][k] = o.x;
+    row[1][k] = o.y;
+    row[2][k] = o.z;
+    row[3][k] = moved.x;
+    row[4][k] = moved.y;
+    row[5][k] = moved.z;
+  }
+}
+
+static inline Vector3 row_vector(const AeroRow row, int base, int k) {
+  return (Vector3){row[base][k], row[base + 1][k], row[base + 2][k]};
+}
+
+// Forces of quads [0, count) between two loaded rows. Quad k has the upper
+// triangle (top k, top k + 1, bottom k + 1) and the lower triangle
+// (top k, bottom k + 1, bottom k), their corner displacements go to upper and
+// lower as structure of arrays.
+static void aero_quads(const AeroParams *params, const AeroRow top,
+                       const AeroRow bottom,
+                       const float air[3][AERO_GRID_CHUNK], int count,
+                       float upper[3][AERO_GRID_CHUNK],
+                       float lower[3][AERO_GRID_CHUNK]) {
+  int k = 0;
+#ifdef CLOTH_SSE
+  __m128 drag = _mm_set1_ps(params->drag);
+  __m128 lift = _mm_set1_ps(params->lift);
+  __m128 to_velocity = _mm_set1_ps(params->to_velocity);
+  for (; k + 4 <= count; k += 4) {
+    __m128 ab[3], ad[3], ac[3], v_upper[3], v_lower[3];
+    for (int a = 0; a < 3; a++) {
+      __m128 p_a = _mm_loadu_ps(&top[a][k]);
+      ab[a] = _mm_sub_ps(_mm_loadu_ps(&top[a][k + 1]), p_a);
+      ad[a] = _mm_sub_ps(_mm_loadu_ps(&bottom[a][k + 1]), p_a);
+      ac[a] = _mm_sub_ps(_mm_loadu_ps(&bottom[a][k]), p_a);
+
+      __m128 shared = _mm_add_ps(_mm_loadu_ps(&top[3 + a][k]),
+                                 _mm_loadu_ps(&bottom[3 + a][k + 1]));
+      __m128 moved_upper = _mm_add_ps(shared, _mm_loadu_ps(&top[3 + a][k + 1]));
+      __m128 moved_lower = _mm_add_ps(shared, _mm_loadu_ps(&bottom[3 + a][k]));
+      __m128 wind = _mm_loadu_ps(&air[a][k]);
+      v_upper[a] = _mm_sub_ps(wind, _mm_mul_ps(moved_upper, to_velocity));
+      v_lower[a] = _mm_sub_ps(wind, _mm_mul_ps(moved_lower, to_velocity));
+    }
+    __m128 c[3], f[3];
+    cross4(ab, ad, c);
+    aero_force4(c, v_upper, drag, lift, f);
+    for (int a = 0; a < 3; a++) {
+      _mm_storeu_ps(&upper[a][k], f[a]);
+    }
+    cross4(ad, ac, c);
+    aero_force4(c, v_lower, drag, lift, f);
+    for (int a = 0; a < 3; a++) {
+      _mm_storeu_ps(&lower[a][k], f[a]);
+    }
+  }
+#endif
+  for (; k < count; k++) {
+    Vector3 p_a = row_vector(top, 0, k);
+    Vector3 ab = Vector3Subtract(row_vector(top, 0, k + 1), p_a);
+    Vector3 ad = Vector3Subtract(row_vector(bottom, 0, k + 1), p_a);
+    Vector3 ac = Vector3Subtract(row_vector(bottom, 0, k), p_a);
+    Vector3 shared =
+        Vector3Add(row_vector(top, 3, k), row_vector(bottom, 3, k + 1));
+    Vector3 moved_upper = Vector3Add(shared, row_vector(top, 3, k + 1));
+    Vector3 moved_lower = Vector3Add(shared, row_vector(bottom, 3, k));
+    Vector3 wind = {air[0][k], air[1][k], air[2][k]};
+    Vector3 f = aero_force(
+        Vector3CrossProduct(ab, ad),
+        Vector3Subtract(wind, Vector3Scale(moved_upper, params->to_velocity)),
+        params->drag, params->lift);
+    upper[0][k] = f.x;
+    upper[1][k] = f.y;
+    upper[2][k] = f.z;
+    f = aero_force(
+        Vector3CrossProduct(ad, ac),
+        Vector3Subtract(wind, Vector3Scale(moved_lower, params->to_velocity)),
+        params->drag, params->lift);
+    lower[0][k] = f.x;
+    lower[1][k] = f.y;
+    lower[2][k] = f.z;
+  }
+}
+
+// Triangle forces summed onto particle k of the top row and its partner in
+// the bottom row. Particle k of the top row is in both triangles of quad k
+// and the upper one of quad k - 1, the bottom row mirrors that.
+static inline void add_aero_particle(Vector3 *position, const bool *pinned,
+                                     int top, int bottom,
+                                     const float upper[3][AERO_GRID_CHUNK],
+                                     const float lower[3][AERO_GRID_CHUNK],
+                                     int count, int k) {
+  Vector3 f_top = {0};
+  Vector3 f_bottom = {0};
+  if (k < count) {
+    Vector3 u = {upper[0][k], upper[1][k], upper[2][k]};
+    Vector3 l = {lower[0][k], lower[1][k], lower[2][k]};
+    f_top = Vector3Add(u, l);
+    f_bottom = l;
+  }
+  if (k > 0) {
+    Vector3 u = {upper[0][k - 1], upper[1][k - 1], upper[2][k - 1]};
+    Vector3 l = {lower[0][k - 1], lower[1][k - 1], lower[2][k - 1]};
+    f_top = Vector3Add(f_top, u);
+    f_bottom = Vector3Add(f_bottom, Vector3Add(u, l));
+  }
+  if (!pinned[top + k])
+    position[top + k] = Vector3Add(position[top + k], f_top);
+  if (!pinned[bottom + k])
+    position[bottom + k] = Vector3Add(position[bottom + k], f_bottom);
+}
+
+#ifdef CLOTH_SSE
+// f added to particles p to p + 3, pinned ones keep their position
+static inline void add_vector3x4(Vector3 *position, const bool *pinned, int p,
+                                 const __m128 f[3]) {
+  __m128 v[3];
+  load_vector3x4(position, p, v);
+  uint32_t pins;
+  memcpy(&pins, &pinned[p], sizeof pins);
+  if (!pins) {
+    for (int a = 0; a < 3; a++) {
+      v[a] = _mm_add_ps(v[a], f[a]);
+    }
+  } else {
+    __m128 keep = _mm_cmpneq_ps(_mm_setr_ps(pinned[p], pinned[p + 1],
+                                            pinned[p + 2], pinned[p + 3]),
+                                _mm_setzero_ps());
+    for (int a = 0; a < 3; a++) {
+      v[a] = _mm_or_ps(_mm_and_ps(keep, v[a]),
+                       _mm_andnot_ps(keep, _mm_add_ps(v[a], f[a])));
+    }
+  }
+  store_vector3x4(position, p, v);
+}
+#endif
+
+// Quad rows of one parity in [first_row, end_row). Rows of the same parity
+// share no particles, so they can go to different threads like the
+// red-black constraint passes. Each row is streamed through structure of
+// arrays buffers and the triangle forces are summed per particle afterwards
+// instead of scattered.
+static void aero_grid(Cloth *cloth, const AeroParams *params, int parity,
+                      int first_row, int end_row) {
+  int cols = cloth->tmpl->grid_cols;
+  int rows = cloth->tmpl->grid_rows;
+  Vector3 *position = cloth->position;
+  const bool *pinned = cloth->pinned;
+  if (end_row > rows - 1)
+    end_row = rows - 1;
+
+  AeroRow top;
+  AeroRow bottom;
+  float air[3][AERO_GRID_CHUNK];
+  float upper[3][AERO_GRID_CHUNK];
+  float lower[3][AERO_GRID_CHUNK];
+  Vector3 centers[AERO_GRID_CHUNK];
+  Vector3 gusts[AERO_GRID_CHUNK];
+
+  for (int y = first_row + ((first_row - parity) & 1); y < end_row; y += 2) {
+    for (int x0 = 0; x0 < cols - 1; x0 += AERO_GRID_CHUNK) {
+      int count = cols - 1 - x0 < AERO_GRID_CHUNK ? cols - 1 - x0
+                                                  : AERO_GRID_CHUNK;
+      int row = y * cols + x0;
+      load_aero_row(cloth, row, count + 1, top);
+      load_aero_row(cloth, row + cols, count + 1, bottom);
+
+      // one gust per quad, at its center
+      int k = 0;
+      if (params->field) {
+#ifdef CLOTH_SSE
+        __m128 quarter = _mm_set1_ps(0.25f);
+        for (; k + 4 <= count; k += 4) {
+          __m128 c[3];
+          for (int a = 0; a < 3; a++) {
+            __m128 sum = _mm_add_ps(
+                _mm_add_ps(_mm_loadu_ps(&top[a][k]),
+                           _mm_loadu_ps(&top[a][k + 1])),
+                _mm_add_ps(_mm_loadu_ps(&bottom[a][k]),
+                           _mm_loadu_ps(&bottom[a][k + 1])));
+            c[a] = _mm_mul_ps(sum, quarter);
+          }
+          store_vector3x4(centers, k, c);
+        }
+#endif
+        for (; k < count; k++) {
+          Vector3 sum = Vector3Add(
+              Vector3Add(row_vector(top, 0, k), row_vector(top, 0, k + 1)),
+              Vector3Add(row_vector(bottom, 0, k),
+                         row_vector(bottom, 0, k + 1)));
+          centers[k] = Vector3Scale(sum, 0.25f);
+        }
+        cloth_wind_field_sample(params->field, centers, count, params->offset,
+                                params->texels_per_unit, gusts);
+      }
+      k = 0;
+#ifdef CLOTH_SSE
+      if (params->field) {
+        __m128 turbulence = _mm_set1_ps(params->turbulence);
+        const float wind[3] = {params->air.x, params->air.y, params->air.z};
+        for (; k + 4 <= count; k += 4) {
+          __m128 g[3];
+          load_vector3x4(gusts, k, g);
+          for (int a = 0; a < 3; a++) {
+            _mm_storeu_ps(&air[a][k],
+                          _mm_add_ps(_mm_set1_ps(wind[a]),
+                                     _mm_mul_ps(g[a], turbulence)));
+          }
+        }
+      }
+#endif
+      for (; k < count; k++) {
+        Vector3 wind = params->air;
+        if (params->field)
+          wind = Vector3Add(wind, Vector3Scale(gusts[k], params->turbulence));
+        air[0][k] = wind.x;
+        air[1][k] = wind.y;
+        air[2][k] = wind.z;
+      }
+
+      aero_quads(params, top, bottom, air, count, upper, lower);
+
+      k = 0;
+#ifdef CLOTH_SSE
+      // particles 1 to count - 1 have quads on both sides, four at a time
+      for (k = 1; k + 4 <= count; k += 4) {
+        __m128 f_top[3], f_bottom[3];
+        for (int a = 0; a < 3; a++) {
+          __m128 u = _mm_loadu_ps(&upper[a][k]);
+          __m128 l = _mm_loadu_ps(&lower[a][k]);
+          __m128 u_left = _mm_loadu_ps(&upper[a][k - 1]);
+          __m128 l_left = _mm_loadu_ps(&lower[a][k - 1]);
+          f_top[a] = _mm_add_ps(_mm_add_ps(u, l), u_left);
+          f_bottom[a] = _mm_add_ps(l, _mm_add_ps(u_left, l_left));
+        }
+        add_vector3x4(position, pinned, row + k, f_top);
+        add_vector3x4(position, pinned, row + cols + k, f_bottom);
+      }
+      add_aero_particle(position, pinned, row, row + cols, upper, lower,
+                        count, 0);
+#endif
+      for (; k <= count; k++) {
+        add_aero_particle(position, pinned, row, row + cols, upper, lower,
+                          count, k);
+      }
+    }
+  }
+}
+
+static bool has_aerodynamics(const Cloth *cloth) {
+  if (cloth->tmpl->area_density <= 0.0f)
+    return false;
+  for (int f = 0; f < cloth->force_count; f++) {
+    if (cloth->forces[f].enabled &&
+        cloth->forces[f].type == CLOTH_FORCE_AERODYNAMIC)
+      return true;
+  }
+  return false;
+}
+
+// Every aerodynamic force over one conflict free pass: quad rows
+// [first, end) of parity pass on grids, triangles [first, end) of color
+// batch pass on meshes
+static void apply_aerodynamics(Cloth *cloth, int pass, int first, int end) {
+  for (int f = 0; f < cloth->force_count; f++) {
+    const ClothForce *force = &cloth->forces[f];
+    if (!force->enabled || force->type != CLOTH_FORCE_AERODYNAMIC)
+      continue;
+    AeroParams params = aero_params(cloth, force);
+    if (cloth->tmpl->topology == CLOTH_TOPOLOGY_GRID)
+      aero_grid(cloth, &params, pass, first, end);
+    else
+      aero_triangles(cloth, &params, &cloth->tmpl->triangles[first],
+                     end - first);
+  }
+}
+
+static void apply_all_aerodynamics(Cloth *cloth) {
+  const ClothTemplate *tmpl = cloth->tmpl;
+  if (!has_aerodynamics(cloth))
+    return;
+  if (tmpl->topology == CLOTH_TOPOLOGY_GRID) {
+    for (int parity = 0; parity < 2; parity++) {
+      apply_aerodynamics(cloth, parity, 0, tmpl->grid_rows);
+    }
+  } else {
+    for (int b = 0; b < tmpl->triangle_batch_count; b++) {
+      apply_aerodynamics(cloth, b, tmpl->triangle_offsets[b],
+                         tmpl->triangle_offsets[b + 1]);
+    }
+  }
+}
+
+bool cloth_step(Cloth *cloth) {
+  arena_reset(&cloth->scratch);
+  int substeps = plan_substeps(cloth);
+  cloth->substep_count = substeps;
+  cloth->motion_tiles = 0;
+  begin_step(cloth);
+  for (int k = 0; k < substeps; k++) {
+    begin_substep(cloth, k, substeps);
+    cloth->motion_sq = verlet(cloth, 0, cloth->particle_count);
+    apply_local_forces(cloth, 0, cloth->particle_count);
+    apply_all_aerodynamics(cloth);
+    if (!satisfy_constraints(cloth))
+      return false;
+  }
+  if (cloth->tear)
+    bound_blocks(cloth, 0, cloth->particle_count);
+  finish_step(cloth);
+  return true;
+}
+
+// Tile sizes when a step is split into jobs, big enough that a job is worth
+// scheduling
+#define CLOTH_JOB_PARTICLES 4096
+#define CLOTH_JOB_CONSTRAINTS 8192
+
+typedef enum {
+  CLOTH_TASK_SUBSTEP,
+  CLOTH_TASK_INTEGRATE,
+  CLOTH_TASK_AERODYNAMICS,
+  CLOTH_TASK_BATCH,
+  CLOTH_TASK_GRID_HORIZONTAL,
+  CLOTH_TASK_GRID_VERTICAL,
+  CLOTH_TASK_GRID_SHEAR,
+  CLOTH_TASK_GRID_BENDING,
+  CLOTH_TASK_STRANDS,
+  CLOTH_TASK_RAGDOLLS,
+  CLOTH_TASK_GLOBAL,
+  CLOTH_TASK_DIHEDRALS,
+  CLOTH_TASK_VOLUMES,
+  CLOTH_TASK_ANCHORS,
+  CLOTH_TASK_STRAIN_LIMIT,
+  CLOTH_TASK_SHAPES,
+  CLOTH_TASK_COLLISIONS,
+  CLOTH_TASK_CUT_BOUNDS,
+  CLOTH_TASK_TEARING,
+} ClothTaskKind;
+
+// One tile of one phase: particles, triangles, batch constraints, grid rows,
+// strands, ragdolls, dihedrals or tetrahedra [first, end), pass is the color
+// batch, red-black parity, stencil pass or substep. Strain limiting on grids
+// adds 2 to the parity for vertical links.
+typedef struct {
+  Cloth *cloth;
+  ClothTaskKind kind;
+  int pass;
+  int first;
+  int end;
+} ClothTask;
+
+static const char *cloth_task_names[] = {
+    "substep", "integrate", "aerodynamics", "constraint batch",
+    "grid horizontal", "grid vertical", "grid shear", "grid bending",
+    "strands", "ragdolls", "global solve", "dihedrals", "volumes",
+    "strain anchors", "strain limit", "shape matching", "collisions",
+    "cut bounds", "tearing"};
+
+static void run_cloth_task(void *data, int worker) {
+  (void)worker;
+  ClothTask *task = data;
+  Cloth *cloth = task->cloth;
+  switch (task->kind) {
+  case CLOTH_TASK_SUBSTEP:
+    if (task->pass == 0)
+      begin_step(cloth);
+    begin_substep(cloth, task->pass, cloth->substep_count);
+    break;
+  case CLOTH_TASK_INTEGRATE:
+    cloth->tile_motion_sq[task->first / CLOTH_JOB_PARTICLES] =
+        verlet(cloth, task->first, task->end);
+    apply_local_forces(cloth, task->first, task->end);
+    break;
+  case CLOTH_TASK_AERODYNAMICS: {
+    int offset = cloth->tmpl->topology == CLOTH_TOPOLOGY_GRID
+                     ? 0
+                     : cloth->tmpl->triangle_offsets[task->pass];
+    apply_aerodynamics(cloth, task->pass, offset + task->first,
+                       offset + task->end);
+    break;
+  }
+  case CLOTH_TASK_BATCH: {
+    int offset = cloth->tmpl->batch_offsets[task->pass];
+    solve_batch(cloth, task->pass, offset + task->first, offset + task->end,
+                false);
+    break;
+  }
+  case CLOTH_TASK_GRID_HORIZONTAL:
+    solve_grid_horizontal(cloth, task->pass, task->first, task->end, false);
+    break;
+  case CLOTH_TASK_GRID_VERTICAL:
+    solve_grid_vertical(cloth, task->pass, task->first, task->end, false);
+    break;
+  case CLOTH_TASK_GRID_SHEAR:
+    solve_grid_shear(cloth, task->pass, task->first, task->end);
+    break;
+  case CLOTH_TASK_GRID_BENDING:
+    solve_grid_bending(cloth, task->pass, task->first, task->end);
+    break;
+  case CLOTH_TASK_STRANDS:
+    solve_strands(cloth, task->first, task->end);
+    break;
+  case CLOTH_TASK_RAGDOLLS:
+    solve_ragdolls(cloth, task->first, task->end);
+    break;
+  case CLOTH_TASK_GLOBAL:
+    solve_global(cloth);
+    break;
+  case CLOTH_TASK_DIHEDRALS: {
+    int offset = cloth->tmpl->dihedral_offsets[task->pass];
+    solve_dihedral_batch(cloth, task->pass, offset + task->first,
+                         offset + task->end);
+    break;
+  }
+  case CLOTH_TASK_VOLUMES: {
+    int offset = cloth->tmpl->tetrahedron_offsets[task->pass];
+    solve_volume_batch(cloth, task->pass, offset + task->first,
+                       offset + task->end);
+    break;
+  }
+  case CLOTH_TASK_ANCHORS:
+    pull_to_anchors(cloth, task->first, task->end);
+    break;
+  case CLOTH_TASK_STRAIN_LIMIT:
+    if (cloth->tmpl->topology != CLOTH_TOPOLOGY_GRID) {
+      int offset = cloth->tmpl->batch_offsets[task->pass];
+      solve_batch(cloth, task->pass, offset + task->first, offset + task->end,
+                  true);
+    } else if (task->pass < 2) {
+      solve_grid_horizontal(cloth, task->pass, task->first, task->end, true);
+    } else {
+      solve_grid_vertical(cloth, task->pass - 2, task->first, task->end, true);
+    }
+    break;
+  case CLOTH_TASK_SHAPES:
+    match_shapes(cloth, task->first, task->end);
+    break;
+  case CLOTH_TASK_COLLISIONS:
+    resolve_collisions(cloth, task->first, task->end);
+    break;
+  case CLOTH_TASK_CUT_BOUNDS:
+    bound_blocks(cloth, task->first, task->end);
+    break;
+  case CLOTH_TASK_TEARING:
+    finish_step(cloth);
+    break;
+  }
+}
+
+// Adds [0, count) in tiles that all wait for *node, then moves *node to a
+// join of the tiles. A single tile needs no join.
+static bool add_tiled_phase(Cloth *cloth, JobGraph *graph, int group,
+                            ClothTaskKind kind, int pass, int count, int tile,
+                            int *node) {
+  int tile_count = (count + tile - 1) / tile;
+  int join = -1;
+  if (tile_count > 1) {
+    join = job_graph_add(graph, NULL, group, NULL, NULL);
+    if (join < 0)
+      return false;
+  }
+
+  for (int t = 0; t < tile_count; t++) {
+    ClothTask *task = job_graph_alloc(graph, sizeof(ClothTask));
+    if (!task)
+      return false;
+    int end = (t + 1) * tile < count ? (t + 1) * tile : count;
+    *task = (ClothTask){cloth, kind, pass, t * tile, end};
+    int tile_node = job_graph_add(graph, cloth_task_names[kind], group,
+                                  run_cloth_task, task);
+    if (tile_node < 0 || (*node >= 0 && !job_graph_depend(graph, tile_node,
+                                                          *node)))
+      return false;
+    if (join >= 0 && !job_graph_depend(graph, join, tile_node))
+      return false;
+    if (tile_count == 1)
+      join = tile_node;
+  }
+  if (tile_count > 0)
+    *node = join;
+  return true;
+}
+
+// Integration, forces and the iterations of one substep after *tail, which
+// moves to the end of them
+static bool add_substep_phases(Cloth *cloth, JobGraph *graph, int group,
+                               int *tail) {
+  const ClothTemplate *tmpl = cloth->tmpl;
+  bool global = cloth->global.newton_steps > 0;
+
+  // explicit cloths built from a mesh have no grid dimensions
+  int grid_tile_rows = 1;
+  int strand_tile = 4;
+  if (tmpl->topology == CLOTH_TOPOLOGY_RAGDOLLS && tmpl->link_count > 0) {
+    // whole chunks once there are enough ragdolls to fill one
+    strand_tile = CLOTH_JOB_CONSTRAINTS / tmpl->link_count / 4 * 4;
+    if (strand_tile >= RAGDOLL_CHUNK)
+      strand_tile -= strand_tile % RAGDOLL_CHUNK;
+    if (strand_tile < 4)
+      strand_tile = 4;
+  } else if (tmpl->topology != CLOTH_TOPOLOGY_EXPLICIT) {
+    grid_tile_rows = CLOTH_JOB_CONSTRAINTS / tmpl->grid_cols;
+    if (grid_tile_rows < 1)
+      grid_tile_rows = 1;
+    // whole groups of four, so only the last tile has a scalar tail
+    strand_tile = CLOTH_JOB_CONSTRAINTS / tmpl->grid_rows / 4 * 4;
+    if (strand_tile < 4)
+      strand_tile = 4;
+  }
+
+  int node = *tail;
+  bool ok = add_tiled_phase(cloth, graph, group, CLOTH_TASK_INTEGRATE, 0,
+                            cloth->particle_count, CLOTH_JOB_PARTICLES, &node);
+  if (ok && has_aerodynamics(cloth)) {
+    if (tmpl->topology == CLOTH_TOPOLOGY_GRID) {
+      for (int parity = 0; ok && parity < 2; parity++) {
+        ok = add_tiled_phase(cloth, graph, group, CLOTH_TASK_AERODYNAMICS,
+                             parity, tmpl->grid_rows, grid_tile_rows, &node);
+      }
+    } else {
+      for (int b = 0; ok && b < tmpl->triangle_batch_count; b++) {
+        int count = tmpl->triangle_offsets[b + 1] - tmpl->triangle_offsets[b];
+        int tile = b < MAX_CONSTRAINT_COLORS - 1 ? CLOTH_JOB_CONSTRAINTS
+                                                 : count;
+        ok = add_tiled_phase(cloth, graph, group, CLOTH_TASK_AERODYNAMICS, b,
+                             count, tile, &node);
+      }
+    }
+  }
+
+  int iterations = global ? cloth->global.newton_steps : cloth->iterations;
+  for (int j = 0; ok && j < iterations; j++) {
+    if (tmpl->topology == CLOTH_TOPOLOGY_GRID) {
+      for (int parity = 0; ok && parity < 2; parity++) {
+        ok = add_tiled_phase(cloth, graph, group, CLOTH_TASK_GRID_HORIZONTAL,
+                             parity, tmpl->grid_rows, grid_tile_rows, &node);
+      }
+      for (int parity = 0; ok && parity < 2; parity++) {
+        ok = add_tiled_phase(cloth, graph, group, CLOTH_TASK_GRID_VERTICAL,
+                             parity, tmpl->grid_rows, grid_tile_rows, &node);
+      }
+      for (int pass = 0; ok && cloth->shear_stiffness > 0.0f && pass < 4;
+           pass++) {
+        ok = add_tiled_phase(cloth, graph, group, CLOTH_TASK_GRID_SHEAR, pass,
+                             tmpl->grid_rows, grid_tile_rows, &node);
+      }
+      for (int pass = 0; ok && cloth->bending_stiffness > 0.0f && pass < 4;
+           pass++) {
+        ok = add_tiled_phase(cloth, graph, group, CLOTH_TASK_GRID_BENDING,
+                             pass, tmpl->grid_rows, grid_tile_rows, &node);
+      }
+    } else if (tmpl->topology == CLOTH_TOPOLOGY_STRANDS) {
+      ok = add_tiled_phase(cloth, graph, group, CLOTH_TASK_STRANDS, 0,
+                           tmpl->grid_cols, strand_tile, &node);
+    } else if (tmpl->topology == CLOTH_TOPOLOGY_RAGDOLLS) {
+      ok = add_tiled_phase(cloth, graph, group, CLOTH_TASK_RAGDOLLS, 0,
+                           tmpl->grid_cols, strand_tile, &node);
+    } else if (global) {
+      // the factorization is sequential, one job per Newton step
+      ok = add_tiled_phase(cloth, graph, group, CLOTH_TASK_GLOBAL, 0, 1, 1,
+                           &node);
+    } else {
+      for (int b = 0; ok && b < tmpl->batch_count; b++) {
+        int count = tmpl->batch_offsets[b + 1] - tmpl->batch_offsets[b];
+        // the overflow color may share particles and can't be split
+        int tile = b < MAX_CONSTRAINT_COLORS - 1 ? CLOTH_JOB_CONSTRAINTS
+                                                 : count;
+        ok = add_tiled_phase(cloth, graph, group, CLOTH_TASK_BATCH, b, count,
+                             tile, &node);
+      }
+    }
+    for (int b = 0; ok && cloth->bending_stiffness > 0.0f &&
+                    b < tmpl->dihedral_batch_count;
+         b++) {
+      int count = tmpl->dihedral_offsets[b + 1] - tmpl->dihedral_offsets[b];
+      // tearing may empty a batch
+      if (count == 0)
+        continue;
+      int tile = b < MAX_CONSTRAINT_COLORS - 1 ? CLOTH_JOB_CONSTRAINTS / 4
+                                               : count;
+      ok = add_tiled_phase(cloth, graph, group, CLOTH_TASK_DIHEDRALS, b, count,
+                           tile, &node);
+    }
+    for (int b = 0; ok && b < tmpl->tetrahedron_batch_count; b++) {
+      int count =
+          tmpl->tetrahedron_offsets[b + 1] - tmpl->tetrahedron_offsets[b];
+      int tile = b < MAX_CONSTRAINT_COLORS - 1 ? CLOTH_JOB_CONSTRAINTS / 4
+                                               : count;
+      ok = add_tiled_phase(cloth, graph, group, CLOTH_TASK_VOLUMES, b, count,
+                           tile, &node);
+    }
+    if (ok && j == iterations - 1 && cloth->strain_limit > 0.0f) {
+      ok = add_tiled_phase(cloth, graph, group, CLOTH_TASK_ANCHORS, 0,
+                           cloth->particle_count, CLOTH_JOB_PARTICLES, &node);
+      if (tmpl->topology == CLOTH_TOPOLOGY_GRID) {
+        for (int pass = 0; ok && pass < 4; pass++) {
+          ok = add_tiled_phase(cloth, graph, group, CLOTH_TASK_STRAIN_LIMIT,
+                               pass, tmpl->grid_rows, grid_tile_rows, &node);
+        }
+      } else {
+        for (int b = 0; ok && b < tmpl->batch_count; b++) {
+          int count = tmpl->batch_offsets[b + 1] - tmpl->batch_offsets[b];
+          int tile = b < MAX_CONSTRAINT_COLORS - 1 ? CLOTH_JOB_CONSTRAINTS
+                                                   : count;
+          ok = add_tiled_phase(cloth, graph, group, CLOTH_TASK_STRAIN_LIMIT,
+                               b, count, tile, &node);
+        }
+      }
+    }
+    // clusters may share particles, so they all go in one job
+    if (ok && cloth->cluster_count > 0)
+      ok = add_tiled_phase(cloth, graph, group, CLOTH_TASK_SHAPES, 0,
+                           cloth->cluster_count, cloth->cluster_count, &node);
+    if (ok && (cloth->sphere_count > 0 || cloth->mesh_count > 0 ||
+               cloth->sdf_count > 0))
+      ok = add_tiled_phase(cloth, graph, group, CLOTH_TASK_COLLISIONS, 0,
+                           cloth->particle_count, CLOTH_JOB_PARTICLES, &node);
+  }
+  *tail = node;
+  return ok;
+}
+
+int cloth_add_step_jobs(Cloth *cloth, JobGraph *graph, int group, int after) {
+  // nothing that steps the cloth happens before the graph runs, so a failure
+  // here leaves it as it was
+  arena_reset(&cloth->scratch);
+  int substeps = plan_substeps(cloth);
+  if (cloth->tmpl->topology == CLOTH_TOPOLOGY_EXPLICIT &&
+      !update_solver_constraints(cloth))
+    return -1;
+  if (cloth->strain_limit > 0.0f && !update_strain_anchors(cloth))
+    return -1;
+  if (cloth->global.newton_steps > 0 && !update_global_solve(cloth))
+    return -1;
+
+  // a slot per integration tile for the motion it measures
+  int tiles = (cloth->particle_count + CLOTH_JOB_PARTICLES - 1) /
+              CLOTH_JOB_PARTICLES;
+  if (tiles > cloth->tile_motion_capacity) {
+    float *slots = arena_realloc(
+        &cloth->arena, cloth->tile_motion_sq,
+        sizeof(float) * cloth->tile_motion_capacity, sizeof(float) * tiles);
+    if (!slots)
+      return -1;
+    cloth->tile_motion_sq = slots;
+    cloth->tile_motion_capacity = tiles;
+  }
+
+  int node = after;
+  bool ok = true;
+  for (int k = 0; ok && k < substeps; k++) {
+    ok = add_tiled_phase(cloth, graph, group, CLOTH_TASK_SUBSTEP, k, 1, 1,
+                         &node) &&
+         add_substep_phases(cloth, graph, group, &node);
+  }
+  // tiles are whole blocks of the cut bounds. Tearing changes the topology,
+  // so it runs alone once everything else is done.
+  if (ok && cloth->tear)
+    ok = add_tiled_phase(cloth, graph, group, CLOTH_TASK_CUT_BOUNDS, 0,
+                         cloth->particle_count, CLOTH_JOB_PARTICLES, &node) &&
+         add_tiled_phase(cloth, graph, group, CLOTH_TASK_TEARING, 0, 1, 1,
+                         &node);
+  if (!ok)
+    return -1;
+  cloth->substep_count = substeps;
+  cloth->motion_sq = 0.0f;
+  cloth->motion_tiles = tiles;
+  return node;
+}
+
+static bool alloc_template_particles(ClothTemplate *tmpl, int count) {
+  tmpl->rest_position = arena_alloc(&tmpl->arena, sizeof(Vector3) * count);
+  tmpl->pinned = arena_alloc_zero(&tmpl->arena, sizeof(bool) * count);
+  tmpl->particle_count = count;
+  return tmpl->rest_position && tmpl->pinned;
+}
+
+static bool init_grid_particles(ClothTemplate *tmpl, const ClothDesc *desc) {
+  if (!alloc_template_particles(tmpl, desc->cols * desc->rows))
+    return false;
+
+  for (int y = 0; y < desc->rows; y++) {
+    for (int x = 0; x < desc->cols; x++) {
+      int index = y * desc->cols + x;
+      Vector3 offset = {x * desc->spacing, y * desc->spacing, 0};
+      tmpl->rest_position[index] = Vector3Add(desc->origin, offset);
+    }
+  }
+  return true;
+}
+
+static bool init_grid_constraints(ClothTemplate *tmpl) {
+  int cols = tmpl->grid_cols;
+  int rows = tmpl->grid_rows;
+  int num_constraints = (cols - 1) * rows + (rows - 1) * cols;
+  tmpl->constraints =
+      arena_alloc(&tmpl->arena, sizeof(Constraint) * num_constraints);
+  if (!tmpl->constraints)
+    return false;
+
+  for (int y = 0; y < rows; y++) {
+    for (int x = 0; x < cols; x++) {
+      int current_idx = y * cols + x;
+      Constraint *c;
+      if (x < cols - 1) {
+        c = &tmpl->constraints[tmpl->constraint_count++];
+        *c = (Constraint){current_idx, current_idx + 1, tmpl->grid_spacing};
+      }
+      if (y < rows - 1) {
+        c = &tmpl->constraints[tmpl->constraint_count++];
+        *c = (Constraint){current_idx, current_idx + cols, tmpl->grid_spacing};
+      }
+    }
+  }
+  return true;
+}
+
+// the two triangles of every quad, as the grid topology implies them
+static bool init_grid_triangles(ClothTemplate *tmpl) {
+  int cols = tmpl->grid_cols;
+  int rows = tmpl->grid_rows;
+  int quads = cols > 1 && rows > 1 ? (cols - 1) * (rows - 1) : 0;
+  tmpl->triangles = arena_alloc(&tmpl->arena, sizeof(Triangle) * 2 * quads);
+  if (quads > 0 && !tmpl->triangles)
+    return false;
+
+  for (int y = 0; y < rows - 1; y++) {
+    for (int x = 0; x < cols - 1; x++) {
+      int a = y * cols + x;
+      Triangle *t = &tmpl->triangles[tmpl->triangle_count];
+      t[0] = (Triangle){{a, a + 1, a + cols + 1}};
+      t[1] = (Triangle){{a, a + cols + 1, a + cols}};
+      tmpl->triangle_count += 2;
+    }
+  }
+  return true;
+}
+
+static bool init_mesh(ClothTemplate *tmpl, const ClothDesc *desc) {
+  if (!alloc_template_particles(tmpl, desc->particle_count))
+    return false;
+  memcpy(tmpl->rest_position, desc->positions,
+         sizeof(Vector3) * desc->particle_count);
+
+  tmpl->constraints =
+      arena_alloc(&tmpl->arena, sizeof(Constraint) * desc->edge_count);
+  if (!tmpl->constraints)
+    return false;
+
+  for (int i = 0; i < desc->edge_count; i++) {
+    int p1 = desc->edges[2 * i];
+    int p2 = desc->edges[2 * i + 1];
+    if (p1 < 0 || p2 < 0 || p1 >= desc->particle_count ||
+        p2 >= desc->particle_count || p1 == p2)
+      return false;
+    float rest_length = Vector3Distance(desc->positions[p1], desc->positions[p2]);
+    tmpl->constraints[tmpl->constraint_count++] =
+        (Constraint){p1 < p2 ? p1 : p2, p1 < p2 ? p2 : p1, rest_length};
+  }
+
+  if (desc->triangle_count > 0) {
+    tmpl->triangles =
+        arena_alloc(&tmpl->arena, sizeof(Triangle) * desc->triangle_count);
+    if (!tmpl->triangles)
+      return false;
+  }
+  for (int i = 0; i < desc->triangle_count; i++) {
+    Triangle *t = &tmpl->triangles[tmpl->triangle_count++];
+    for (int k = 0; k < 3; k++) {
+      t->p[k] = desc->triangles[3 * i + k];
+      if (t->p[k] < 0 || t->p[k] >= desc->particle_count)
+        return false;
+    }
+    if (t->p[0] == t->p[1] || t->p[1] == t->p[2] || t->p[0] == t->p[2])
+      return false;
+  }
+
+  if (desc->tetrahedron_count > 0) {
+    tmpl->tetrahedra = arena_alloc(
+        &tmpl->arena, sizeof(Tetrahedron) * desc->tetrahedron_count);
+    if (!tmpl->tetrahedra)
+      return false;
+  }
+  for (int i = 0; i < desc->tetrahedron_count; i++) {
+    Tetrahedron *t = &tmpl->tetrahedra[tmpl->tetrahedron_count++];
+    for (int k = 0; k < 4; k++) {
+      t->p[k] = desc->tetrahedra[4 * i + k];
+      if (t->p[k] < 0 || t->p[k] >= desc->particle_count)
+        return false;
+      for (int j = 0; j < k; j++) {
+        if (t->p[j] == t->p[k])
+          return false;
+      }
+    }
+    Vector3 x0 = desc->positions[t->p[0]];
+    Vector3 e1 = Vector3Subtract(desc->positions[t->p[1]], x0);
+    Vector3 e2 = Vector3Subtract(desc->positions[t->p[2]], x0);
+    Vector3 e3 = Vector3Subtract(desc->positions[t->p[3]], x0);
+    t->rest_volume =
+        Vector3DotProduct(e1, Vector3CrossProduct(e2, e3)) / 6.0f;
+  }
+  return true;
+}
+
+// Edge k of a triangle, a and b in the triangle's winding, lo and hi sorted
+typedef struct {
+  int lo;
+  int hi;
+  int a;
+  int b;
+  int opposite;
+} TriangleEdge;
+
+static int compare_triangle_edges(const void *a, const void *b) {
+  const TriangleEdge *ea = a;
+  const TriangleEdge *eb = b;
+  if (ea->lo != eb->lo)
+    return ea->lo < eb->lo ? -1 : 1;
+  return (ea->hi > eb->hi) - (ea->hi < eb->hi);
+}
+
+// A dihedral across every edge of exactly two triangles, at the angle they
+// make at rest. The first triangle keeps its winding, so the angle is 0
+// wherever a consistently wound mesh is flat.
+static bool init_dihedrals(ClothTemplate *tmpl, Arena *scratch) {
+  int count = 3 * tmpl->triangle_count;
+  if (count == 0)
+    return true;
+  ArenaMark mark = arena_mark(scratch);
+  TriangleEdge *edges = arena_alloc(scratch, sizeof(TriangleEdge) * count);
+  tmpl->dihedrals = arena_alloc(&tmpl->arena, sizeof(Dihedral) * (count / 2));
+  if (!edges || !tmpl->dihedrals) {
+    arena_rewind(scratch, mark);
+    return false;
+  }
+
+  for (int i = 0; i < tmpl->triangle_count; i++) {
+    const int *p = tmpl->triangles[i].p;
+    for (int k = 0; k < 3; k++) {
+      int a = p[k];
+      int b = p[(k + 1) % 3];
+      edges[3 * i + k] =
+          (TriangleEdge){a < b ? a : b, a < b ? b : a, a, b, p[(k + 2) % 3]};
+    }
+  }
+  qsort(edges, count, sizeof(TriangleEdge), compare_triangle_edges);
+
+  const Vector3 *x = tmpl->rest_position;
+  for (int i = 0; i < count;) {
+    int j = i + 1;
+    while (j < count && edges[j].lo == edges[i].lo &&
+           edges[j].hi == edges[i].hi)
+      j++;
+    if (j - i == 2 && edges[i].opposite != edges[i + 1].opposite) {
+      Dihedral *d = &tmpl->dihedrals[tmpl->dihedral_count++];
+      *d = (Dihedral){{edges[i].opposite, edges[i + 1].opposite, edges[i].a,
+                       edges[i].b},
+                      0.0f};
+      Vector3 e = Vector3Subtract(x[d->p[3]], x[d->p[2]]);
+      Vector3 n1 = Vector3CrossProduct(Vector3Subtract(x[d->p[2]], x[d->p[0]]),
+                                       Vector3Subtract(x[d->p[3]], x[d->p[0]]));
+      Vector3 n2 = Vector3CrossProduct(Vector3Subtract(x[d->p[3]], x[d->p[1]]),
+                                       Vector3Subtract(x[d->p[2]], x[d->p[1]]));
+      d->rest_angle = normal_angle(n1, n2, e, Vector3Length(e));
+    }
+    i = j;
+  }
+  arena_rewind(scratch, mark);
+  return true;
+}
+
+// cols copies of the skeleton, joint-major, and the range of every link of
+// every copy
+static bool init_ragdolls(ClothTemplate *tmpl, const ClothDesc *desc) {
+  int cols = desc->cols;
+  int joints = desc->particle_count;
+  if (!alloc_template_particles(tmpl, joints * cols))
+    return false;
+  for (int r = 0; r < cols; r++) {
+    Matrix transform =
+        desc->transforms
+            ? desc->transforms[r]
+            : MatrixTranslate(desc->origin.x + r * desc->spacing,
+                              desc->origin.y, desc->origin.z);
+    for (int j = 0; j < joints; j++) {
+      tmpl->rest_position[j * cols + r] =
+          Vector3Transform(desc->positions[j], transform);
+    }
+  }
+
+  int link_count = desc->edge_count + desc->angle_limit_count;
+  tmpl->links = arena_alloc(&tmpl->arena, sizeof(RagdollLink) * link_count);
+  tmpl->link_range =
+      arena_alloc(&tmpl->arena, 2 * sizeof(float) * link_count * cols);
+  if (link_count > 0 && (!tmpl->links || !tmpl->link_range))
+    return false;
+
+  for (int i = 0; i < desc->edge_count; i++) {
+    int a = desc->edges[2 * i];
+    int b = desc->edges[2 * i + 1];
+    if (a < 0 || b < 0 || a >= joints || b >= joints || a == b)
+      return false;
+    int l = tmpl->link_count++;
+    tmpl->links[l] = (RagdollLink){a, b};
+    for (int r = 0; r < cols; r++) {
+      float rest = Vector3Distance(tmpl->rest_position[a * cols + r],
+                                   tmpl->rest_position[b * cols + r]);
+      tmpl->link_range[2 * l * cols + r] = rest;
+      tmpl->link_range[(2 * l + 1) * cols + r] = rest;
+    }
+  }
+  tmpl->bone_count = tmpl->link_count;
+
+  for (int i = 0; i < desc->angle_limit_count; i++) {
+    ClothAngleLimit limit = desc->angle_limits[i];
+    if (limit.a < 0 || limit.b < 0 || limit.c < 0 || limit.a >= joints ||
+        limit.b >= joints || limit.c >= joints || limit.a == limit.b ||
+        limit.b == limit.c || limit.a == limit.c ||
+        !(limit.min_angle >= 0.0f && limit.min_angle <= limit.max_angle &&
+          limit.max_angle <= PI))
+      return false;
+    int l = tmpl->link_count++;
+    tmpl->links[l] = (RagdollLink){limit.a, limit.c};
+    // law of cosines with the bones' lengths at rest
+    float cos_min = cosf(limit.min_angle);
+    float cos_max = cosf(limit.max_angle);
+    for (int r = 0; r < cols; r++) {
+      Vector3 b = tmpl->rest_position[limit.b * cols + r];
+      float l1 = Vector3Distance(tmpl->rest_position[limit.a * cols + r], b);
+      float l2 = Vector3Distance(tmpl->rest_position[limit.c * cols + r], b);
+      float sum = l1 * l1 + l2 * l2;
+      tmpl->link_range[2 * l * cols + r] =
+          sqrtf(fmaxf(sum - 2.0f * l1 * l2 * cos_min, 0.0f));
+      tmpl->link_range[(2 * l + 1) * cols + r] =
+          sqrtf(fmaxf(sum - 2.0f * l1 * l2 * cos_max, 0.0f));
+    }
+  }
+  return true;
+}
+
+// Particles per unit of rest area, so a triangle force spread over its
+// corners accelerates the average particle like a unit of cloth
+static float measure_area_density(const ClothTemplate *tmpl) {
+  double area = 0.0;
+  if (tmpl->topology == CLOTH_TOPOLOGY_GRID) {
+    int quads = (tmpl->grid_cols - 1) * (tmpl->grid_rows - 1);
+    area = (double)quads * tmpl->grid_spacing * tmpl->grid_spacing;
+  } else {
+    for (int i = 0; i < tmpl->triangle_count; i++) {
+      const int *p = tmpl->triangles[i].p;
+      Vector3 a = tmpl->rest_position[p[0]];
+      Vector3 e1 = Vector3Subtract(tmpl->rest_position[p[1]], a);
+      Vector3 e2 = Vector3Subtract(tmpl->rest_position[p[2]], a);
+      area += 0.5 * Vector3Length(Vector3CrossProduct(e1, e2));
+    }
+  }
+  return area > 0.0 ? (float)(tmpl->particle_count / area) : 0.0f;
+}
+
+static float measure_min_rest_length(const ClothTemplate *tmpl) {
+  if (tmpl->topology == CLOTH_TOPOLOGY_GRID ||
+      tmpl->topology == CLOTH_TOPOLOGY_STRANDS)
+    return tmpl->grid_spacing;
+  float shortest = INFINITY;
+  for (int i = 0; i < tmpl->constraint_count; i++) {
+    if (tmpl->constraints[i].rest_length > 0.0f)
+      shortest = fminf(shortest, tmpl->constraints[i].rest_length);
+  }
+  // the lower end of a bone's range is its rest length
+  int ragdolls = tmpl->grid_cols;
+  for (int l = 0; tmpl->link_range && l < tmpl->bone_count; l++) {
+    for (int r = 0; r < ragdolls; r++) {
+      float rest = tmpl->link_range[2 * l * ragdolls + r];
+      if (rest > 0.0f)
+        shortest = fminf(shortest, rest);
+    }
+  }
+  return isinf(shortest) ? 0.0f : shortest;
+}
+
+ClothTemplate *cloth_template_create(const ClothDesc *desc) {
+  bool from_mesh = desc->topology == CLOTH_TOPOLOGY_EXPLICIT && desc->positions;
+  bool ragdolls = desc->topology == CLOTH_TOPOLOGY_RAGDOLLS;
+  if (ragdolls ? !desc->positions || desc->particle_count <= 0 ||
+                     desc->cols <= 0 || desc->edge_count < 0 ||
+                     desc->angle_limit_count < 0 ||
+                     (desc->edge_count > 0 && !desc->edges) ||
+                     (desc->angle_limit_count > 0 && !desc->angle_limits)
+      : from_mesh ? desc->particle_count <= 0 || desc->edge_count < 0 ||
+                        desc->triangle_count < 0 ||
+                        (desc->triangle_count > 0 && !desc->triangles) ||
+                        desc->tetrahedron_count < 0 ||
+                        (desc->tetrahedron_count > 0 && !desc->tetrahedra)
+                  : desc->cols <= 0 || desc->rows <= 0 ||
+                        desc->spacing <= 0.0f)
+    return NULL;
+  // materials the topology has no links for, refused like the setters do
+  bool grid = desc->topology == CLOTH_TOPOLOGY_GRID;
+  if ((desc->shear_stiffness > 0.0f && !grid) ||
+      (desc->bending_stiffness > 0.0f && !grid &&
+       desc->topology != CLOTH_TOPOLOGY_EXPLICIT))
+    return NULL;
+
+  Arena arena = {0};
+  ClothTemplate *tmpl = arena_alloc_zero(&arena, sizeof(ClothTemplate));
+  if (!tmpl)
+    return NULL;
+  tmpl->arena = arena;
+
+  tmpl->topology = desc->topology;
+  tmpl->grid_cols = desc->cols;
+  tmpl->grid_rows = ragdolls ? desc->particle_count : desc->rows;
+  tmpl->grid_spacing = desc->spacing;
+  tmpl->iterations = desc->iterations;
+  tmpl->time_step = desc->time_step;
+  tmpl->damping = desc->damping;
+  tmpl->particle_radius = desc->particle_radius;
+  tmpl->gravity = desc->gravity;
+  tmpl->shear_stiffness = Clamp(desc->shear_stiffness, 0.0f, 1.0f);
+  tmpl->bending_stiffness = Clamp(desc->bending_stiffness, 0.0f, 1.0f);
+
+  bool ok;
+  if (ragdolls) {
+    ok = init_ragdolls(tmpl, desc);
+  } else if (from_mesh) {
+    ok = init_mesh(tmpl, desc);
+  } else {
+    ok = init_grid_particles(tmpl, desc);
+    if (ok && desc->topology == CLOTH_TOPOLOGY_EXPLICIT)
+      ok = init_grid_constraints(tmpl) && init_grid_triangles(tmpl);
+  }
+  if (ok) {
+    tmpl->area_density = measure_area_density(tmpl);
+    tmpl->min_rest_length = measure_min_rest_length(tmpl);
+  }
+
+  if (ok && desc->pinned && ragdolls) {
+    for (int i = 0; i < tmpl->particle_count; i++) {
+      tmpl->pinned[i] = desc->pinned[i / tmpl->grid_cols];
+    }
+  } else if (ok && desc->pinned) {
+    memcpy(tmpl->pinned, desc->pinned, sizeof(bool) * tmpl->particle_count);
+  }
+
+  // explicit constraints are solved in color batches
+  if (ok && tmpl->topology == CLOTH_TOPOLOGY_EXPLICIT) {
+    Arena scratch = {0};
+    ok = color_constraints(tmpl, &scratch) &&
+         (desc->bending_stiffness <= 0.0f || init_dihedrals(tmpl, &scratch)) &&
+         color_triangles(tmpl, &scratch) &&
+         color_tetrahedra(tmpl, &scratch) && color_dihedrals(tmpl, &scratch) &&
+         build_solver(&tmpl->arena, &tmpl->solver, tmpl, tmpl->pinned);
+    arena_free(&scratch);
+  }
+
+  if (!ok) {
+    cloth_template_destroy(tmpl);
+    return NULL;
+  }
+  return tmpl;
+}
+
+void cloth_template_destroy(ClothTemplate *tmpl) {
+  if (!tmpl)
+    return;
+  // the template itself lives in its arena
+  Arena arena = tmpl->arena;
+  arena_free(&arena);
+}
+
+Cloth *cloth_create_instance(const ClothTemplate *tmpl, Matrix transform) {
+  int count = tmpl->particle_count;
+  // one block that fits the instance, a few colliders and forces, crowds of
+  // small cloths would waste most of a default sized block each
+  Arena arena = {0};
+  arena.block_size = sizeof(Cloth) +
+                     (2 * sizeof(Vector3) + sizeof(bool)) * count +
+                     4 * sizeof(SphereCollider) + 4 * sizeof(ClothForce) +
+                     7 * ARENA_ALIGNMENT;
+  if (tmpl->topology == CLOTH_TOPOLOGY_STRANDS)
+    arena.block_size += 5 * sizeof(float) * count;
+  Cloth *cloth = arena_alloc_zero(&arena, sizeof(Cloth));
+  if (!cloth)
+    return NULL;
+
+  cloth->position = arena_alloc(&arena, sizeof(Vector3) * count);
+  cloth->prev_position = arena_alloc(&arena, sizeof(Vector3) * count);
+  cloth->pinned = arena_alloc(&arena, sizeof(bool) * count);
+  if (tmpl->topology == CLOTH_TOPOLOGY_STRANDS)
+    cloth->strand_work = arena_alloc(&arena, 5 * sizeof(float) * count);
+  cloth->arena = arena;
+  if (!cloth->position || !cloth->prev_position || !cloth->pinned ||
+      (tmpl->topology == CLOTH_TOPOLOGY_STRANDS && !cloth->strand_work)) {
+    cloth_destroy(cloth);
+    return NULL;
+  }
+
+  cloth->tmpl = tmpl;
+  cloth->solver = &tmpl->solver;
+  cloth->particle_count = count;
+  cloth->particle_capacity = count;
+  cloth->iterations = tmpl->iterations;
+  cloth->time_step = tmpl->time_step;
+  cloth->damping = tmpl->damping;
+  cloth->substep_count = 1;
+  cloth->step_dt = tmpl->time_step;
+  cloth->particle_radius = tmpl->particle_radius;
+  cloth->gravity = tmpl->gravity;
+  cloth->volume_stiffness = 1.0f;
+  cloth->shear_stiffness = tmpl->shear_stiffness;
+  cloth->bending_stiffness = tmpl->bending_stiffness;
+  cloth->continuous_collision = true;
+
+  for (int i = 0; i < count; i++) {
+    cloth->position[i] = Vector3Transform(tmpl->rest_position[i], transform);
+  }
+  memcpy(cloth->prev_position, cloth->position, sizeof(Vector3) * count);
+  memcpy(cloth->pinned, tmpl->pinned, sizeof(bool) * count);
+  return cloth;
+}
+
+Cloth *cloth_create(const ClothDesc *desc) {
+  ClothTemplate *tmpl = cloth_template_create(desc);
+  if (!tmpl)
+    return NULL;
+  Cloth *cloth = cloth_create_instance(tmpl, MatrixIdentity());
+  if (!cloth) {
+    cloth_template_destroy(tmpl);
+    return NULL;
+  }
+  cloth->owned_tmpl = tmpl;
+  return cloth;
+}
+
+void cloth_destroy(Cloth *cloth) {
+  if (!cloth)
+    return;
+  ClothTemplate *owned_tmpl = cloth->owned_tmpl;
+  sparse_cholesky_destroy(cloth->global.chol);
+  arena_free(&cloth->global.arena);
+  arena_free(&cloth->scratch);
+  // the cloth itself lives in its arena
+  Arena arena = cloth->arena;
+  arena_free(&arena);
+  cloth_template_destroy(owned_tmpl);
+}
+
+int cloth_particle_count(const Cloth *cloth) { return cloth->particle_count; }
+
+const Vector3 *cloth_positions(const Cloth *cloth) { return cloth->position; }
+
+bool cloth_is_pinned(const Cloth *cloth, int index) {
+  return cloth->pinned[index];
+}
+
+void cloth_set_pinned(Cloth *cloth, int index, bool pinned) {
+  if (cloth->pinned[index] == pinned)
+    return;
+  cloth->pinned[index] = pinned;
+  cloth->solver_dirty = true;
+  cloth->anchors_valid = false;
+}
+
+void cloth_set_position(Cloth *cloth, int index, Vector3 position) {
+  cloth->position[index] = position;
+  cloth->prev_position[index] = position;
+  if (cloth->tear)
+    cloth->tear->bounds_valid = false;
+}
+
+int cloth_edge_count(const Cloth *cloth) {
+  const ClothTemplate *tmpl = cloth->tmpl;
+  if (tmpl->topology == CLOTH_TOPOLOGY_GRID) {
+    int cols = tmpl->grid_cols;
+    int rows = tmpl->grid_rows;
+    return (cols - 1) * rows + (rows - 1) * cols;
+  }
+  if (tmpl->topology == CLOTH_TOPOLOGY_STRANDS)
+    return (tmpl->grid_rows - 1) * tmpl->grid_cols;
+  if (tmpl->topology == CLOTH_TOPOLOGY_RAGDOLLS)
+    return tmpl->bone_count * tmpl->grid_cols;
+  return tmpl->constraint_count;
+}
+
+// Grid links are numbered horizontal first, row by row, then vertical.
+// Strand links are numbered by their upper particle, ragdoll bones bone by
+// bone across all ragdolls. Angle limits aren't edges.
+void cloth_get_edge(const Cloth *cloth, int index, int *p1, int *p2) {
+  const ClothTemplate *tmpl = cloth->tmpl;
+  if (tmpl->topology == CLOTH_TOPOLOGY_RAGDOLLS) {
+    int cols = tmpl->grid_cols;
+    const RagdollLink *bone = &tmpl->links[index / cols];
+    *p1 = bone->a * cols + index % cols;
+    *p2 = bone->b * cols + index % cols;
+    return;
+  }
+  if (tmpl->topology == CLOTH_TOPOLOGY_STRANDS) {
+    *p1 = index;
+    *p2 = index + tmpl->grid_cols;
+    return;
+  }
+  if (tmpl->topology == CLOTH_TOPOLOGY_GRID) {
+    int cols = tmpl->grid_cols;
+    int horizontal = (cols - 1) * tmpl->grid_rows;
+    if (index < horizontal) {
+      *p1 = (index / (cols - 1)) * cols + index % (cols - 1);
+      *p2 = *p1 + 1;
+    } else {
+      *p1 = index - horizontal;
+      *p2 = *p1 + cols;
+    }
+    return;
+  }
+  *p1 = tmpl->constraints[index].p1;
+  *p2 = tmpl->constraints[index].p2;
+}
+
+int cloth_add_sphere_collider(Cloth *cloth, Vector3 center, float radius) {
+  if (cloth->sphere_count == cloth->sphere_capacity) {
+    int capacity = cloth->sphere_capacity ? cloth->sphere_capacity * 2 : 4;
+    SphereCollider *spheres = arena_realloc(
+        &cloth->arena, cloth->spheres,
+        sizeof(SphereCollider) * cloth->sphere_capacity,
+        sizeof(SphereCollider) * capacity);
+    if (!spheres)
+      return -1;
+    cloth->spheres = spheres;
+    cloth->sphere_capacity = capacity;
+  }
+  cloth->spheres[cloth->sphere_count] =
+      (SphereCollider){center, radius, center, center, center, center};
+  return cloth->sphere_count++;
+}
+
+void cloth_set_sphere_collider(Cloth *cloth, int id, Vector3 center,
+                               float radius) {
+  cloth->spheres[id].center = center;
+  cloth->spheres[id].radius = radius;
+}
+
+int cloth_add_mesh_collider(Cloth *cloth, const ClothMeshCollider *mesh,
+                            float thickness) {
+  if (cloth->mesh_count == cloth->mesh_capacity) {
+    int capacity = cloth->mesh_capacity ? cloth->mesh_capacity * 2 : 4;
+    MeshCollider *meshes = arena_realloc(
+        &cloth->arena, cloth->meshes,
+        sizeof(MeshCollider) * cloth->mesh_capacity,
+        sizeof(MeshCollider) * capacity);
+    if (!meshes)
+      return -1;
+    cloth->meshes = meshes;
+    cloth->mesh_capacity = capacity;
+  }
+  cloth->meshes[cloth->mesh_count] = (MeshCollider){mesh, thickness};
+  return cloth->mesh_count++;
+}
+
+int cloth_add_sdf_collider(Cloth *cloth, const ClothSdfCollider *sdf,
+                           float thickness) {
+  if (cloth->sdf_count == cloth->sdf_capacity) {
+    int capacity = cloth->sdf_capacity ? cloth->sdf_capacity * 2 : 4;
+    SdfCollider *sdfs = arena_realloc(&cloth->arena, cloth->sdfs,
+                                      sizeof(SdfCollider) * cloth->sdf_capacity,
+                                      sizeof(SdfCollider) * capacity);
+    if (!sdfs)
+      return -1;
+    cloth->sdfs = sdfs;
+    cloth->sdf_capacity = capacity;
+  }
+  cloth->sdfs[cloth->sdf_count] = (SdfCollider){sdf, thickness};
+  return cloth->sdf_count++;
+}
+
+bool cloth_set_tearing(Cloth *cloth, float stretch_ratio) {
+  if (stretch_ratio <= 0.0f) {
+    cloth->tear_ratio_sq = 0.0f;
+    return true;
+  }
+  // implicit grid links can't be removed, tearing a shared template would
+  // tear every instance and split particles would leave tetrahedra behind
+  if (cloth->tmpl->topology != CLOTH_TOPOLOGY_EXPLICIT || !cloth->owned_tmpl ||
+      cloth->tmpl->tetrahedron_count > 0)
+    return false;
+  if (!cloth->tear && !init_tearing(cloth))
+    return false;
+  cloth->tear_ratio_sq = stretch_ratio * stretch_ratio;
+  return true;
+}
+
+int cloth_cut(Cloth *cloth, ClothRay from, ClothRay to) {
+  if (cloth->tmpl->topology != CLOTH_TOPOLOGY_EXPLICIT || !cloth->owned_tmpl ||
+      cloth->tmpl->tetrahedron_count > 0)
+    return -1;
+  if (cloth->particle_count == 0)
+    return 0;
+  if (!cloth->tear && !init_tearing(cloth))
+    return -1;
+  return cut_constraints(cloth, from, to);
+}
+
+bool cloth_set_global_solve(Cloth *cloth, int newton_steps) {
+  if (newton_steps <= 0) {
+    cloth->global.newton_steps = 0;
+    release_global_solve(cloth);
+    return true;
+  }
+  if (cloth->tmpl->topology != CLOTH_TOPOLOGY_EXPLICIT)
+    return false;
+  cloth->global.newton_steps = newton_steps;
+  return true;
+}
+
+int cloth_add_shape_cluster(Cloth *cloth, const int *particles, int count,
+                            float stiffness) {
+  if (count < 2)
+    return -1;
+  for (int i = 0; i < count; i++) {
+    if (particles[i] < 0 || particles[i] >= cloth->particle_count)
+      return -1;
+  }
+  if (cloth->cluster_count == cloth->cluster_capacity) {
+    int capacity = cloth->cluster_capacity ? cloth->cluster_capacity * 2 : 4;
+    ShapeCluster *clusters = arena_realloc(
+        &cloth->arena, cloth->clusters,
+        sizeof(ShapeCluster) * cloth->cluster_capacity,
+        sizeof(ShapeCluster) * capacity);
+    if (!clusters)
+      return -1;
+    cloth->clusters = clusters;
+    cloth->cluster_capacity = capacity;
+  }
+  if (cloth->member_count + count > cloth->member_capacity) {
+    int capacity = cloth->member_capacity ? cloth->member_capacity * 2 : 64;
+    while (capacity < cloth->member_count + count)
+      capacity *= 2;
+    int *members = arena_realloc(&cloth->arena, cloth->cluster_particles,
+                                 sizeof(int) * cloth->member_capacity,
+                                 sizeof(int) * capacity);
+    if (!members)
+      return -1;
+    cloth->cluster_particles = members;
+    Vector3 *rest = arena_realloc(&cloth->arena, cloth->cluster_rest,
+                                  sizeof(Vector3) * cloth->member_capacity,
+                                  sizeof(Vector3) * capacity);
+    if (!rest)
+      return -1;
+    cloth->cluster_rest = rest;
+    cloth->member_capacity = capacity;
+  }
+
+  Vector3 center = {0, 0, 0};
+  for (int i = 0; i < count; i++) {
+    center = Vector3Add(center, cloth->position[particles[i]]);
+  }
+  center = Vector3Scale(center, 1.0f / count);
+  int first = cloth->member_count;
+  for (int i = 0; i < count; i++) {
+    cloth->cluster_particles[first + i] = particles[i];
+    cloth->cluster_rest[first + i] =
+        Vector3Subtract(cloth->position[particles[i]], center);
+  }
+  cloth->member_count += count;
+  cloth->clusters[cloth->cluster_count] = (ShapeCluster){
+      .rotation = {0, 0, 0, 1},
+      .first = first,
+      .count = count,
+      .stiffness = Clamp(stiffness, 0.0f, 1.0f),
+  };
+  return cloth->cluster_count++;
+}
+
+void cloth_set_shape_plasticity(Cloth *cloth, int id, float yield,
+                                float creep) {
+  cloth->clusters[id].yield = fmaxf(yield, 0.0f);
+  cloth->clusters[id].creep = Clamp(creep, 0.0f, 1.0f);
+}
+
+bool cloth_set_strain_limit(Cloth *cloth, float max_stretch) {
+  if (max_stretch <= 0.0f) {
+    cloth->strain_limit = 0.0f;
+    return true;
+  }
+  // strands and ragdolls solve their links their own way
+  ClothTopology topology = cloth->tmpl->topology;
+  if (topology != CLOTH_TOPOLOGY_GRID && topology != CLOTH_TOPOLOGY_EXPLICIT)
+    return false;
+  cloth->strain_limit = 1.0f + max_stretch;
+  return true;
+}
+
+void cloth_set_volume_stiffness(Cloth *cloth, float stiffness) {
+  cloth->volume_stiffness = Clamp(stiffness, 0.0f, 1.0f);
+}
+
+bool cloth_set_shear_stiffness(Cloth *cloth, float stiffness) {
+  if (stiffness <= 0.0f) {
+    cloth->shear_stiffness = 0.0f;
+    return true;
+  }
+  // meshes shear through their edges, strands and ragdolls don't shear
+  if (cloth->tmpl->topology != CLOTH_TOPOLOGY_GRID)
+    return false;
+  cloth->shear_stiffness = fminf(stiffness, 1.0f);
+  return true;
+}
+
+bool cloth_set_bending_stiffness(Cloth *cloth, float stiffness) {
+  if (stiffness <= 0.0f) {
+    cloth->bending_stiffness = 0.0f;
+    return true;
+  }
+  const ClothTemplate *tmpl = cloth->tmpl;
+  // a mesh only has dihedrals when its desc asked for bending
+  bool bends = tmpl->topology == CLOTH_TOPOLOGY_GRID ||
+               (tmpl->topology == CLOTH_TOPOLOGY_EXPLICIT &&
+                tmpl->bending_stiffness > 0.0f);
+  if (!bends)
+    return false;
+  cloth->bending_stiffness = fminf(stiffness, 1.0f);
+  return true;
+}
+
+void cloth_set_adaptive_step(Cloth *cloth, float courant, int max_substeps) {
+  bool enabled = courant > 0.0f && max_substeps > 1;
+  cloth->courant = enabled ? courant : 0.0f;
+  cloth->max_substeps = enabled ? max_substeps : 0;
+}
+
+int cloth_get_substep_count(const Cloth *cloth) {
+  return cloth->substep_count;
+}
+
+void cloth_set_continuous_collision(Cloth *cloth, bool enabled) {
+  cloth->continuous_collision = enabled;
+}
+
+void cloth_set_wind(Cloth *cloth, Vector3 acceleration) {
+  cloth->wind = acceleration;
+}
+
+int cloth_add_force(Cloth *cloth, ClothForce force) {
+  if (cloth->force_count == cloth->force_capacity) {
+    int capacity = cloth->force_capacity ? cloth->force_capacity * 2 : 4;
+    ClothForce *forces =
+        arena_realloc(&cloth->arena, cloth->forces,
+                      sizeof(ClothForce) * cloth->force_capacity,
+                      sizeof(ClothForce) * capacity);
+    if (!forces)
+      return -1;
+    cloth->forces = forces;
+    cloth->force_capacity = capacity;
+  }
+  cloth->forces[cloth->force_count] = force;
+  return cloth->force_count++;
+}
+
+void cloth_set_force(Cloth *cloth, int id, ClothForce force) {
+  cloth->forces[id] = force;
+}
+
+void cloth_enable_force(Cloth *cloth, int id, bool enabled) {
+  cloth->forces[id].enabled = enabled;
+}
+
+static size_t arena_reserved(const Arena *arena) {
+  size_t bytes = 0;
+  for (ArenaBlock *block = arena->first; block; block = block->next) {
+    bytes += block->capacity;
+  }
+  return bytes;
+}
+
+ClothStats cloth_get_stats(const Cloth *cloth) {
+  ClothStats stats = {0};
+  stats.particle_count = cloth->particle_count;
+  stats.constraint_count = cloth->tmpl->constraint_count;
+  stats.batch_count = cloth->tmpl->batch_count;
+  stats.constraint_record_bytes = (int)sizeof(PackedConstraint);
+  stats.memory_bytes = arena_reserved(&cloth->arena) +
+                       arena_reserved(&cloth->scratch) +
+                       arena_reserved(&cloth->global.arena);
+  stats.heap_allocations = cloth->arena.heap_allocations +
+                           cloth->scratch.heap_allocations +
+                           cloth->global.arena.heap_allocations;
+  if (cloth->owned_tmpl) {
+    stats.memory_bytes += arena_reserved(&cloth->owned_tmpl->arena);
+    stats.heap_allocations += cloth->owned_tmpl->arena.heap_allocations;
+  } else {
+    stats.shared_memory_bytes = arena_reserved(&cloth->tmpl->arena);
+  }
+  return stats;
+}
+
+size_t cloth_step_cost(const Cloth *cloth) {
+  size_t per_iteration =
+      (size_t)cloth_edge_count(cloth) +
+      (size_t)cloth->particle_count * (cloth->sphere_count + cloth->sdf_count);
+  // a direct solve goes down and back up every strand
+  if (cloth->tmpl->topology == CLOTH_TOPOLOGY_STRANDS)
+    per_iteration += (size_t)cloth_edge_count(cloth);
+  // angle limits cost as much as bones
+  if (cloth->tmpl->topology == CLOTH_TOPOLOGY_RAGDOLLS)
+    per_iteration += (size_t)(cloth->tmpl->link_count -
+                              cloth->tmpl->bone_count) *
+                     cloth->tmpl->grid_cols;
+  // a Newton step factors the system and solves with the factor twice
+  size_t iterations = (size_t)cloth->iterations;
+  if (cloth->global.newton_steps > 0) {
+    iterations = (size_t)cloth->global.newton_steps;
+    if (cloth->global.chol)
+      per_iteration += sparse_cholesky_factor_flops(cloth->global.chol) +
+                       2 * sparse_cholesky_factor_nonzeros(cloth->global.chol);
+  }
+  // a tetrahedron moves four corners, about two sticks' work, a dihedral
+  // also needs its angle and takes about five
+  per_iteration += 2 * (size_t)cloth->tmpl->tetrahedron_count;
+  if (cloth->bending_stiffness > 0.0f)
+    per_iteration += 5 * (size_t)cloth->tmpl->dihedral_count;
+  // the grid stencils have about as many links as the grid itself
+  if (cloth->tmpl->topology == CLOTH_TOPOLOGY_GRID) {
+    if (cloth->shear_stiffness > 0.0f)
+      per_iteration += (size_t)cloth_edge_count(cloth);
+    if (cloth->bending_stiffness > 0.0f)
+      per_iteration += (size_t)cloth_edge_count(cloth);
+  }
+  // a fit and a pull per cluster member
+  per_iteration += 2 * (size_t)cloth->member_count;
+  // a query descends about log2 of the triangle count
+  for (int m = 0; m < cloth->mesh_count; m++) {
+    int depth = 1;
+    int triangles = cloth_mesh_collider_triangle_count(cloth->meshes[m].mesh);
+    while (triangles >>= 1)
+      depth++;
+    per_iteration += (size_t)cloth->particle_count * depth;
+  }
+  int local_forces = 0;
+  for (int f = 0; f < cloth->force_count; f++) {
+    if (!cloth->forces[f].enabled)
+      continue;
+    // about two triangles per particle
+    if (cloth->forces[f].type == CLOTH_FORCE_AERODYNAMIC)
+      local_forces += 2;
+    else if (cloth->forces[f].type != CLOTH_FORCE_UNIFORM)
+      local_forces++;
+  }
+  // strain limiting visits every particle and constraint once more per
+  // substep, tearing once per step and cut bounds every particle once per
+  // step
+  size_t substep = iterations * per_iteration +
+                   (size_t)cloth->particle_count * (1 + local_forces);
+  if (cloth->strain_limit > 0.0f)
+    substep += (size_t)cloth->particle_count + cloth_edge_count(cloth);
+  size_t tearing =
+      cloth->tear_ratio_sq > 0.0f ? (size_t)cloth_edge_count(cloth) : 0;
+  if (cloth->tear)
+    tearing += (size_t)cloth->particle_count;
+  return (size_t)plan_substeps(cloth) * substep + tearing;
+}
@@ -0,0 +1,416 @@
+/**
+ * libcloth - Verlet cloth simulation core
+ *
+ * Implementation based on Thomas Jakobsen's 2001 paper
+ * "Advanced Character Physics"
+ *
+ * Every Cloth owns all of its state (particles, colliders and memory
+ * arenas), there are no globals. Topology (constraints, coloring, rest
+ * lengths, initial pinning) lives in a ClothTemplate, either private to the
+ * cloth or shared read-only by many instances. Different instances can be
+ * stepped from different threads at the same time, a single instance must
+ * only be used by one thread at a time.
+ */
+
+#ifndef CLOTH_H_
+#define CLOTH_H_
+
+#include <raymath.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define CLOTH_DEFAULT_ITERATIONS 5 // Increase iterations for stiffer cloth
+#define CLOTH_DEFAULT_TIME_STEP 0.2f
+#define CLOTH_DEFAULT_DAMPING 0.99f
+#define CLOTH_DEFAULT_GRAVITY 0.8f
+#define CLOTH_DEFAULT_PARTICLE_RADIUS 2.5f
+
+typedef struct Cloth Cloth;
+typedef struct ClothTemplate ClothTemplate;
+struct JobGraph; // jobs.h
+
+typedef enum {
+  // general meshes, constraints stored as explicit p1/p2/rest_length records
+  CLOTH_TOPOLOGY_EXPLICIT,
+  // regular grid, neighbors implied by (row, col) and rest length by spacing
+  CLOTH_TOPOLOGY_GRID,
+  // independent chains such as ropes or hair: column c of the grid is one
+  // strand of rows particles. Each iteration solves a strand's links
+  // directly, one holds them at rest length in a steady wind, heavier loads
+  // need two or more and with too few stretch instead of settling.
+  CLOTH_TOPOLOGY_STRANDS,
+  // crowds of articulated bodies as in the paper: positions and edges below
+  // are the joints and bones of one skeleton and cols copies of it are
+  // solved side by side, one per SIMD lane. Joint j of ragdoll r is particle
+  // j * cols + r. Skeletons past 512 joints lose the faster chunked solve.
+  CLOTH_TOPOLOGY_RAGDOLLS,
+} ClothTopology;
+
+// Keeps the angle at joint b between its bones to a and c within
+// [min_angle, max_angle] radians, 0 folds them onto each other and PI
+// stretches them out. Solved as a bound on the distance from a to c, so it
+// limits how far the joint opens or closes but not in which direction.
+typedef struct {
+  int a;
+  int b;
+  int c;
+  float min_angle;
+  float max_angle;
+} ClothAngleLimit;
+
+typedef struct {
+  ClothTopology topology;
+
+  // Grid source: particle (row, col) starts at origin + (col, row) * spacing.
+  // CLOTH_TOPOLOGY_EXPLICIT with no mesh below builds the same grid with
+  // explicit constraints.
+  int cols;
+  int rows;
+  float spacing;
+  Vector3 origin;
+
+  // Mesh source for CLOTH_TOPOLOGY_EXPLICIT, skeleton for
+  // CLOTH_TOPOLOGY_RAGDOLLS. Edges are pairs of particle indices, rest
+  // lengths are taken from the initial positions.
+  // Triangles are optional index triples, only aerodynamic forces use them.
+  // Tetrahedra are optional index quadruples that keep their rest volume,
+  // which makes a tetrahedral mesh a soft body.
+  const Vector3 *positions;
+  int particle_count;
+  const int *edges;
+  int edge_count;
+  const int *triangles;
+  int triangle_count;
+  const int *tetrahedra;
+  int tetrahedron_count;
+
+  // Ragdolls, only for CLOTH_TOPOLOGY_RAGDOLLS. Ragdoll r starts as the
+  // skeleton moved by transforms[r], or by origin + (r * spacing, 0, 0)
+  // when transforms is NULL. Rest lengths and limits are measured per
+  // ragdoll, so transforms may scale them.
+  const ClothAngleLimit *angle_limits;
+  int angle_limit_count;
+  const Matrix *transforms;
+
+  // Optional, one flag per particle, NULL pins nothing. Ragdolls take one
+  // flag per skeleton joint.
+  const bool *pinned;
+
+  int iterations;
+  float time_step;
+  float damping;
+  float particle_radius;
+  Vector3 gravity;
+
+  // Share of the error corrected per iteration, 0 (the default) leaves the
+  // material out. Grids resist shear with diagonal links across their quads
+  // and bending with links skipping one particle, both implied by the grid
+  // like its own links. Meshes resist shear through their edges and bend
+  // across every edge of two triangles, whose dihedrals are only built when
+  // bending_stiffness is set here. Grid bending takes under twice the step
+  // time. A dihedral costs about five sticks and a mesh has half again as
+  // many dihedrals as sticks, so mesh bending takes about 8 times the step
+  // time and 20 bytes per dihedral. Creation fails with shear on anything
+  // but grids and bending on strands and ragdolls, as the setters do.
+  float shear_stiffness;
+  float bending_stiffness;
+} ClothDesc;
+
+typedef struct {
+  int particle_count;
+  int constraint_count;
+  int batch_count;
+  int constraint_record_bytes;
+  // bytes reserved by the arenas of this instance, including its template
+  // when it isn't shared
+  size_t memory_bytes;
+  // bytes of a template shared with other instances
+  size_t shared_memory_bytes;
+  // number of times the instance went to the heap since creation
+  size_t heap_allocations;
+} ClothStats;
+
+// Library defaults, fill in the source and tweak from there
+ClothDesc cloth_default_desc(void);
+
+// Returns NULL when the description is invalid or memory runs out
+Cloth *cloth_create(const ClothDesc *desc);
+void cloth_destroy(Cloth *cloth);
+
+// Builds the topology once for any number of identical cloths. Instances
+// only allocate their particles, the template must outlive all of them.
+ClothTemplate *cloth_template_create(const ClothDesc *desc);
+void cloth_template_destroy(ClothTemplate *tmpl);
+// Places a new instance at the template positions moved by transform
+Cloth *cloth_create_instance(const ClothTemplate *tmpl, Matrix transform);
+
+// One time step: forces, Verlet integration, constraints and collisions, in
+// substeps when adaptive (see cloth_set_adaptive_step)
+bool cloth_step(Cloth *cloth);
+
+int cloth_particle_count(const Cloth *cloth);
+// Live particle positions, valid until the next step or destroy
+const Vector3 *cloth_positions(const Cloth *cloth);
+bool cloth_is_pinned(const Cloth *cloth, int index);
+void cloth_set_pinned(Cloth *cloth, int index, bool pinned);
+// Moves a particle and kills its velocity, for dragging
+void cloth_set_position(Cloth *cloth, int index, Vector3 position);
+
+// Constraints as particle pairs, implicit grid links are enumerated too
+int cloth_edge_count(const Cloth *cloth);
+void cloth_get_edge(const Cloth *cloth, int index, int *p1, int *p2);
+
+// Returns the collider id or -1 when out of memory
+int cloth_add_sphere_collider(Cloth *cloth, Vector3 center, float radius);
+// Moves a collider. The next step sweeps it from where the previous step
+// left it, so a fast sphere pushes the cloth instead of passing through.
+void cloth_set_sphere_collider(Cloth *cloth, int id, Vector3 center,
+                               float radius);
+// Static or skinned triangle mesh with a bounding volume hierarchy, shared
+// read-only by any number of cloths. Faces are one sided, their front is
+// where (b - a) x (c - a) points.
+typedef struct ClothMeshCollider ClothMeshCollider;
+
+// indices holds three vertex indices per triangle, returns NULL when they
+// are out of range or memory runs out
+ClothMeshCollider *cloth_mesh_collider_create(const Vector3 *vertices,
+                                              int vertex_count,
+                                              const int *indices,
+                                              int triangle_count);
+void cloth_mesh_collider_destroy(ClothMeshCollider *mesh);
+// Moves every vertex and refits the hierarchy, much cheaper than creating
+// the collider again. Not while a cloth using it is stepping.
+void cloth_mesh_collider_update(ClothMeshCollider *mesh,
+                                const Vector3 *vertices);
+int cloth_mesh_collider_triangle_count(const ClothMeshCollider *mesh);
+// Nearest point of the mesh within max_distance of point and the unit normal
+// of its face, false when there is none
+bool cloth_mesh_collider_closest(const ClothMeshCollider *mesh, Vector3 point,
+                                 float max_distance, Vector3 *closest,
+                                 Vector3 *normal);
+
+// Keeps particles thickness away from the mesh, which must outlive the
+// cloth. Returns the collider id or -1 when out of memory.
+int cloth_add_mesh_collider(Cloth *cloth, const ClothMeshCollider *mesh,
+                            float thickness);
+
+// Static geometry baked into a voxel grid of signed distances, negative
+// inside, shared read-only by any number of cloths. Contacts cost one
+// trilinear lookup per particle however complex the geometry is.
+typedef struct ClothSdfCollider ClothSdfCollider;
+typedef float (*ClothDistanceFunction)(Vector3 point, void *user);
+
+// Samples distance at every voxel corner of the box [min, max], at most 1024
+// per axis. Returns NULL when the box is empty or memory runs out.
+ClothSdfCollider *cloth_sdf_collider_create(Vector3 min, Vector3 max,
+                                            float voxel_size,
+                                            ClothDistanceFunction distance,
+                                            void *user);
+// The same from a closed mesh, inside is behind its faces
+ClothSdfCollider *cloth_sdf_collider_create_from_mesh(
+    const ClothMeshCollider *mesh, Vector3 min, Vector3 max,
+    float voxel_size);
+void cloth_sdf_collider_destroy(ClothSdfCollider *sdf);
+// Caches a baked field on disk, in native byte order
+bool cloth_sdf_collider_save(const ClothSdfCollider *sdf, const char *path);
+ClothSdfCollider *cloth_sdf_collider_load(const char *path);
+// Distances and, unless gradients is NULL, their gradients at count points.
+// Outside the box the distance keeps growing from the nearest border sample.
+void cloth_sdf_collider_sample(const ClothSdfCollider *sdf,
+                               const Vector3 *points, int count,
+                               float *distances, Vector3 *gradients);
+
+// Keeps particles thickness outside the field, which must outlive the cloth.
+// Returns the collider id or -1 when out of memory.
+int cloth_add_sdf_collider(Cloth *cloth, const ClothSdfCollider *sdf,
+                           float thickness);
+
+// Continuous collision (on by default) tests every particle's path against
+// the swept spheres, off only tests where particles end up
+void cloth_set_continuous_collision(Cloth *cloth, bool enabled);
+
+// Adaptive substeps: a step is split into up to max_substeps equal substeps,
+// as many as keep the fastest particle and every sphere collider from moving
+// more than courant times the smaller of the particle radius and the
+// shortest constraint per substep. Particle speed is judged from the last
+// substep, so quiet scenes take a single one and violent ones more. Verlet
+// rescales the velocity it carries over whenever the substep length changes.
+// max_substeps below 2 turns it off.
+void cloth_set_adaptive_step(Cloth *cloth, float courant, int max_substeps);
+// Substeps the last step was split into
+int cloth_get_substep_count(const Cloth *cloth);
+
+// Strain limiting: after the last iteration every particle is pulled to
+// within 1 + max_stretch times its rest distance along the cloth from its
+// nearest pin, then one more pass over the sticks pulls back any stretched
+// past 1 + max_stretch times its rest length. The pull takes the weight of
+// long hanging columns off the sticks below the pins, which a pass over the
+// sticks alone only passes on a stick or two, so a settled sheet at 2
+// iterations stays within 10% for about half again the step time. Nearest
+// pins are found when the limit is first used and again after pinning or
+// tearing changes. 0.1 clamps at 10%, 0 turns it off. Fails on strands and
+// ragdolls.
+bool cloth_set_strain_limit(Cloth *cloth, float max_stretch);
+
+// Constraints stretched past stretch_ratio (above 1) times their rest length
+// break at the end of a step, 0 turns tearing off. A particle whose
+// triangles come apart on both sides of a tear is split in two. Only for
+// explicit topologies the cloth owns without tetrahedra, fails on grids,
+// soft bodies and instances of a shared template. Edges, triangles,
+// dihedrals and new particles are updated in place, a tear costs about the
+// same however big the cloth is.
+bool cloth_set_tearing(Cloth *cloth, float stretch_ratio);
+
+// A ray like raylib's, the library only depends on raymath
+typedef struct {
+  Vector3 position;
+  Vector3 direction;
+} ClothRay;
+
+// Cuts every constraint crossed by a blade swept from one ray to another,
+// such as the mouse ray of the last frame and this one. Cut constraints are
+// removed like torn ones, with the same restrictions, whether or not tearing
+// is on. Returns how many were cut, -1 where tearing isn't possible or memory
+// ran out, which cuts nothing. The first cut makes every later step bound
+// the particles in blocks for the next one.
+int cloth_cut(Cloth *cloth, ClothRay from, ClothRay to);
+
+// Solves the explicit constraints together instead of relaxing them one by
+// one: each of newton_steps linearizes the whole system and solves it with a
+// sparse Cholesky factorization, replacing the iterations. The ordering and
+// layout of the factor are kept until the topology changes. Pays off on
+// stiff cloths that would need many iterations, 0 goes back to relaxation.
+// Fails on grids, strands and ragdolls.
+bool cloth_set_global_solve(Cloth *cloth, int newton_steps);
+
+// Shape matching: the particles of a cluster are pulled towards its rest
+// shape, rotated and moved to fit where they are now, once per iteration.
+// The rest shape is their layout when the cluster is added. Stiffness 1
+// snaps them to it and keeps the cluster rigid however many particles it
+// has, lower values make it soft. Clusters may overlap and work with any
+// topology, a mesh without edges and one cluster is a rigid body. Returns
+// the cluster's id, -1 for fewer than two or invalid particles.
+int cloth_add_shape_cluster(Cloth *cloth, const int *particles, int count,
+                            float stiffness);
+// Makes a cluster plastic: once its particles stray from the fitted shape by
+// more than yield times its size (both RMS), its rest shape moves creep of
+// the way to the current one every pass. creep 0 keeps it elastic.
+void cloth_set_shape_plasticity(Cloth *cloth, int id, float yield,
+                                float creep);
+
+// Share of a tetrahedron's volume error corrected per iteration. 1, the
+// default, keeps soft bodies close to incompressible, lower values let them
+// squash.
+void cloth_set_volume_stiffness(Cloth *cloth, float stiffness);
+
+// Change the stiffness of the desc's materials, 0 turns one off. Shear fails
+// on anything but grids, bending on strands, ragdolls and meshes whose desc
+// had no bending_stiffness.
+bool cloth_set_shear_stiffness(Cloth *cloth, float stiffness);
+bool cloth_set_bending_stiffness(Cloth *cloth, float stiffness);
+
+// Constant acceleration added on top of gravity, zero disables it
+void cloth_set_wind(Cloth *cloth, Vector3 acceleration);
+
+// Tileable 3D vector noise baked once and shared read-only by any number of
+// cloths. Samples are trilinear and have unit RMS per component.
+typedef struct ClothWindField ClothWindField;
+
+// resolution is rounded up to a power of two of at least 16, 32 texels per
+// axis take 512 KiB
+ClothWindField *cloth_wind_field_create(int resolution, unsigned seed);
+void cloth_wind_field_destroy(ClothWindField *field);
+int cloth_wind_field_resolution(const ClothWindField *field);
+// Samples count points at point * texels_per_unit + offset, in texels, the
+// volume wraps around on every axis
+void cloth_wind_field_sample(const ClothWindField *field,
+                             const Vector3 *points, int count, Vector3 offset,
+                             float texels_per_unit, Vector3 *out);
+
+typedef enum {
+  // same acceleration everywhere, folded into the integrator as a constant
+  CLOTH_FORCE_UNIFORM,
+  // towards center, fading linearly to zero at radius, negative repels
+  CLOTH_FORCE_ATTRACTOR,
+  // acceleration for particles inside the box [min, max]
+  CLOTH_FORCE_REGION,
+  // acceleration plus gusts of strength turbulence from a wind field, one
+  // texel spans scale world units and the pattern drifts by scroll per unit
+  // of simulated time
+  CLOTH_FORCE_TURBULENCE,
+  // drag and lift on every triangle from the air velocity relative to it,
+  // plus gusts from field like CLOTH_FORCE_TURBULENCE with turbulence as a
+  // speed. Inside cloth facing the air head on at relative speed s is
+  // pushed at about drag * s^2. Grids have two triangles per quad, meshes
+  // need ClothDesc.triangles. It runs every substep at roughly 10-20 ns per
+  // triangle, a fifth to a third of a calm grid step, and gusts sampled per
+  // quad about double that.
+  CLOTH_FORCE_AERODYNAMIC,
+} ClothForceType;
+
+// A force generator, evaluated once per step over all particles or
+// triangles. Fields a type doesn't use are ignored.
+typedef struct {
+  ClothForceType type;
+  bool enabled;
+  Vector3 acceleration; // uniform, region, turbulence
+  Vector3 center;       // attractor
+  float strength;       // attractor, acceleration at the center
+  float radius;         // attractor
+  Vector3 min;          // region
+  Vector3 max;          // region
+  Vector3 velocity;            // aerodynamic, of the air
+  float drag;                  // aerodynamic
+  float lift;                  // aerodynamic
+  const ClothWindField *field; // turbulence, aerodynamic
+  float turbulence;            // turbulence, aerodynamic
+  float scale;                 // turbulence, aerodynamic
+  Vector3 scroll;              // turbulence, aerodynamic
+} ClothForce;
+
+// Returns the force id or -1 when out of memory
+int cloth_add_force(Cloth *cloth, ClothForce force);
+void cloth_set_force(Cloth *cloth, int id, ClothForce force);
+void cloth_enable_force(Cloth *cloth, int id, bool enabled);
+
+// Renumbers particles along a Morton curve for memory locality, meant for
+// meshes with scattered indices. Indices returned earlier become invalid.
+// Fails on instances of a shared template.
+bool cloth_reorder(Cloth *cloth);
+
+ClothStats cloth_get_stats(const Cloth *cloth);
+// Relative cost of one step, used to balance cloths across threads
+size_t cloth_step_cost(const Cloth *cloth);
+
+// A world steps many independent cloths on a work-stealing thread pool.
+// Cloths are balanced by their step cost, small ones are packed together
+// into one job so they don't drown in scheduling overhead.
+typedef struct ClothWorld ClothWorld;
+
+// thread_count counts the calling thread, 0 uses every core
+ClothWorld *cloth_world_create(int thread_count);
+void cloth_world_destroy(ClothWorld *world);
+int cloth_world_thread_count(const ClothWorld *world);
+
+// The world steps the cloth but doesn't own it, remove it before destroying
+bool cloth_world_add(ClothWorld *world, Cloth *cloth);
+void cloth_world_remove(ClothWorld *world, Cloth *cloth);
+int cloth_world_count(const ClothWorld *world);
+Cloth *cloth_world_get(const ClothWorld *world, int index);
+
+// Steps every cloth once, returns false if any of them failed
+bool cloth_world_step_all(ClothWorld *world);
+
+// Records the job graph of the following steps, see job_graph_write_trace()
+void cloth_world_set_tracing(ClothWorld *world, bool tracing);
+bool cloth_world_write_trace(const ClothWorld *world, const char *path);
+
+// Appends one step of the cloth to a job graph (jobs.h) as tiles per phase,
+// color batch and red-black pass, all after node after (-1 for none).
+// Returns the node that finishes the step or -1 when out of memory. On -1 the
+// cloth is untouched but some of its jobs may be in the graph already, reset
+// the graph rather than running it.
+int cloth_add_step_jobs(Cloth *cloth, struct JobGraph *graph, int group,
+                        int after);
+
+#endif // CLOTH_H_
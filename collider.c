@@ -0,0 +1,630 @@
+/**
+ * libcloth - triangle mesh and signed distance field colliders
+ *
+ * A mesh collider is a copy of the mesh with a binary bounding volume
+ * hierarchy over its triangles. The tree is built once by median splits,
+ * skinned or moving meshes only refit the boxes bottom-up, so a frame costs
+ * one pass over the vertices and nodes instead of a rebuild. Closest point
+ * queries walk the tree nearest child first and prune every box farther than
+ * the best hit so far, which keeps them logarithmic in the triangle count.
+ *
+ * A signed distance field bakes static geometry of any complexity into a
+ * voxel grid of distances once, so a particle costs one trilinear lookup
+ * whose gradient is the contact normal. Batches are sampled four points at a
+ * time with SSE, like the wind field.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "arena.h"
+#include "cloth.h"
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define CLOTH_SSE 1
+#endif
+
+// triangles per leaf, a few keep the tree shallow without long leaf scans
+#define BVH_LEAF_TRIANGLES 4
+// deeper than any tree a median split builds for 2^31 triangles
+#define BVH_MAX_DEPTH 64
+
+// Nodes are stored depth first, an inner node's left child directly follows
+// it and its right child is at first, so children always come after their
+// parent. Two nodes per cache line.
+typedef struct {
+  Vector3 min;
+  Vector3 max;
+  int first; // leaf: first triangle, inner: right child
+  int count; // leaf: triangle count, inner: 0
+} BvhNode;
+
+struct ClothMeshCollider {
+  Arena arena;
+  Vector3 *vertices;
+  int vertex_count;
+  // three vertex indices each, in leaf order
+  int (*triangles)[3];
+  int triangle_count;
+  BvhNode *nodes;
+  int node_count;
+};
+
+// Plain compares rather than Vector3Min/Max, whose fminf and fmaxf handle
+// NaNs with a libm call each and would dominate traversal
+static inline Vector3 min3(Vector3 a, Vector3 b) {
+  return (Vector3){a.x < b.x ? a.x : b.x, a.y < b.y ? a.y : b.y,
+                   a.z < b.z ? a.z : b.z};
+}
+
+static inline Vector3 max3(Vector3 a, Vector3 b) {
+  return (Vector3){a.x > b.x ? a.x : b.x, a.y > b.y ? a.y : b.y,
+                   a.z > b.z ? a.z : b.z};
+}
+
+static void triangle_bounds(const ClothMeshCollider *mesh, int t,
+                            Vector3 *min, Vector3 *max) {
+  const int *v = mesh->triangles[t];
+  *min = mesh->vertices[v[0]];
+  *max = *min;
+  for (int k = 1; k < 3; k++) {
+    *min = min3(*min, mesh->vertices[v[k]]);
+    *max = max3(*max, mesh->vertices[v[k]]);
+  }
+}
+
+static float axis_value(Vector3 v, int axis) {
+  return axis == 0 ? v.x : axis == 1 ? v.y : v.z;
+}
+
+// Quickselect on the centroid along axis, so order[first, end) is split
+// around the median at mid
+static void select_median(int *order, const Vector3 *centroids, int first,
+                          int end, int mid, int axis) {
+  while (end - first > 1) {
+    float pivot = axis_value(centroids[order[(first + end) / 2]], axis);
+    int lo = first;
+    int hi = end - 1;
+    while (lo <= hi) {
+      while (axis_value(centroids[order[lo]], axis) < pivot)
+        lo++;
+      while (axis_value(centroids[order[hi]], axis) > pivot)
+        hi--;
+      if (lo <= hi) {
+        int swap = order[lo];
+        order[lo++] = order[hi];
+        order[hi--] = swap;
+      }
+    }
+    if (mid <= hi)
+      end = hi + 1;
+    else if (mid >= lo)
+      first = lo;
+    else
+      return;
+  }
+}
+
+// Builds the subtree over order[first, end) at node and returns the next free
+// node. Boxes are left for refit_bvh().
+static int build_node(ClothMeshCollider *mesh, int node, int *order,
+                      const Vector3 *centroids, int first, int end) {
+  BvhNode *n = &mesh->nodes[node];
+  if (end - first <= BVH_LEAF_TRIANGLES) {
+    n->first = first;
+    n->count = end - first;
+    return node + 1;
+  }
+
+  Vector3 min = centroids[order[first]];
+  Vector3 max = min;
+  for (int i = first + 1; i < end; i++) {
+    min = min3(min, centroids[order[i]]);
+    max = max3(max, centroids[order[i]]);
+  }
+  Vector3 extent = Vector3Subtract(max, min);
+  int axis = extent.x >= extent.y && extent.x >= extent.z ? 0
+             : extent.y >= extent.z                      ? 1
+                                                         : 2;
+
+  // the median rounded up to whole leaves, so only one leaf of the tree is
+  // ever partly filled
+  int half = ((end - first) / 2 + BVH_LEAF_TRIANGLES - 1) /
+             BVH_LEAF_TRIANGLES * BVH_LEAF_TRIANGLES;
+  int mid = first + half;
+  select_median(order, centroids, first, end, mid, axis);
+  n->count = 0;
+  n->first = build_node(mesh, node + 1, order, centroids, first, mid);
+  return build_node(mesh, n->first, order, centroids, mid, end);
+}
+
+// Bounds bottom-up, children come after their parent so a reverse sweep
+// sees them first
+static void refit_bvh(ClothMeshCollider *mesh) {
+  for (int i = mesh->node_count - 1; i >= 0; i--) {
+    BvhNode *n = &mesh->nodes[i];
+    if (n->count > 0) {
+      triangle_bounds(mesh, n->first, &n->min, &n->max);
+      for (int t = n->first + 1; t < n->first + n->count; t++) {
+        Vector3 min, max;
+        triangle_bounds(mesh, t, &min, &max);
+        n->min = min3(n->min, min);
+        n->max = max3(n->max, max);
+      }
+    } else {
+      const BvhNode *left = &mesh->nodes[i + 1];
+      const BvhNode *right = &mesh->nodes[n->first];
+      n->min = min3(left->min, right->min);
+      n->max = max3(left->max, right->max);
+    }
+  }
+}
+
+ClothMeshCollider *cloth_mesh_collider_create(const Vector3 *vertices,
+                                              int vertex_count,
+                                              const int *indices,
+                                              int triangle_count) {
+  if (vertex_count <= 0 || triangle_count <= 0)
+    return NULL;
+  for (int i = 0; i < 3 * triangle_count; i++) {
+    if (indices[i] < 0 || indices[i] >= vertex_count)
+      return NULL;
+  }
+
+  Arena arena = {0};
+  ClothMeshCollider *mesh = arena_alloc_zero(&arena, sizeof(ClothMeshCollider));
+  if (!mesh)
+    return NULL;
+  mesh->vertices = arena_alloc(&arena, sizeof(Vector3) * vertex_count);
+  mesh->triangles = arena_alloc(&arena, sizeof(int[3]) * triangle_count);
+  // a binary tree has one inner node less than it has leaves
+  int leaves = (triangle_count + BVH_LEAF_TRIANGLES - 1) / BVH_LEAF_TRIANGLES;
+  int max_nodes = 2 * leaves - 1;
+  mesh->nodes = arena_alloc(&arena, sizeof(BvhNode) * max_nodes);
+  mesh->arena = arena;
+  mesh->vertex_count = vertex_count;
+  mesh->triangle_count = triangle_count;
+
+  Arena scratch = {0};
+  int *order = arena_alloc(&scratch, sizeof(int) * triangle_count);
+  Vector3 *centroids = arena_alloc(&scratch, sizeof(Vector3) * triangle_count);
+  if (!mesh->vertices || !mesh->triangles || !mesh->nodes || !order ||
+      !centroids) {
+    arena_free(&scratch);
+    cloth_mesh_collider_destroy(mesh);
+    return NULL;
+  }
+
+  memcpy(mesh->vertices, vertices, sizeof(Vector3) * vertex_count);
+  for (int t = 0; t < triangle_count; t++) {
+    const int *v = &indices[3 * t];
+    Vector3 sum = Vector3Add(Vector3Add(vertices[v[0]], vertices[v[1]]),
+                             vertices[v[2]]);
+    centroids[t] = Vector3Scale(sum, 1.0f / 3.0f);
+    order[t] = t;
+  }
+  mesh->node_count =
+      build_node(mesh, 0, order, centroids, 0, triangle_count);
+
+  // triangles in leaf order, so a leaf is one contiguous range
+  for (int t = 0; t < triangle_count; t++) {
+    memcpy(mesh->triangles[t], &indices[3 * order[t]], sizeof(int[3]));
+  }
+  arena_free(&scratch);
+  refit_bvh(mesh);
+  return mesh;
+}
+
+void cloth_mesh_collider_destroy(ClothMeshCollider *mesh) {
+  if (!mesh)
+    return;
+  // the collider itself lives in its arena
+  Arena arena = mesh->arena;
+  arena_free(&arena);
+}
+
+void cloth_mesh_collider_update(ClothMeshCollider *mesh,
+                                const Vector3 *vertices) {
+  memcpy(mesh->vertices, vertices, sizeof(Vector3) * mesh->vertex_count);
+  refit_bvh(mesh);
+}
+
+int cloth_mesh_collider_triangle_count(const ClothMeshCollider *mesh) {
+  return mesh->triangle_count;
+}
+
+// Closest point to p on triangle abc, from Ericson's "Real-Time Collision
+// Detection" 5.1.5: find the Voronoi region of p by its barycentric signs
+static Vector3 closest_on_triangle(Vector3 p, Vector3 a, Vector3 b,
+                                   Vector3 c) {
+  Vector3 ab = Vector3Subtract(b, a);
+  Vector3 ac = Vector3Subtract(c, a);
+  Vector3 ap = Vector3Subtract(p, a);
+  float d1 = Vector3DotProduct(ab, ap);
+  float d2 = Vector3DotProduct(ac, ap);
+  if (d1 <= 0.0f && d2 <= 0.0f)
+    return a;
+
+  Vector3 bp = Vector3Subtract(p, b);
+  float d3 = Vector3DotProduct(ab, bp);
+  float d4 = Vector3DotProduct(ac, bp);
+  if (d3 >= 0.0f && d4 <= d3)
+    return b;
+
+  float vc = d1 * d4 - d3 * d2;
+  if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+    return Vector3Add(a, Vector3Scale(ab, d1 / (d1 - d3)));
+
+  Vector3 cp = Vector3Subtract(p, c);
+  float d5 = Vector3DotProduct(ab, cp);
+  float d6 = Vector3DotProduct(ac, cp);
+  if (d6 >= 0.0f && d5 <= d6)
+    return c;
+
+  float vb = d5 * d2 - d1 * d6;
+  if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+    return Vector3Add(a, Vector3Scale(ac, d2 / (d2 - d6)));
+
+  float va = d3 * d6 - d5 * d4;
+  if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) {
+    Vector3 bc = Vector3Subtract(c, b);
+    return Vector3Add(b, Vector3Scale(bc, (d4 - d3) / ((d4 - d3) + (d5 - d6))));
+  }
+
+  float denom = 1.0f / (va + vb + vc);
+  return Vector3Add(a, Vector3Add(Vector3Scale(ab, vb * denom),
+                                  Vector3Scale(ac, vc * denom)));
+}
+
+static inline float box_distance_sq(const BvhNode *n, Vector3 p) {
+  Vector3 below = max3(Vector3Subtract(n->min, p), Vector3Zero());
+  Vector3 above = max3(Vector3Subtract(p, n->max), Vector3Zero());
+  return Vector3LengthSqr(Vector3Add(below, above));
+}
+
+bool cloth_mesh_collider_closest(const ClothMeshCollider *mesh, Vector3 point,
+                                 float max_distance, Vector3 *closest,
+                                 Vector3 *normal) {
+  float best_sq = max_distance * max_distance;
+  int best = -1;
+  Vector3 best_point = {0};
+
+  int stack[BVH_MAX_DEPTH];
+  int top = 0;
+  if (box_distance_sq(&mesh->nodes[0], point) < best_sq)
+    stack[top++] = 0;
+
+  while (top > 0) {
+    const BvhNode *n = &mesh->nodes[stack[--top]];
+    // the best hit may have improved since n was pushed
+    if (box_distance_sq(n, point) >= best_sq)
+      continue;
+
+    if (n->count > 0) {
+      for (int t = n->first; t < n->first + n->count; t++) {
+        const int *v = mesh->triangles[t];
+        Vector3 q = closest_on_triangle(point, mesh->vertices[v[0]],
+                                        mesh->vertices[v[1]],
+                                        mesh->vertices[v[2]]);
+        float dist_sq = Vector3LengthSqr(Vector3Subtract(point, q));
+        if (dist_sq < best_sq) {
+          best_sq = dist_sq;
+          best = t;
+          best_point = q;
+        }
+      }
+      continue;
+    }
+
+    // nearer child on top so it is searched first and prunes the other
+    int nearer = (int)(n - mesh->nodes) + 1;
+    int farther = n->first;
+    float nearer_sq = box_distance_sq(&mesh->nodes[nearer], point);
+    float farther_sq = box_distance_sq(&mesh->nodes[farther], point);
+    if (farther_sq < nearer_sq) {
+      int swap = nearer;
+      nearer = farther;
+      farther = swap;
+      float swap_sq = nearer_sq;
+      nearer_sq = farther_sq;
+      farther_sq = swap_sq;
+    }
+    if (farther_sq < best_sq && top < BVH_MAX_DEPTH)
+      stack[top++] = farther;
+    if (nearer_sq < best_sq && top < BVH_MAX_DEPTH)
+      stack[top++] = nearer;
+  }
+
+  if (best < 0)
+    return false;
+  const int *v = mesh->triangles[best];
+  Vector3 a = mesh->vertices[v[0]];
+  *closest = best_point;
+  *normal = Vector3Normalize(
+      Vector3CrossProduct(Vector3Subtract(mesh->vertices[v[1]], a),
+                          Vector3Subtract(mesh->vertices[v[2]], a)));
+  return true;
+}
+
+// Samples per axis stay below this, so voxel indices fit in an int
+#define SDF_MAX_SAMPLES 1024
+#define SDF_FILE_MAGIC 0x46445343u // "CSDF" little endian
+#define SDF_FILE_VERSION 1u
+
+struct ClothSdfCollider {
+  Arena arena;
+  // distances[(z * size[1] + y) * size[0] + x] at min + (x, y, z) * voxel
+  float *distances;
+  int size[3];
+  Vector3 min;
+  float voxel_size;
+};
+
+// Header of a cached field, followed by the distances. Native byte order,
+// a cache is only meant for the machine that baked it.
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  int32_t size[3];
+  float min[3];
+  float voxel_size;
+} SdfFileHeader;
+
+static ClothSdfCollider *sdf_alloc(const int size[3], Vector3 min,
+                                   float voxel_size) {
+  for (int a = 0; a < 3; a++) {
+    if (size[a] < 2 || size[a] > SDF_MAX_SAMPLES)
+      return NULL;
+  }
+  if (!(voxel_size > 0.0f))
+    return NULL;
+
+  Arena arena = {0};
+  ClothSdfCollider *sdf = arena_alloc_zero(&arena, sizeof(ClothSdfCollider));
+  if (!sdf)
+    return NULL;
+  size_t count = (size_t)size[0] * size[1] * size[2];
+  sdf->distances = arena_alloc(&arena, sizeof(float) * count);
+  sdf->arena = arena;
+  if (!sdf->distances) {
+    cloth_sdf_collider_destroy(sdf);
+    return NULL;
+  }
+  memcpy(sdf->size, size, sizeof(sdf->size));
+  sdf->min = min;
+  sdf->voxel_size = voxel_size;
+  return sdf;
+}
+
+ClothSdfCollider *cloth_sdf_collider_create(Vector3 min, Vector3 max,
+                                            float voxel_size,
+                                            ClothDistanceFunction distance,
+                                            void *user) {
+  if (!(voxel_size > 0.0f))
+    return NULL;
+  Vector3 extent = Vector3Subtract(max, min);
+  const float extents[3] = {extent.x, extent.y, extent.z};
+  int size[3];
+  for (int a = 0; a < 3; a++) {
+    float samples = ceilf(extents[a] / voxel_size) + 1.0f;
+    // also rejects NaN and inverted bounds
+    if (!(samples >= 2.0f && samples <= SDF_MAX_SAMPLES))
+      return NULL;
+    size[a] = (int)samples;
+  }
+  ClothSdfCollider *sdf = sdf_alloc(size, min, voxel_size);
+  if (!sdf)
+    return NULL;
+
+  float *out = sdf->distances;
+  for (int z = 0; z < size[2]; z++) {
+    for (int y = 0; y < size[1]; y++) {
+      for (int x = 0; x < size[0]; x++) {
+        Vector3 point = Vector3Add(
+            min, Vector3Scale((Vector3){(float)x, (float)y, (float)z},
+                              voxel_size));
+        *out++ = distance(point, user);
+      }
+    }
+  }
+  return sdf;
+}
+
+// Inside is behind the nearest face, which needs a closed mesh for a
+// meaningful sign
+static float mesh_signed_distance(Vector3 point, void *user) {
+  const ClothMeshCollider *mesh = user;
+  Vector3 closest, normal;
+  if (!cloth_mesh_collider_closest(mesh, point, INFINITY, &closest, &normal))
+    return INFINITY;
+  Vector3 diff = Vector3Subtract(point, closest);
+  float dist = Vector3Length(diff);
+  return Vector3DotProduct(diff, normal) < 0.0f ? -dist : dist;
+}
+
+ClothSdfCollider *cloth_sdf_collider_create_from_mesh(
+    const ClothMeshCollider *mesh, Vector3 min, Vector3 max,
+    float voxel_size) {
+  return cloth_sdf_collider_create(min, max, voxel_size,
+                                   mesh_signed_distance, (void *)mesh);
+}
+
+void cloth_sdf_collider_destroy(ClothSdfCollider *sdf) {
+  if (!sdf)
+    return;
+  // the collider itself lives in its arena
+  Arena arena = sdf->arena;
+  arena_free(&arena);
+}
+
+bool cloth_sdf_collider_save(const ClothSdfCollider *sdf, const char *path) {
+  FILE *file = fopen(path, "wb");
+  if (!file)
+    return false;
+
+  SdfFileHeader header = {
+      .magic = SDF_FILE_MAGIC,
+      .version = SDF_FILE_VERSION,
+      .size = {sdf->size[0], sdf->size[1], sdf->size[2]},
+      .min = {sdf->min.x, sdf->min.y, sdf->min.z},
+      .voxel_size = sdf->voxel_size,
+  };
+  size_t count = (size_t)sdf->size[0] * sdf->size[1] * sdf->size[2];
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(sdf->distances, sizeof(float), count, file) == count;
+  return fclose(file) == 0 && ok;
+}
+
+ClothSdfCollider *cloth_sdf_collider_load(const char *path) {
+  FILE *file = fopen(path, "rb");
+  if (!file)
+    return NULL;
+
+  SdfFileHeader header;
+  ClothSdfCollider *sdf = NULL;
+  if (fread(&header, sizeof(header), 1, file) == 1 &&
+      header.magic == SDF_FILE_MAGIC && header.version == SDF_FILE_VERSION) {
+    const int size[3] = {header.size[0], header.size[1], header.size[2]};
+    Vector3 min = {header.min[0], header.min[1], header.min[2]};
+    sdf = sdf_alloc(size, min, header.voxel_size);
+  }
+  if (sdf) {
+    size_t count = (size_t)sdf->size[0] * sdf->size[1] * sdf->size[2];
+    if (fread(sdf->distances, sizeof(float), count, file) != count) {
+      cloth_sdf_collider_destroy(sdf);
+      sdf = NULL;
+    }
+  }
+  fclose(file);
+  return sdf;
+}
+
+// Trilinear blend of the corners c[z][y][x] of one voxel at (u, v, w) and
+// its partial derivatives along u, v and w
+static inline float sdf_blend(const float c[8], float u, float v, float w,
+                              float derivative[3]) {
+  float c00 = c[0] + (c[1] - c[0]) * u;
+  float c10 = c[2] + (c[3] - c[2]) * u;
+  float c01 = c[4] + (c[5] - c[4]) * u;
+  float c11 = c[6] + (c[7] - c[6]) * u;
+  float c0 = c00 + (c10 - c00) * v;
+  float c1 = c01 + (c11 - c01) * v;
+  float dx0 = (c[1] - c[0]) + ((c[3] - c[2]) - (c[1] - c[0])) * v;
+  float dx1 = (c[5] - c[4]) + ((c[7] - c[6]) - (c[5] - c[4])) * v;
+  derivative[0] = dx0 + (dx1 - dx0) * w;
+  derivative[1] = (c10 - c00) + ((c11 - c01) - (c10 - c00)) * w;
+  derivative[2] = c1 - c0;
+  return c0 + (c1 - c0) * w;
+}
+
+// Voxel and position inside it along one axis, clamped to the grid, plus how
+// far outside the grid the coordinate was
+static inline int sdf_cell(float coord, int size, float *frac,
+                           float *outside) {
+  float clamped = coord < 0.0f                ? 0.0f
+                  : coord > (float)(size - 1) ? (float)(size - 1)
+                                              : coord;
+  int cell = (int)clamped;
+  if (cell > size - 2)
+    cell = size - 2;
+  *frac = clamped - (float)cell;
+  *outside = coord - clamped;
+  return cell;
+}
+
+void cloth_sdf_collider_sample(const ClothSdfCollider *sdf,
+                               const Vector3 *points, int count,
+                               float *distances, Vector3 *gradients) {
+  const float *grid = sdf->distances;
+  int row = sdf->size[0];
+  int plane = sdf->size[0] * sdf->size[1];
+  float to_voxel = 1.0f / sdf->voxel_size;
+  // corner offsets of a voxel in c[z][y][x] order
+  const int corners[8] = {0,         1,         row,         row + 1,
+                          plane,     plane + 1, plane + row, plane + row + 1};
+
+  // indices and corners are gathered per point, the blend runs over four
+  int i = 0;
+#ifdef CLOTH_SSE
+  for (; i + 4 <= count; i += 4) {
+    float c[8][4];
+    float frac[3][4];
+    float outside_sq[4];
+    for (int k = 0; k < 4; k++) {
+      Vector3 local =
+          Vector3Scale(Vector3Subtract(points[i + k], sdf->min), to_voxel);
+      float out[3];
+      int x = sdf_cell(local.x, sdf->size[0], &frac[0][k], &out[0]);
+      int y = sdf_cell(local.y, sdf->size[1], &frac[1][k], &out[1]);
+      int z = sdf_cell(local.z, sdf->size[2], &frac[2][k], &out[2]);
+      outside_sq[k] = out[0] * out[0] + out[1] * out[1] + out[2] * out[2];
+      const float *base = &grid[z * plane + y * row + x];
+      for (int n = 0; n < 8; n++) {
+        c[n][k] = base[corners[n]];
+      }
+    }
+
+    __m128 u = _mm_loadu_ps(frac[0]);
+    __m128 v = _mm_loadu_ps(frac[1]);
+    __m128 w = _mm_loadu_ps(frac[2]);
+    __m128 corner[8];
+    for (int n = 0; n < 8; n++) {
+      corner[n] = _mm_loadu_ps(c[n]);
+    }
+#define SDF_LERP(a, b, t) _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t))
+    __m128 c00 = SDF_LERP(corner[0], corner[1], u);
+    __m128 c10 = SDF_LERP(corner[2], corner[3], u);
+    __m128 c01 = SDF_LERP(corner[4], corner[5], u);
+    __m128 c11 = SDF_LERP(corner[6], corner[7], u);
+    __m128 c0 = SDF_LERP(c00, c10, v);
+    __m128 c1 = SDF_LERP(c01, c11, v);
+    __m128 dx0 = SDF_LERP(_mm_sub_ps(corner[1], corner[0]),
+                          _mm_sub_ps(corner[3], corner[2]), v);
+    __m128 dx1 = SDF_LERP(_mm_sub_ps(corner[5], corner[4]),
+                          _mm_sub_ps(corner[7], corner[6]), v);
+    __m128 dx = SDF_LERP(dx0, dx1, w);
+    __m128 dy = SDF_LERP(_mm_sub_ps(c10, c00), _mm_sub_ps(c11, c01), w);
+    __m128 dz = _mm_sub_ps(c1, c0);
+    __m128 value = SDF_LERP(c0, c1, w);
+#undef SDF_LERP
+    // in world units, past the border the distance keeps growing
+    __m128 outside = _mm_sqrt_ps(_mm_loadu_ps(outside_sq));
+    __m128 voxel = _mm_set1_ps(sdf->voxel_size);
+    _mm_storeu_ps(&distances[i], _mm_add_ps(value, _mm_mul_ps(outside, voxel)));
+    if (gradients) {
+      __m128 scale = _mm_set1_ps(to_voxel);
+      float gx[4], gy[4], gz[4];
+      _mm_storeu_ps(gx, _mm_mul_ps(dx, scale));
+      _mm_storeu_ps(gy, _mm_mul_ps(dy, scale));
+      _mm_storeu_ps(gz, _mm_mul_ps(dz, scale));
+      for (int k = 0; k < 4; k++) {
+        gradients[i + k] = (Vector3){gx[k], gy[k], gz[k]};
+      }
+    }
+  }
+#endif
+
+  for (; i < count; i++) {
+    Vector3 local =
+        Vector3Scale(Vector3Subtract(points[i], sdf->min), to_voxel);
+    float u, v, w, out[3];
+    int x = sdf_cell(local.x, sdf->size[0], &u, &out[0]);
+    int y = sdf_cell(local.y, sdf->size[1], &v, &out[1]);
+    int z = sdf_cell(local.z, sdf->size[2], &w, &out[2]);
+    const float *base = &grid[z * plane + y * row + x];
+    float c[8];
+    for (int n = 0; n < 8; n++) {
+      c[n] = base[corners[n]];
+    }
+    float derivative[3];
+    float value = sdf_blend(c, u, v, w, derivative);
+    float outside = sqrtf(out[0] * out[0] + out[1] * out[1] + out[2] * out[2]);
+    distances[i] = value + outside * sdf->voxel_size;
+    if (gradients)
+      gradients[i] = Vector3Scale(
+          (Vector3){derivative[0], derivative[1], derivative[2]}, to_voxel);
+  }
+}
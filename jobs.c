@@ -0,0 +1,518 @@
+/**
+ * Work-stealing job pool and job graphs
+ *
+ * Deques are small mutex protected ring buffers, jobs are coarse enough
+ * (whole cloths or constraint batches) that a lock per push/pop doesn't show
+ * up next to the work itself. Idle workers sleep on one condition variable.
+ */
+
+#include "jobs.h"
+
+#include <stdio.h>
+#include <time.h>
+
+#include "arena.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+typedef HANDLE JobThread;
+typedef CRITICAL_SECTION JobMutex;
+typedef CONDITION_VARIABLE JobCond;
+#define job_mutex_init(m) InitializeCriticalSection(m)
+#define job_mutex_destroy(m) DeleteCriticalSection(m)
+#define job_mutex_lock(m) EnterCriticalSection(m)
+#define job_mutex_unlock(m) LeaveCriticalSection(m)
+#define job_cond_init(c) InitializeConditionVariable(c)
+#define job_cond_destroy(c) ((void)(c))
+#define job_cond_wait(c, m) SleepConditionVariableCS(c, m, INFINITE)
+#define job_cond_broadcast(c) WakeAllConditionVariable(c)
+#else
+#include <pthread.h>
+#include <unistd.h>
+typedef pthread_t JobThread;
+typedef pthread_mutex_t JobMutex;
+typedef pthread_cond_t JobCond;
+#define job_mutex_init(m) pthread_mutex_init(m, NULL)
+#define job_mutex_destroy(m) pthread_mutex_destroy(m)
+#define job_mutex_lock(m) pthread_mutex_lock(m)
+#define job_mutex_unlock(m) pthread_mutex_unlock(m)
+#define job_cond_init(c) pthread_cond_init(c, NULL)
+#define job_cond_destroy(c) pthread_cond_destroy(c)
+#define job_cond_wait(c, m) pthread_cond_wait(c, m)
+#define job_cond_broadcast(c) pthread_cond_broadcast(c)
+#endif
+
+typedef struct {
+  JobMutex lock;
+  Job jobs[JOB_DEQUE_CAPACITY];
+  int top;    // oldest job, thieves take from here
+  int bottom; // one past the newest job, the owner takes from here
+} JobDeque;
+
+typedef struct {
+  JobPool *pool;
+  int index;
+} JobWorker;
+
+struct JobPool {
+  // the pool itself and its arrays
+  Arena arena;
+
+  // one deque per requested worker plus one for threads outside the pool,
+  // fixed before the workers start so they can read it without locking
+  JobDeque *deques;
+  JobWorker *workers;
+  JobThread *threads;
+  int thread_count;
+  int deque_count;
+
+  // guards sleeping and waking, pending counts queued jobs
+  JobMutex lock;
+  JobCond wake;
+  volatile long pending;
+  bool shutdown;
+};
+
+long job_atomic_add(volatile long *value, long amount) {
+#ifdef _MSC_VER
+  return InterlockedExchangeAdd(value, amount) + amount;
+#else
+  return __atomic_add_fetch(value, amount, __ATOMIC_ACQ_REL);
+#endif
+}
+
+static bool deque_push(JobDeque *deque, Job job) {
+  job_mutex_lock(&deque->lock);
+  bool pushed = deque->bottom - deque->top < JOB_DEQUE_CAPACITY;
+  if (pushed) {
+    deque->jobs[deque->bottom % JOB_DEQUE_CAPACITY] = job;
+    deque->bottom++;
+  }
+  job_mutex_unlock(&deque->lock);
+  return pushed;
+}
+
+static bool deque_pop(JobDeque *deque, Job *job) {
+  job_mutex_lock(&deque->lock);
+  bool popped = deque->bottom > deque->top;
+  if (popped) {
+    deque->bottom--;
+    *job = deque->jobs[deque->bottom % JOB_DEQUE_CAPACITY];
+    if (deque->bottom == deque->top)
+      deque->bottom = deque->top = 0;
+  }
+  job_mutex_unlock(&deque->lock);
+  return popped;
+}
+
+static bool deque_steal(JobDeque *deque, Job *job) {
+  job_mutex_lock(&deque->lock);
+  bool stolen = deque->bottom > deque->top;
+  if (stolen) {
+    *job = deque->jobs[deque->top % JOB_DEQUE_CAPACITY];
+    deque->top++;
+  }
+  job_mutex_unlock(&deque->lock);
+  return stolen;
+}
+
+static void run_job(JobPool *pool, Job job, int worker) {
+  job.func(job.data, worker);
+  if (job.counter && job_atomic_add(&job.counter->pending, -1) == 0) {
+    // take the lock so a waiter can't miss the wake up between its check
+    // and going to sleep
+    job_mutex_lock(&pool->lock);
+    job_cond_broadcast(&pool->wake);
+    job_mutex_unlock(&pool->lock);
+  }
+}
+
+// own deque first, then steal round the others starting past our own
+static bool try_run_one(JobPool *pool, int worker) {
+  int deque_count = pool->deque_count;
+  Job job;
+  bool found = deque_pop(&pool->deques[worker], &job);
+  for (int i = 1; !found && i < deque_count; i++) {
+    found = deque_steal(&pool->deques[(worker + i) % deque_count], &job);
+  }
+  if (!found)
+    return false;
+
+  job_atomic_add(&pool->pending, -1);
+  run_job(pool, job, worker);
+  return true;
+}
+
+#ifdef _WIN32
+static DWORD WINAPI worker_main(LPVOID arg)
+#else
+static void *worker_main(void *arg)
+#endif
+{
+  JobWorker *self = arg;
+  JobPool *pool = self->pool;
+
+  for (;;) {
+    if (try_run_one(pool, self->index))
+      continue;
+
+    job_mutex_lock(&pool->lock);
+    while (!pool->shutdown && job_atomic_add(&pool->pending, 0) == 0) {
+      job_cond_wait(&pool->wake, &pool->lock);
+    }
+    bool shutdown = pool->shutdown;
+    job_mutex_unlock(&pool->lock);
+    if (shutdown)
+      break;
+  }
+  return 0;
+}
+
+int job_pool_default_thread_count(void) {
+#ifdef _WIN32
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  int cores = (int)info.dwNumberOfProcessors;
+#else
+  int cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  // the thread calling job_pool_wait() does work too
+  return cores > 1 ? cores - 1 : 0;
+}
+
+JobPool *job_pool_create(int thread_count) {
+  if (thread_count < 0)
+    thread_count = job_pool_default_thread_count();
+
+  Arena arena = {0};
+  JobPool *pool = arena_alloc_zero(&arena, sizeof(JobPool));
+  if (!pool)
+    return NULL;
+  pool->deques =
+      arena_alloc_zero(&arena, sizeof(JobDeque) * (thread_count + 1));
+  pool->workers =
+      arena_alloc_zero(&arena, sizeof(JobWorker) * (thread_count + 1));
+  pool->threads =
+      arena_alloc_zero(&arena, sizeof(JobThread) * (thread_count + 1));
+  pool->arena = arena;
+  if (!pool->deques || !pool->workers || !pool->threads) {
+    arena_free(&arena);
+    return NULL;
+  }
+
+  job_mutex_init(&pool->lock);
+  job_cond_init(&pool->wake);
+  pool->deque_count = thread_count + 1;
+  for (int i = 0; i < pool->deque_count; i++) {
+    job_mutex_init(&pool->deques[i].lock);
+    pool->workers[i] = (JobWorker){pool, i};
+  }
+
+  for (int i = 0; i < thread_count; i++) {
+#ifdef _WIN32
+    pool->threads[i] =
+        CreateThread(NULL, 0, worker_main, &pool->workers[i], 0, NULL);
+    bool started = pool->threads[i] != NULL;
+#else
+    bool started = pthread_create(&pool->threads[i], NULL, worker_main,
+                                  &pool->workers[i]) == 0;
+#endif
+    if (!started)
+      break;
+    pool->thread_count++;
+  }
+  return pool;
+}
+
+void job_pool_destroy(JobPool *pool) {
+  if (!pool)
+    return;
+
+  job_mutex_lock(&pool->lock);
+  pool->shutdown = true;
+  job_cond_broadcast(&pool->wake);
+  job_mutex_unlock(&pool->lock);
+
+  for (int i = 0; i < pool->thread_count; i++) {
+#ifdef _WIN32
+    WaitForSingleObject(pool->threads[i], INFINITE);
+    CloseHandle(pool->threads[i]);
+#else
+    pthread_join(pool->threads[i], NULL);
+#endif
+  }
+
+  // deques of workers that failed to start were initialized as well
+  for (int i = 0; i < pool->deque_count; i++) {
+    job_mutex_destroy(&pool->deques[i].lock);
+  }
+  job_cond_destroy(&pool->wake);
+  job_mutex_destroy(&pool->lock);
+  // the pool itself lives in its arena
+  Arena arena = pool->arena;
+  arena_free(&arena);
+}
+
+int job_pool_thread_count(const JobPool *pool) { return pool->thread_count; }
+
+void job_pool_submit(JobPool *pool, int worker, Job job) {
+  if (job.counter)
+    job_atomic_add(&job.counter->pending, 1);
+
+  // outside threads share the last deque
+  if (worker < 0 || worker >= pool->deque_count)
+    worker = pool->deque_count - 1;
+
+  // count first so a worker popping the job right away never sees it negative
+  job_atomic_add(&pool->pending, 1);
+  if (!deque_push(&pool->deques[worker], job)) {
+    job_atomic_add(&pool->pending, -1);
+    run_job(pool, job, worker);
+    return;
+  }
+
+  job_mutex_lock(&pool->lock);
+  job_cond_broadcast(&pool->wake);
+  job_mutex_unlock(&pool->lock);
+}
+
+void job_pool_wait(JobPool *pool, JobCounter *counter) {
+  int self = pool->deque_count - 1;
+  while (job_atomic_add(&counter->pending, 0) > 0) {
+    if (try_run_one(pool, self))
+      continue;
+
+    job_mutex_lock(&pool->lock);
+    while (job_atomic_add(&counter->pending, 0) > 0 &&
+           job_atomic_add(&pool->pending, 0) == 0) {
+      job_cond_wait(&pool->wake, &pool->lock);
+    }
+    job_mutex_unlock(&pool->lock);
+  }
+}
+
+typedef struct {
+  JobGraph *graph;
+  JobFunc func;
+  void *data;
+  const char *name;
+  int group;
+
+  int predecessor_count;
+  volatile long remaining; // predecessors still running during a run
+  // range in JobGraph.successors, built by job_graph_run()
+  int first_successor;
+  int successor_count;
+
+  // trace of the last run, seconds since it started
+  double start;
+  double end;
+  int worker;
+} JobGraphNode;
+
+struct JobGraph {
+  // job data, reset with the graph
+  Arena arena;
+  // the graph itself and the arrays below, kept across resets
+  Arena storage;
+
+  JobGraphNode *nodes;
+  int node_count;
+  int node_capacity;
+
+  // {before, node} pairs as added, turned into successor lists on run
+  int (*edges)[2];
+  int edge_count;
+  int edge_capacity;
+  int *successors;
+  int successor_capacity;
+
+  JobPool *pool;
+  JobCounter done;
+  volatile long executed;
+
+  bool tracing;
+  bool traced;
+  double trace_start;
+};
+
+static double job_now(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// grows *array to hold at least count elements, keeps the old one on failure
+static bool grow_array(Arena *arena, void **array, int *capacity, int count,
+                       size_t element_size) {
+  if (count <= *capacity)
+    return true;
+  int new_capacity = *capacity ? *capacity : 64;
+  while (new_capacity < count)
+    new_capacity *= 2;
+  void *grown = arena_realloc(arena, *array, element_size * *capacity,
+                              element_size * new_capacity);
+  if (!grown)
+    return false;
+  *array = grown;
+  *capacity = new_capacity;
+  return true;
+}
+
+JobGraph *job_graph_create(void) {
+  Arena storage = {0};
+  JobGraph *graph = arena_alloc_zero(&storage, sizeof(JobGraph));
+  if (graph)
+    graph->storage = storage;
+  return graph;
+}
+
+void job_graph_destroy(JobGraph *graph) {
+  if (!graph)
+    return;
+  arena_free(&graph->arena);
+  // the graph itself lives in its storage arena
+  Arena storage = graph->storage;
+  arena_free(&storage);
+}
+
+void job_graph_reset(JobGraph *graph) {
+  arena_reset(&graph->arena);
+  graph->node_count = 0;
+  graph->edge_count = 0;
+  graph->traced = false;
+}
+
+int job_graph_add(JobGraph *graph, const char *name, int group, JobFunc func,
+                  void *data) {
+  if (!grow_array(&graph->storage, (void **)&graph->nodes,
+                  &graph->node_capacity, graph->node_count + 1,
+                  sizeof(JobGraphNode)))
+    return -1;
+  JobGraphNode *node = &graph->nodes[graph->node_count];
+  *node = (JobGraphNode){0};
+  node->graph = graph;
+  node->func = func;
+  node->data = data;
+  node->name = name;
+  node->group = group;
+  return graph->node_count++;
+}
+
+bool job_graph_depend(JobGraph *graph, int node, int before) {
+  if (node < 0 || before < 0 || node >= graph->node_count ||
+      before >= graph->node_count)
+    return false;
+  if (!grow_array(&graph->storage, (void **)&graph->edges,
+                  &graph->edge_capacity, graph->edge_count + 1,
+                  sizeof(graph->edges[0])))
+    return false;
+  graph->edges[graph->edge_count][0] = before;
+  graph->edges[graph->edge_count][1] = node;
+  graph->edge_count++;
+  graph->nodes[node].predecessor_count++;
+  return true;
+}
+
+void *job_graph_alloc(JobGraph *graph, size_t size) {
+  return arena_alloc(&graph->arena, size);
+}
+
+int job_graph_node_count(const JobGraph *graph) { return graph->node_count; }
+
+static void run_graph_node(void *data, int worker) {
+  JobGraphNode *node = data;
+  JobGraph *graph = node->graph;
+
+  if (graph->tracing)
+    node->start = job_now() - graph->trace_start;
+  if (node->func)
+    node->func(node->data, worker);
+  if (graph->tracing) {
+    node->end = job_now() - graph->trace_start;
+    node->worker = worker;
+  }
+  job_atomic_add(&graph->executed, 1);
+
+  // released successors go to our own deque, others steal them from there
+  for (int i = 0; i < node->successor_count; i++) {
+    int index = graph->successors[node->first_successor + i];
+    JobGraphNode *next = &graph->nodes[index];
+    if (job_atomic_add(&next->remaining, -1) == 0)
+      job_pool_submit(graph->pool, worker,
+                      (Job){run_graph_node, next, &graph->done});
+  }
+}
+
+bool job_graph_run(JobGraph *graph, JobPool *pool) {
+  if (!grow_array(&graph->storage, (void **)&graph->successors,
+                  &graph->successor_capacity, graph->edge_count, sizeof(int)))
+    return false;
+
+  // counting sort of the edges by predecessor
+  for (int i = 0; i < graph->node_count; i++) {
+    graph->nodes[i].successor_count = 0;
+  }
+  for (int e = 0; e < graph->edge_count; e++) {
+    graph->nodes[graph->edges[e][0]].successor_count++;
+  }
+  int offset = 0;
+  for (int i = 0; i < graph->node_count; i++) {
+    JobGraphNode *node = &graph->nodes[i];
+    node->first_successor = offset;
+    offset += node->successor_count;
+    node->successor_count = 0;
+    node->remaining = node->predecessor_count;
+  }
+  for (int e = 0; e < graph->edge_count; e++) {
+    JobGraphNode *node = &graph->nodes[graph->edges[e][0]];
+    graph->successors[node->first_successor + node->successor_count++] =
+        graph->edges[e][1];
+  }
+
+  graph->pool = pool;
+  graph->done.pending = 0;
+  graph->executed = 0;
+  graph->traced = graph->tracing;
+  graph->trace_start = job_now();
+  for (int i = 0; i < graph->node_count; i++) {
+    if (graph->nodes[i].predecessor_count == 0)
+      job_pool_submit(pool, -1,
+                      (Job){run_graph_node, &graph->nodes[i], &graph->done});
+  }
+  job_pool_wait(pool, &graph->done);
+
+  // nodes on a cycle never become ready
+  return graph->executed == graph->node_count;
+}
+
+void job_graph_set_tracing(JobGraph *graph, bool tracing) {
+  graph->tracing = tracing;
+}
+
+bool job_graph_write_trace(const JobGraph *graph, const char *path) {
+  if (!graph->traced)
+    return false;
+  FILE *file = fopen(path, "w");
+  if (!file)
+    return false;
+
+  fprintf(file, "{\"traceEvents\":[\n");
+  for (int i = 0; i < graph->node_count; i++) {
+    const JobGraphNode *node = &graph->nodes[i];
+    fprintf(file,
+            "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,"
+            "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"node\":%d,"
+            "\"group\":%d,\"successors\":[",
+            node->name ? node->name : "join", node->worker, node->start * 1e6,
+            (node->end - node->start) * 1e6, i, node->group);
+    for (int k = 0; k < node->successor_count; k++) {
+      fprintf(file, k ? ",%d" : "%d",
+              graph->successors[node->first_successor + k]);
+    }
+    fprintf(file, "]}}%s\n", i + 1 < graph->node_count ? "," : "");
+  }
+  fprintf(file, "]}\n");
+  return fclose(file) == 0;
+}
@@ -0,0 +1,80 @@
+/**
+ * Work-stealing job pool
+ *
+ * Every worker owns a deque, it pops its own jobs newest first and steals
+ * the oldest jobs of other workers when it runs dry. Threads that wait for a
+ * counter help out by running jobs instead of blocking.
+ */
+
+#ifndef JOBS_H_
+#define JOBS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// jobs that don't fit into a full deque run inline on the submitting thread
+#define JOB_DEQUE_CAPACITY 4096
+
+typedef struct JobPool JobPool;
+
+// worker is the index of the thread running the job, threads outside the pool
+// that help in job_pool_wait() all get the last index
+typedef void (*JobFunc)(void *data, int worker);
+
+// Counts unfinished jobs, job_pool_wait() returns once it reaches zero
+typedef struct {
+  volatile long pending;
+} JobCounter;
+
+typedef struct {
+  JobFunc func;
+  void *data;
+  JobCounter *counter; // optional
+} Job;
+
+// thread_count < 0 uses one worker per core minus the calling thread, 0
+// runs everything on the thread calling job_pool_wait()
+JobPool *job_pool_create(int thread_count);
+void job_pool_destroy(JobPool *pool);
+int job_pool_thread_count(const JobPool *pool);
+int job_pool_default_thread_count(void);
+
+// worker is the index of the submitting worker or -1 from outside the pool.
+// The counter, if any, is incremented before the job becomes visible.
+void job_pool_submit(JobPool *pool, int worker, Job job);
+// Runs jobs until the counter reaches zero. Threads outside the pool share
+// one worker index, so only one of them should wait at a time.
+void job_pool_wait(JobPool *pool, JobCounter *counter);
+
+long job_atomic_add(volatile long *value, long amount);
+
+// A graph of jobs with dependencies. Nodes whose predecessors are done are
+// submitted to the pool by whichever worker finished the last of them, so
+// independent chains (different cloths, tiles of one phase) overlap freely.
+// Building is single threaded, reset keeps all memory for the next frame.
+typedef struct JobGraph JobGraph;
+
+JobGraph *job_graph_create(void);
+void job_graph_destroy(JobGraph *graph);
+void job_graph_reset(JobGraph *graph);
+
+// Returns the node index or -1 when out of memory. func may be NULL for a
+// join node. name must outlive the graph, group shows up in the trace.
+int job_graph_add(JobGraph *graph, const char *name, int group, JobFunc func,
+                  void *data);
+// node won't start before before is done
+bool job_graph_depend(JobGraph *graph, int node, int before);
+// Memory for job data, released by the next reset
+void *job_graph_alloc(JobGraph *graph, size_t size);
+int job_graph_node_count(const JobGraph *graph);
+
+// Runs every node and returns when all are done
+bool job_graph_run(JobGraph *graph, JobPool *pool);
+
+// Records start, end and worker of each node while running
+void job_graph_set_tracing(JobGraph *graph, bool tracing);
+// Writes the last traced run in Chrome trace event format (chrome://tracing,
+// Perfetto), one lane per worker, edges listed as successors
+bool job_graph_write_trace(const JobGraph *graph, const char *path);
+
+#endif // JOBS_H_
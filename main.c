@@ -4,8 +4,10 @@
  * Implementation based on Thomas Jakobsen's 2001 paper
  * "Advanced Character Physics"
  * 
- * Features: Verlet integration, distance constraints, sphere collision,
- * and interactive particle dragging.
+ * Features: Verlet integration with adaptive substeps, distance and bending
+ * constraints, sphere collision, tearing, cutting and interactive particle
+ * dragging. The simulation itself lives in libcloth (cloth.h), this is the
+ * raylib front end.
  */
 
 #include <math.h>
@@ -14,6 +16,8 @@
 #include <rlgl.h>
 #include <stdlib.h>
 
+#include "cloth.h"
+
 #define WIDTH 1000
 #define HEIGHT 1000
 
@@ -28,62 +32,57 @@
 #define PARTICLE_COLOR GetColor(0xFF6F61ff)
 #define CONSTRAINT_COLOR RAYWHITE
 
+// Cloth topology: CLOTH_TOPOLOGY_GRID (implicit neighbors) or
+// CLOTH_TOPOLOGY_EXPLICIT, only explicit cloth can tear
+#define CLOTH_TOPOLOGY CLOTH_TOPOLOGY_EXPLICIT
+
 // Physics settings
 #define GRAVITY 0.8f
 #define TIME_STEP 0.2f
 #define NUM_ITERATIONS 5 // Increase iterations for stiffer cloth
+#define SHEAR_STIFFNESS 0.5f // diagonal links, grid topology only
+#define BENDING_STIFFNESS 0.05f // skip-one links, grid topology only
+#define WIND_X 50.0f // air velocity
+#define WIND_Z 80.0f
+#define WIND_DRAG 1.2e-4f
+#define WIND_LIFT 0.6e-4f
+#define WIND_GUST_SPEED 50.0f
+#define WIND_GUST_SIZE 40.0f // world units per wind field texel
+#define ATTRACTOR_STRENGTH 3.0f
+#define ATTRACTOR_RADIUS 400.0f
+#define TEAR_STRETCH 1.8f // stick length over rest length that tears it
+#define GLOBAL_NEWTON_STEPS 2
+#define COURANT 0.5f // radii a particle may move per substep
+#define MAX_SUBSTEPS 4
 
 // Collision Sphere Constants
 #define SPHERE_RADIUS 60.0f
 #define SPHERE_MOVEMENT_ARROW_SIZE 100.0f
 #define SPHERE_MOVEMENT_ARROW_THICKNESS 5.0f
 
-typedef struct {
-  Vector3 position;
-  Vector3 prev_position;
-  Vector3 acceleration;
-  bool is_pinned;
-  Color color;
-} Particle;
-
-typedef struct Constraint {
-  int p1;
-  int p2;
-  float rest_length;
-} Constraint;
-
-typedef struct {
-  Particle *particles;
-  Constraint *constraints;
-  int particle_count;
-  int constraint_count;
-} ParticleSystem;
-
 typedef struct {
   Vector3 position;
   int selected_axis;
   Vector3 click_offset;
 } SphereMovementArrows;
 
-ParticleSystem psystem = {0};
 SphereMovementArrows movarrows = {0};
 
-Particle create_particle(float x, float y, float z, Color color, bool pinned) {
-  Particle p;
-  p.position = (Vector3){x, y, z};
-  p.prev_position = (Vector3){x, y, z};
-  p.acceleration = (Vector3){0, 0, 0};
-  p.color = color;
-  p.is_pinned = pinned;
-  return p;
-}
-
-Constraint create_constraint(int p1, int p2, float rest_length) {
-  Constraint c;
-  c.p1 = p1;
-  c.p2 = p2;
-  c.rest_length = rest_length;
-  return c;
+// Keyboard state relevant to the simulation, sampled once per frame
+typedef struct {
+  bool wind;
+  bool attract;
+  bool toggle_tearing;
+  bool toggle_global_solve;
+} FrameCommand;
+
+FrameCommand sample_input(void) {
+  FrameCommand command = {0};
+  command.wind = IsKeyDown(KEY_SPACE);
+  command.attract = IsKeyDown(KEY_F);
+  command.toggle_tearing = IsKeyPressed(KEY_T);
+  command.toggle_global_solve = IsKeyPressed(KEY_G);
+  return command;
 }
 
 // check if ray intersects with plane and return intersection point
@@ -129,112 +128,45 @@ bool CheckRayBoxCollision(Ray ray, Vector3 p1, Vector3 p2, float radius) {
   return collision.hit;
 }
 
-void resolve_sphere_collision(ParticleSystem *psystem, Vector3 spherePos,
-                              float radius) {
-  for (int i = 0; i < psystem->particle_count; i++) {
-    Particle *p = &psystem->particles[i];
-
-    Vector3 diff = Vector3Subtract(p->position, spherePos);
-    float dist = Vector3Length(diff);
-
-    // If inside sphere
-    if (dist < radius + PARTICLE_RADIUS) {
-      Vector3 normal = Vector3Normalize(diff);
-      // Push out to surface
-      Vector3 push_vec =
-          Vector3Scale(normal, (radius + PARTICLE_RADIUS) - dist);
-      p->position = Vector3Add(p->position, push_vec);
-
-      // friction
-      p->prev_position = Vector3Lerp(p->prev_position, p->position, 0.1f);
-    }
-  }
-}
-
-// verlet integration step
-void verlet(ParticleSystem *psystem) {
-  for (int i = 0; i < psystem->particle_count; i++) {
-    Particle *p = &psystem->particles[i];
-
-    if (p->is_pinned)
-      continue;
-
-    Vector3 temp = p->position;
-
-    // Calculate Velocity
-    Vector3 velocity = Vector3Subtract(p->position, p->prev_position);
-    velocity = Vector3Scale(velocity, 0.99f); // Damping
-
-    // Calculate Acceleration term (a * dt * dt)
-    Vector3 accelerationStep =
-        Vector3Scale(p->acceleration, TIME_STEP * TIME_STEP);
 
-    // Verlet Integration: next = curr + vel + acc
-    Vector3 nextPos =
-        Vector3Add(Vector3Add(p->position, velocity), accelerationStep);
-
-    p->position = nextPos;
-    p->prev_position = temp;
+Cloth *create_cloth(void) {
+  bool pinned[CLOTH_COLS * CLOTH_ROWS] = {0};
+  for (int x = 0; x < CLOTH_COLS; x++) {
+    pinned[x] = (x % 5 == 0 || x == CLOTH_COLS - 1);
   }
-}
 
-void accumulate_forces(ParticleSystem *psystem) {
-  for (int i = 0; i < psystem->particle_count; i++) {
-    Particle *p = &psystem->particles[i];
-    p->acceleration.y = GRAVITY;
-
-    if (IsKeyDown(KEY_SPACE)) {
-      p->acceleration.x = 0.5f;
-      p->acceleration.z = 0.8f;
-    } else {
-      p->acceleration.x = 0.0f;
-      p->acceleration.z = 0.0f;
-    }
+  ClothDesc desc = cloth_default_desc();
+  desc.topology = CLOTH_TOPOLOGY;
+  desc.cols = CLOTH_COLS;
+  desc.rows = CLOTH_ROWS;
+  desc.spacing = SPACING;
+  desc.origin = (Vector3){START_X, START_Y, 0};
+  desc.pinned = pinned;
+  desc.iterations = NUM_ITERATIONS;
+  desc.time_step = TIME_STEP;
+  desc.particle_radius = PARTICLE_RADIUS;
+  desc.gravity = (Vector3){0, GRAVITY, 0};
+  // meshes shear through their edges, and their dihedrals would cost several
+  // times the rest of the step
+  if (desc.topology == CLOTH_TOPOLOGY_GRID) {
+    desc.shear_stiffness = SHEAR_STIFFNESS;
+    desc.bending_stiffness = BENDING_STIFFNESS;
   }
+  return cloth_create(&desc);
 }
 
-void satisfy_constraints(ParticleSystem *psystem) {
-  for (int j = 0; j < NUM_ITERATIONS; j++) {
-    for (int i = 0; i < psystem->constraint_count; i++) {
-      Constraint *c = &psystem->constraints[i];
-      Particle *p1 = &psystem->particles[c->p1];
-      Particle *p2 = &psystem->particles[c->p2];
-
-      Vector3 delta = Vector3Subtract(p2->position, p1->position);
-      float current_dist = Vector3Length(delta);
-
-      // Avoid division by zero
-      if (current_dist == 0.0f)
-        continue;
-
-      // Calculate the difference ratio
-      // how far we are from rest length vs current length
-      float difference = (current_dist - c->rest_length) / current_dist;
-
-      // We want to move each particle half the difference
-      Vector3 correction = Vector3Scale(delta, difference * 0.5f);
-
-      if (!p1->is_pinned && !p2->is_pinned) {
-        p1->position = Vector3Add(p1->position, correction);
-        p2->position = Vector3Subtract(p2->position, correction);
-      } else if (p1->is_pinned && !p2->is_pinned) {
-        p2->position =
-            Vector3Subtract(p2->position, Vector3Scale(correction, 2.0f));
-      } else if (!p1->is_pinned && p2->is_pinned) {
-        p1->position = Vector3Add(p1->position, Vector3Scale(correction, 2.0f));
-      }
-    }
+void draw_constraints(const Cloth *cloth) {
+  Color color = Fade(CONSTRAINT_COLOR, 0.4f);
+  const Vector3 *positions = cloth_positions(cloth);
+  int edge_count = cloth_edge_count(cloth);
 
-    resolve_sphere_collision(psystem, movarrows.position, SPHERE_RADIUS);
+  for (int i = 0; i < edge_count; i++) {
+    int p1, p2;
+    cloth_get_edge(cloth, i, &p1, &p2);
+    DrawLine3D(positions[p1], positions[p2], color);
   }
 }
 
-void time_step(ParticleSystem *psystem) {
-  accumulate_forces(psystem);
-  verlet(psystem);
-  satisfy_constraints(psystem);
-}
-
 void DrawMovementArrows(Vector3 pos) {
   Vector3 directions[3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
 
@@ -358,53 +290,40 @@ int main(void) {
   movarrows.position = (Vector3){target.x, target.y, 100.0f};
   movarrows.selected_axis = -1;
 
-  // Allocate
-  int num_particles = CLOTH_COLS * CLOTH_ROWS;
-  int num_constraints =
-      (CLOTH_COLS - 1) * CLOTH_ROWS + (CLOTH_ROWS - 1) * CLOTH_COLS;
-  psystem.particles = malloc(sizeof(Particle) * num_particles);
-  psystem.constraints = malloc(sizeof(Constraint) * num_constraints);
-
-  if (!psystem.particles || !psystem.constraints) {
+  Cloth *cloth = create_cloth();
+  if (!cloth) {
     TraceLog(LOG_ERROR, "Failed to allocate memory for particle system");
     return 1;
   }
-
-  // Init Particles
-  for (int y = 0; y < CLOTH_ROWS; y++) {
-    for (int x = 0; x < CLOTH_COLS; x++) {
-      int index = y * CLOTH_COLS + x;
-      float px = START_X + x * SPACING;
-      float py = START_Y + y * SPACING;
-
-      bool pin = (y == 0 && (x % 5 == 0 || x == CLOTH_COLS - 1));
-
-      psystem.particles[index] =
-          create_particle(px, py, 0, PARTICLE_COLOR, pin);
-      psystem.particle_count++;
-    }
-  }
-
-  // Init Constraints
-  for (int y = 0; y < CLOTH_ROWS; y++) {
-    for (int x = 0; x < CLOTH_COLS; x++) {
-      int current_idx = y * CLOTH_COLS + x;
-      if (x < CLOTH_COLS - 1) {
-        psystem.constraints[psystem.constraint_count++] =
-            create_constraint(current_idx, y * CLOTH_COLS + (x + 1), SPACING);
-      }
-      if (y < CLOTH_ROWS - 1) {
-        psystem.constraints[psystem.constraint_count++] =
-            create_constraint(current_idx, (y + 1) * CLOTH_COLS + x, SPACING);
-      }
-    }
-  }
+  // fast drags and sphere moves take more substeps, a resting cloth one
+  cloth_set_adaptive_step(cloth, COURANT, MAX_SUBSTEPS);
+  int sphere_collider =
+      cloth_add_sphere_collider(cloth, movarrows.position, SPHERE_RADIUS);
+  ClothWindField *wind_field = cloth_wind_field_create(32, 1);
+  // drag and lift per triangle so the cloth billows, gusts drift along with
+  // the mean wind
+  int wind = cloth_add_force(
+      cloth, (ClothForce){.type = CLOTH_FORCE_AERODYNAMIC,
+                          .velocity = {WIND_X, 0, WIND_Z},
+                          .drag = WIND_DRAG,
+                          .lift = WIND_LIFT,
+                          .field = wind_field,
+                          .turbulence = WIND_GUST_SPEED,
+                          .scale = WIND_GUST_SIZE,
+                          .scroll = {WIND_X, 0, WIND_Z}});
+  int attractor = cloth_add_force(
+      cloth, (ClothForce){.type = CLOTH_FORCE_ATTRACTOR,
+                          .strength = ATTRACTOR_STRENGTH,
+                          .radius = ATTRACTOR_RADIUS});
 
   int dragged_particle_idx = -1;
+  Ray blade = {0}; // mouse ray of the last frame while cutting
   float time_counter = 0.0f;
 
   // UI State
   bool auto_sphere_move = false;
+  bool tearing = false;
+  bool global_solve = false;
   Rectangle toggle_btn_bounds = { 10, 70, 240, 30 };
 
   while (!WindowShouldClose()) {
@@ -447,9 +366,10 @@ int main(void) {
         float min_dist = 100000.0f;
         int closest_idx = -1;
 
-        for (int i = 0; i < psystem.particle_count; i++) {
+        const Vector3 *positions = cloth_positions(cloth);
+        for (int i = 0; i < cloth_particle_count(cloth); i++) {
           RayCollision collision =
-              GetRayCollisionSphere(ray, psystem.particles[i].position, 15.0f);
+              GetRayCollisionSphere(ray, positions[i], 15.0f);
           if (collision.hit && collision.distance < min_dist) {
             min_dist = collision.distance;
             closest_idx = i;
@@ -464,7 +384,7 @@ int main(void) {
 
       if (dragged_particle_idx != -1) {
         Ray ray = GetMouseRay(GetMousePosition(), camera);
-        Vector3 planePos = psystem.particles[dragged_particle_idx].position;
+        Vector3 planePos = cloth_positions(cloth)[dragged_particle_idx];
         Vector3 planeNormal = {0, 0, 1}; // Simple drag plane
 
         // Adjust plane normal based on view for better feel
@@ -478,35 +398,57 @@ int main(void) {
         Vector3 hitPoint = GetRayPlaneIntersection(ray, planePos, planeNormal);
 
         if (Vector3Length(hitPoint) > 0) {
-          psystem.particles[dragged_particle_idx].position = hitPoint;
-          // kill velocity
-          psystem.particles[dragged_particle_idx].prev_position = hitPoint;
+          // also kills velocity
+          cloth_set_position(cloth, dragged_particle_idx, hitPoint);
         }
       }
     }
 
-    time_step(&psystem);
+    // --- Cutting ---
+    // the blade sweeps from last frame's mouse ray to this one's
+    if (IsMouseButtonDown(MOUSE_BUTTON_RIGHT)) {
+      Ray ray = GetMouseRay(GetMousePosition(), camera);
+      if (!IsMouseButtonPressed(MOUSE_BUTTON_RIGHT))
+        cloth_cut(cloth, (ClothRay){blade.position, blade.direction},
+                  (ClothRay){ray.position, ray.direction});
+      blade = ray;
+    }
+
+    FrameCommand command = sample_input();
+    if (command.toggle_tearing &&
+        cloth_set_tearing(cloth, tearing ? 0.0f : TEAR_STRETCH))
+      tearing = !tearing;
+    if (command.toggle_global_solve &&
+        cloth_set_global_solve(cloth,
+                               global_solve ? 0 : GLOBAL_NEWTON_STEPS))
+      global_solve = !global_solve;
+    cloth_enable_force(cloth, wind, command.wind);
+    cloth_set_force(cloth, attractor,
+                    (ClothForce){.type = CLOTH_FORCE_ATTRACTOR,
+                                 .enabled = command.attract,
+                                 .center = movarrows.position,
+                                 .strength = ATTRACTOR_STRENGTH,
+                                 .radius = ATTRACTOR_RADIUS});
+
+    cloth_set_sphere_collider(cloth, sphere_collider, movarrows.position,
+                              SPHERE_RADIUS);
+    cloth_step(cloth);
 
     BeginDrawing();
     ClearBackground(GetColor(0x052A4Fff));
     BeginMode3D(camera);
 
     // Draw Constraints
-    for (int i = 0; i < psystem.constraint_count; i++) {
-      Constraint c = psystem.constraints[i];
-      Vector3 p1 = psystem.particles[c.p1].position;
-      Vector3 p2 = psystem.particles[c.p2].position;
-      DrawLine3D(p1, p2, Fade(CONSTRAINT_COLOR, 0.4f));
-    }
+    draw_constraints(cloth);
 
     // Draw Particles
-    for (int i = 0; i < psystem.particle_count; i++) {
-      Particle *p = &psystem.particles[i];
-      if (p->is_pinned)
-        DrawModel(particleModel, p->position, 1.5f,
+    const Vector3 *positions = cloth_positions(cloth);
+    for (int i = 0; i < cloth_particle_count(cloth); i++) {
+      if (cloth_is_pinned(cloth, i))
+        DrawModel(particleModel, positions[i], 1.5f,
                   RED); // Scale up pinned slightly
       else
-        DrawModel(particleModel, p->position, 1.0f, p->color);
+        DrawModel(particleModel, positions[i], 1.0f, PARTICLE_COLOR);
     }
 
     // Draw Collision Sphere
@@ -519,8 +461,14 @@ int main(void) {
     DrawGrid(100, 50.0f);
     EndMode3D();
 
-    DrawText("Space for Wind | Mouse to Drag | A/D to Rotate", 10, 10, 20, RAYWHITE);
+    DrawText("Space for Wind | F to Attract | Mouse to Drag | Right Drag to Cut | A/D to Rotate", 10, 10, 20, RAYWHITE);
     DrawFPS(10, 40);
+    DrawText(TextFormat("T: tearing (%s)", tearing ? "on" : "off"), 10, 110,
+             20, RAYWHITE);
+    DrawText(TextFormat("G: solver (%s)", global_solve ? "global" : "relaxed"),
+             10, 140, 20, RAYWHITE);
+    DrawText(TextFormat("substeps: %d", cloth_get_substep_count(cloth)), 10,
+             170, 20, RAYWHITE);
 
     // Draw Toggle Button
     DrawRectangleRec(toggle_btn_bounds, auto_sphere_move ? GREEN : RED);
@@ -530,8 +478,8 @@ int main(void) {
     EndDrawing();
   }
 
-  free(psystem.particles);
-  free(psystem.constraints);
+  cloth_destroy(cloth);
+  cloth_wind_field_destroy(wind_field);
   CloseWindow();
   return 0;
 }
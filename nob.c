@@ -76,6 +76,45 @@ bool ensure_raylib(RaylibPlatform platform) {
   return true;
 }
 
+// libcloth only needs raymath.h, which is header only, so it doesn't link
+// against raylib
+static const char *libcloth_sources[] = {"cloth", "jobs", "world", "wind",
+                                         "collider", "sparse"};
+
+bool build_libcloth(RaylibPlatform platform) {
+  for (size_t i = 0; i < ARRAY_LEN(libcloth_sources); i++) {
+    cmd_append(&command, "cc");
+    cmd_append(&command, "-Wall");
+    cmd_append(&command, "-Wextra");
+    cmd_append(&command, "-O2");
+    cmd_append(&command, temp_sprintf("-I./%s/include/", platform.dir));
+    cmd_append(&command, "-c", temp_sprintf("%s.c", libcloth_sources[i]));
+    cmd_append(&command, "-o", temp_sprintf("%s.o", libcloth_sources[i]));
+    if (!cmd_run(&command))
+      return false;
+  }
+
+  cmd_append(&command, "ar", "rcs", "libcloth.a");
+  for (size_t i = 0; i < ARRAY_LEN(libcloth_sources); i++) {
+    cmd_append(&command, temp_sprintf("%s.o", libcloth_sources[i]));
+  }
+  return cmd_run(&command);
+}
+
+bool build_bench(RaylibPlatform platform) {
+  cmd_append(&command, "cc");
+  cmd_append(&command, "-Wall");
+  cmd_append(&command, "-Wextra");
+  cmd_append(&command, "-O2");
+  cmd_append(&command, temp_sprintf("-I./%s/include/", platform.dir));
+  cmd_append(&command, "-o", "bench", "bench.c");
+  cmd_append(&command, "libcloth.a");
+#ifndef _WIN32
+  cmd_append(&command, "-lm", "-lpthread");
+#endif
+  return cmd_run(&command);
+}
+
 int main(int argc, char **argv) {
   NOB_GO_REBUILD_URSELF(argc, argv);
 
@@ -86,12 +125,18 @@ int main(int argc, char **argv) {
     return 1;
   }
 
+  if (!build_libcloth(platform)) {
+    nob_log(NOB_ERROR, "Failed to build libcloth");
+    return 1;
+  }
+
   // Build main application
   cmd_append(&command, "cc");
   cmd_append(&command, "-Wall");
   cmd_append(&command, "-Wextra");
   cmd_append(&command, temp_sprintf("-I./%s/include/", platform.dir));
   cmd_append(&command, "-o", "main", "main.c");
+  cmd_append(&command, "libcloth.a");
   cmd_append(&command, temp_sprintf("-L./%s/lib/", platform.dir));
 
 #ifdef _WIN32
@@ -105,12 +150,16 @@ int main(int argc, char **argv) {
   cmd_append(&command, "-Wl,-rpath,@executable_path/raylib-5.5_macos/lib");
 #else
   cmd_append(&command, "-l:libraylib.a");
-  cmd_append(&command, "-lm");
+  cmd_append(&command, "-lm", "-lpthread");
 #endif
 
   if (!cmd_run(&command)) {
     return 1;
   }
 
+  if (!build_bench(platform)) {
+    return 1;
+  }
+
   return 0;
 }
@@ -0,0 +1,427 @@
+/**
+ * Sparse Cholesky factorization
+ *
+ * The ordering is a plain minimum degree on an explicit elimination graph:
+ * the unknown with the fewest neighbors goes next and its neighbors become a
+ * clique, which is the fill it causes. Cloth constraint graphs are sparse
+ * and local enough that the graph stays small. The factor is computed row by
+ * row (up-looking): the pattern of row k of L is the set of elimination tree
+ * nodes reached from the nonzeros of column k of A, then a sparse triangular
+ * solve fills it in. The symbolic phase runs the same traversal once to
+ * count the nonzeros per column, so the numeric phase never allocates.
+ */
+
+#include "sparse.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+struct SparseCholesky {
+  Arena arena;
+  int n;
+  int *perm;  // perm[k] is the unknown eliminated k-th
+  int *iperm; // iperm[perm[k]] == k
+  // upper triangle of the permuted matrix by columns, rows sorted, one
+  // value slot per entry
+  int *col_start;
+  int *rows;
+  int *parent; // elimination tree, -1 at roots
+  // L by columns, diagonal first
+  int *l_start;
+  int *l_rows;
+  double *l_values;
+  size_t flops;
+  // numeric workspaces
+  int *next; // next free entry per column of L
+  int *stack;
+  int *visited;
+  double *dense;
+};
+
+// Minimum degree ordering
+
+typedef struct {
+  int *items;
+  int count;
+  int capacity;
+} NodeList;
+
+typedef struct {
+  int degree;
+  int node;
+} DegreeEntry;
+
+typedef struct {
+  DegreeEntry *entries;
+  int count;
+  int capacity;
+} DegreeHeap;
+
+static bool degree_less(DegreeEntry a, DegreeEntry b) {
+  return a.degree < b.degree || (a.degree == b.degree && a.node < b.node);
+}
+
+static bool heap_push(DegreeHeap *heap, Arena *scratch, DegreeEntry entry) {
+  if (heap->count == heap->capacity) {
+    int capacity = heap->capacity ? 2 * heap->capacity : 64;
+    DegreeEntry *entries = arena_realloc(
+        scratch, heap->entries, sizeof(DegreeEntry) * heap->capacity,
+        sizeof(DegreeEntry) * capacity);
+    if (!entries)
+      return false;
+    heap->entries = entries;
+    heap->capacity = capacity;
+  }
+  int i = heap->count++;
+  while (i > 0 && degree_less(entry, heap->entries[(i - 1) / 2])) {
+    heap->entries[i] = heap->entries[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  heap->entries[i] = entry;
+  return true;
+}
+
+static DegreeEntry heap_pop(DegreeHeap *heap) {
+  DegreeEntry top = heap->entries[0];
+  DegreeEntry last = heap->entries[--heap->count];
+  int i = 0;
+  for (;;) {
+    int child = 2 * i + 1;
+    if (child >= heap->count)
+      break;
+    if (child + 1 < heap->count &&
+        degree_less(heap->entries[child + 1], heap->entries[child]))
+      child++;
+    if (!degree_less(heap->entries[child], last))
+      break;
+    heap->entries[i] = heap->entries[child];
+    i = child;
+  }
+  heap->entries[i] = last;
+  return top;
+}
+
+static bool list_append(NodeList *list, Arena *scratch, int item) {
+  if (list->count == list->capacity) {
+    int capacity = list->capacity ? 2 * list->capacity : 8;
+    int *items = arena_realloc(scratch, list->items,
+                               sizeof(int) * list->capacity,
+                               sizeof(int) * capacity);
+    if (!items)
+      return false;
+    list->items = items;
+    list->capacity = capacity;
+  }
+  list->items[list->count++] = item;
+  return true;
+}
+
+// Fills perm with the elimination order. Lists only ever hold unknowns not
+// eliminated yet, so a list's count is the current degree and heap entries
+// whose degree no longer matches are stale.
+static bool order_minimum_degree(int n, const int *start,
+                                 const int *neighbors, int *perm,
+                                 Arena *scratch) {
+  NodeList *lists = arena_alloc_zero(scratch, sizeof(NodeList) * n);
+  int *mark = arena_alloc_zero(scratch, sizeof(int) * n);
+  bool *eliminated = arena_alloc_zero(scratch, sizeof(bool) * n);
+  DegreeHeap heap = {0};
+  if (!lists || !mark || !eliminated)
+    return false;
+
+  int stamp = 0;
+  for (int i = 0; i < n; i++) {
+    stamp++;
+    mark[i] = stamp;
+    for (int p = start[i]; p < start[i + 1]; p++) {
+      int j = neighbors[p];
+      if (mark[j] != stamp) {
+        mark[j] = stamp;
+        if (!list_append(&lists[i], scratch, j))
+          return false;
+      }
+    }
+    if (!heap_push(&heap, scratch, (DegreeEntry){lists[i].count, i}))
+      return false;
+  }
+
+  for (int k = 0; k < n; k++) {
+    DegreeEntry entry;
+    do {
+      entry = heap_pop(&heap);
+    } while (eliminated[entry.node] ||
+             entry.degree != lists[entry.node].count);
+    int v = entry.node;
+    perm[k] = v;
+    eliminated[v] = true;
+
+    // the neighbors of v become a clique without v
+    const NodeList *clique = &lists[v];
+    for (int c = 0; c < clique->count; c++) {
+      int u = clique->items[c];
+      NodeList *list = &lists[u];
+      stamp++;
+      mark[u] = stamp;
+      for (int p = 0; p < list->count; p++) {
+        if (list->items[p] == v)
+          list->items[p--] = list->items[--list->count];
+        else
+          mark[list->items[p]] = stamp;
+      }
+      for (int q = 0; q < clique->count; q++) {
+        int w = clique->items[q];
+        if (mark[w] != stamp) {
+          mark[w] = stamp;
+          if (!list_append(list, scratch, w))
+            return false;
+        }
+      }
+      if (!heap_push(&heap, scratch, (DegreeEntry){list->count, u}))
+        return false;
+    }
+  }
+  return true;
+}
+
+// Factor
+
+static int compare_ints(const void *a, const void *b) {
+  int x = *(const int *)a;
+  int y = *(const int *)b;
+  return (x > y) - (x < y);
+}
+
+// Pattern of row k of L as the elimination tree nodes reached from column k
+// of the permuted matrix, returned in stack[top, n)
+static int elimination_reach(const SparseCholesky *chol, int k, int *stack,
+                             int *visited) {
+  int top = chol->n;
+  visited[k] = k + 1;
+  for (int p = chol->col_start[k]; p < chol->col_start[k + 1]; p++) {
+    int len = 0;
+    for (int i = chol->rows[p]; visited[i] != k + 1; i = chol->parent[i]) {
+      stack[len++] = i;
+      visited[i] = k + 1;
+    }
+    // keep the path in order, later paths end in nodes already reached
+    while (len > 0) {
+      stack[--top] = stack[--len];
+    }
+  }
+  return top;
+}
+
+void sparse_cholesky_destroy(SparseCholesky *chol) {
+  if (!chol)
+    return;
+  Arena arena = chol->arena;
+  arena_free(&arena);
+}
+
+SparseCholesky *sparse_cholesky_create(int n, const int *start,
+                                       const int *neighbors) {
+  if (n <= 0)
+    return NULL;
+  Arena arena = {0};
+  SparseCholesky *chol = arena_alloc_zero(&arena, sizeof(SparseCholesky));
+  if (!chol)
+    return NULL;
+  chol->perm = arena_alloc(&arena, sizeof(int) * n);
+  chol->iperm = arena_alloc(&arena, sizeof(int) * n);
+  chol->col_start = arena_alloc_zero(&arena, sizeof(int) * (n + 1));
+  chol->parent = arena_alloc(&arena, sizeof(int) * n);
+  chol->l_start = arena_alloc_zero(&arena, sizeof(int) * (n + 1));
+  chol->next = arena_alloc(&arena, sizeof(int) * n);
+  chol->stack = arena_alloc(&arena, sizeof(int) * n);
+  chol->visited = arena_alloc(&arena, sizeof(int) * n);
+  chol->dense = arena_alloc_zero(&arena, sizeof(double) * n);
+  chol->arena = arena;
+  chol->n = n;
+
+  Arena scratch = {0};
+  int *mark = arena_alloc(&scratch, sizeof(int) * n);
+  bool ok = chol->perm && chol->iperm && chol->col_start && chol->parent &&
+            chol->l_start && chol->next && chol->stack && chol->visited &&
+            chol->dense && mark &&
+            order_minimum_degree(n, start, neighbors, chol->perm, &scratch);
+  if (ok) {
+    for (int k = 0; k < n; k++) {
+      chol->iperm[chol->perm[k]] = k;
+    }
+
+    // upper triangle of the permuted pattern, duplicates dropped
+    for (int pass = 0; ok && pass < 2; pass++) {
+      memset(mark, 0xff, sizeof(int) * n);
+      for (int j = 0; j < n; j++) {
+        int v = chol->perm[j];
+        int count = 0;
+        int *column = pass ? &chol->rows[chol->col_start[j]] : NULL;
+        mark[j] = j;
+        if (pass)
+          column[count] = j;
+        count++;
+        for (int p = start[v]; p < start[v + 1]; p++) {
+          int i = chol->iperm[neighbors[p]];
+          if (i < j && mark[i] != j) {
+            mark[i] = j;
+            if (pass)
+              column[count] = i;
+            count++;
+          }
+        }
+        if (pass)
+          qsort(column, count, sizeof(int), compare_ints);
+        else
+          chol->col_start[j + 1] = chol->col_start[j] + count;
+      }
+      if (!pass) {
+        chol->rows =
+            arena_alloc(&chol->arena, sizeof(int) * chol->col_start[n]);
+        ok = chol->rows != NULL;
+      }
+    }
+  }
+
+  if (ok) {
+    // elimination tree, ancestors are path compressed as it grows
+    int *ancestor = mark;
+    for (int k = 0; k < n; k++) {
+      chol->parent[k] = -1;
+      ancestor[k] = -1;
+      for (int p = chol->col_start[k]; p < chol->col_start[k + 1]; p++) {
+        int next;
+        for (int i = chol->rows[p]; i != -1 && i < k; i = next) {
+          next = ancestor[i];
+          ancestor[i] = k;
+          if (next == -1)
+            chol->parent[i] = k;
+        }
+      }
+    }
+
+    // nonzeros per column of L, each row k adds one to every column it
+    // reaches
+    int *counts = mark;
+    for (int j = 0; j < n; j++) {
+      counts[j] = 1;
+      chol->visited[j] = 0;
+    }
+    for (int k = 0; k < n; k++) {
+      for (int top = elimination_reach(chol, k, chol->stack, chol->visited);
+           top < n; top++) {
+        counts[chol->stack[top]]++;
+      }
+    }
+    for (int j = 0; j < n; j++) {
+      chol->l_start[j + 1] = chol->l_start[j] + counts[j];
+      chol->flops += (size_t)counts[j] * (counts[j] - 1) / 2;
+    }
+    chol->l_rows = arena_alloc(&chol->arena, sizeof(int) * chol->l_start[n]);
+    chol->l_values =
+        arena_alloc(&chol->arena, sizeof(double) * chol->l_start[n]);
+    ok = chol->l_rows && chol->l_values;
+  }
+  arena_free(&scratch);
+
+  if (!ok) {
+    sparse_cholesky_destroy(chol);
+    return NULL;
+  }
+  return chol;
+}
+
+int sparse_cholesky_slot(const SparseCholesky *chol, int i, int j) {
+  int a = chol->iperm[i];
+  int b = chol->iperm[j];
+  int row = a < b ? a : b;
+  int col = a < b ? b : a;
+  int lo = chol->col_start[col];
+  int hi = chol->col_start[col + 1];
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (chol->rows[mid] < row)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo < chol->col_start[col + 1] && chol->rows[lo] == row ? lo : -1;
+}
+
+int sparse_cholesky_slot_count(const SparseCholesky *chol) {
+  return chol->col_start[chol->n];
+}
+
+bool sparse_cholesky_factor(SparseCholesky *chol, const double *values) {
+  int n = chol->n;
+  double *x = chol->dense;
+  for (int j = 0; j < n; j++) {
+    chol->next[j] = chol->l_start[j];
+    chol->visited[j] = 0;
+  }
+
+  for (int k = 0; k < n; k++) {
+    int top = elimination_reach(chol, k, chol->stack, chol->visited);
+    // solve L(0:k-1, 0:k-1) l = A(0:k-1, k) over the reached pattern
+    for (int p = chol->col_start[k]; p < chol->col_start[k + 1]; p++) {
+      x[chol->rows[p]] = values[p];
+    }
+    double d = x[k];
+    x[k] = 0.0;
+    for (; top < n; top++) {
+      int i = chol->stack[top];
+      double lki = x[i] / chol->l_values[chol->l_start[i]];
+      x[i] = 0.0;
+      for (int p = chol->l_start[i] + 1; p < chol->next[i]; p++) {
+        x[chol->l_rows[p]] -= chol->l_values[p] * lki;
+      }
+      d -= lki * lki;
+      int p = chol->next[i]++;
+      chol->l_rows[p] = k;
+      chol->l_values[p] = lki;
+    }
+    if (!(d > 0.0))
+      return false;
+    int p = chol->next[k]++;
+    chol->l_rows[p] = k;
+    chol->l_values[p] = sqrt(d);
+  }
+  return true;
+}
+
+void sparse_cholesky_solve(SparseCholesky *chol, double *x) {
+  int n = chol->n;
+  double *y = chol->dense;
+  const int *l_start = chol->l_start;
+  const int *l_rows = chol->l_rows;
+  const double *l_values = chol->l_values;
+  for (int k = 0; k < n; k++) {
+    y[k] = x[chol->perm[k]];
+  }
+  for (int j = 0; j < n; j++) {
+    y[j] /= l_values[l_start[j]];
+    for (int p = l_start[j] + 1; p < l_start[j + 1]; p++) {
+      y[l_rows[p]] -= l_values[p] * y[j];
+    }
+  }
+  for (int j = n - 1; j >= 0; j--) {
+    for (int p = l_start[j] + 1; p < l_start[j + 1]; p++) {
+      y[j] -= l_values[p] * y[l_rows[p]];
+    }
+    y[j] /= l_values[l_start[j]];
+  }
+  for (int k = 0; k < n; k++) {
+    x[chol->perm[k]] = y[k];
+    y[k] = 0.0;
+  }
+}
+
+size_t sparse_cholesky_factor_nonzeros(const SparseCholesky *chol) {
+  return (size_t)chol->l_start[chol->n];
+}
+
+size_t sparse_cholesky_factor_flops(const SparseCholesky *chol) {
+  return chol->flops;
+}
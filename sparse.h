@@ -0,0 +1,40 @@
+/**
+ * Sparse Cholesky factorization
+ *
+ * Factors symmetric positive definite matrices whose pattern stays fixed
+ * while their values change, such as the constraint system of a cloth. The
+ * symbolic phase orders the unknowns by minimum degree to limit fill and
+ * lays out the factor once, the numeric phase refills it from new values.
+ */
+
+#ifndef SPARSE_H_
+#define SPARSE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct SparseCholesky SparseCholesky;
+
+// Orders and lays out the factor of an n by n matrix. Its off-diagonal
+// nonzeros are given as symmetric adjacency lists, unknown i is coupled to
+// neighbors[start[i]] to neighbors[start[i + 1] - 1]. The diagonal is always
+// part of the pattern. Returns NULL when memory runs out.
+SparseCholesky *sparse_cholesky_create(int n, const int *start,
+                                       const int *neighbors);
+void sparse_cholesky_destroy(SparseCholesky *chol);
+
+// Values are passed as one array with a slot per stored entry, entry (i, j)
+// and (j, i) share a slot. Returns -1 outside the pattern.
+int sparse_cholesky_slot(const SparseCholesky *chol, int i, int j);
+int sparse_cholesky_slot_count(const SparseCholesky *chol);
+
+// Numeric factorization, false when the matrix isn't positive definite
+bool sparse_cholesky_factor(SparseCholesky *chol, const double *values);
+// Solves A x = b in place with the last factorization
+void sparse_cholesky_solve(SparseCholesky *chol, double *x);
+
+// Nonzeros of the factor and multiply-adds of one factorization
+size_t sparse_cholesky_factor_nonzeros(const SparseCholesky *chol);
+size_t sparse_cholesky_factor_flops(const SparseCholesky *chol);
+
+#endif // SPARSE_H_
@@ -0,0 +1,280 @@
+/**
+ * libcloth - precomputed turbulent wind
+ *
+ * A few octaves of periodic value noise baked into a small vector volume
+ * once, so gusts cost a trilinear lookup per particle instead of evaluating
+ * noise. Texels are padded to four floats, every corner is a single SSE load
+ * and the blend runs over x, y and z at once.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "arena.h"
+#include "cloth.h"
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define CLOTH_SSE 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define CLOTH_SSE2 1
+#endif
+
+// lattice cells per axis of the coarsest octave, each octave doubles them
+#define WIND_BASE_CELLS 4
+#define WIND_OCTAVES 3
+
+struct ClothWindField {
+  Arena arena;
+  float *texels; // resolution^3 texels of {x, y, z, 0}, x fastest
+  int resolution;
+};
+
+static uint32_t wind_random(uint32_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+static float smooth(float t) { return t * t * (3.0f - 2.0f * t); }
+
+// Adds one octave of periodic value noise with cells lattice points per axis
+static void add_octave(ClothWindField *field, const Vector3 *lattice,
+                       int cells, float amplitude) {
+  int resolution = field->resolution;
+  float texels_per_cell = (float)resolution / cells;
+
+  for (int z = 0; z < resolution; z++) {
+    for (int y = 0; y < resolution; y++) {
+      for (int x = 0; x < resolution; x++) {
+        float u[3] = {x / texels_per_cell, y / texels_per_cell,
+                      z / texels_per_cell};
+        int i0[3], i1[3];
+        float w[3];
+        for (int a = 0; a < 3; a++) {
+          i0[a] = (int)u[a];
+          i1[a] = (i0[a] + 1) % cells;
+          w[a] = smooth(u[a] - i0[a]);
+        }
+
+        Vector3 sum = {0};
+        for (int corner = 0; corner < 8; corner++) {
+          int cx = corner & 1 ? i1[0] : i0[0];
+          int cy = corner & 2 ? i1[1] : i0[1];
+          int cz = corner & 4 ? i1[2] : i0[2];
+          float weight = (corner & 1 ? w[0] : 1.0f - w[0]) *
+                         (corner & 2 ? w[1] : 1.0f - w[1]) *
+                         (corner & 4 ? w[2] : 1.0f - w[2]);
+          Vector3 value = lattice[(cz * cells + cy) * cells + cx];
+          sum = Vector3Add(sum, Vector3Scale(value, weight));
+        }
+
+        float *texel = &field->texels[4 * ((z * resolution + y) * resolution + x)];
+        texel[0] += sum.x * amplitude;
+        texel[1] += sum.y * amplitude;
+        texel[2] += sum.z * amplitude;
+      }
+    }
+  }
+}
+
+ClothWindField *cloth_wind_field_create(int resolution, unsigned seed) {
+  int rounded = WIND_BASE_CELLS << (WIND_OCTAVES - 1);
+  while (rounded < resolution)
+    rounded *= 2;
+  resolution = rounded;
+
+  Arena arena = {0};
+  ClothWindField *field = arena_alloc_zero(&arena, sizeof(ClothWindField));
+  if (!field)
+    return NULL;
+  size_t texel_count = (size_t)resolution * resolution * resolution;
+  field->texels = arena_alloc_zero(&arena, sizeof(float) * 4 * texel_count);
+  int max_cells = WIND_BASE_CELLS << (WIND_OCTAVES - 1);
+  Vector3 *lattice = arena_alloc(
+      &arena, sizeof(Vector3) * max_cells * max_cells * max_cells);
+  field->arena = arena;
+  field->resolution = resolution;
+  if (!field->texels || !lattice) {
+    cloth_wind_field_destroy(field);
+    return NULL;
+  }
+
+  uint32_t state = seed ? seed : 0x9e3779b9;
+  float amplitude = 1.0f;
+  for (int octave = 0; octave < WIND_OCTAVES; octave++) {
+    int cells = WIND_BASE_CELLS << octave;
+    for (int i = 0; i < cells * cells * cells; i++) {
+      float v[3];
+      for (int a = 0; a < 3; a++) {
+        v[a] = (wind_random(&state) >> 8) * (2.0f / 16777216.0f) - 1.0f;
+      }
+      lattice[i] = (Vector3){v[0], v[1], v[2]};
+    }
+    add_octave(field, lattice, cells, amplitude);
+    amplitude *= 0.5f;
+  }
+
+  // unit RMS per component, so turbulence is the typical gust strength
+  double sum_sq[3] = {0};
+  for (size_t i = 0; i < texel_count; i++) {
+    for (int a = 0; a < 3; a++) {
+      sum_sq[a] += field->texels[4 * i + a] * field->texels[4 * i + a];
+    }
+  }
+  for (int a = 0; a < 3; a++) {
+    float scale = sum_sq[a] > 0.0 ? (float)(1.0 / sqrt(sum_sq[a] / texel_count))
+                                  : 0.0f;
+    for (size_t i = 0; i < texel_count; i++) {
+      field->texels[4 * i + a] *= scale;
+    }
+  }
+  return field;
+}
+
+void cloth_wind_field_destroy(ClothWindField *field) {
+  if (!field)
+    return;
+  // the field itself lives in its arena
+  Arena arena = field->arena;
+  arena_free(&arena);
+}
+
+int cloth_wind_field_resolution(const ClothWindField *field) {
+  return field->resolution;
+}
+
+#ifdef CLOTH_SSE
+// Trilinear fetch of one sample into the x, y and z lanes, corners as texel
+// offsets of the x0/y0/z0 and x1/y1/z1 planes
+static inline __m128 fetch_texels(const float *texels, int x0, int x1, int y0,
+                                  int y1, int z0, int z1, float u, float v,
+                                  float w) {
+  __m128 wu = _mm_set1_ps(u);
+  __m128 wv = _mm_set1_ps(v);
+  __m128 ww = _mm_set1_ps(w);
+#define WIND_TEXEL(x, y, z) _mm_loadu_ps(&texels[4 * ((z) + (y) + (x))])
+#define WIND_LERP(a, b, t) _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t))
+  __m128 c00 = WIND_LERP(WIND_TEXEL(x0, y0, z0), WIND_TEXEL(x1, y0, z0), wu);
+  __m128 c10 = WIND_LERP(WIND_TEXEL(x0, y1, z0), WIND_TEXEL(x1, y1, z0), wu);
+  __m128 c01 = WIND_LERP(WIND_TEXEL(x0, y0, z1), WIND_TEXEL(x1, y0, z1), wu);
+  __m128 c11 = WIND_LERP(WIND_TEXEL(x0, y1, z1), WIND_TEXEL(x1, y1, z1), wu);
+#undef WIND_TEXEL
+  __m128 sample =
+      WIND_LERP(WIND_LERP(c00, c10, wv), WIND_LERP(c01, c11, wv), ww);
+#undef WIND_LERP
+  return sample;
+}
+#endif
+
+// Trilinear fetch of one sample, corners as texel offsets of the x0/y0/z0
+// and x1/y1/z1 planes
+static inline Vector3 sample_texels(const float *texels, int x0, int x1,
+                                    int y0, int y1, int z0, int z1, float u,
+                                    float v, float w) {
+#ifdef CLOTH_SSE
+  float result[4];
+  _mm_storeu_ps(result, fetch_texels(texels, x0, x1, y0, y1, z0, z1, u, v, w));
+  return (Vector3){result[0], result[1], result[2]};
+#else
+  const int corners[8] = {z0 + y0 + x0, z0 + y0 + x1, z0 + y1 + x0,
+                          z0 + y1 + x1, z1 + y0 + x0, z1 + y0 + x1,
+                          z1 + y1 + x0, z1 + y1 + x1};
+  float result[3];
+  for (int a = 0; a < 3; a++) {
+    float c[8];
+    for (int k = 0; k < 8; k++) {
+      c[k] = texels[4 * corners[k] + a];
+    }
+    float c00 = c[0] + (c[1] - c[0]) * u;
+    float c10 = c[2] + (c[3] - c[2]) * u;
+    float c01 = c[4] + (c[5] - c[4]) * u;
+    float c11 = c[6] + (c[7] - c[6]) * u;
+    float c0 = c00 + (c10 - c00) * v;
+    float c1 = c01 + (c11 - c01) * v;
+    result[a] = c0 + (c1 - c0) * w;
+  }
+  return (Vector3){result[0], result[1], result[2]};
+#endif
+}
+
+void cloth_wind_field_sample(const ClothWindField *field,
+                             const Vector3 *points, int count, Vector3 offset,
+                             float texels_per_unit, Vector3 *out) {
+  int resolution = field->resolution;
+  int mask = resolution - 1;
+  const float *texels = field->texels;
+  int i = 0;
+
+#ifdef CLOTH_SSE2
+  // texel coordinates, floors and corner offsets for four points at a time
+  __m128 scale = _mm_set1_ps(texels_per_unit);
+  __m128i vmask = _mm_set1_epi32(mask);
+  __m128i one = _mm_set1_epi32(1);
+  for (; i + 4 <= count; i += 4) {
+    const Vector3 *p = &points[i];
+    __m128 coord[3] = {
+        _mm_set_ps(p[3].x, p[2].x, p[1].x, p[0].x),
+        _mm_set_ps(p[3].y, p[2].y, p[1].y, p[0].y),
+        _mm_set_ps(p[3].z, p[2].z, p[1].z, p[0].z),
+    };
+    const float offsets[3] = {offset.x, offset.y, offset.z};
+    int lo[3][4], hi[3][4];
+    float frac[3][4];
+    for (int a = 0; a < 3; a++) {
+      __m128 t = _mm_add_ps(_mm_mul_ps(coord[a], scale),
+                            _mm_set1_ps(offsets[a]));
+      // floor: truncate, then step down where truncation rounded up
+      __m128i it = _mm_cvttps_epi32(t);
+      __m128 ft = _mm_cvtepi32_ps(it);
+      __m128i up = _mm_castps_si128(_mm_cmplt_ps(t, ft));
+      it = _mm_add_epi32(it, up);
+      ft = _mm_cvtepi32_ps(it);
+      __m128i i0 = _mm_and_si128(it, vmask);
+      __m128i i1 = _mm_and_si128(_mm_add_epi32(i0, one), vmask);
+      _mm_storeu_si128((__m128i *)lo[a], i0);
+      _mm_storeu_si128((__m128i *)hi[a], i1);
+      _mm_storeu_ps(frac[a], _mm_sub_ps(t, ft));
+    }
+    int plane = resolution * resolution;
+    for (int k = 0; k < 4; k++) {
+      __m128 sample = fetch_texels(
+          texels, lo[0][k], hi[0][k], lo[1][k] * resolution,
+          hi[1][k] * resolution, lo[2][k] * plane, hi[2][k] * plane,
+          frac[0][k], frac[1][k], frac[2][k]);
+      // whole register stores spill into the next sample, which is written
+      // after, only the very last one is stored a lane at a time
+      if (i + k + 1 < count) {
+        _mm_storeu_ps(&out[i + k].x, sample);
+      } else {
+        float result[4];
+        _mm_storeu_ps(result, sample);
+        out[i + k] = (Vector3){result[0], result[1], result[2]};
+      }
+    }
+  }
+#endif
+
+  for (; i < count; i++) {
+    float u = points[i].x * texels_per_unit + offset.x;
+    float v = points[i].y * texels_per_unit + offset.y;
+    float w = points[i].z * texels_per_unit + offset.z;
+    // floor without a libm call, truncation rounds negatives up
+    int iu = (int)u - (u < (int)u);
+    int iv = (int)v - (v < (int)v);
+    int iw = (int)w - (w < (int)w);
+    // the resolution is a power of two, masking wraps negatives too
+    int x0 = iu & mask;
+    int y0 = iv & mask;
+    int z0 = iw & mask;
+    out[i] = sample_texels(texels, x0, (x0 + 1) & mask, y0 * resolution,
+                           ((y0 + 1) & mask) * resolution,
+                           z0 * resolution * resolution,
+                           ((z0 + 1) & mask) * resolution * resolution,
+                           u - (float)iu, v - (float)iv, w - (float)iw);
+  }
+}
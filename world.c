@@ -0,0 +1,195 @@
+/**
+ * libcloth - many cloths stepped across cores
+ *
+ * Every step is built as a job graph. Cloths are sorted by cost and cut into
+ * bins of roughly equal cost, small ones share a bin so a flag with a few
+ * hundred particles doesn't cost a whole job. Cloths too big for one bin are
+ * split into their step phases instead, tiled so one cloth keeps several
+ * workers busy, and their chains overlap with the bins and each other.
+ */
+
+#include <stdlib.h>
+
+#include "arena.h"
+#include "cloth.h"
+#include "jobs.h"
+
+// bins per thread, more gives stealing room to even out bad estimates
+#define WORLD_BINS_PER_THREAD 4
+// below this a bin isn't worth a job of its own
+#define WORLD_MIN_BIN_COST 16384
+
+typedef struct {
+  Cloth *cloth;
+  size_t cost;
+} WorldEntry;
+
+typedef struct {
+  ClothWorld *world;
+  int first; // range in ClothWorld.order
+  int count;
+} WorldBin;
+
+struct ClothWorld {
+  // the world itself and its arrays
+  Arena arena;
+  JobPool *pool;
+
+  Cloth **cloths;
+  int count;
+  int capacity;
+
+  // scratch for step_all, sized to capacity so stepping never allocates
+  WorldEntry *order;
+  WorldBin *bins;
+  JobGraph *graph;
+
+  volatile long failed;
+};
+
+ClothWorld *cloth_world_create(int thread_count) {
+  Arena arena = {0};
+  ClothWorld *world = arena_alloc_zero(&arena, sizeof(ClothWorld));
+  if (!world)
+    return NULL;
+  world->arena = arena;
+
+  // the thread calling step_all works too
+  world->pool = job_pool_create(thread_count > 0 ? thread_count - 1 : -1);
+  world->graph = job_graph_create();
+  if (!world->pool || !world->graph) {
+    cloth_world_destroy(world);
+    return NULL;
+  }
+  return world;
+}
+
+void cloth_world_destroy(ClothWorld *world) {
+  if (!world)
+    return;
+  job_pool_destroy(world->pool);
+  job_graph_destroy(world->graph);
+  // the world itself lives in its arena
+  Arena arena = world->arena;
+  arena_free(&arena);
+}
+
+int cloth_world_thread_count(const ClothWorld *world) {
+  return job_pool_thread_count(world->pool) + 1;
+}
+
+bool cloth_world_add(ClothWorld *world, Cloth *cloth) {
+  if (world->count == world->capacity) {
+    int capacity = world->capacity ? world->capacity * 2 : 16;
+    Cloth **cloths =
+        arena_realloc(&world->arena, world->cloths,
+                      sizeof(Cloth *) * world->capacity,
+                      sizeof(Cloth *) * capacity);
+    WorldEntry *order = arena_alloc(&world->arena, sizeof(WorldEntry) * capacity);
+    WorldBin *bins = arena_alloc(&world->arena, sizeof(WorldBin) * capacity);
+    if (!cloths || !order || !bins)
+      return false;
+    world->cloths = cloths;
+    world->order = order;
+    world->bins = bins;
+    world->capacity = capacity;
+  }
+  world->cloths[world->count++] = cloth;
+  return true;
+}
+
+void cloth_world_remove(ClothWorld *world, Cloth *cloth) {
+  for (int i = 0; i < world->count; i++) {
+    if (world->cloths[i] == cloth) {
+      world->cloths[i] = world->cloths[--world->count];
+      return;
+    }
+  }
+}
+
+int cloth_world_count(const ClothWorld *world) { return world->count; }
+
+Cloth *cloth_world_get(const ClothWorld *world, int index) {
+  return world->cloths[index];
+}
+
+static int compare_entries_by_cost(const void *a, const void *b) {
+  const WorldEntry *ea = a;
+  const WorldEntry *eb = b;
+  return (ea->cost < eb->cost) - (ea->cost > eb->cost);
+}
+
+static void step_bin(void *data, int worker) {
+  (void)worker;
+  WorldBin *bin = data;
+  for (int i = bin->first; i < bin->first + bin->count; i++) {
+    if (!cloth_step(bin->world->order[i].cloth))
+      job_atomic_add(&bin->world->failed, 1);
+  }
+}
+
+bool cloth_world_step_all(ClothWorld *world) {
+  size_t total = 0;
+  for (int i = 0; i < world->count; i++) {
+    world->order[i].cloth = world->cloths[i];
+    world->order[i].cost = cloth_step_cost(world->cloths[i]);
+    total += world->order[i].cost;
+  }
+  // biggest first, so they start early and the small ones fill the gaps
+  qsort(world->order, world->count, sizeof(WorldEntry),
+        compare_entries_by_cost);
+
+  int thread_count = cloth_world_thread_count(world);
+  size_t target = total / ((size_t)thread_count * WORLD_BINS_PER_THREAD);
+  if (target < WORLD_MIN_BIN_COST)
+    target = WORLD_MIN_BIN_COST;
+
+  JobGraph *graph = world->graph;
+  job_graph_reset(graph);
+  world->failed = 0;
+
+  // with a single thread splitting is pure overhead
+  int first = 0;
+  if (thread_count > 1) {
+    for (; first < world->count && world->order[first].cost > target;
+         first++) {
+      // a partial graph would step the cloth part way, so nothing runs
+      if (cloth_add_step_jobs(world->order[first].cloth, graph, first, -1) <
+          0) {
+        job_graph_reset(graph);
+        return false;
+      }
+    }
+  }
+
+  int bin_count = 0;
+  size_t bin_cost = 0;
+  for (int i = first; i < world->count; i++) {
+    if (bin_cost == 0) {
+      world->bins[bin_count++] = (WorldBin){world, i, 0};
+    }
+    world->bins[bin_count - 1].count++;
+    bin_cost += world->order[i].cost;
+    if (bin_cost >= target)
+      bin_cost = 0;
+  }
+  for (int b = 0; b < bin_count; b++) {
+    if (job_graph_add(graph, "cloth bin", world->bins[b].first, step_bin,
+                      &world->bins[b]) < 0) {
+      // step it here rather than skipping it
+      step_bin(&world->bins[b], 0);
+    }
+  }
+
+  if (!job_graph_run(graph, world->pool))
+    return false;
+  return world->failed == 0;
+}
+
+void cloth_world_set_tracing(ClothWorld *world, bool tracing) {
+  job_graph_set_tracing(world->graph, tracing);
+}
+
+bool cloth_world_write_trace(const ClothWorld *world, const char *path) {
+  return job_graph_write_trace(world->graph, path);
+}